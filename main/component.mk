@@ -3,4 +3,13 @@
 #
 # (Uses default behaviour of compiling all source files in directory, adding 'include' to include path.)
 
-COMPONENT_EMBED_TXTFILES := whoop_we1.pem
\ No newline at end of file
+COMPONENT_EMBED_TXTFILES := whoop_we1.pem
+
+# Dashboard assets are gzipped at build time and served as they are from flash
+WHOOP_DASHBOARD_ASSETS := index.html app.js
+COMPONENT_EMBED_FILES := $(addprefix $(COMPONENT_BUILD_DIR)/dashboard/,$(addsuffix .gz,$(WHOOP_DASHBOARD_ASSETS)))
+COMPONENT_EXTRA_CLEAN := $(COMPONENT_EMBED_FILES)
+
+$(COMPONENT_BUILD_DIR)/dashboard/%.gz: $(COMPONENT_PATH)/dashboard/%
+	mkdir -p $(@D)
+	gzip -9 -n -c $< > $@
\ No newline at end of file
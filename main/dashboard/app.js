@@ -0,0 +1,124 @@
+// Dashboard for the monitor's local API. Records come from /api/v1/latest and are refreshed when /events
+// reports an update, trends are kept by the browser since the device only stores the latest record
+(function () {
+  'use strict';
+  var TYPES = ['recovery', 'sleep', 'cycle', 'workout'];
+  var TREND_FIELDS = { recovery: 'recovery_score', sleep: 'sleep_performance_percentage', cycle: 'strain', workout: 'strain' };
+  var TREND_LENGTH = 30;
+  var user = Number(new URLSearchParams(location.search).get('user') || 0);
+  var records = document.getElementById('records');
+  var statusLine = document.getElementById('status');
+  var userSelect = document.getElementById('user');
+
+  function trendKey(type) { return 'trend-' + user + '-' + type; }
+
+  function loadTrend(type) {
+    try { return JSON.parse(localStorage.getItem(trendKey(type))) || []; } catch (e) { return []; }
+  }
+
+  // One point per record ID, so refetching the same record does not repeat it
+  function recordTrend(type, record) {
+    var field = TREND_FIELDS[type];
+    var id = record.id || record.cycle_id;
+    var trend = loadTrend(type);
+    if (record.score_state !== 'SCORED' || typeof record[field] !== 'number') return trend;
+    if (!trend.length || trend[trend.length - 1].id !== id) trend.push({ id: id, value: record[field] });
+    else trend[trend.length - 1].value = record[field];
+    trend = trend.slice(-TREND_LENGTH);
+    localStorage.setItem(trendKey(type), JSON.stringify(trend));
+    return trend;
+  }
+
+  function drawTrend(canvas, trend) {
+    var ctx = canvas.getContext('2d');
+    var width = canvas.width = canvas.clientWidth;
+    var height = canvas.height = canvas.clientHeight;
+    var values = trend.map(function (point) { return point.value; });
+    var min = Math.min.apply(null, values), max = Math.max.apply(null, values);
+    ctx.clearRect(0, 0, width, height);
+    if (values.length < 2) return;
+    ctx.strokeStyle = '#4c9';
+    ctx.lineWidth = 2;
+    ctx.beginPath();
+    values.forEach(function (value, index) {
+      var x = index * (width - 4) / (values.length - 1) + 2;
+      var y = height - 2 - (max > min ? (value - min) / (max - min) : 0.5) * (height - 4);
+      if (index) ctx.lineTo(x, y); else ctx.moveTo(x, y);
+    });
+    ctx.stroke();
+  }
+
+  function formatValue(value) {
+    if (typeof value === 'number' && value % 1) return value.toFixed(1);
+    return String(value);
+  }
+
+  function render(body) {
+    records.textContent = '';
+    TYPES.forEach(function (type) {
+      var record = body[type];
+      var section = document.createElement('section');
+      var title = document.createElement('h2');
+      title.textContent = type;
+      section.appendChild(title);
+      if (!record) {
+        section.appendChild(document.createTextNode('Nothing recorded yet'));
+        records.appendChild(section);
+        return;
+      }
+      if (record.stale) {
+        var stale = document.createElement('span');
+        stale.className = 'stale';
+        stale.textContent = ' (cached before restart)';
+        title.appendChild(stale);
+      }
+      var canvas = document.createElement('canvas');
+      section.appendChild(canvas);
+      var table = document.createElement('table');
+      Object.keys(record).forEach(function (field) {
+        if (field === 'stale') return;
+        var row = table.insertRow();
+        row.insertCell().textContent = field.replace(/_/g, ' ');
+        row.insertCell().textContent = formatValue(record[field]);
+      });
+      section.appendChild(table);
+      records.appendChild(section);
+      drawTrend(canvas, recordTrend(type, record));
+    });
+  }
+
+  function refresh() {
+    fetch('/api/v1/latest?user=' + user).then(function (response) {
+      if (!response.ok) throw new Error(response.status);
+      return response.json();
+    }).then(function (body) {
+      render(body);
+      statusLine.textContent = 'Updated ' + new Date().toLocaleTimeString();
+    }).catch(function (error) {
+      statusLine.textContent = 'Could not load records (' + error.message + ')';
+    });
+  }
+
+  function listen() {
+    var events = new EventSource('/events');
+    events.addEventListener('record', function (event) {
+      if (JSON.parse(event.data).user === user) refresh();
+    });
+    events.onerror = function () { statusLine.textContent = 'Live updates paused, retrying'; };
+  }
+
+  // The API answers 400 past the last account, which bounds the list
+  function listUsers(index) {
+    fetch('/api/v1/latest?user=' + index).then(function (response) {
+      if (!response.ok) return;
+      var option = new Option('User ' + index, index, false, index === user);
+      userSelect.add(option);
+      listUsers(index + 1);
+    });
+  }
+
+  userSelect.onchange = function () { location.search = '?user=' + userSelect.value; };
+  listUsers(0);
+  refresh();
+  listen();
+})();
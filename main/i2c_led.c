@@ -9,8 +9,10 @@
 #include "esp_log.h"
 #include "esp_system.h"
 #include "esp_err.h"
+#include "esp_timer.h"
 
 #include "driver/i2c.h"
+#include "rom/ets_sys.h"
 #include "i2c_led.h"
 
 #define I2C_MASTER_SCL_IO           2                /*!< gpio number for I2C master clock */
@@ -73,12 +75,57 @@
 #define En 0x04  // Enable bit
 #define Rw 0x02  // Read/Write bit
 #define Rs 0x01  // Register select bit
+#define LCD_BUSY_FLAG 0x80
+
+#define LCD_COLS I2C_LCD_1602_COLS
+#define LCD_ROWS I2C_LCD_1602_ROWS
+#define LCD_ADDR_UNKNOWN 0xff
+#define LCD_FUNCTION (LCD_FUNCTIONSET | LCD_4BITMODE | LCD_2LINE | LCD_5x8DOTS)
+#define LCD_GLYPH_SLOTS I2C_LCD_1602_GLYPH_SLOTS
+#define LCD_GLYPH_ROWS I2C_LCD_1602_GLYPH_ROWS
+#define LCD_GLYPH_NONE 0xff
+// A whole frame with a cursor move per row, four expander writes per LCD byte
+#define LCD_BATCH_LEN ((LCD_COLS + 1) * LCD_ROWS * 4)
+
+// HD44780 execution times are 37 us, and 1.52 ms for clear and home, at the nominal 270 kHz oscillator. The
+// slow commands wait for the 190 kHz minimum, the rest need no wait: a nibble is two bus bytes, 180 us at the
+// ESP8266 driver's ~100 kHz clock, so the next one cannot land before the controller is ready
+// Clear and home poll the busy flag when the backpack can read it back and a read is cheap enough to beat the
+// worst case wait: the status read has to fit in the gap between the nominal 1.52 ms and the slow part's 2.16 ms.
+// At the ESP8266 driver's ~100 kHz a read is about 1 ms, so they stay timed there and poll on a faster bus
+#define LCD_SLOW_COMMAND_US 2160
+#define LCD_NOMINAL_SLOW_COMMAND_US 1520
+#define LCD_INIT_FIRST_US 4100
+#define LCD_INIT_SECOND_US 100
 
 // Local variables
+static const char *TAG = "I2C LCD";
 uint8_t g_backlight = LCD_BACKLIGHT;
 uint8_t g_display_control = LCD_DISPLAYON | LCD_CURSOROFF | LCD_BLINKOFF;
 uint8_t g_entry_mode = LCD_ENTRYLEFT | LCD_ENTRYSHIFTDECREMENT;
 
+// Callers draw into g_frame, g_panel mirrors what the controller holds for the visible cells
+static const uint8_t g_row_offsets[LCD_ROWS] = { 0x00, 0x40 };
+static char g_frame[LCD_ROWS][LCD_COLS];
+static char g_panel[LCD_ROWS][LCD_COLS];
+static uint8_t g_panel_valid = 0;
+static uint8_t g_ddram_addr = LCD_ADDR_UNKNOWN;
+static i2c_lcd_1602_stats_t g_stats;
+static uint8_t g_batch[LCD_BATCH_LEN];
+static int g_batch_len = 0;
+static uint8_t g_busy_poll = 0;
+static uint8_t g_resync = 0;
+
+// Frame cells below LCD_GLYPH_SLOTS index g_frame_glyphs, the flush maps them to the CGRAM slot holding the bitmap.
+// g_cgram mirrors the slots, g_cgram_used is the glyph clock when a frame last needed each one and 0 for a slot
+// whose contents aren't known
+static uint8_t g_frame_glyphs[LCD_GLYPH_SLOTS][LCD_GLYPH_ROWS];
+static int g_frame_glyph_count = 0;
+static uint8_t g_glyph_slot[LCD_GLYPH_SLOTS];
+static uint8_t g_cgram[LCD_GLYPH_SLOTS][LCD_GLYPH_ROWS];
+static uint32_t g_cgram_used[LCD_GLYPH_SLOTS];
+static uint32_t g_glyph_clock = 0;
+
 static esp_err_t i2c_master_init()
 {
     i2c_config_t conf;
@@ -103,55 +150,247 @@ static esp_err_t i2c_set_byte(uint8_t data)
     i2c_master_stop(cmd);
     ret = i2c_master_cmd_begin(I2C_NUM_0, cmd, 1000 / portTICK_RATE_MS);
     i2c_cmd_link_delete(cmd);
+    if (ret == ESP_OK) {
+        g_stats.i2c_transactions++;
+        g_stats.i2c_bytes += 2;
+    }
     return ret;
 }
 
-/**
- * @brief test code to write mpu6050
- *
- * 1. send data
- * ___________________________________________________________________________________________________
- * | start | slave_addr + wr_bit + ack | write reg_address + ack | write data_len byte + ack  | stop |
- * --------|---------------------------|-------------------------|----------------------------|------|
- *
- * @param i2c_num I2C port number
- * @param reg_address slave reg address
- * @param data data to send
- * @param data_len data length
- *
- * @return
- *     - ESP_OK Success
- *     - ESP_ERR_INVALID_ARG Parameter error
- *     - ESP_FAIL Sending command error, slave doesn't ACK the transfer.
- *     - ESP_ERR_INVALID_STATE I2C driver not installed or not in master mode.
- *     - ESP_ERR_TIMEOUT Operation timeout because the bus is busy.
- */
-static esp_err_t i2c_lcd_write_enable(uint8_t data)
-{
-    uint8_t data_to_send = data | g_backlight;
-    esp_err_t ret;
-    ret = i2c_set_byte(data_to_send | En);
-    if (ret != ESP_OK) {
-        return ret;
+// The controller latches a nibble when E falls, so each nibble is two writes: the data with E high, then the
+// same data with E low
+static int i2c_lcd_put_nibble(uint8_t *buffer, int len, uint8_t data)
+{
+    buffer[len++] = data | g_backlight | En;
+    buffer[len++] = data | g_backlight;
+    return len;
+}
+
+static esp_err_t i2c_lcd_write_expander(uint8_t *data, int data_len)
+{
+    int ret;
+    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+    i2c_master_start(cmd);
+    i2c_master_write_byte(cmd, 0x27 << 1 | WRITE_BIT, ACK_CHECK_EN);
+    i2c_master_write(cmd, data, data_len, ACK_CHECK_EN);
+    i2c_master_stop(cmd);
+    ret = i2c_master_cmd_begin(I2C_NUM_0, cmd, 1000 / portTICK_RATE_MS);
+    i2c_cmd_link_delete(cmd);
+    if (ret == ESP_OK) {
+        g_stats.i2c_transactions++;
+        g_stats.i2c_bytes += 1 + data_len;
+    } else {
+        // Part of the write may have landed, nothing on the panel can be trusted until it is redrawn and the
+        // controller may be holding the first half of a byte
+        g_ddram_addr = LCD_ADDR_UNKNOWN;
+        g_panel_valid = 0;
+        memset(g_cgram_used, 0, sizeof(g_cgram_used));
+        g_resync = 1;
+    }
+    return ret;
+}
+
+// Three 8-bit function sets land the controller in 8-bit mode from either nibble phase, whether it just powered
+// up or a failed write left it half way through a byte, and from there it is switched to a 4-bit interface. Only
+// the last write has to get through, the earlier ones are retries
+static esp_err_t i2c_lcd_enter_4bit(void)
+{
+    uint8_t sequence[4];
+    int ret;
+    i2c_lcd_write_expander(sequence, i2c_lcd_put_nibble(sequence, 0, 0x30));
+    ets_delay_us(LCD_INIT_FIRST_US);
+    // second try
+    i2c_lcd_write_expander(sequence, i2c_lcd_put_nibble(sequence, 0, 0x30));
+    ets_delay_us(LCD_INIT_SECOND_US);
+    // third go, and finally set to 4-bit interface. Two bus bytes between them cover the execution time
+    ret = i2c_lcd_write_expander(sequence, i2c_lcd_put_nibble(sequence, i2c_lcd_put_nibble(sequence, 0, 0x30), 0x20));
+    if (ret == ESP_OK) {
+        g_resync = 0;
+    }
+    return ret;
+}
+
+// After a failed write the interface is brought back in step and the modes restored before anything else is
+// sent. The first function set may have completed a stray command, it only touches state that is redrawn anyway
+static esp_err_t i2c_lcd_resync(void)
+{
+    uint8_t modes[12];
+    int len = 0;
+    int ret;
+    if ((ret = i2c_lcd_enter_4bit()) != ESP_OK) return ret;
+    len = i2c_lcd_put_nibble(modes, len, LCD_FUNCTION & 0xf0);
+    len = i2c_lcd_put_nibble(modes, len, (LCD_FUNCTION << 4) & 0xf0);
+    len = i2c_lcd_put_nibble(modes, len, (LCD_DISPLAYCONTROL | g_display_control) & 0xf0);
+    len = i2c_lcd_put_nibble(modes, len, ((LCD_DISPLAYCONTROL | g_display_control) << 4) & 0xf0);
+    len = i2c_lcd_put_nibble(modes, len, (LCD_ENTRYMODESET | g_entry_mode) & 0xf0);
+    len = i2c_lcd_put_nibble(modes, len, ((LCD_ENTRYMODESET | g_entry_mode) << 4) & 0xf0);
+    if ((ret = i2c_lcd_write_expander(modes, len)) != ESP_OK) return ret;
+    g_stats.lcd_bytes += 3;
+    g_stats.resyncs++;
+    return ESP_OK;
+}
+
+// Expander writes queued so a whole string or frame goes out as one I2C transaction
+static esp_err_t i2c_lcd_send_batch(void)
+{
+    int ret = ESP_OK;
+    if (!g_batch_len) {
+        return ESP_OK;
+    }
+    if (g_resync) {
+        ret = i2c_lcd_resync();
+    }
+    if (ret == ESP_OK) {
+        ret = i2c_lcd_write_expander(g_batch, g_batch_len);
+    }
+    g_batch_len = 0;
+    return ret;
+}
+
+static esp_err_t i2c_lcd_queue_nibble(uint8_t data)
+{
+    esp_err_t ret = ESP_OK;
+    if (g_batch_len + 2 > LCD_BATCH_LEN) {
+        ret = i2c_lcd_send_batch();
+    }
+    g_batch_len = i2c_lcd_put_nibble(g_batch, g_batch_len, data);
+    return ret;
+}
+
+// Status read with RW high. D4-D7 are released by writing them high, the controller pulls them down while E is
+// high: the busy flag and the address counter's top three bits on the first pulse, the low four on the second.
+// Each write to read turnaround needs a repeated start, eleven bytes in all
+static esp_err_t i2c_lcd_read_status(uint8_t *status_out)
+{
+    int ret;
+    uint8_t idle = 0xf0 | g_backlight | Rw;
+    uint8_t high = 0xff;
+    uint8_t low = 0xff;
+    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+    i2c_master_start(cmd);
+    i2c_master_write_byte(cmd, 0x27 << 1 | WRITE_BIT, ACK_CHECK_EN);
+    i2c_master_write_byte(cmd, idle | En, ACK_CHECK_EN);
+    i2c_master_start(cmd);
+    i2c_master_write_byte(cmd, 0x27 << 1 | READ_BIT, ACK_CHECK_EN);
+    i2c_master_read_byte(cmd, &high, NACK_VAL);
+    i2c_master_start(cmd);
+    i2c_master_write_byte(cmd, 0x27 << 1 | WRITE_BIT, ACK_CHECK_EN);
+    i2c_master_write_byte(cmd, idle, ACK_CHECK_EN);
+    i2c_master_write_byte(cmd, idle | En, ACK_CHECK_EN);
+    i2c_master_start(cmd);
+    i2c_master_write_byte(cmd, 0x27 << 1 | READ_BIT, ACK_CHECK_EN);
+    i2c_master_read_byte(cmd, &low, NACK_VAL);
+    i2c_master_start(cmd);
+    i2c_master_write_byte(cmd, 0x27 << 1 | WRITE_BIT, ACK_CHECK_EN);
+    i2c_master_write_byte(cmd, idle, ACK_CHECK_EN);
+    i2c_master_stop(cmd);
+    ret = i2c_master_cmd_begin(I2C_NUM_0, cmd, 1000 / portTICK_RATE_MS);
+    i2c_cmd_link_delete(cmd);
+    if (ret == ESP_OK) {
+        g_stats.i2c_transactions++;
+        g_stats.i2c_bytes += 11;
+        g_stats.busy_polls++;
     }
-    vTaskDelay(10);
-    ret = i2c_set_byte(data_to_send & ~En);
-    vTaskDelay(pdMS_TO_TICKS(10));
+    *status_out = (high & 0xf0) | (low >> 4);
     return ret;
 }
 
+// Waits out clear or home, both of which leave the address counter at 0. A read that fails, a counter that
+// isn't 0 or a controller still busy past the slow oscillator's worst case means the read path can't be trusted
+// on this board, the rest of the wait and every later one are timed
+static void i2c_lcd_wait_slow_command(void)
+{
+    uint8_t status;
+    int64_t start_us = esp_timer_get_time();
+    int64_t elapsed_us = 0;
+    if (g_busy_poll) {
+        while (elapsed_us < LCD_SLOW_COMMAND_US) {
+            if (i2c_lcd_read_status(&status) != ESP_OK) break;
+            if (!(status & LCD_BUSY_FLAG)) {
+                if (status == 0) return;
+                break;
+            }
+            elapsed_us = esp_timer_get_time() - start_us;
+        }
+        ESP_LOGI(TAG, "LCD busy flag unreadable, falling back to timed waits");
+        g_busy_poll = 0;
+        g_ddram_addr = LCD_ADDR_UNKNOWN;
+        g_panel_valid = 0;
+    }
+    g_stats.timed_waits++;
+    if (elapsed_us < LCD_SLOW_COMMAND_US) ets_delay_us(LCD_SLOW_COMMAND_US - elapsed_us);
+}
+
+// Address the controller moves to after a character, the two lines of DDRAM are 0x00-0x27 and 0x40-0x67
+static uint8_t next_ddram_addr(uint8_t addr)
+{
+    if (g_entry_mode & LCD_ENTRYLEFT) {
+        addr++;
+        if (addr == 0x28) return 0x40;
+        if (addr == 0x68) return 0x00;
+        return addr;
+    }
+    if (addr == 0x00) return 0x67;
+    if (addr == 0x40) return 0x27;
+    return addr - 1;
+}
+
+// Follows what each byte does to the address counter and the visible cells, so a flush knows which cells
+// already hold the right character and when the cursor has to be moved
+static void track_lcd_byte(uint8_t data, uint8_t write_mode)
+{
+    if (write_mode) {
+        if (g_ddram_addr == LCD_ADDR_UNKNOWN) return;
+        for (int row = 0; row < LCD_ROWS; row++) {
+            if (g_ddram_addr >= g_row_offsets[row] && g_ddram_addr < g_row_offsets[row] + LCD_COLS) {
+                g_panel[row][g_ddram_addr - g_row_offsets[row]] = (char) data;
+            }
+        }
+        if (g_entry_mode & LCD_ENTRYSHIFTINCREMENT) g_panel_valid = 0;
+        g_ddram_addr = next_ddram_addr(g_ddram_addr);
+    } else if (data & LCD_SETDDRAMADDR) {
+        g_ddram_addr = data & 0x7f;
+    } else if (data & LCD_SETCGRAMADDR) {
+        g_ddram_addr = LCD_ADDR_UNKNOWN;
+    } else if (data & LCD_FUNCTIONSET) {
+        return;
+    } else if (data & LCD_CURSORSHIFT) {
+        g_ddram_addr = LCD_ADDR_UNKNOWN;
+        if (data & LCD_DISPLAYMOVE) g_panel_valid = 0;
+    } else if (data & (LCD_DISPLAYCONTROL | LCD_ENTRYMODESET)) {
+        return;
+    } else if (data & LCD_RETURNHOME) {
+        g_ddram_addr = 0;
+    } else if (data & LCD_CLEARDISPLAY) {
+        memset(g_panel, ' ', sizeof(g_panel));
+        g_panel_valid = 1;
+        g_ddram_addr = 0;
+    }
+}
+
 //write_mode is 0 for commands and 1 for setting character
-static esp_err_t i2c_lcd_write_byte(uint8_t data, uint8_t write_mode)
+static esp_err_t i2c_lcd_queue_byte(uint8_t data, uint8_t write_mode)
 {
     int ret;
     uint8_t highnib=data&0xf0;
 	uint8_t lownib=(data<<4)&0xf0;
-    ret = i2c_lcd_write_enable((highnib)|write_mode);
+    ret = i2c_lcd_queue_nibble((highnib)|write_mode);
+    if (ret == ESP_OK) {
+        ret = i2c_lcd_queue_nibble((lownib)|write_mode);
+    }
+    g_stats.lcd_bytes++;
+    track_lcd_byte(data, write_mode);
+    return ret; 
+}
+
+static esp_err_t i2c_lcd_write_byte(uint8_t data, uint8_t write_mode)
+{
+    esp_err_t ret = i2c_lcd_queue_byte(data, write_mode);
     if (ret != ESP_OK) {
+        g_batch_len = 0;
         return ret;
     }
-	ret = i2c_lcd_write_enable((lownib)|write_mode); 
-    return ret; 
+    return i2c_lcd_send_batch();
 }
 
 // When the display powers up, it is configured as follows:
@@ -170,35 +409,43 @@ static esp_err_t i2c_lcd_write_byte(uint8_t data, uint8_t write_mode)
 //    S = 0; No shift 
 int i2c_lcd_1602_init(void)
 {
-    uint8_t cmd_data;
+    uint8_t status;
+    int64_t read_start_us;
     i2c_master_init();
+    memset(g_frame, ' ', sizeof(g_frame));
+    g_frame_glyph_count = 0;
+    // CGRAM holds noise at power on
+    memset(g_cgram_used, 0, sizeof(g_cgram_used));
+    g_busy_poll = 0;
+    g_resync = 0;
     
     //Allow startup power on if called immediately
     vTaskDelay(pdMS_TO_TICKS(50));
   
-    cmd_data = 0x30;
-    i2c_lcd_write_enable( cmd_data );
-    vTaskDelay(pdMS_TO_TICKS(5));
-    // second try
-    i2c_lcd_write_enable(cmd_data);
-    vTaskDelay(pdMS_TO_TICKS(1));
-   
-    // third go!
-    ESP_ERROR_CHECK(i2c_lcd_write_enable(cmd_data)); 
-    
-    // finally, set to 4-bit interface
-    cmd_data = 0x20;
-    ESP_ERROR_CHECK(i2c_lcd_write_enable(cmd_data)); 
+    ESP_ERROR_CHECK(i2c_lcd_enter_4bit());
 
 	// set # lines, font size, etc.
-    cmd_data = LCD_FUNCTIONSET | LCD_4BITMODE |LCD_2LINE | LCD_5x8DOTS;
-    ESP_ERROR_CHECK(i2c_lcd_write_byte(cmd_data, 0));  
+    ESP_ERROR_CHECK(i2c_lcd_write_byte(LCD_FUNCTION, 0));  
 	
 	// turn the display on with no cursor or blinking default
     i2c_lcd_1602_display(); 
 	
 	// clear it off
     i2c_lcd_1602_clear();
+
+    // The busy flag can't be read until the controller is in 4-bit mode. After the clear it must read back idle
+    // with the address counter at 0, boards with RW tied low or reads that fail stay on timed waits
+    read_start_us = esp_timer_get_time();
+    if (i2c_lcd_read_status(&status) != ESP_OK || status != 0) {
+        ESP_LOGI(TAG, "LCD busy flag unreadable, using timed waits");
+        g_ddram_addr = LCD_ADDR_UNKNOWN;
+        g_panel_valid = 0;
+    } else {
+        g_stats.status_read_us = esp_timer_get_time() - read_start_us;
+        g_busy_poll = g_stats.status_read_us < LCD_SLOW_COMMAND_US - LCD_NOMINAL_SLOW_COMMAND_US;
+        ESP_LOGI(TAG, "LCD status read takes %u us, %s", g_stats.status_read_us,
+                 g_busy_poll ? "polling the busy flag" : "timed waits are quicker");
+    }
 	
     // set the entry mode
     // Initialize to default text direction (for roman languages)
@@ -211,12 +458,12 @@ int i2c_lcd_1602_init(void)
 void i2c_lcd_1602_clear(void)
 {
     ESP_ERROR_CHECK(i2c_lcd_write_byte(LCD_CLEARDISPLAY, 0)); 
-    vTaskDelay(pdMS_TO_TICKS(2));
+    i2c_lcd_wait_slow_command();
 }
 void i2c_lcd_1602_home(void)
 {
     ESP_ERROR_CHECK(i2c_lcd_write_byte(LCD_RETURNHOME, 0));
-    vTaskDelay(pdMS_TO_TICKS(2));
+    i2c_lcd_wait_slow_command();
 }
 void i2c_lcd_1602_noDisplay(void)
 {
@@ -258,12 +505,12 @@ void i2c_lcd_1602_scrollDisplayRight(void)
 }
 void i2c_lcd_1602_leftToRight(void)
 {
-    g_entry_mode |= LCD_MOVERIGHT;
+    g_entry_mode |= LCD_ENTRYLEFT;
     ESP_ERROR_CHECK(i2c_lcd_write_byte(LCD_ENTRYMODESET | g_entry_mode, 0)); 
 }
 void i2c_lcd_1602_rightToLeft(void)
 {
-    g_entry_mode &= ~LCD_MOVERIGHT;
+    g_entry_mode &= ~LCD_ENTRYLEFT;
     ESP_ERROR_CHECK(i2c_lcd_write_byte(LCD_ENTRYMODESET | g_entry_mode, 0)); 
 }
 void i2c_lcd_1602_noBacklight(void)
@@ -296,6 +543,120 @@ void i2c_lcd_1602_print(const char *buffer, int buffer_len)
 {
     for(int char_index = 0; char_index < buffer_len; char_index++)
     {
-        ESP_ERROR_CHECK( i2c_lcd_write_byte( (uint8_t) buffer[char_index], 1 ) );
+        ESP_ERROR_CHECK( i2c_lcd_queue_byte( (uint8_t) buffer[char_index], 1 ) );
+    }
+    ESP_ERROR_CHECK( i2c_lcd_send_batch() );
+}
+
+void i2c_lcd_1602_frameClear(void)
+{
+    memset(g_frame, ' ', sizeof(g_frame));
+    g_frame_glyph_count = 0;
+}
+
+void i2c_lcd_1602_framePrint(uint8_t col, uint8_t row, const char *buffer, int buffer_len)
+{
+    if (row >= LCD_ROWS || col >= LCD_COLS) return;
+    if (buffer_len > LCD_COLS - col) buffer_len = LCD_COLS - col;
+    memcpy(&g_frame[row][col], buffer, buffer_len);
+}
+
+int i2c_lcd_1602_framePutGlyph(uint8_t col, uint8_t row, const uint8_t glyph[I2C_LCD_1602_GLYPH_ROWS])
+{
+    int index;
+    if (row >= LCD_ROWS || col >= LCD_COLS) return ESP_ERR_INVALID_ARG;
+    for (index = 0; index < g_frame_glyph_count; index++) {
+        if (!memcmp(g_frame_glyphs[index], glyph, LCD_GLYPH_ROWS)) break;
+    }
+    if (index == LCD_GLYPH_SLOTS) return ESP_ERR_NO_MEM;
+    if (index == g_frame_glyph_count) {
+        memcpy(g_frame_glyphs[index], glyph, LCD_GLYPH_ROWS);
+        g_frame_glyph_count++;
+    }
+    g_frame[row][col] = (char) index;
+    return ESP_OK;
+}
+
+// Glyphs already resident are used where they are. Missing ones go to the least recently needed slot this frame
+// doesn't use, so no cell being kept changes shape. A slot rewritten under a cell the frame changes anyway is fine,
+// the cell is rewritten in the same flush
+static esp_err_t load_glyphs(void)
+{
+    esp_err_t ret;
+    uint8_t needed = 0;
+    g_glyph_clock++;
+    for (int glyph = 0; glyph < g_frame_glyph_count; glyph++) {
+        g_glyph_slot[glyph] = LCD_GLYPH_NONE;
+        for (int slot = 0; slot < LCD_GLYPH_SLOTS; slot++) {
+            if (g_cgram_used[slot] && !memcmp(g_cgram[slot], g_frame_glyphs[glyph], LCD_GLYPH_ROWS)) {
+                g_glyph_slot[glyph] = slot;
+                g_cgram_used[slot] = g_glyph_clock;
+                needed |= 1 << slot;
+                g_stats.glyph_hits++;
+                break;
+            }
+        }
+    }
+    for (int glyph = 0; glyph < g_frame_glyph_count; glyph++) {
+        int victim = -1;
+        if (g_glyph_slot[glyph] != LCD_GLYPH_NONE) continue;
+        for (int slot = 0; slot < LCD_GLYPH_SLOTS; slot++) {
+            if (!(needed & 1 << slot) && (victim < 0 || g_cgram_used[slot] < g_cgram_used[victim])) victim = slot;
+        }
+        if ((ret = i2c_lcd_queue_byte(LCD_SETCGRAMADDR | victim << 3, 0)) != ESP_OK) return ret;
+        for (int glyph_row = 0; glyph_row < LCD_GLYPH_ROWS; glyph_row++) {
+            if ((ret = i2c_lcd_queue_byte(g_frame_glyphs[glyph][glyph_row], 1)) != ESP_OK) return ret;
+        }
+        memcpy(g_cgram[victim], g_frame_glyphs[glyph], LCD_GLYPH_ROWS);
+        g_cgram_used[victim] = g_glyph_clock;
+        g_glyph_slot[glyph] = victim;
+        needed |= 1 << victim;
+        g_stats.glyph_misses++;
+        g_stats.cgram_bytes += 1 + LCD_GLYPH_ROWS;
+    }
+    return ESP_OK;
+}
+
+// Writes the cells of a row that differ from the panel. The address counter already sits on the next cell
+// after a character, so only the first cell of each run of changes costs a cursor move
+static esp_err_t flush_row(int row)
+{
+    esp_err_t ret;
+    for (int col = 0; col < LCD_COLS; col++) {
+        uint8_t addr = g_row_offsets[row] + col;
+        uint8_t data = (uint8_t) g_frame[row][col];
+        if (data < LCD_GLYPH_SLOTS) data = g_glyph_slot[data];
+        if (g_panel_valid && (uint8_t) g_panel[row][col] == data) continue;
+        if (g_ddram_addr != addr && (ret = i2c_lcd_queue_byte(LCD_SETDDRAMADDR | addr, 0)) != ESP_OK) return ret;
+        if ((ret = i2c_lcd_queue_byte(data, 1)) != ESP_OK) return ret;
     }
+    return ESP_OK;
+}
+
+int i2c_lcd_1602_frameFlush(void)
+{
+    uint32_t lcd_bytes = g_stats.lcd_bytes;
+    uint32_t i2c_bytes = g_stats.i2c_bytes;
+    // Unknown contents are redrawn in full, a failed write leaves them unknown again for the next flush
+    uint8_t panel_valid = g_panel_valid;
+    esp_err_t ret = load_glyphs();
+    for (int row = 0; row < LCD_ROWS && ret == ESP_OK; row++) {
+        ret = flush_row(row);
+    }
+    if (ret == ESP_OK) {
+        ret = i2c_lcd_send_batch();
+    }
+    g_batch_len = 0;
+    if (ret == ESP_OK && !panel_valid && !(g_entry_mode & LCD_ENTRYSHIFTINCREMENT)) {
+        g_panel_valid = 1;
+    }
+    g_stats.frames++;
+    g_stats.last_frame_lcd_bytes = g_stats.lcd_bytes - lcd_bytes;
+    g_stats.last_frame_i2c_bytes = g_stats.i2c_bytes - i2c_bytes;
+    return ret;
+}
+
+void i2c_lcd_1602_getStats(i2c_lcd_1602_stats_t *stats_out)
+{
+    *stats_out = g_stats;
 }
\ No newline at end of file
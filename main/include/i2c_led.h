@@ -2,6 +2,29 @@
 #define _I2C_LED_H_
 #include <stdint.h>
 
+#define I2C_LCD_1602_COLS 16
+#define I2C_LCD_1602_ROWS 2
+#define I2C_LCD_1602_GLYPH_SLOTS 8      /*CGRAM custom characters*/
+#define I2C_LCD_1602_GLYPH_ROWS 8       /*5 pixel rows, bit 4 is the leftmost column*/
+#define I2C_LCD_1602_FULL_BLOCK 0xff    /*Solid cell in the A00 character ROM*/
+
+/*Traffic to the panel. An LCD byte is one command or character, sent as two nibbles of two I2C writes each*/
+typedef struct i2c_lcd_1602_stats
+{
+    uint32_t frames;                /*Framebuffer flushes*/
+    uint32_t lcd_bytes;
+    uint32_t i2c_transactions;
+    uint32_t i2c_bytes;             /*Address and data bytes on the bus*/
+    uint32_t last_frame_lcd_bytes;
+    uint32_t last_frame_i2c_bytes;
+    uint32_t busy_polls;            /*Busy flag reads*/
+    uint32_t timed_waits;           /*Slow commands waited out on the clock rather than polled*/
+    uint32_t status_read_us;        /*Measured at init, 0 when the busy flag can't be read*/
+    uint32_t glyph_hits;            /*Glyphs a flush found already in CGRAM*/
+    uint32_t glyph_misses;          /*Glyphs that had to be written to CGRAM*/
+    uint32_t cgram_bytes;           /*LCD bytes spent loading them*/
+    uint32_t resyncs;               /*Interface brought back in step after a failed write*/
+} i2c_lcd_1602_stats_t;
 
 int i2c_lcd_1602_init(void);
 void i2c_lcd_1602_clear(void);
@@ -27,4 +50,15 @@ void i2c_lcd_1602_noAutoscroll(void);
 void i2c_lcd_1602_setCursor(uint8_t col, uint8_t row); 
 void i2c_lcd_1602_print(const char *buffer, int buffer_len);
 
+/*Shadow framebuffer. Pages are drawn into RAM and a flush sends only the cells that differ from what the panel
+  shows, moving the cursor where a run of changes starts. Nothing is cleared so the panel never blanks*/
+void i2c_lcd_1602_frameClear(void);
+void i2c_lcd_1602_framePrint(uint8_t col, uint8_t row, const char *buffer, int buffer_len);
+/*Places a custom character. Up to I2C_LCD_1602_GLYPH_SLOTS different glyphs fit in a frame, the flush loads any
+  that aren't already in CGRAM into the least recently used slots, so redrawing the same glyphs costs no CGRAM
+  writes at all*/
+int i2c_lcd_1602_framePutGlyph(uint8_t col, uint8_t row, const uint8_t glyph[I2C_LCD_1602_GLYPH_ROWS]);
+int i2c_lcd_1602_frameFlush(void);
+void i2c_lcd_1602_getStats(i2c_lcd_1602_stats_t *stats_out);
+
 #endif //_I2C_LED_H_
\ No newline at end of file
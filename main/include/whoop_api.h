@@ -0,0 +1,56 @@
+#ifndef _WHOOP_API_H_
+#define _WHOOP_API_H_
+#include <stddef.h>
+#include <stdint.h>
+#include "whoop_data.h"
+#include "whoop_encode.h"
+
+#define WHOOP_API_ETAG_LEN 40
+
+/*Resources served under /api/v1, the record types share whoop_data_type_n values*/
+typedef enum whoop_api_resource
+{
+    WHOOP_API_RESOURCE_SLEEP =      WHOOP_DATA_TYPE_SLEEP,
+    WHOOP_API_RESOURCE_WORKOUT =    WHOOP_DATA_TYPE_WORKOUT,
+    WHOOP_API_RESOURCE_RECOVERY =   WHOOP_DATA_TYPE_RECOVERY,
+    WHOOP_API_RESOURCE_CYCLE =      WHOOP_DATA_TYPE_CYCLE,
+    WHOOP_API_RESOURCE_LATEST,
+    WHOOP_API_RESOURCE_MAX
+} whoop_api_resource_n;
+
+typedef struct whoop_api_stats
+{
+    uint32_t hits;          /*Requests answered from a serialized body*/
+    uint32_t builds;        /*Bodies serialized after a store change*/
+    uint32_t build_us;
+    uint32_t not_modified;  /*Requests answered 304 without touching a body*/
+} whoop_api_stats_t;
+
+/*One page of /api/v1/history. Records have no timestamps on the device, so the range is by record ID, which
+  Whoop hands out in increasing order (cycle ID for recoveries)*/
+typedef struct whoop_api_history_query
+{
+    int account;
+    whoop_data_type_n type;
+    int from_id;                    /*Inclusive, 0 leaves that end open*/
+    int to_id;
+    unsigned int cursor;            /*"next" of the previous page, 0 for the first*/
+    int limit;                      /*0 for as many as allowed*/
+} whoop_api_history_query_t;
+
+/*JSON body of a resource for one account, straight from the store. The body is serialized once per change to
+  the types it covers and owned by the cache along with its ETag, both valid until the next call. Only called
+  from the httpd task*/
+int whoop_api_get_body(int account, whoop_api_resource_n resource, const char **body, size_t *body_len, const char **etag);
+/*1 when If-None-Match already names the current version, so a 304 can go out before any serialization.
+  Fills etag with the current tag either way*/
+int whoop_api_not_modified(int account, whoop_api_resource_n resource, const char *if_none_match, char *etag, size_t etag_len);
+/*1 when one of the tags in an If-None-Match list, weak or not, is etag*/
+int whoop_api_etag_list_matches(const char *if_none_match, const char *etag);
+/*Streams a page as {"user","type","records":[...],"next"} through the encoder, newest record first. "next" is
+  null on the last page. The caller finishes the encoder*/
+int whoop_api_write_history(whoop_encoder_t *encoder, const whoop_api_history_query_t *query);
+void whoop_api_get_stats(whoop_api_stats_t *stats_out);
+const char *whoop_api_resource_name(whoop_api_resource_n resource);
+
+#endif //_WHOOP_API_H_
\ No newline at end of file
@@ -1,24 +1,95 @@
 #ifndef _WHOOP_CLIENT_H_
 #define _WHOOP_CLIENT_H_
+#include <stddef.h>
+#include <stdint.h>
+
+#define WHOOP_POLL_INTERVAL_MS 300000
 
 typedef enum whoop_api_request_type
 {
     WHOOP_API_REQUEST_TYPE_SLEEP,
     WHOOP_API_REQUEST_TYPE_WORKOUT,
     WHOOP_API_REQUEST_TYPE_RECOVERY,
-    WHOOP_API_REQUEST_TYPE_CYCLE
+    WHOOP_API_REQUEST_TYPE_CYCLE,
+    WHOOP_API_REQUEST_TYPE_TOKEN,   /*Token exchange, used for per-request accounting only*/
+    WHOOP_API_REQUEST_TYPE_MAX
 } whoop_api_request_type_n;
 
+/*Bytes received per request type, wire is what came off the socket and body what reached the parser*/
+typedef struct whoop_transfer_stats
+{
+    uint32_t requests;
+    uint32_t errors;                /*Transport failures and non-2xx responses*/
+    uint32_t responses;
+    uint32_t gzip_responses;
+    uint32_t wire_bytes;
+    uint32_t body_bytes;
+} whoop_transfer_stats_t;
+
+typedef enum whoop_job_state
+{
+    WHOOP_JOB_STATE_QUEUED,
+    WHOOP_JOB_STATE_RUNNING,
+    WHOOP_JOB_STATE_DONE,
+    WHOOP_JOB_STATE_FAILED
+} whoop_job_state_n;
+
+/*Fetch queued on behalf of a caller that does not wait for it*/
+typedef struct whoop_job
+{
+    uint32_t id;
+    int account;
+    whoop_api_request_type_n request_type;
+    whoop_job_state_n state;
+    int status;                     /*Result of the fetch once done or failed*/
+    int64_t queued_us;
+    int64_t started_us;
+    int64_t finished_us;
+} whoop_job_t;
+
 enum token_request_type {
     TOKEN_REQUEST_TYPE_AUTH_CODE = 0,
     TOKEN_REQUEST_TYPE_REFRESH = 1
 };
 
 //void print_whoop_data_old(void);
-void whoop_get_token(const char *code_or_token, int token_request_type);
-void whoop_get_data(whoop_api_request_type_n request_type);
+/*Fetch task only, other tasks queue the exchange with whoop_queue_token*/
+void whoop_get_token(int account, const char *code_or_token, int token_request_type);
+/*Latest record of one type into the store, 0 on success. Fetch task only, other tasks queue a job*/
+int whoop_get_data(int account, whoop_api_request_type_n request_type);
+/*Fetches every data type for every authorized account, interleaving accounts*/
+void whoop_poll_accounts(void);
+/*Queue work for the fetch task, returns 0 when queued. ID 0 fetches the most recent record*/
+int whoop_queue_fetch(int account, whoop_api_request_type_n request_type, int id);
+/*Copies the code or token and exchanges it on the fetch task, returns 0 when queued. A second call before the
+  exchange has run replaces the waiting code*/
+int whoop_queue_token(int account, const char *code_or_token, int token_request_type);
+int whoop_queue_poll(void);
+/*Microseconds until the poll timer next queues a poll, 0 before the first one. Webhook fetches can land sooner*/
+int64_t whoop_client_get_next_poll_us(void);
+/*Queues a fetch of the latest record and hands back a job ID to follow it with. While a job for the same
+  account and type is still queued or running, its ID is handed back instead of queueing another. The fetch
+  honours the freshness window like whoop_get_data*/
+int whoop_queue_job(int account, whoop_api_request_type_n request_type, uint32_t *job_id);
+/*Copy of a recent job, -1 once it has been recycled*/
+int whoop_client_get_job(uint32_t job_id, whoop_job_t *job_out);
+const char *whoop_job_state_name(whoop_job_state_n state);
+/*Account whose records carry this Whoop user_id, -1 if none*/
+int whoop_client_account_for_user(int user_id);
+/*Fetches queued before the network is ready wait until this is set*/
+void whoop_client_set_network_ready(int ready);
+/*Times the network came back after being lost*/
+uint32_t whoop_client_get_reconnect_count(void);
+/*Unix time in milliseconds from the Date header of the last Whoop response, -1 until one has arrived*/
+int whoop_client_get_unix_time_ms(int64_t *now_ms_out);
+/*Notes a verified webhook so polling can drop to the safety net interval*/
+void whoop_client_webhook_received(void);
 void init_whoop_tls_client(void);
 void end_whoop_tls_client(void);
+/*Bytes of client state reserved for each account*/
+size_t whoop_client_account_size(void);
+int whoop_client_get_transfer_stats(whoop_api_request_type_n request_type, whoop_transfer_stats_t *stats_out);
+const char *whoop_api_request_type_name(whoop_api_request_type_n request_type);
 
 
 #endif //_WHOOP_CLIENT_H_
\ No newline at end of file
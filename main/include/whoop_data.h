@@ -1,5 +1,10 @@
 #ifndef _WHOOP_DATA_H_
 #define _WHOOP_DATA_H_
+#include <stddef.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+
+#define WHOOP_ACCOUNT_COUNT CONFIG_WHOOP_ACCOUNT_COUNT
 
 typedef void * whoop_data_handle_t;
 
@@ -9,10 +14,21 @@ typedef enum whoop_data_status
 
     WHOOP_DATA_STATUS_ID_NOT_FOUND =            -100,
     WHOOP_DATA_STATUS_NO_RECORDINGS,
-    WHOOP_DATA_STATUS_INVALID_OPTION
+    WHOOP_DATA_STATUS_INVALID_OPTION,
+    WHOOP_DATA_STATUS_INVALID_ACCOUNT
 } whoop_data_status_n;
 
 
+/*Same order as the client's request types*/
+typedef enum whoop_data_type
+{
+    WHOOP_DATA_TYPE_SLEEP,
+    WHOOP_DATA_TYPE_WORKOUT,
+    WHOOP_DATA_TYPE_RECOVERY,
+    WHOOP_DATA_TYPE_CYCLE,
+    WHOOP_DATA_TYPE_MAX
+} whoop_data_type_n;
+
 typedef enum whoop_score_state
 {
     WHOOP_SCORE_STATE_SCORED,
@@ -80,28 +96,84 @@ typedef enum whoop_data_opt
     WHOOP_DATA_OPT_RECOVERY_SKIN_TEMP_CELCIUS =                             0x8104
 } whoop_data_opt_n;
 
+#define WHOOP_DATA_FIELD_REQUIRED       0x01    /*Whoop always sends it for a scored record*/
+#define WHOOP_DATA_FIELD_ID             0x02    /*Identifies the record, not a metric*/
+#define WHOOP_DATA_FIELD_SCORE_STATE    0x04    /*Holds a whoop_score_state_n*/
+#define WHOOP_DATA_FIELD_BOOL           0x08
+
+typedef struct whoop_data_field
+{
+    const char *name;
+    whoop_data_opt_n opt;
+    int flags;
+} whoop_data_field_t;
+
+/*Walks the records of one type from the most recently stored back. The cursor counts the records stored up to
+  the next one returned, so it can be handed out and picked up in a later request*/
+typedef struct whoop_data_iter
+{
+    int account;
+    whoop_data_type_n type;
+    unsigned int cursor;            /*0 once there is nothing left*/
+} whoop_data_iter_t;
+
 int init_whoop_data(void);
 int discard_whoop_data(void);
-
-/*Sleep ID or 0 for most recent*/
-int get_whoop_sleep_handle_by_id(int id, whoop_data_handle_t *handle);
-int create_whoop_sleep_data(int id, whoop_data_handle_t *handle);
+/*Bytes of store reserved for each account*/
+size_t get_whoop_data_account_size(void);
+/*Loads the most recent records cached in flash, marked stale until fetched again. Needs NVS initialized*/
+int restore_whoop_data(void);
+/*Called after a successful fetch, clears the stale mark and caches the most recent record in flash. Fields not read
+  yet are cached as their text and stay undecoded*/
+int save_whoop_data_record(int account, whoop_data_type_n type);
+int is_whoop_data_stale(int account, whoop_data_type_n type);
+
+/*Account index in [0, WHOOP_ACCOUNT_COUNT). Sleep ID or 0 for most recent*/
+int get_whoop_sleep_handle_by_id(int account, int id, whoop_data_handle_t *handle);
+int create_whoop_sleep_data(int account, int id, whoop_data_handle_t *handle);
 
 /*Cycle ID or 0 for most recent*/
-int get_whoop_cycle_handle_by_id(int id, whoop_data_handle_t *handle);
-int create_whoop_cycle_data(int id, whoop_data_handle_t *handle);
+int get_whoop_cycle_handle_by_id(int account, int id, whoop_data_handle_t *handle);
+int create_whoop_cycle_data(int account, int id, whoop_data_handle_t *handle);
 
 /*Workout ID or 0 for most recent*/
-int get_whoop_workout_handle_by_id(int id, whoop_data_handle_t *handle);
-int create_whoop_workout_data(int id, whoop_data_handle_t *handle);
+int get_whoop_workout_handle_by_id(int account, int id, whoop_data_handle_t *handle);
+int create_whoop_workout_data(int account, int id, whoop_data_handle_t *handle);
 
 /*ID can be either sleep or cycle id related to recovery or 0 for most recent*/
-int get_whoop_recovery_handle_by_id(int id, whoop_data_handle_t *handle);
-int create_whoop_recovery_data(int sleep_id, int cycle_id, whoop_data_handle_t *handle);
+int get_whoop_recovery_handle_by_id(int account, int id, whoop_data_handle_t *handle);
+int create_whoop_recovery_data(int account, int sleep_id, int cycle_id, whoop_data_handle_t *handle);
 
 
+typedef struct whoop_data_lazy_stats
+{
+    uint32_t deferred;      /*Fields stored as text*/
+    uint32_t decoded;       /*Fields later converted on first read*/
+    uint32_t decode_us;
+} whoop_data_lazy_stats_t;
+
 int set_whoop_data(whoop_data_handle_t handle, whoop_data_opt_n whoop_data_opt, ...);
 int get_whoop_data(whoop_data_handle_t handle, whoop_data_opt_n whoop_data_opt, void *data_out);
+/*With CONFIG_WHOOP_DATA_LAZY a record's fields can be stored as their JSON text and converted on first read.
+  Begin before setting a record's fields, values are decoded straight away when lazy mode is off*/
+int begin_whoop_data_lazy(whoop_data_handle_t handle);
+int set_whoop_data_lazy(whoop_data_handle_t handle, whoop_data_opt_n whoop_data_opt, const char *text, size_t text_len);
+/*Decodes every deferred field of the record, for readers that go around get_whoop_data*/
+int materialize_whoop_data(whoop_data_handle_t handle);
+void get_whoop_data_lazy_stats(whoop_data_lazy_stats_t *stats_out);
+/*Every field stored for a type, in the order they are printed and served*/
+const whoop_data_field_t *get_whoop_data_fields(whoop_data_type_n type, int *field_count);
+/*Most recent record of any type, same as the get_*_handle_by_id functions with ID 0*/
+int get_whoop_data_latest_handle(int account, whoop_data_type_n type, whoop_data_handle_t *handle);
+/*Cursor 0 starts at the most recent record. Only the ring of recent records is kept, a cursor that has fallen
+  behind it ends the walk*/
+int begin_whoop_data_iter(int account, whoop_data_type_n type, unsigned int cursor, whoop_data_iter_t *iter);
+int next_whoop_data_iter(whoop_data_iter_t *iter, whoop_data_handle_t *handle);
+const char *get_whoop_data_type_name(whoop_data_type_n type);
+/*Changes every time a value is set, lets readers notice new data without polling every record*/
+unsigned int get_whoop_data_generation(void);
+/*Same for the records of one type across all accounts, stale marks included*/
+unsigned int get_whoop_data_version(whoop_data_type_n type);
 
 void print_whoop_cycle_data(whoop_data_handle_t handle);
 void print_whoop_sleep_data(whoop_data_handle_t handle);
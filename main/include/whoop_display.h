@@ -0,0 +1,18 @@
+#ifndef _WHOOP_DISPLAY_H_
+#define _WHOOP_DISPLAY_H_
+#include <stdint.h>
+
+/*Starts the display task, which brings up the LCD and draws the first page. The LCD is only touched from there*/
+int init_whoop_display(void);
+/*Queue a command for the display task without blocking, returns 0 when queued. Commands that pile up while a frame
+  is going out are folded into the next render*/
+int whoop_display_next_page(void);
+/*Redraw the current page with the latest data*/
+int whoop_display_refresh(void);
+int whoop_display_set_backlight(int on);
+/*Times the LCD page was redrawn since boot*/
+uint32_t whoop_display_get_render_count(void);
+/*Commands folded into a render along with others rather than drawn on their own*/
+uint32_t whoop_display_get_superseded_count(void);
+
+#endif //_WHOOP_DISPLAY_H_
\ No newline at end of file
@@ -0,0 +1,55 @@
+#ifndef _WHOOP_ENCODE_H_
+#define _WHOOP_ENCODE_H_
+#include <stddef.h>
+#include <stdint.h>
+
+#define WHOOP_ENCODE_BUFFER_LEN 256
+#define WHOOP_ENCODE_MAX_DEPTH 16
+
+typedef enum whoop_encode_format
+{
+    WHOOP_ENCODE_FORMAT_JSON,
+    WHOOP_ENCODE_FORMAT_CBOR,       /*RFC 8949, containers are indefinite length so nothing is counted up front*/
+    WHOOP_ENCODE_FORMAT_MAX
+} whoop_encode_format_n;
+
+/*Takes each full buffer, returns 0 to keep going. Data is only valid during the call*/
+typedef int (*whoop_encode_flush_fn)(void *ctx, const uint8_t *data, size_t len);
+
+/*Push-style writer for maps, arrays and scalars. Output goes through a fixed buffer, so a document of any size
+  costs the same RAM. Errors stick, the first one is returned by whoop_encode_finish*/
+typedef struct whoop_encoder
+{
+    whoop_encode_format_n format;
+    whoop_encode_flush_fn flush;
+    void *ctx;
+    int err;
+    int depth;
+    int after_key;
+    uint16_t has_items;             /*Bit per depth, set once the container holds something*/
+    uint16_t is_array;              /*Bit per depth*/
+    size_t len;
+    uint8_t buffer[WHOOP_ENCODE_BUFFER_LEN];
+} whoop_encoder_t;
+
+void whoop_encode_begin(whoop_encoder_t *encoder, whoop_encode_format_n format, whoop_encode_flush_fn flush, void *ctx);
+void whoop_encode_map_begin(whoop_encoder_t *encoder);
+void whoop_encode_array_begin(whoop_encoder_t *encoder);
+/*Closes the innermost map or array*/
+void whoop_encode_end(whoop_encoder_t *encoder);
+/*Inside a map, every value is preceded by its key*/
+void whoop_encode_key(whoop_encoder_t *encoder, const char *key);
+void whoop_encode_int(whoop_encoder_t *encoder, int32_t value);
+void whoop_encode_uint(whoop_encoder_t *encoder, uint32_t value);
+/*Three decimals in JSON, single precision in CBOR*/
+void whoop_encode_float(whoop_encoder_t *encoder, float value);
+void whoop_encode_bool(whoop_encoder_t *encoder, int value);
+void whoop_encode_null(whoop_encoder_t *encoder);
+void whoop_encode_string(whoop_encoder_t *encoder, const char *value);
+/*Flushes what is left, 0 when every write made it out*/
+int whoop_encode_finish(whoop_encoder_t *encoder);
+const char *whoop_encode_content_type(whoop_encode_format_n format);
+/*Format named by a format= parameter, -1 if unknown*/
+int whoop_encode_format_from_name(const char *name);
+
+#endif //_WHOOP_ENCODE_H_
\ No newline at end of file
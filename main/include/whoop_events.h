@@ -0,0 +1,31 @@
+#ifndef _WHOOP_EVENTS_H_
+#define _WHOOP_EVENTS_H_
+#include <stdint.h>
+#include <esp_http_server.h>
+#include "whoop_data.h"
+
+typedef struct whoop_events_stats
+{
+    uint32_t clients;
+    uint32_t connects;
+    uint32_t rejected;          /*Turned away with every client slot taken*/
+    uint32_t evicted;           /*Dropped for falling a whole backlog behind or a failed send*/
+    uint32_t published;
+    uint32_t delivered;         /*Events completely written to a client*/
+    uint32_t fanout_avg_us;     /*Publish until written to the client socket*/
+    uint32_t fanout_max_us;
+    uint32_t client_state_bytes;    /*Stream state allocated per client, not what its socket and unsent events hold*/
+    uint32_t backlog_bytes;     /*Shared event backlog, whatever the number of clients*/
+} whoop_events_stats_t;
+
+void init_whoop_events(void);
+/*Server the event stream runs on, NULL when it stops*/
+void whoop_events_set_server(httpd_handle_t server);
+/*Turns the request into a Server-Sent Events stream kept open after the handler returns*/
+esp_err_t whoop_events_add_client(httpd_req_t *req);
+/*Safe from any task, the sockets are only written from the httpd task*/
+void whoop_events_publish_record(int account, whoop_data_type_n type);
+void whoop_events_publish_page(int account, whoop_data_type_n type);
+void whoop_events_get_stats(whoop_events_stats_t *stats_out);
+
+#endif //_WHOOP_EVENTS_H_
\ No newline at end of file
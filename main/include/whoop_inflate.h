@@ -0,0 +1,27 @@
+#ifndef _WHOOP_INFLATE_H_
+#define _WHOOP_INFLATE_H_
+#include <stddef.h>
+
+typedef struct whoop_inflate * whoop_inflate_handle_t;
+
+typedef enum whoop_inflate_status
+{
+    WHOOP_INFLATE_STATUS_OK =               0,
+    WHOOP_INFLATE_STATUS_DONE =             1,      /*gzip trailer read, later input is ignored*/
+
+    WHOOP_INFLATE_STATUS_BAD_DATA =         -100,
+    WHOOP_INFLATE_STATUS_NO_MEM,
+    WHOOP_INFLATE_STATUS_INCOMPLETE
+} whoop_inflate_status_n;
+
+/*Streaming gzip decoder. Input can be fed in chunks of any size; the inflated body is written straight into
+  one growing buffer, which doubles as the deflate window, so only a small carry of undecoded input is kept.
+  Size hint is the expected inflated length, 0 if unknown*/
+int whoop_inflate_begin(whoop_inflate_handle_t *handle, size_t size_hint);
+int whoop_inflate_feed(whoop_inflate_handle_t handle, const void *data, size_t data_len);
+/*Checks the trailer and hands over the NUL terminated body, to be released with whoop_mem_free*/
+int whoop_inflate_finish(whoop_inflate_handle_t handle, char **output, size_t *output_len);
+/*Frees the decoder and any body not taken by whoop_inflate_finish*/
+void whoop_inflate_end(whoop_inflate_handle_t handle);
+
+#endif //_WHOOP_INFLATE_H_
\ No newline at end of file
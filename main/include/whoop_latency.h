@@ -0,0 +1,34 @@
+#ifndef _WHOOP_LATENCY_H_
+#define _WHOOP_LATENCY_H_
+#include <stdint.h>
+#include "whoop_client.h"
+
+#define WHOOP_LATENCY_BUCKET_COUNT 24    /*Bucket n holds samples in [2^n, 2^(n+1)) microseconds*/
+
+typedef enum whoop_latency_phase
+{
+    WHOOP_LATENCY_PHASE_CONNECT,        /*DNS, TCP connect and TLS handshake, only when a new connection is opened*/
+    WHOOP_LATENCY_PHASE_REQUEST,        /*Connected until request headers sent*/
+    WHOOP_LATENCY_PHASE_FIRST_BYTE,     /*Request sent until first response header*/
+    WHOOP_LATENCY_PHASE_BODY,           /*First response header until body complete*/
+    WHOOP_LATENCY_PHASE_PARSE,          /*JSON parse*/
+    WHOOP_LATENCY_PHASE_COMMIT,         /*Storing parsed fields*/
+    WHOOP_LATENCY_PHASE_TOTAL,
+    WHOOP_LATENCY_PHASE_MAX
+} whoop_latency_phase_n;
+
+typedef struct whoop_latency_summary
+{
+    uint32_t count;
+    uint32_t p50_us;
+    uint32_t p90_us;
+    uint32_t p99_us;
+} whoop_latency_summary_t;
+
+void whoop_latency_record(whoop_api_request_type_n request_type, whoop_latency_phase_n phase, int64_t duration_us);
+int whoop_latency_get_summary(whoop_api_request_type_n request_type, whoop_latency_phase_n phase, whoop_latency_summary_t *summary_out);
+/*Per bucket sample counts since boot, and optionally the exact sum of all samples*/
+int whoop_latency_get_buckets(whoop_api_request_type_n request_type, whoop_latency_phase_n phase, uint32_t *buckets_out, uint64_t *sum_us_out);
+const char *whoop_latency_phase_name(whoop_latency_phase_n phase);
+
+#endif //_WHOOP_LATENCY_H_
\ No newline at end of file
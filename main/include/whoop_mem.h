@@ -0,0 +1,44 @@
+#ifndef _WHOOP_MEM_H_
+#define _WHOOP_MEM_H_
+#include <stddef.h>
+#include "whoop_client.h"
+
+/*Accounting slots. Upstream request slots mirror whoop_api_request_type_n.*/
+typedef enum whoop_mem_slot
+{
+    WHOOP_MEM_SLOT_SLEEP =      WHOOP_API_REQUEST_TYPE_SLEEP,
+    WHOOP_MEM_SLOT_WORKOUT =    WHOOP_API_REQUEST_TYPE_WORKOUT,
+    WHOOP_MEM_SLOT_RECOVERY =   WHOOP_API_REQUEST_TYPE_RECOVERY,
+    WHOOP_MEM_SLOT_CYCLE =      WHOOP_API_REQUEST_TYPE_CYCLE,
+    WHOOP_MEM_SLOT_TOKEN =      WHOOP_API_REQUEST_TYPE_TOKEN,
+    WHOOP_MEM_SLOT_SERVER,
+    WHOOP_MEM_SLOT_MAX
+} whoop_mem_slot_n;
+
+typedef struct whoop_mem_stats
+{
+    unsigned int request_count;     /*Completed requests charged to this slot*/
+    unsigned int alloc_count;       /*Allocations during the last request*/
+    unsigned int failed_count;      /*Failed allocations over all requests*/
+    size_t peak_bytes;              /*Peak live bytes during the last request*/
+    size_t largest_block;           /*Largest single block during the last request*/
+    size_t max_peak_bytes;          /*Worst peak over all requests*/
+    size_t live_bytes;              /*Bytes currently outstanding*/
+} whoop_mem_stats_t;
+
+void init_whoop_mem(void);
+
+/*Starts charging the calling task's tracked allocations to slot. Returns the slot to hand back to
+  whoop_mem_request_end on the same task. Other tasks keep charging to their own slots.*/
+whoop_mem_slot_n whoop_mem_request_begin(whoop_mem_slot_n slot);
+void whoop_mem_request_end(whoop_mem_slot_n previous_slot);
+
+void *whoop_mem_malloc(size_t size);
+void *whoop_mem_realloc(void *ptr, size_t size);
+void whoop_mem_free(void *ptr);
+
+int whoop_mem_get_stats(whoop_mem_slot_n slot, whoop_mem_stats_t *stats_out);
+size_t whoop_mem_get_min_free_heap(void);
+const char *whoop_mem_slot_name(whoop_mem_slot_n slot);
+
+#endif //_WHOOP_MEM_H_
\ No newline at end of file
@@ -0,0 +1,18 @@
+#ifndef _WHOOP_RATELIMIT_H_
+#define _WHOOP_RATELIMIT_H_
+#include <stdint.h>
+
+typedef struct whoop_ratelimit_stats
+{
+    uint32_t allowed;
+    uint32_t throttled;         /*Requests answered 429*/
+    uint32_t evicted;           /*Least recently seen clients dropped to make room for a new one*/
+    uint32_t clients;           /*Clients currently tracked*/
+} whoop_ratelimit_stats_t;
+
+/*Takes a token from the client's bucket, 0 when the request may go ahead. Otherwise retry_after_s is the
+  wait until the next token. Clients are keyed by IPv4 address. Only called from the httpd task*/
+int whoop_ratelimit_take(uint32_t client_addr, int *retry_after_s);
+void whoop_ratelimit_get_stats(whoop_ratelimit_stats_t *stats_out);
+
+#endif //_WHOOP_RATELIMIT_H_
\ No newline at end of file
@@ -18,18 +18,23 @@
 #include "esp_netif.h"
 #include "esp_event.h"
 #include "esp_wifi.h"
+#include "esp_timer.h"
+#include "nvs_flash.h"
 #include "mdns.h"
 
 #include "whoop_data.h"
 #include "whoop_client.h"
 #include "gpio_manager.h"
-#include "i2c_led.h"
 #include "whoop_esp_server.h"
+#include "whoop_mem.h"
+#include "whoop_display.h"
+#include "whoop_events.h"
 
 //Timer information
 TimerHandle_t task_timer_handle;
 TimerHandle_t task_timer_update_data_handle;
 static int g_last_button_state = 0;
+static unsigned int g_posted_data_generation = 0;
 
 #define MDNS_HOSTNAME "esp8266-whoop-api"
 
@@ -69,6 +74,7 @@ static void on_wifi_disconnect(void *arg, esp_event_base_t event_base,
     system_event_sta_disconnected_t *event = (system_event_sta_disconnected_t *)event_data;
 
     ESP_LOGI(TAG, "Wi-Fi disconnected, trying to reconnect...");
+    whoop_client_set_network_ready(0);
     if (event->reason == WIFI_REASON_BASIC_RATE_NOT_SUPPORT) {
         /*Switch to 802.11 bgn mode */
         esp_wifi_set_protocol(ESP_IF_WIFI_STA, WIFI_PROTOCOL_11B | WIFI_PROTOCOL_11G | WIFI_PROTOCOL_11N);
@@ -83,6 +89,9 @@ static void on_got_ip(void *arg, esp_event_base_t event_base,
     ip_event_got_ip_t *event = (ip_event_got_ip_t *)event_data;
     memcpy(&s_ip_addr, &event->ip_info.ip, sizeof(s_ip_addr));
     xEventGroupSetBits(s_connect_event_group, GOT_IPV4_BIT);
+    ESP_LOGI(TAG, "Connected to %s after %d ms", s_connection_name, (int) (esp_timer_get_time() / 1000));
+    ESP_LOGI(TAG, "IPv4 address: " IPSTR, IP2STR(&s_ip_addr));
+    whoop_client_set_network_ready(1);
 }
 
 
@@ -109,6 +118,7 @@ static void start(void)
     ESP_ERROR_CHECK(esp_wifi_connect());
 }
 
+/*Starts association and returns straight away, on_got_ip lets the client know when the network is up*/
 esp_err_t connect_to_wifi(void)
 {
     if (s_connect_event_group != NULL) {
@@ -117,205 +127,61 @@ esp_err_t connect_to_wifi(void)
 
     s_connect_event_group = xEventGroupCreate();
     start();
-    xEventGroupWaitBits(s_connect_event_group, GOT_IPV4_BIT, true, true, portMAX_DELAY);
-    ESP_LOGI(TAG, "Connected to %s", s_connection_name);
-    ESP_LOGI(TAG, "IPv4 address: " IPSTR, IP2STR(&s_ip_addr));
     return ESP_OK;
 }
 
-static void recovery_to_led(float recovery_score)
-{
-    int r = 0;
-    int g = 0;
-    int b = 0;
-    if(recovery_score > 67.0)
-    {
-        g = 255;
-    }
-    else if (recovery_score > 34.0)
-    {
-        r = 255;
-        g = 255;
-    }
-    else
-    {
-        r = 255;
-    }
-    set_rgb_led_value(r, g, b);
-}
-
-static void strain_to_led(float strain)
-{
-    int r = 0;
-    int g = 0;
-    int b = 0;
-    if(strain < 10.0)
-    {
-        g = 255;
-    }
-    else if (strain < 14.0)
-    {
-        r = 255;
-        g = 255;
-    }
-    else if (strain < 19.0)
-    {
-        r = 255;
-        g = 127;
-    }
-    else
-    {
-        r = 255;
-    }
-    set_rgb_led_value(r, g, b);
-}
-
-static void sleep_percentage_to_led(float sleep_percentage)
-{
-    int r = 0;
-    int g = 0;
-    int b = 0;
-    if(sleep_percentage > 90.0)
-    {
-        g = 255;
-    }
-    else if (sleep_percentage > 70.0)
-    {
-        r = 255;
-        g = 255;
-    }
-    else
-    {
-        r = 255;
-    }
-    set_rgb_led_value(r, g, b);
-}
-
-typedef enum current_data_selection
-{
-    DATA_SELECTION_RECOVERY,
-    DATA_SELECTION_SLEEP,
-    DATA_SELECTION_CYCLE,
-    DATA_SELECTION_WORKOUT
-} current_data_selection_t;
-
-static int g_update_data = 1;
-current_data_selection_t g_data_selection = DATA_SELECTION_WORKOUT;
-char *data_selection_text[] = {"Selected recovery", "Selected Sleep", "Selected Cycle", "Selected Workout"};
+/*Runs on the timer service task, so it only reads the button and the data generation and posts to the display
+  task. A command that does not fit in the queue is posted again on the next tick*/
  void vTimerCallback( TimerHandle_t xTimer )
  {
     int button_state = 0;
-    float data_float = 0.0;
-    char data_str[17];
-    whoop_data_handle_t handle = NULL;
+    unsigned int data_generation = get_whoop_data_generation();
     get_touch_button_state(&button_state);
-    int data_selection = g_data_selection;
-    if(button_state != g_last_button_state || g_update_data)
-    {
-        i2c_lcd_1602_clear();
-        i2c_lcd_1602_home();
+    if(button_state != g_last_button_state && whoop_display_next_page() == 0)
         g_last_button_state = button_state;
-        g_update_data = 0;
-        for(int i =1; i <= 4; i++)
-        {
-            data_selection = (g_data_selection + i) % 4;
-            switch(data_selection)
-            {
-                case DATA_SELECTION_RECOVERY:
-                    get_whoop_recovery_handle_by_id(0, &handle);
-                    break;
-                case DATA_SELECTION_SLEEP:
-                    get_whoop_sleep_handle_by_id(0, &handle);
-                    break;
-                case DATA_SELECTION_CYCLE:
-                    get_whoop_cycle_handle_by_id(0, &handle);
-                    break;
-                case DATA_SELECTION_WORKOUT:
-                    get_whoop_workout_handle_by_id(0, &handle);
-                    break;
-            }
-            if(handle) break;
-        }
-        g_data_selection = data_selection;
-        ESP_LOGI(TAG, data_selection_text[g_data_selection]);
-        
-        if(!handle)
-        {
-            i2c_lcd_1602_print("No Data!", 8);
-            set_rgb_led_value(255, 0, 0);
-            return;
-        }
-        switch(data_selection)
-        {
-            case DATA_SELECTION_RECOVERY:
-                get_whoop_data(handle, WHOOP_DATA_OPT_RECOVERY_RECOVERY_SCORE, &data_float);
-                recovery_to_led(data_float);
-                i2c_lcd_1602_print("Recovery", strlen("Recovery"));
-                i2c_lcd_1602_setCursor(0,1);
-                sprintf(data_str, "Score: %0.2f",data_float);
-                i2c_lcd_1602_print(data_str, strlen(data_str));
-                break;
-            case DATA_SELECTION_SLEEP:
-                get_whoop_data(handle, WHOOP_DATA_OPT_SLEEP_SLEEP_PERFORMANCE_PERCENTAGE, &data_float);
-                sleep_percentage_to_led(data_float);
-                i2c_lcd_1602_print("Sleep", strlen("Sleep"));
-                i2c_lcd_1602_setCursor(0,1);
-                sprintf(data_str, "Perf: %0.2f%%",data_float);
-                i2c_lcd_1602_print(data_str, strlen(data_str));
-                break;
-            case DATA_SELECTION_CYCLE:
-                get_whoop_data(handle, WHOOP_DATA_OPT_CYCLE_STRAIN, &data_float);
-                strain_to_led(data_float);
-                i2c_lcd_1602_print("Cycle", strlen("Cycle"));
-                i2c_lcd_1602_setCursor(0,1);
-                sprintf(data_str, "Strain: %0.2f",data_float);
-                i2c_lcd_1602_print(data_str, strlen(data_str));
-                break;
-            case DATA_SELECTION_WORKOUT:
-                get_whoop_data(handle, WHOOP_DATA_OPT_WORKOUT_STRAIN, &data_float);
-                strain_to_led(data_float);
-                i2c_lcd_1602_print("Workout", strlen("Workout"));
-                i2c_lcd_1602_setCursor(0,1);
-                sprintf(data_str, "Strain: %0.2f",data_float);
-                i2c_lcd_1602_print(data_str, strlen(data_str));
-                break;
-        }
-    }
+    if(data_generation != g_posted_data_generation && whoop_display_refresh() == 0)
+        g_posted_data_generation = data_generation;
  }
 
  void vTimerCallbackUpdateData( TimerHandle_t xTimer )
  {
-    whoop_get_data(WHOOP_API_REQUEST_TYPE_SLEEP);
-    whoop_get_data(WHOOP_API_REQUEST_TYPE_WORKOUT);
-    whoop_get_data(WHOOP_API_REQUEST_TYPE_RECOVERY);
-    whoop_get_data(WHOOP_API_REQUEST_TYPE_CYCLE);
-    g_update_data = 1;
+    // Runs on the fetch task, webhook fetches share the same connection
+    whoop_queue_poll();
  }
 
 void app_main()
 {
-    //ESP_ERROR_CHECK(nvs_flash_init());
+    esp_err_t err = nvs_flash_init();
+    if (err == ESP_ERR_NVS_NO_FREE_PAGES) {
+        ESP_ERROR_CHECK(nvs_flash_erase());
+        err = nvs_flash_init();
+    }
+    ESP_ERROR_CHECK(err);
+    init_whoop_mem();
+    init_whoop_data();
+    restore_whoop_data();
+    init_whoop_events();
+
     ESP_ERROR_CHECK(esp_netif_init());
-    
     ESP_ERROR_CHECK(esp_event_loop_create_default());
-    initialise_mdns();
-
+    // Client first so it is listening for the network before association can finish, token refreshes are queued
+    init_whoop_tls_client();
     ESP_ERROR_CHECK(connect_to_wifi());
-    init_whoop_data();
-    
-    
+
+    // Peripherals come up while Wi-Fi associates, the cached records are on screen before the first fetch
     initialize_gpio();
     get_touch_button_state(&g_last_button_state);
-
-    i2c_lcd_1602_init();
-    
-    init_whoop_server();
-    init_whoop_tls_client();
+    g_posted_data_generation = get_whoop_data_generation();
+    ESP_ERROR_CHECK(init_whoop_display());
 
     //Start task loop
     task_timer_handle = xTimerCreate("Timer", pdMS_TO_TICKS(100) , pdTRUE,( void * ) 0,vTimerCallback);
     xTimerStart( task_timer_handle, 0 );
-    task_timer_update_data_handle = xTimerCreate("Update Data", pdMS_TO_TICKS(300000) , pdTRUE,( void * ) 0,vTimerCallbackUpdateData);
+
+    initialise_mdns();
+    init_whoop_server();
+
+    task_timer_update_data_handle = xTimerCreate("Update Data", pdMS_TO_TICKS(WHOOP_POLL_INTERVAL_MS) , pdTRUE,( void * ) 0,vTimerCallbackUpdateData);
     vTimerCallbackUpdateData(task_timer_update_data_handle);
     xTimerStart( task_timer_update_data_handle, 0 );
 }
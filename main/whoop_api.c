@@ -0,0 +1,281 @@
+#include <string.h>
+#include <stdio.h>
+#include <sys/param.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+
+#include "whoop_api.h"
+#include "whoop_mem.h"
+
+// Defines
+#define WHOOP_API_INITIAL_BODY_LEN 512
+#define WHOOP_API_HISTORY_MAX_LIMIT 100
+
+// Types
+typedef struct whoop_api_body
+{
+    char *text;
+    size_t len;
+    size_t capacity;
+    unsigned int version;       /*Resource version the text was serialized from*/
+    int valid;
+    char etag[WHOOP_API_ETAG_LEN];
+} whoop_api_body_t;
+
+// Local Global Variables
+static const char *TAG = "WHOOP API";
+static const char *g_resource_names[WHOOP_API_RESOURCE_MAX] = {"sleep", "workout", "recovery", "cycle", "latest"};
+static const char *g_score_state_names[] = {"SCORED", "PENDING_SCORE", "UNSCORABLE"};
+static whoop_api_body_t g_bodies[WHOOP_ACCOUNT_COUNT][WHOOP_API_RESOURCE_MAX];
+static whoop_api_stats_t g_stats;
+// Identifies a record of each type in history ranges, recoveries go by their cycle
+static const whoop_data_opt_n g_id_opts[WHOOP_DATA_TYPE_MAX] = {
+    WHOOP_DATA_OPT_SLEEP_ID, WHOOP_DATA_OPT_WORKOUT_ID, WHOOP_DATA_OPT_RECOVERY_CYCLE_ID, WHOOP_DATA_OPT_CYCLE_ID
+};
+static uint32_t g_boot_id = 0;
+
+// Local functions
+/*Encoder flush into the body cache, grown once for the first bodies and after that the buffer already fits*/
+static int append_body(void *ctx, const uint8_t *data, size_t len)
+{
+    whoop_api_body_t *body = ctx;
+    if(body->len + len > body->capacity)
+    {
+        size_t capacity = MAX(body->capacity * 2, body->len + len);
+        char *text = whoop_mem_realloc(body->text, capacity);
+        if(!text)
+            return -1;
+        body->text = text;
+        body->capacity = capacity;
+    }
+    memcpy(body->text + body->len, data, len);
+    body->len += len;
+    return 0;
+}
+
+/*Fields of a record into the map already opened for it. Unscored records only carry their IDs and score state*/
+static void encode_fields(whoop_encoder_t *encoder, whoop_data_handle_t handle, whoop_data_type_n type)
+{
+    int field_count = 0;
+    const whoop_data_field_t *fields = get_whoop_data_fields(type, &field_count);
+    int score_state = WHOOP_SCORE_STATE_UNSCORABLE;
+    int int_value;
+    float float_value;
+
+    for(int index = 0; index < field_count; index++)
+    {
+        const whoop_data_field_t *field = &fields[index];
+        if(!(field->flags & (WHOOP_DATA_FIELD_ID | WHOOP_DATA_FIELD_SCORE_STATE)) && score_state != WHOOP_SCORE_STATE_SCORED)
+            continue;
+        whoop_encode_key(encoder, field->name);
+        if(field->opt & 0x0100)
+        {
+            get_whoop_data(handle, field->opt, &float_value);
+            whoop_encode_float(encoder, float_value);
+            continue;
+        }
+        get_whoop_data(handle, field->opt, &int_value);
+        if(field->flags & WHOOP_DATA_FIELD_SCORE_STATE)
+        {
+            score_state = int_value;
+            whoop_encode_string(encoder, g_score_state_names[MIN((unsigned int) int_value, WHOOP_SCORE_STATE_UNSCORABLE)]);
+        }
+        else if(field->flags & WHOOP_DATA_FIELD_BOOL)
+        {
+            whoop_encode_bool(encoder, int_value);
+        }
+        else
+        {
+            whoop_encode_int(encoder, int_value);
+        }
+    }
+}
+
+/*Most recent record as "type":{...}, or "type":null before the first fetch*/
+static void encode_latest_record(whoop_encoder_t *encoder, int account, whoop_data_type_n type)
+{
+    whoop_data_handle_t handle = NULL;
+    whoop_encode_key(encoder, get_whoop_data_type_name(type));
+    if(get_whoop_data_latest_handle(account, type, &handle))
+    {
+        whoop_encode_null(encoder);
+        return;
+    }
+    whoop_encode_map_begin(encoder);
+    whoop_encode_key(encoder, "stale");
+    whoop_encode_bool(encoder, is_whoop_data_stale(account, type));
+    encode_fields(encoder, handle, type);
+    whoop_encode_end(encoder);
+}
+
+static int serialize_resource(whoop_api_body_t *body, int account, whoop_api_resource_n resource)
+{
+    whoop_encoder_t encoder;
+    whoop_encode_begin(&encoder, WHOOP_ENCODE_FORMAT_JSON, append_body, body);
+    whoop_encode_map_begin(&encoder);
+    whoop_encode_key(&encoder, "user");
+    whoop_encode_int(&encoder, account);
+    if(resource == WHOOP_API_RESOURCE_LATEST)
+    {
+        for(int type = 0; type < WHOOP_DATA_TYPE_MAX; type++)
+            encode_latest_record(&encoder, account, type);
+    }
+    else
+    {
+        encode_latest_record(&encoder, account, (whoop_data_type_n) resource);
+    }
+    whoop_encode_end(&encoder);
+    return whoop_encode_finish(&encoder);
+}
+
+static int in_history_range(const whoop_api_history_query_t *query, whoop_data_handle_t handle)
+{
+    int id = 0;
+    get_whoop_data(handle, g_id_opts[query->type], &id);
+    return (!query->from_id || id >= query->from_id) && (!query->to_id || id <= query->to_id);
+}
+
+/*Latest changes with any of the types it is made of, the sum moves whenever one of them does*/
+static unsigned int get_resource_version(whoop_api_resource_n resource)
+{
+    unsigned int version = 0;
+    if(resource != WHOOP_API_RESOURCE_LATEST)
+        return get_whoop_data_version((whoop_data_type_n) resource);
+    for(int type = 0; type < WHOOP_DATA_TYPE_MAX; type++)
+        version += get_whoop_data_version(type);
+    return version;
+}
+
+/*Versions restart at zero on boot, the boot ID keeps a tag cached by a browser before a reboot from matching*/
+static void format_etag(char *etag, size_t etag_len, int account, whoop_api_resource_n resource, unsigned int version)
+{
+    if(!g_boot_id)
+        g_boot_id = esp_random() | 1;
+    snprintf(etag, etag_len, "\"%08x-%d-%s-%u\"", g_boot_id, account, g_resource_names[resource], version);
+}
+
+/*If-None-Match holds a list of tags, possibly weak ones, or a lone asterisk*/
+int whoop_api_etag_list_matches(const char *if_none_match, const char *etag)
+{
+    size_t etag_len = strlen(etag);
+    const char *cursor = if_none_match;
+    while(*cursor)
+    {
+        while(*cursor == ' ' || *cursor == ',')
+            cursor++;
+        if(*cursor == '*')
+            return 1;
+        if(cursor[0] == 'W' && cursor[1] == '/')
+            cursor += 2;
+        if(!strncmp(cursor, etag, etag_len) && (cursor[etag_len] == '\0' || cursor[etag_len] == ',' || cursor[etag_len] == ' '))
+            return 1;
+        while(*cursor && *cursor != ',')
+            cursor++;
+    }
+    return 0;
+}
+
+// Global Functions
+int whoop_api_not_modified(int account, whoop_api_resource_n resource, const char *if_none_match, char *etag, size_t etag_len)
+{
+    if(account < 0 || account >= WHOOP_ACCOUNT_COUNT || resource < 0 || resource >= WHOOP_API_RESOURCE_MAX)
+        return 0;
+    format_etag(etag, etag_len, account, resource, get_resource_version(resource));
+    if(!if_none_match || !whoop_api_etag_list_matches(if_none_match, etag))
+        return 0;
+    g_stats.not_modified++;
+    return 1;
+}
+
+int whoop_api_get_body(int account, whoop_api_resource_n resource, const char **body_text, size_t *body_len, const char **etag)
+{
+    if(account < 0 || account >= WHOOP_ACCOUNT_COUNT || resource < 0 || resource >= WHOOP_API_RESOURCE_MAX)
+        return WHOOP_DATA_STATUS_INVALID_OPTION;
+
+    whoop_api_body_t *body = &g_bodies[account][resource];
+    // Read before serializing, a change made meanwhile rebuilds the body on the next request
+    unsigned int version = get_resource_version(resource);
+    if(!body->valid || body->version != version)
+    {
+        int64_t start_us = esp_timer_get_time();
+        whoop_mem_slot_n previous_mem_slot = whoop_mem_request_begin(WHOOP_MEM_SLOT_SERVER);
+        if(!body->text && (body->text = whoop_mem_malloc(WHOOP_API_INITIAL_BODY_LEN)))
+            body->capacity = WHOOP_API_INITIAL_BODY_LEN;
+        body->len = 0;
+        body->valid = !serialize_resource(body, account, resource);
+        whoop_mem_request_end(previous_mem_slot);
+        if(!body->valid)
+        {
+            ESP_LOGI(TAG, "Could not serialize %s for account %d", g_resource_names[resource], account);
+            return WHOOP_DATA_STATUS_NO_RECORDINGS;
+        }
+        body->version = version;
+        format_etag(body->etag, sizeof(body->etag), account, resource, version);
+        g_stats.builds++;
+        g_stats.build_us += esp_timer_get_time() - start_us;
+    }
+    else
+    {
+        g_stats.hits++;
+    }
+    *body_text = body->text;
+    *body_len = body->len;
+    *etag = body->etag;
+    return WHOOP_DATA_STATUS_OK;
+}
+
+int whoop_api_write_history(whoop_encoder_t *encoder, const whoop_api_history_query_t *query)
+{
+    whoop_data_iter_t iter;
+    whoop_data_handle_t handle = NULL;
+    unsigned int next_cursor = 0;
+    int limit = (query->limit > 0) ? MIN(query->limit, WHOOP_API_HISTORY_MAX_LIMIT) : WHOOP_API_HISTORY_MAX_LIMIT;
+    int status = begin_whoop_data_iter(query->account, query->type, query->cursor, &iter);
+    if(status)
+        return status;
+
+    whoop_encode_map_begin(encoder);
+    whoop_encode_key(encoder, "user");
+    whoop_encode_int(encoder, query->account);
+    whoop_encode_key(encoder, "type");
+    whoop_encode_string(encoder, get_whoop_data_type_name(query->type));
+    whoop_encode_key(encoder, "records");
+    whoop_encode_array_begin(encoder);
+    while(limit && !next_whoop_data_iter(&iter, &handle))
+    {
+        if(!in_history_range(query, handle))
+            continue;
+        whoop_encode_map_begin(encoder);
+        encode_fields(encoder, handle, query->type);
+        whoop_encode_end(encoder);
+        limit--;
+    }
+    whoop_encode_end(encoder);
+    // Looks ahead so the last page says so instead of pointing at an empty one
+    for(unsigned int cursor = iter.cursor; !next_whoop_data_iter(&iter, &handle); cursor = iter.cursor)
+    {
+        if(in_history_range(query, handle))
+        {
+            next_cursor = cursor;
+            break;
+        }
+    }
+    whoop_encode_key(encoder, "next");
+    if(next_cursor)
+        whoop_encode_uint(encoder, next_cursor);
+    else
+        whoop_encode_null(encoder);
+    whoop_encode_end(encoder);
+    return WHOOP_DATA_STATUS_OK;
+}
+
+void whoop_api_get_stats(whoop_api_stats_t *stats_out)
+{
+    *stats_out = g_stats;
+}
+
+const char *whoop_api_resource_name(whoop_api_resource_n resource)
+{
+    return (resource >= 0 && resource < WHOOP_API_RESOURCE_MAX) ? g_resource_names[resource] : "unknown";
+}
\ No newline at end of file
@@ -8,22 +8,31 @@
 */
 
 #include <string.h>
+#include <strings.h>
 #include <stdlib.h>
+#include <sys/param.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
 #include "esp_log.h"
 #include "esp_system.h"
 #include "nvs.h"
-#include "nvs_flash.h"
 #include "esp_event.h"
 #include "esp_netif.h"
 #include "esp_tls.h"
+#include "esp_timer.h"
 
 #include "cJSON.h"
 #include "whoop_client.h"
 
 #include "esp_http_client.h"
 #include "whoop_data.h"
+#include "whoop_mem.h"
+#include "whoop_latency.h"
+#include "whoop_inflate.h"
+#include "whoop_events.h"
 
 #define MAX_HTTP_RECV_BUFFER 512
 #define MAX_HTTP_OUTPUT_BUFFER 2048
@@ -32,10 +41,27 @@
 #define CLIENT_ID CONFIG_CLIENT_ID
 #define CLIENT_SECRET CONFIG_CLIENT_SECRET
 
+#define STRLEN_CONST(str) (sizeof(str) - 1)
+#define WHOOP_TOKEN_BUFFER_LEN 128
+#define WHOOP_PENDING_TOKEN_LEN 256     /*Longest code or token taken from the web server, fits post_data*/
+#define AUTHORIZATION_PREFIX "Bearer "
+#define REFRESH_POST_DATA_PREFIX "grant_type=refresh_token&client_id=" CLIENT_ID "&client_secret=" CLIENT_SECRET "&refresh_token="
+#define WHOOP_BUDGET_WINDOW_US (300LL * 1000 * 1000)
+#define WHOOP_FETCH_QUEUE_LEN 8
+#define WHOOP_FETCH_TASK_STACK_SIZE 8192
+#define WHOOP_FETCH_POLL_ACCOUNTS -1
+#define WHOOP_JOB_COUNT 8             /*Finished jobs stay readable until this many newer ones were queued*/
+#define WHOOP_GZIP_SIZE_HINT_RATIO 4    /*Whoop JSON typically inflates 4-6x*/
+#define WHOOP_NETWORK_READY_BIT BIT(0)
+#define WHOOP_FRESHNESS_WINDOW_US (CONFIG_WHOOP_FRESHNESS_WINDOW_SECONDS * 1000LL * 1000)
+#ifdef CONFIG_WHOOP_WEBHOOK_ENABLE
+#define WHOOP_SAFETY_POLL_US (CONFIG_WHOOP_WEBHOOK_SAFETY_POLL_MINUTES * 60LL * 1000 * 1000)
+#endif
+#define AUTH_CODE_POST_DATA_PREFIX "grant_type=authorization_code&client_id=" CLIENT_ID "&client_secret=" CLIENT_SECRET "&scope=offline&redirect_uri=http://localhost:3100&code="
+
 static const char *TAG = "WHOOP CLIENT";
 extern const char whoop_we1_pem_start[] asm("_binary_whoop_we1_pem_start");
 extern const char whoop_we1_pem_end[]   asm("_binary_whoop_we1_pem_end");
-nvs_handle_t g_nvs_handle;
 
 typedef enum whoop_event_type
 {
@@ -46,18 +72,107 @@ typedef enum whoop_event_type
     WHOOP_EVENT_TYPE_ACCESS_TOKEN
 } whoop_event_type_n;
 
-size_t g_refresh_token_buffer_len = 128;
+typedef struct whoop_request_timing
+{
+    int64_t start_us;
+    int64_t connected_us;
+    int64_t header_sent_us;
+    int64_t first_header_us;
+    int64_t finish_us;
+} whoop_request_timing_t;
+
+// State of the one TLS connection shared by every account
 typedef struct whoop_rest_client
 {
+    whoop_request_timing_t timing;
     char *server_response;
-    char access_token[128];
-    int expires_in;
-    char refresh_token[128];
+    int authorization_account;      /*Account whose Authorization header is set on the client, -1 for none*/
+    // Per response, gzip bodies are inflated as they arrive
+    whoop_inflate_handle_t inflate;
+    int gzip;
+    int inflate_status;
+    size_t wire_bytes;
+    size_t body_bytes;
 } whoop_rest_client_t;
 
-whoop_rest_client_t g_whoop_rest_client = {0};
+typedef struct whoop_account
+{
+    nvs_handle_t nvs_handle;
+    char access_token[WHOOP_TOKEN_BUFFER_LEN];
+    int expires_in;
+    char refresh_token[WHOOP_TOKEN_BUFFER_LEN];
+    // Derived from the tokens, rebuilt only when they change
+    char authorization_header[STRLEN_CONST(AUTHORIZATION_PREFIX) + WHOOP_TOKEN_BUFFER_LEN];
+    char refresh_post_data[STRLEN_CONST(REFRESH_POST_DATA_PREFIX) + WHOOP_TOKEN_BUFFER_LEN];
+    int refresh_post_data_len;
+    // Upstream request budget
+    int64_t budget_window_start_us;
+    int budget_used;
+    int user_id;                    /*Whoop user_id seen in this account's records, 0 until the first record*/
+    // Handed over by the web server for the fetch task to exchange, empty when nothing is waiting
+    char pending_token[WHOOP_PENDING_TOKEN_LEN];
+    int pending_token_type;
+} whoop_account_t;
+
+// Outcome of the latest record fetch for one account and type, for the freshness window
+typedef struct whoop_fetch_result
+{
+    int status;
+    int64_t completed_us;
+} whoop_fetch_result_t;
+
+// Work item for the fetch task, account is WHOOP_FETCH_POLL_ACCOUNTS for a full poll
+typedef struct whoop_fetch_request
+{
+    int account;
+    whoop_api_request_type_n request_type;
+    int id;
+    uint32_t job_id;                /*0 when nobody follows the request*/
+} whoop_fetch_request_t;
+
+typedef struct whoop_request_template
+{
+    esp_http_client_method_t method;
+    const char *path;
+} whoop_request_template_t;
+
+static const whoop_request_template_t g_data_request_templates[WHOOP_API_REQUEST_TYPE_TOKEN] = {
+    [WHOOP_API_REQUEST_TYPE_SLEEP] =    { HTTP_METHOD_GET, "/developer/v1/activity/sleep?limit=1" },
+    [WHOOP_API_REQUEST_TYPE_WORKOUT] =  { HTTP_METHOD_GET, "/developer/v1/activity/workout?limit=1" },
+    [WHOOP_API_REQUEST_TYPE_RECOVERY] = { HTTP_METHOD_GET, "/developer/v1/recovery?limit=1" },
+    [WHOOP_API_REQUEST_TYPE_CYCLE] =    { HTTP_METHOD_GET, "/developer/v1/cycle?limit=1" }
+};
+/*Single record paths used for webhook fetches. Recovery webhooks carry the sleep ID, which the API cannot
+  look a recovery up by, so recovery falls back to the latest record*/
+static const char *g_data_by_id_paths[WHOOP_API_REQUEST_TYPE_TOKEN] = {
+    [WHOOP_API_REQUEST_TYPE_SLEEP] =    "/developer/v1/activity/sleep/%d",
+    [WHOOP_API_REQUEST_TYPE_WORKOUT] =  "/developer/v1/activity/workout/%d",
+    [WHOOP_API_REQUEST_TYPE_RECOVERY] = NULL,
+    [WHOOP_API_REQUEST_TYPE_CYCLE] =    "/developer/v1/cycle/%d"
+};
+static const whoop_request_template_t g_token_request_template = { HTTP_METHOD_POST, "/oauth/oauth2/token" };
+
+whoop_rest_client_t g_whoop_rest_client = { .authorization_account = -1 };
+whoop_account_t g_whoop_accounts[WHOOP_ACCOUNT_COUNT];
+static int g_poll_first_account = 0;
+static int64_t g_poll_queued_us = 0;
+static QueueHandle_t g_fetch_queue = NULL;
+static SemaphoreHandle_t g_client_mutex = NULL;    /*Recursive, a 401 refreshes the token from inside a data request*/
+static EventGroupHandle_t g_client_event_group = NULL;
+static whoop_fetch_result_t g_fetch_results[WHOOP_ACCOUNT_COUNT][WHOOP_API_REQUEST_TYPE_TOKEN]; /*Fetch task only*/
+static whoop_transfer_stats_t g_transfer_stats[WHOOP_API_REQUEST_TYPE_MAX];
+static whoop_job_t g_jobs[WHOOP_JOB_COUNT];
+static uint32_t g_next_job_id = 1;
+static const char *g_job_state_names[] = {"queued", "running", "done", "failed"};
+static int g_network_lost = 0;        /*Set when a ready network goes away, cleared when it comes back*/
+static uint32_t g_reconnect_count = 0;
+#ifdef CONFIG_WHOOP_WEBHOOK_ENABLE
+static int64_t g_last_webhook_us = 0;
+static int64_t g_last_poll_us = 0;
+static int64_t g_unix_offset_ms = 0;  /*Unix time minus esp_timer time, 0 until a Date header was seen*/
+#endif
 esp_http_client_handle_t client;
-char post_data[1024];
+char post_data[STRLEN_CONST(AUTH_CODE_POST_DATA_PREFIX) + 256];
 
 #define GET_REQUIRED_JSON_OBJ( parent_obj, obj_assign_to, obj_name ) do { if( !( (obj_assign_to) = cJSON_GetObjectItem( (parent_obj), (obj_name) ) ) ) { \
                                             ESP_LOGI(TAG, "Could not find required JSON obj: %s", (obj_name) ); status = -1; goto Error; } } while(0);
@@ -91,6 +206,143 @@ char post_data[1024];
 
 
 //Local functions
+static int build_post_data(char *buffer, size_t buffer_len, const char *prefix, size_t prefix_len, const char *value)
+{
+    size_t value_len = strlen(value);
+    if(prefix_len + value_len + 1 > buffer_len)
+    {
+        return -1;
+    }
+    memcpy(buffer, prefix, prefix_len);
+    memcpy(buffer + prefix_len, value, value_len + 1);
+    return prefix_len + value_len;
+}
+
+/*Rebuilds the Authorization header and refresh POST body, only needed when the tokens change*/
+static void update_request_templates(int account)
+{
+    whoop_account_t *whoop_account = &g_whoop_accounts[account];
+    size_t token_len = strnlen(whoop_account->access_token, WHOOP_TOKEN_BUFFER_LEN - 1);
+    memcpy(whoop_account->authorization_header, AUTHORIZATION_PREFIX, STRLEN_CONST(AUTHORIZATION_PREFIX));
+    memcpy(whoop_account->authorization_header + STRLEN_CONST(AUTHORIZATION_PREFIX), whoop_account->access_token, token_len);
+    whoop_account->authorization_header[STRLEN_CONST(AUTHORIZATION_PREFIX) + token_len] = '\0';
+    if(g_whoop_rest_client.authorization_account == account)
+    {
+        g_whoop_rest_client.authorization_account = -1;
+    }
+
+    whoop_account->refresh_post_data_len = build_post_data(whoop_account->refresh_post_data, sizeof(whoop_account->refresh_post_data),
+                                                    REFRESH_POST_DATA_PREFIX, STRLEN_CONST(REFRESH_POST_DATA_PREFIX), whoop_account->refresh_token);
+}
+
+#ifdef CONFIG_WHOOP_WEBHOOK_ENABLE
+/*RFC 7231 IMF-fixdate, "Sun, 06 Nov 1994 08:49:37 GMT". Returns seconds since the epoch, -1 if malformed*/
+static int64_t parse_http_date(const char *date)
+{
+    static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    char month_name[4];
+    const char *month_found;
+    int day, month, year, hour, minute, second, era, year_of_era, day_of_year, day_of_era;
+    if(sscanf(date, "%*3s, %2d %3s %4d %2d:%2d:%2d", &day, month_name, &year, &hour, &minute, &second) != 6) return -1;
+    if(!(month_found = strstr(months, month_name)) || (month_found - months) % 3 || year < 1970) return -1;
+    month = (month_found - months) / 3 + 1;
+
+    // Days from 1970-01-01 in the proleptic Gregorian calendar, years counted from March so leap days come last
+    year -= month <= 2;
+    era = year / 400;
+    year_of_era = year - era * 400;
+    day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    return ((((int64_t) era * 146097 + day_of_era - 719468) * 24 + hour) * 60 + minute) * 60 + second;
+}
+
+/*Whoop's responses arrive over TLS, so their Date header is a clock webhook timestamps can be checked against*/
+static void set_unix_time(const char *date)
+{
+    int64_t unix_s = parse_http_date(date);
+    if(unix_s < 0) return;
+    int64_t offset_ms = unix_s * 1000 - esp_timer_get_time() / 1000;
+    portENTER_CRITICAL();
+    g_unix_offset_ms = offset_ms;
+    portEXIT_CRITICAL();
+}
+#endif
+
+static void remove_authorization_header(void)
+{
+    if(g_whoop_rest_client.authorization_account < 0) return;
+    esp_http_client_delete_header(client, "Authorization");
+    g_whoop_rest_client.authorization_account = -1;
+}
+
+/*The header stays set on the client between data requests of the same account and is only swapped out for
+  token exchanges or when the scheduler moves to another account. An account without an access token must not
+  inherit the previous account's header*/
+static void install_authorization_header(int account)
+{
+    if(!g_whoop_accounts[account].access_token[0])
+    {
+        remove_authorization_header();
+        return;
+    }
+    if(g_whoop_rest_client.authorization_account == account) return;
+    esp_http_client_set_header(client, "Authorization", g_whoop_accounts[account].authorization_header);
+    g_whoop_rest_client.authorization_account = account;
+}
+
+/*Every upstream exchange counts against the account's budget for the current five minute window*/
+static int take_request_budget(int account)
+{
+    whoop_account_t *whoop_account = &g_whoop_accounts[account];
+    int64_t now_us = esp_timer_get_time();
+    if(!whoop_account->budget_window_start_us || now_us - whoop_account->budget_window_start_us >= WHOOP_BUDGET_WINDOW_US)
+    {
+        whoop_account->budget_window_start_us = now_us;
+        whoop_account->budget_used = 0;
+    }
+    if(whoop_account->budget_used >= CONFIG_WHOOP_ACCOUNT_REQUEST_BUDGET)
+    {
+        ESP_LOGI(TAG, "Account %d request budget exhausted.", account);
+        return -1;
+    }
+    whoop_account->budget_used++;
+    return 0;
+}
+
+static int is_account_authorized(int account)
+{
+    const char *refresh_token = g_whoop_accounts[account].refresh_token;
+    return refresh_token[0] && strcmp(refresh_token, "000");
+}
+
+/*Authorized and holding an access token, false while the first refresh has not succeeded*/
+static int is_account_ready(int account)
+{
+    return is_account_authorized(account) && g_whoop_accounts[account].access_token[0];
+}
+
+static void apply_request_template(const whoop_request_template_t *request_template, const char *post_field, int post_field_len)
+{
+    esp_http_client_set_url(client, request_template->path);
+    esp_http_client_set_method(client, request_template->method);
+    esp_http_client_set_post_field(client, post_field, post_field_len);
+}
+
+/*List responses wrap records in "records", single record fetches return the record itself. The record's user_id
+  is remembered so webhooks can be routed to the account*/
+static const cJSON *get_response_record(int account, const cJSON *json)
+{
+    const cJSON *records = cJSON_GetObjectItem(json, "records");
+    const cJSON *record = records ? cJSON_GetArrayItem(records, 0) : json;
+    const cJSON *user_id = cJSON_GetObjectItem(record, "user_id");
+    if(user_id && g_whoop_accounts[account].user_id != user_id->valueint)
+    {
+        g_whoop_accounts[account].user_id = user_id->valueint;
+        ESP_LOGI(TAG, "Account %d is Whoop user %d", account, user_id->valueint);
+    }
+    return record;
+}
+
 static whoop_score_state_n parse_string_to_score_state(const char *str)
 {
     if(!strncmp(str, "SCORED",7) )
@@ -107,24 +359,16 @@ static whoop_score_state_n parse_string_to_score_state(const char *str)
     }
 }
 
-static int parse_cycle_json_data(const char *json_data)
+static int parse_cycle_json_data(int account, const cJSON *json)
 {
     whoop_data_handle_t handle = NULL;
     whoop_score_state_n score_state_value = 0;
     char *score_state_str = NULL;
     int status = 0;
-    const cJSON *records = NULL;
     const cJSON *record = NULL;
     const cJSON *score = NULL;
     const cJSON *item = NULL;
-    cJSON *json = cJSON_Parse(json_data);
-    if(!json)
-    {
-        ESP_LOGI(TAG, "Could not parse JSON.");
-        return -1;
-    }
-    GET_REQUIRED_JSON_OBJ(json, records, "records");
-    record = cJSON_GetArrayItem(records, 0);
+    record = get_response_record(account, json);
 
     if( !( item = cJSON_GetObjectItem( record, "id" ) ) )
     {   
@@ -133,9 +377,9 @@ static int parse_cycle_json_data(const char *json_data)
     }
     else
     {
-        if( ( status = get_whoop_cycle_handle_by_id(item->valueint, &handle) ) ) 
+        if( ( status = get_whoop_cycle_handle_by_id(account, item->valueint, &handle) ) ) 
         {
-            if( ( status = create_whoop_cycle_data(item->valueint, &handle) ) ) 
+            if( ( status = create_whoop_cycle_data(account, item->valueint, &handle) ) ) 
             {
                 ESP_LOGI(TAG, "Could not create cycle.");
                 goto Error;
@@ -163,11 +407,10 @@ static int parse_cycle_json_data(const char *json_data)
     ASSIGN_REQUIRED_JSON_FLOAT(score, item, "kilojoule", handle, WHOOP_DATA_OPT_CYCLE_KILOJOULE);
 
 Error:
-    cJSON_Delete(json);
     return status;
 }
 
-static int parse_recovery_json_data(const char *json_data)
+static int parse_recovery_json_data(int account, const cJSON *json)
 {
     whoop_data_handle_t handle = NULL;
     whoop_score_state_n score_state_value = 0;
@@ -175,19 +418,11 @@ static int parse_recovery_json_data(const char *json_data)
     int status = 0;
     int sleep_id = 0;
     int cycle_id = 0;
-    const cJSON *records = NULL;
     const cJSON *record = NULL;
     const cJSON *score = NULL;
     const cJSON *item = NULL;
-    cJSON *json = cJSON_Parse(json_data);
-    if(!json)
-    {
-        ESP_LOGI(TAG, "Could not parse JSON.");
-        return -1;
-    }
 
-    GET_REQUIRED_JSON_OBJ(json, records, "records");
-    record = cJSON_GetArrayItem(records, 0);
+    record = get_response_record(account, json);
     if( !( item = cJSON_GetObjectItem( record, "sleep_id" ) ) )
     {
         ESP_LOGI(TAG, "Could not find required parameter: id");
@@ -201,9 +436,9 @@ static int parse_recovery_json_data(const char *json_data)
     }
     cycle_id = item->valueint; 
 
-    if( ( status = get_whoop_recovery_handle_by_id(sleep_id, &handle) ) ||  ( status = get_whoop_recovery_handle_by_id(cycle_id, &handle) ) ) 
+    if( ( status = get_whoop_recovery_handle_by_id(account, sleep_id, &handle) ) ||  ( status = get_whoop_recovery_handle_by_id(account, cycle_id, &handle) ) ) 
     {
-        if( ( status = create_whoop_recovery_data(sleep_id, cycle_id, &handle) ) ) 
+        if( ( status = create_whoop_recovery_data(account, sleep_id, cycle_id, &handle) ) ) 
         {
             ESP_LOGI(TAG, "Could not create recovery.");
             goto Error;
@@ -232,30 +467,21 @@ static int parse_recovery_json_data(const char *json_data)
     ASSIGN_OPTIONAL_JSON_FLOAT(score, item, "skin_temp_celsius", handle, WHOOP_DATA_OPT_RECOVERY_SKIN_TEMP_CELCIUS);
     
 Error:
-    cJSON_Delete(json);
     return status;
 }
 
-static int parse_sleep_json_data(const char *json_data)
+static int parse_sleep_json_data(int account, const cJSON *json)
 {
     whoop_data_handle_t handle = NULL;
     whoop_score_state_n score_state_value = 0;
     char *score_state_str = NULL;
     int status = 0;
-    const cJSON *records = NULL;
     const cJSON *record = NULL;
     const cJSON *score = NULL;
     const cJSON *item = NULL;
     const cJSON *sleep_needed = NULL;
     const cJSON *stage_summary = NULL;
-    cJSON *json = cJSON_Parse(json_data);
-    if(!json)
-    {
-        ESP_LOGI(TAG, "Could not parse JSON.");
-        return -1;
-    }
-    GET_REQUIRED_JSON_OBJ(json, records, "records");
-    record = cJSON_GetArrayItem(records, 0);
+    record = get_response_record(account, json);
 
     if( !( item = cJSON_GetObjectItem( record, "id" ) ) )
     {   
@@ -264,9 +490,9 @@ static int parse_sleep_json_data(const char *json_data)
     }
     else
     {
-        if( ( status = get_whoop_sleep_handle_by_id(item->valueint, &handle) ) ) 
+        if( ( status = get_whoop_sleep_handle_by_id(account, item->valueint, &handle) ) ) 
         {
-            if( ( status = create_whoop_sleep_data(item->valueint, &handle) ) ) 
+            if( ( status = create_whoop_sleep_data(account, item->valueint, &handle) ) ) 
             {
                 ESP_LOGI(TAG, "Could not create sleep.");
                 goto Error;
@@ -312,30 +538,21 @@ static int parse_sleep_json_data(const char *json_data)
     ASSIGN_REQUIRED_JSON_FLOAT(score, item, "sleep_efficiency_percentage", handle, WHOOP_DATA_OPT_SLEEP_SLEEP_EFFICIENCY_PERCENTAGE);
     
 Error:
-    cJSON_Delete(json);
     return status;
 }
 
-static int parse_workout_json_data(const char *json_data)
+static int parse_workout_json_data(int account, const cJSON *json)
 {
     whoop_data_handle_t handle = NULL;
     whoop_score_state_n score_state_value = 0;
     char *score_state_str = NULL;
     int status = 0;
-    const cJSON *records = NULL;
     const cJSON *record = NULL;
     const cJSON *score = NULL;
     const cJSON *zone_duration = NULL;
     const cJSON *item = NULL;
-    cJSON *json = cJSON_Parse(json_data);
-    if(!json)
-    {
-        ESP_LOGI(TAG, "Could not parse JSON.");
-        return -1;
-    }
 
-    GET_REQUIRED_JSON_OBJ(json, records, "records");
-    record = cJSON_GetArrayItem(records, 0);
+    record = get_response_record(account, json);
 
     if( !( item = cJSON_GetObjectItem( record, "id" ) ) )
     {   
@@ -344,9 +561,9 @@ static int parse_workout_json_data(const char *json_data)
     }
     else
     {
-        if( ( status = get_whoop_workout_handle_by_id(item->valueint, &handle) ) ) 
+        if( ( status = get_whoop_workout_handle_by_id(account, item->valueint, &handle) ) ) 
         {
-            if( ( status = create_whoop_workout_data(item->valueint, &handle) ) ) 
+            if( ( status = create_whoop_workout_data(account, item->valueint, &handle) ) ) 
             {
                 ESP_LOGI(TAG, "Could not create workout.");
                 goto Error;
@@ -387,30 +604,226 @@ static int parse_workout_json_data(const char *json_data)
     ASSIGN_REQUIRED_JSON_INT(zone_duration,item, "zone_four_milli", handle, WHOOP_DATA_OPT_WORKOUT_ZONE_DURATION_FOUR);
     ASSIGN_REQUIRED_JSON_INT(zone_duration,item, "zone_five_milli", handle, WHOOP_DATA_OPT_WORKOUT_ZONE_DURATION_FIVE);
 Error:
-    cJSON_Delete(json);
     return status;
 }
 
-static void parse_token_json_response(whoop_rest_client_t *whoop_rest_client)
+#ifdef CONFIG_WHOOP_DATA_LAZY
+#define WHOOP_JSON_MAX_FIELDS 24
+#define WHOOP_SCORE_STATE_TEXT_LEN 16
+
+typedef struct whoop_json_span
+{
+    const char *text;
+    int len;
+} whoop_json_span_t;
+
+// Hash of the last committed record text per account and type, an unchanged response is not committed again
+static uint32_t g_lazy_record_hashes[WHOOP_ACCOUNT_COUNT][WHOOP_API_REQUEST_TYPE_TOKEN];
+
+static const char *skip_json_string(const char *cursor)
 {
-    cJSON *json = cJSON_Parse(whoop_rest_client->server_response);
+    while(*cursor && *cursor != '"')
+    {
+        if(*cursor == '\\' && cursor[1]) cursor++;
+        cursor++;
+    }
+    return cursor;
+}
+
+static const char *skip_json_space(const char *cursor)
+{
+    while(*cursor == ' ' || *cursor == '\t' || *cursor == '\r' || *cursor == '\n') cursor++;
+    return cursor;
+}
+
+/*One pass over the response noting where the first scalar value of each stored field sits, and the user_id,
+  without converting anything. Objects and arrays are walked into, so nesting does not matter; strings are
+  spanned without quotes*/
+static void scan_json_fields(const char *json_text, const whoop_data_field_t *fields, int field_count, whoop_json_span_t *spans, whoop_json_span_t *user_id_span)
+{
+    const char *cursor = json_text;
+    memset(spans, 0, field_count * sizeof(*spans));
+    memset(user_id_span, 0, sizeof(*user_id_span));
+    while(*cursor)
+    {
+        if(*cursor++ != '"') continue;
+        const char *key = cursor;
+        cursor = skip_json_string(cursor);
+        if(!*cursor) break;
+        int key_len = cursor++ - key;
+        cursor = skip_json_space(cursor);
+        // A string in an array, not a key
+        if(*cursor != ':') continue;
+        cursor = skip_json_space(cursor + 1);
+        if(*cursor == '{' || *cursor == '[') continue;
+
+        const char *value = cursor;
+        if(*cursor == '"')
+        {
+            value = ++cursor;
+            cursor = skip_json_string(cursor);
+        }
+        else
+        {
+            while(*cursor && *cursor != ',' && *cursor != '}' && *cursor != ']' && *cursor != ' ' && *cursor != '\r' && *cursor != '\n') cursor++;
+        }
+        whoop_json_span_t *span = NULL;
+        if(key_len == STRLEN_CONST("user_id") && !strncmp(key, "user_id", key_len))
+            span = user_id_span;
+        for(int index = 0; !span && index < field_count; index++)
+        {
+            if(!strncmp(fields[index].name, key, key_len) && !fields[index].name[key_len])
+                span = &spans[index];
+        }
+        if(span && !span->text)
+        {
+            span->text = value;
+            span->len = cursor - value;
+        }
+        if(*cursor == '"') cursor++;
+    }
+}
+
+static uint32_t hash_json_spans(const whoop_json_span_t *spans, int span_count)
+{
+    uint32_t hash = 2166136261u;
+    for(int index = 0; index < span_count; index++)
+    {
+        for(int offset = 0; offset < spans[index].len; offset++)
+            hash = (hash ^ (uint8_t) spans[index].text[offset]) * 16777619u;
+        hash = (hash ^ (uint32_t) spans[index].len) * 16777619u;
+    }
+    return hash;
+}
+
+static int get_json_span_int(const whoop_data_field_t *fields, int field_count, const whoop_json_span_t *spans, whoop_data_opt_n opt, int *value_out)
+{
+    for(int index = 0; index < field_count; index++)
+    {
+        if(fields[index].opt != opt) continue;
+        if(!spans[index].text)
+        {
+            ESP_LOGI(TAG, "Could not find required parameter: %s", fields[index].name);
+            return -1;
+        }
+        *value_out = (int) strtol(spans[index].text, NULL, 10);
+        return 0;
+    }
+    return -1;
+}
+
+static int get_lazy_record_handle(int account, whoop_api_request_type_n request, const whoop_data_field_t *fields, int field_count, const whoop_json_span_t *spans, whoop_data_handle_t *handle)
+{
+    int id = 0;
+    int cycle_id = 0;
+    switch(request)
+    {
+        case WHOOP_API_REQUEST_TYPE_RECOVERY:
+            if(get_json_span_int(fields, field_count, spans, WHOOP_DATA_OPT_RECOVERY_SLEEP_ID, &id)
+                || get_json_span_int(fields, field_count, spans, WHOOP_DATA_OPT_RECOVERY_CYCLE_ID, &cycle_id))
+                return -1;
+            if(!get_whoop_recovery_handle_by_id(account, id, handle) || !get_whoop_recovery_handle_by_id(account, cycle_id, handle))
+                return 0;
+            return create_whoop_recovery_data(account, id, cycle_id, handle);
+        case WHOOP_API_REQUEST_TYPE_CYCLE:
+            if(get_json_span_int(fields, field_count, spans, WHOOP_DATA_OPT_CYCLE_ID, &id)) return -1;
+            return get_whoop_cycle_handle_by_id(account, id, handle) ? create_whoop_cycle_data(account, id, handle) : 0;
+        case WHOOP_API_REQUEST_TYPE_SLEEP:
+            if(get_json_span_int(fields, field_count, spans, WHOOP_DATA_OPT_SLEEP_ID, &id)) return -1;
+            return get_whoop_sleep_handle_by_id(account, id, handle) ? create_whoop_sleep_data(account, id, handle) : 0;
+        case WHOOP_API_REQUEST_TYPE_WORKOUT:
+            if(get_json_span_int(fields, field_count, spans, WHOOP_DATA_OPT_WORKOUT_ID, &id)) return -1;
+            return get_whoop_workout_handle_by_id(account, id, handle) ? create_whoop_workout_data(account, id, handle) : 0;
+        default:
+            return -1;
+    }
+}
+
+/*Lazy counterpart of the parse_*_json_data functions: IDs and score state are read now, every metric is
+  stored as its JSON text and only converted when something reads it*/
+static int parse_lazy_json_data(int account, whoop_api_request_type_n request, const whoop_data_field_t *fields, int field_count,
+                                const whoop_json_span_t *spans, const whoop_json_span_t *user_id_span)
+{
+    whoop_data_handle_t handle = NULL;
+    whoop_score_state_n score_state_value = WHOOP_SCORE_STATE_UNSCORABLE;
+    char score_state_str[WHOOP_SCORE_STATE_TEXT_LEN] = {0};
+    int user_id = 0;
+    int status = 0;
+
+    if(user_id_span->text && g_whoop_accounts[account].user_id != (user_id = (int) strtol(user_id_span->text, NULL, 10)))
+    {
+        g_whoop_accounts[account].user_id = user_id;
+        ESP_LOGI(TAG, "Account %d is Whoop user %d", account, user_id);
+    }
+    if( ( status = get_lazy_record_handle(account, request, fields, field_count, spans, &handle) ) )
+    {
+        ESP_LOGI(TAG, "Could not find or create record.");
+        return status;
+    }
+
+    for(int index = 0; index < field_count; index++)
+    {
+        if(!(fields[index].flags & WHOOP_DATA_FIELD_SCORE_STATE)) continue;
+        if(!spans[index].text)
+        {
+            ESP_LOGI(TAG, "Could not find required parameter: score_state");
+            return -1;
+        }
+        memcpy(score_state_str, spans[index].text, MIN(spans[index].len, WHOOP_SCORE_STATE_TEXT_LEN - 1));
+        score_state_value = parse_string_to_score_state(score_state_str);
+        set_whoop_data(handle, fields[index].opt, score_state_value);
+    }
+    if(score_state_value != WHOOP_SCORE_STATE_SCORED )
+    {
+        ESP_LOGI(TAG, "Record not scored.");
+        return 0;
+    }
+
+    begin_whoop_data_lazy(handle);
+    for(int index = 0; index < field_count; index++)
+    {
+        const whoop_data_field_t *field = &fields[index];
+        if(field->flags & (WHOOP_DATA_FIELD_ID | WHOOP_DATA_FIELD_SCORE_STATE)) continue;
+        if(spans[index].text)
+        {
+            set_whoop_data_lazy(handle, field->opt, spans[index].text, spans[index].len);
+        }
+        else if(field->flags & WHOOP_DATA_FIELD_REQUIRED)
+        {
+            ESP_LOGI(TAG, "Could not find required parameter: %s", field->name);
+            status = -1;
+        }
+    }
+    return status;
+}
+#endif
+
+static void parse_token_json_response(int account, const char *server_response)
+{
+    whoop_account_t *whoop_account = &g_whoop_accounts[account];
+    int64_t phase_start_us = esp_timer_get_time();
+    cJSON *json = cJSON_Parse(server_response);
+    whoop_latency_record(WHOOP_API_REQUEST_TYPE_TOKEN, WHOOP_LATENCY_PHASE_PARSE, esp_timer_get_time() - phase_start_us);
     if(json)
     {
-        strcpy(whoop_rest_client->access_token, cJSON_GetStringValue(cJSON_GetObjectItem(json, "access_token")));
-        strcpy(whoop_rest_client->refresh_token, cJSON_GetStringValue(cJSON_GetObjectItem(json, "refresh_token")));
+        phase_start_us = esp_timer_get_time();
+        strcpy(whoop_account->access_token, cJSON_GetStringValue(cJSON_GetObjectItem(json, "access_token")));
+        strcpy(whoop_account->refresh_token, cJSON_GetStringValue(cJSON_GetObjectItem(json, "refresh_token")));
+        update_request_templates(account);
         const cJSON *expires = cJSON_GetObjectItem(json, "expires_in");
-        if(ESP_OK == nvs_set_str(g_nvs_handle, "token", whoop_rest_client->refresh_token))
+        if(ESP_OK == nvs_set_str(whoop_account->nvs_handle, "token", whoop_account->refresh_token))
         {
-            ESP_LOGI(TAG, "Refresh token set to NVS Data: %s", whoop_rest_client->refresh_token);
-            nvs_commit(g_nvs_handle);
+            ESP_LOGI(TAG, "Account %d refresh token set to NVS Data: %s", account, whoop_account->refresh_token);
+            nvs_commit(whoop_account->nvs_handle);
         }
         else
         {
-            ESP_LOGI(TAG, "Error setting token to NVS: %s", whoop_rest_client->refresh_token);
+            ESP_LOGI(TAG, "Error setting account %d token to NVS: %s", account, whoop_account->refresh_token);
         }
         if(expires)
-            whoop_rest_client->expires_in = (int) expires->valuedouble;
+            whoop_account->expires_in = (int) expires->valuedouble;
         cJSON_Delete(json);
+        whoop_latency_record(WHOOP_API_REQUEST_TYPE_TOKEN, WHOOP_LATENCY_PHASE_COMMIT, esp_timer_get_time() - phase_start_us);
     }
 }
 
@@ -425,25 +838,53 @@ esp_err_t _http_event_handler(esp_http_client_event_t *evt)
             break;
         case HTTP_EVENT_ON_CONNECTED:
             ESP_LOGD(TAG, "HTTP_EVENT_ON_CONNECTED");
+            event_data->timing.connected_us = esp_timer_get_time();
             break;
         case HTTP_EVENT_HEADER_SENT:
             ESP_LOGD(TAG, "HTTP_EVENT_HEADER_SENT");
+            event_data->timing.header_sent_us = esp_timer_get_time();
             break;
         case HTTP_EVENT_ON_HEADER:
             ESP_LOGD(TAG, "HTTP_EVENT_ON_HEADER, key=%s, value=%s", evt->header_key, evt->header_value);
+            if(!event_data->timing.first_header_us) event_data->timing.first_header_us = esp_timer_get_time();
+            if(!strcasecmp(evt->header_key, "Content-Encoding") && !strcasecmp(evt->header_value, "gzip")) event_data->gzip = 1;
+#ifdef CONFIG_WHOOP_WEBHOOK_ENABLE
+            if(!strcasecmp(evt->header_key, "Date")) set_unix_time(evt->header_value);
+#endif
             break;
         case HTTP_EVENT_ON_DATA:
             ESP_LOGI(TAG, "HTTP_EVENT_ON_DATA, len=%d", evt->data_len);
+            event_data->wire_bytes += evt->data_len;
+            if(event_data->gzip)
+            {
+                // Only the inflated body is kept, the compressed bytes are decoded straight out of the receive buffer
+                if(!event_data->inflate && !event_data->inflate_status)
+                {
+                    int content_length = esp_http_client_get_content_length(evt->client);
+                    event_data->inflate_status = whoop_inflate_begin(&event_data->inflate,
+                                                        content_length > 0 ? content_length * WHOOP_GZIP_SIZE_HINT_RATIO : 0);
+                }
+                if(event_data->inflate && !event_data->inflate_status)
+                {
+                    int status = whoop_inflate_feed(event_data->inflate, evt->data, evt->data_len);
+                    if(status < 0)
+                    {
+                        ESP_LOGE(TAG, "Could not inflate response: %d", status);
+                        event_data->inflate_status = status;
+                    }
+                }
+                break;
+            }
 
             if(esp_http_client_is_chunked_response(evt->client))
             {
                 if (event_data->server_response == NULL) {
-                    event_data->server_response = (char *) malloc(evt->data_len);
+                    event_data->server_response = (char *) whoop_mem_malloc(evt->data_len + 1);
                     output_len = 0;
                 }
                 else 
                 {
-                    event_data->server_response = (char *) realloc(event_data->server_response, output_len + evt->data_len + 1);
+                    event_data->server_response = (char *) whoop_mem_realloc(event_data->server_response, output_len + evt->data_len + 1);
                 }
                 if (event_data->server_response == NULL) {
                     ESP_LOGE(TAG, "Failed to allocate memory for output buffer");
@@ -453,7 +894,7 @@ esp_err_t _http_event_handler(esp_http_client_event_t *evt)
             else
             {
                 if (event_data->server_response == NULL) {
-                    event_data->server_response = (char *) malloc(esp_http_client_get_content_length(evt->client));
+                    event_data->server_response = (char *) whoop_mem_malloc(esp_http_client_get_content_length(evt->client) + 1);
                     output_len = 0;
                     if (event_data->server_response == NULL) {
                         ESP_LOGE(TAG, "Failed to allocate memory for output buffer");
@@ -467,10 +908,12 @@ esp_err_t _http_event_handler(esp_http_client_event_t *evt)
             break;
         case HTTP_EVENT_ON_FINISH:
             ESP_LOGD(TAG, "HTTP_EVENT_ON_FINISH");
+            event_data->timing.finish_us = esp_timer_get_time();
             if (event_data->server_response != NULL) {
                 event_data->server_response[output_len] = '\0';
-                // Response is accumulated in event_data->server_response. Uncomment the below line to print the accumulated response
-                ESP_LOGI(TAG, event_data->server_response);
+                event_data->body_bytes = output_len;
+                // Response is accumulated in event_data->server_response, whole bodies only at debug level
+                ESP_LOGD(TAG, "%s", event_data->server_response);
                 output_len = 0;
             }
             break;
@@ -487,144 +930,554 @@ esp_err_t _http_event_handler(esp_http_client_event_t *evt)
     return ESP_OK;
 }
 
-static int perform_https_and_check_error(esp_http_client_handle_t client)
+static void record_request_timing(whoop_api_request_type_n request_type, const whoop_request_timing_t *timing)
+{
+    /*Connection is reused when the server keeps it alive, in which case no connect phase is seen*/
+    int64_t request_start_us = timing->start_us;
+    if(timing->connected_us)
+    {
+        whoop_latency_record(request_type, WHOOP_LATENCY_PHASE_CONNECT, timing->connected_us - timing->start_us);
+        request_start_us = timing->connected_us;
+    }
+    if(timing->header_sent_us)
+        whoop_latency_record(request_type, WHOOP_LATENCY_PHASE_REQUEST, timing->header_sent_us - request_start_us);
+    if(timing->header_sent_us && timing->first_header_us)
+        whoop_latency_record(request_type, WHOOP_LATENCY_PHASE_FIRST_BYTE, timing->first_header_us - timing->header_sent_us);
+    if(timing->first_header_us && timing->finish_us)
+        whoop_latency_record(request_type, WHOOP_LATENCY_PHASE_BODY, timing->finish_us - timing->first_header_us);
+}
+
+/*Hands the inflated body over as the server response and adds the response to the transfer counters*/
+static void finish_response_body(whoop_rest_client_t *data, whoop_api_request_type_n request_type)
 {
+    whoop_transfer_stats_t *stats = &g_transfer_stats[request_type];
+    if(data->inflate)
+    {
+        size_t body_len = 0;
+        if(!data->inflate_status && !whoop_inflate_finish(data->inflate, &data->server_response, &body_len))
+        {
+            data->body_bytes = body_len;
+            ESP_LOGI(TAG, "gzip: %u bytes on the wire, %u inflated", data->wire_bytes, data->body_bytes);
+            ESP_LOGD(TAG, "%s", data->server_response);
+        }
+        else
+        {
+            ESP_LOGE(TAG, "Discarding gzip response");
+        }
+        whoop_inflate_end(data->inflate);
+        data->inflate = NULL;
+    }
+    stats->responses++;
+    if(data->gzip) stats->gzip_responses++;
+    stats->wire_bytes += data->wire_bytes;
+    stats->body_bytes += data->body_bytes;
+}
+
+static int perform_https_and_check_error(esp_http_client_handle_t client, whoop_rest_client_t *data, whoop_api_request_type_n request_type)
+{
+    memset(&data->timing, 0, sizeof(data->timing));
+    data->gzip = 0;
+    data->inflate_status = 0;
+    data->wire_bytes = 0;
+    data->body_bytes = 0;
+    data->timing.start_us = esp_timer_get_time();
     esp_err_t err = esp_http_client_perform(client);
     int response_code = 400;
+    finish_response_body(data, request_type);
+    g_transfer_stats[request_type].requests++;
     if (err == ESP_OK) {
         response_code = esp_http_client_get_status_code(client);
-        ESP_LOGI(TAG, "HTTPS Status = %d, content_length = %d",
+        if (response_code < 200 || response_code >= 300) g_transfer_stats[request_type].errors++;
+        record_request_timing(request_type, &data->timing);
+        ESP_LOGI(TAG, "HTTPS Status = %d, content_length = %d, connect %d us, first byte %d us, body %d us",
                 response_code,
-                esp_http_client_get_content_length(client));
+                esp_http_client_get_content_length(client),
+                data->timing.connected_us ? (int) (data->timing.connected_us - data->timing.start_us) : 0,
+                data->timing.first_header_us ? (int) (data->timing.first_header_us - data->timing.header_sent_us) : 0,
+                data->timing.finish_us ? (int) (data->timing.finish_us - data->timing.first_header_us) : 0);
     } else {
+        g_transfer_stats[request_type].errors++;
         ESP_LOGE(TAG, "Error perform http request %s", esp_err_to_name(err));
     }
     return response_code;
 }
 
-static void handle_whoop_api_response_data(int response_code, whoop_api_request_type_n request, whoop_rest_client_t *data)
+static int handle_whoop_api_response_data(int account, int response_code, whoop_api_request_type_n request, whoop_rest_client_t *data)
 {
     if(response_code != 401 && response_code != 200 ) 
     {
         ESP_LOGI(TAG, "Response code not 401 or 200. Response code: %d", response_code);
-        return;
+        return -1;
     }
     if(response_code == 401)
     {
         ESP_LOGI(TAG, "Recieved 401 code... Refreshing token.");
-        whoop_get_token(data->refresh_token, TOKEN_REQUEST_TYPE_REFRESH);
-        return;
+        if(data->server_response)
+        {
+            whoop_mem_free(data->server_response);
+            data->server_response = NULL;
+        }
+        whoop_get_token(account, g_whoop_accounts[account].refresh_token, TOKEN_REQUEST_TYPE_REFRESH);
+        return -1;
     }
     int status = 0;
+    int64_t phase_start_us = esp_timer_get_time();
+#ifdef CONFIG_WHOOP_DATA_LAZY
+    // Parse is the key scan only, values are converted on first read instead of here
+    whoop_json_span_t spans[WHOOP_JSON_MAX_FIELDS];
+    whoop_json_span_t user_id_span;
+    int field_count = 0;
+    const whoop_data_field_t *fields = get_whoop_data_fields((whoop_data_type_n) request, &field_count);
+    if(!data->server_response || field_count > WHOOP_JSON_MAX_FIELDS)
+        return -1;
+    scan_json_fields(data->server_response, fields, field_count, spans, &user_id_span);
+    whoop_latency_record(request, WHOOP_LATENCY_PHASE_PARSE, esp_timer_get_time() - phase_start_us);
+    uint32_t record_hash = hash_json_spans(spans, field_count);
+    if(record_hash == g_lazy_record_hashes[account][request])
+    {
+        ESP_LOGI(TAG, "Record unchanged.");
+        return 0;
+    }
+    phase_start_us = esp_timer_get_time();
+    status = parse_lazy_json_data(account, request, fields, field_count, spans, &user_id_span);
+    whoop_latency_record(request, WHOOP_LATENCY_PHASE_COMMIT, esp_timer_get_time() - phase_start_us);
+    g_lazy_record_hashes[account][request] = status ? 0 : record_hash;
+#else
+    cJSON *json = cJSON_Parse(data->server_response);
+    whoop_latency_record(request, WHOOP_LATENCY_PHASE_PARSE, esp_timer_get_time() - phase_start_us);
+    if(!json)
+    {
+        ESP_LOGI(TAG, "Could not parse JSON.");
+        return -1;
+    }
+    phase_start_us = esp_timer_get_time();
     switch(request)
     {
         case WHOOP_API_REQUEST_TYPE_CYCLE:
-            status = parse_cycle_json_data(data->server_response);
+            status = parse_cycle_json_data(account, json);
             break;
         case WHOOP_API_REQUEST_TYPE_RECOVERY:
-            status = parse_recovery_json_data(data->server_response);
+            status = parse_recovery_json_data(account, json);
             break;
         case WHOOP_API_REQUEST_TYPE_SLEEP:
-            status = parse_sleep_json_data(data->server_response);
+            status = parse_sleep_json_data(account, json);
             break;
         case WHOOP_API_REQUEST_TYPE_WORKOUT:
-            status = parse_workout_json_data(data->server_response);
+            status = parse_workout_json_data(account, json);
+            break;
+        default:
             break;
     }
+    whoop_latency_record(request, WHOOP_LATENCY_PHASE_COMMIT, esp_timer_get_time() - phase_start_us);
+    cJSON_Delete(json);
+#endif
     if(status)
     {
         ESP_LOGI(TAG, "Encountered an error when parsing data.");
     }
+    else
+    {
+        save_whoop_data_record(account, (whoop_data_type_n) request);
+        whoop_events_publish_record(account, (whoop_data_type_n) request);
+    }
+    return status;
 }
 
-//Public functions
-void whoop_get_data(whoop_api_request_type_n request_type)
+/*Fetches the record with the given ID, or the most recent record when the ID is 0. Returns 0 once the
+  record is in the store*/
+static int whoop_fetch_data(int account, whoop_api_request_type_n request_type, int id)
 {
     int response_code = 400;
-    char *authorization_string = (char *) malloc(strlen("Bearer ") + strlen(g_whoop_rest_client.access_token) + 1);
-    if(!authorization_string) return;
-
-    strcpy(authorization_string, "Bearer ");
-    strcpy(authorization_string+ strlen(authorization_string), g_whoop_rest_client.access_token);
-    esp_http_client_set_header(client, "Authorization", authorization_string);
-    esp_http_client_set_method(client, HTTP_METHOD_GET);
-
-    switch(request_type)
+    int status;
+    int64_t request_start_us = esp_timer_get_time();
+    char path[48];
+    whoop_request_template_t by_id_template;
+    const whoop_request_template_t *request_template = &g_data_request_templates[request_type];
+    whoop_mem_slot_n previous_mem_slot;
+    if(request_type < 0 || request_type >= WHOOP_API_REQUEST_TYPE_TOKEN || account < 0 || account >= WHOOP_ACCOUNT_COUNT)
     {
-        case WHOOP_API_REQUEST_TYPE_CYCLE:
-            esp_http_client_set_url(client, "/developer/v1/cycle?limit=1");
-            break;
-        case WHOOP_API_REQUEST_TYPE_RECOVERY:
-            esp_http_client_set_url(client, "/developer/v1/recovery?limit=1");
-            break;
-        case WHOOP_API_REQUEST_TYPE_SLEEP:
-            esp_http_client_set_url(client, "/developer/v1/activity/sleep?limit=1");
-            break;
-        case WHOOP_API_REQUEST_TYPE_WORKOUT:
-            esp_http_client_set_url(client, "/developer/v1/activity/workout?limit=1");
-            break;
-        default:
-            break;
+        ESP_LOGI(TAG, "Invalid data request. Account: %d type: %d", account, request_type);
+        return -1;
+    }
+    if(!is_account_ready(account))
+    {
+        ESP_LOGI(TAG, "Account %d has no access token, not fetching %s", account, whoop_api_request_type_name(request_type));
+        return -1;
+    }
+    if(id && g_data_by_id_paths[request_type])
+    {
+        snprintf(path, sizeof(path), g_data_by_id_paths[request_type], id);
+        by_id_template.method = HTTP_METHOD_GET;
+        by_id_template.path = path;
+        request_template = &by_id_template;
+    }
+    xSemaphoreTakeRecursive(g_client_mutex, portMAX_DELAY);
+    // The client is gone once end_whoop_tls_client has run
+    if(!client || take_request_budget(account))
+    {
+        xSemaphoreGiveRecursive(g_client_mutex);
+        return -1;
     }
+    previous_mem_slot = whoop_mem_request_begin((whoop_mem_slot_n) request_type);
 
-    response_code = perform_https_and_check_error(client);
-    handle_whoop_api_response_data(response_code, request_type, &g_whoop_rest_client);
+    install_authorization_header(account);
+    apply_request_template(request_template, NULL, 0);
+
+    response_code = perform_https_and_check_error(client, &g_whoop_rest_client, request_type);
+    status = handle_whoop_api_response_data(account, response_code, request_type, &g_whoop_rest_client);
+    whoop_latency_record(request_type, WHOOP_LATENCY_PHASE_TOTAL, esp_timer_get_time() - request_start_us);
     if(g_whoop_rest_client.server_response)
     {
-        free(g_whoop_rest_client.server_response);
+        whoop_mem_free(g_whoop_rest_client.server_response);
         g_whoop_rest_client.server_response = NULL;
     }
+    whoop_mem_request_end(previous_mem_slot);
+    xSemaphoreGiveRecursive(g_client_mutex);
+    return status;
+}
 
-    //clean up
-    esp_http_client_delete_header(client, "Authorization");
-    free(authorization_string);
+static void set_job_state(uint32_t job_id, whoop_job_state_n state, int status)
+{
+    whoop_job_t *job = &g_jobs[job_id % WHOOP_JOB_COUNT];
+    int64_t now_us = esp_timer_get_time();
+    portENTER_CRITICAL();
+    if(job->id == job_id)
+    {
+        job->state = state;
+        job->status = status;
+        if(state == WHOOP_JOB_STATE_RUNNING) job->started_us = now_us;
+        else job->finished_us = now_us;
+    }
+    portEXIT_CRITICAL();
+}
+
+static void run_job(const whoop_fetch_request_t *fetch_request)
+{
+    int status;
+    set_job_state(fetch_request->job_id, WHOOP_JOB_STATE_RUNNING, 0);
+    status = whoop_get_data(fetch_request->account, fetch_request->request_type);
+    set_job_state(fetch_request->job_id, status ? WHOOP_JOB_STATE_FAILED : WHOOP_JOB_STATE_DONE, status);
+    ESP_LOGI(TAG, "Job %u %s", fetch_request->job_id, status ? "failed" : "done");
+}
+
+/*A code or token from the web server goes first, otherwise this is the background refresh of the stored token*/
+static void run_token_request(int account)
+{
+    whoop_account_t *whoop_account = &g_whoop_accounts[account];
+    char code_or_token[WHOOP_PENDING_TOKEN_LEN];
+    int token_request_type;
+    portENTER_CRITICAL();
+    strcpy(code_or_token, whoop_account->pending_token);
+    token_request_type = whoop_account->pending_token_type;
+    whoop_account->pending_token[0] = '\0';
+    portEXIT_CRITICAL();
+    if(code_or_token[0])
+        whoop_get_token(account, code_or_token, token_request_type);
+    else
+        whoop_get_token(account, whoop_account->refresh_token, TOKEN_REQUEST_TYPE_REFRESH);
+}
+
+static void whoop_fetch_task(void *arg)
+{
+    whoop_fetch_request_t fetch_request;
+    for(;;)
+    {
+        if(xQueueReceive(g_fetch_queue, &fetch_request, portMAX_DELAY) != pdTRUE) continue;
+        // Work queued at boot or while Wi-Fi is down waits here for an IP address
+        xEventGroupWaitBits(g_client_event_group, WHOOP_NETWORK_READY_BIT, pdFALSE, pdTRUE, portMAX_DELAY);
+        if(fetch_request.account == WHOOP_FETCH_POLL_ACCOUNTS)
+        {
+            whoop_poll_accounts();
+        }
+        else if(fetch_request.request_type == WHOOP_API_REQUEST_TYPE_TOKEN)
+        {
+            run_token_request(fetch_request.account);
+        }
+        else if(fetch_request.job_id)
+        {
+            run_job(&fetch_request);
+        }
+        else
+        {
+            ESP_LOGI(TAG, "Fetching %s %d for account %d", whoop_api_request_type_name(fetch_request.request_type),
+                    fetch_request.id, fetch_request.account);
+            whoop_fetch_data(fetch_request.account, fetch_request.request_type, fetch_request.id);
+        }
+    }
+}
+
+static int queue_fetch_request(int account, whoop_api_request_type_n request_type, int id, uint32_t job_id)
+{
+    whoop_fetch_request_t fetch_request = { .account = account, .request_type = request_type, .id = id, .job_id = job_id };
+    if(!g_fetch_queue || xQueueSend(g_fetch_queue, &fetch_request, 0) != pdTRUE)
+    {
+        ESP_LOGI(TAG, "Fetch queue full, dropping %s request for account %d", whoop_api_request_type_name(request_type), account);
+        return -1;
+    }
+    return 0;
+}
+
+//Public functions
+/*Only the fetch task calls this, so fetches never overlap. Concurrent requests for the same account and type
+  are merged earlier, in whoop_queue_job, and a fetch that completed within the freshness window is answered
+  from the store*/
+int whoop_get_data(int account, whoop_api_request_type_n request_type)
+{
+    whoop_fetch_result_t *result;
+    if(request_type < 0 || request_type >= WHOOP_API_REQUEST_TYPE_TOKEN || account < 0 || account >= WHOOP_ACCOUNT_COUNT)
+    {
+        ESP_LOGI(TAG, "Invalid data request. Account: %d type: %d", account, request_type);
+        return -1;
+    }
+    result = &g_fetch_results[account][request_type];
+    if(!result->status && result->completed_us && esp_timer_get_time() - result->completed_us < WHOOP_FRESHNESS_WINDOW_US)
+    {
+        ESP_LOGI(TAG, "Account %d %s fetched recently, serving from store", account, whoop_api_request_type_name(request_type));
+        return 0;
+    }
+    result->status = whoop_fetch_data(account, request_type, 0);
+    result->completed_us = esp_timer_get_time();
+    return result->status;
+}
+
+int whoop_queue_fetch(int account, whoop_api_request_type_n request_type, int id)
+{
+    if(request_type < 0 || request_type >= WHOOP_API_REQUEST_TYPE_TOKEN || account < 0 || account >= WHOOP_ACCOUNT_COUNT)
+    {
+        return -1;
+    }
+    return queue_fetch_request(account, request_type, id, 0);
+}
+
+int whoop_queue_token(int account, const char *code_or_token, int token_request_type)
+{
+    whoop_account_t *whoop_account;
+    int already_queued;
+    if(account < 0 || account >= WHOOP_ACCOUNT_COUNT || !code_or_token[0] || strlen(code_or_token) >= WHOOP_PENDING_TOKEN_LEN)
+    {
+        return -1;
+    }
+    whoop_account = &g_whoop_accounts[account];
+    portENTER_CRITICAL();
+    // An exchange still waiting picks up the newer code instead of running twice
+    already_queued = whoop_account->pending_token[0] != '\0';
+    strcpy(whoop_account->pending_token, code_or_token);
+    whoop_account->pending_token_type = token_request_type;
+    portEXIT_CRITICAL();
+    if(already_queued)
+        return 0;
+    if(queue_fetch_request(account, WHOOP_API_REQUEST_TYPE_TOKEN, 0, 0))
+    {
+        portENTER_CRITICAL();
+        whoop_account->pending_token[0] = '\0';
+        portEXIT_CRITICAL();
+        return -1;
+    }
+    return 0;
+}
+
+int whoop_queue_poll(void)
+{
+    g_poll_queued_us = esp_timer_get_time();
+    return queue_fetch_request(WHOOP_FETCH_POLL_ACCOUNTS, WHOOP_API_REQUEST_TYPE_MAX, 0, 0);
+}
+
+int64_t whoop_client_get_next_poll_us(void)
+{
+    int64_t interval_us = WHOOP_POLL_INTERVAL_MS * 1000LL;
+    int64_t now_us = esp_timer_get_time();
+    int64_t next_us;
+    if(!g_poll_queued_us) return 0;
+    next_us = g_poll_queued_us + interval_us;
+#ifdef CONFIG_WHOOP_WEBHOOK_ENABLE
+    // Ticks before the safety interval runs out are skipped while webhooks keep arriving
+    if(g_last_webhook_us && g_last_poll_us && now_us - g_last_webhook_us < WHOOP_SAFETY_POLL_US)
+    {
+        int64_t due_us = MIN(g_last_webhook_us, g_last_poll_us) + WHOOP_SAFETY_POLL_US;
+        while(next_us < due_us) next_us += interval_us;
+    }
+#endif
+    return next_us > now_us ? next_us - now_us : 0;
+}
+
+int whoop_queue_job(int account, whoop_api_request_type_n request_type, uint32_t *job_id)
+{
+    whoop_job_t *job;
+    if(request_type < 0 || request_type >= WHOOP_API_REQUEST_TYPE_TOKEN || account < 0 || account >= WHOOP_ACCOUNT_COUNT)
+    {
+        return -1;
+    }
+    portENTER_CRITICAL();
+    // A job still waiting for or running the same fetch answers this request too
+    for(int index = 0; index < WHOOP_JOB_COUNT; index++)
+    {
+        job = &g_jobs[index];
+        if(job->id && job->account == account && job->request_type == request_type
+            && (job->state == WHOOP_JOB_STATE_QUEUED || job->state == WHOOP_JOB_STATE_RUNNING))
+        {
+            *job_id = job->id;
+            portEXIT_CRITICAL();
+            ESP_LOGI(TAG, "Joining job %u for account %d %s", *job_id, account, whoop_api_request_type_name(request_type));
+            return 0;
+        }
+    }
+    *job_id = g_next_job_id++;
+    job = &g_jobs[*job_id % WHOOP_JOB_COUNT];
+    memset(job, 0, sizeof(whoop_job_t));
+    job->id = *job_id;
+    job->account = account;
+    job->request_type = request_type;
+    job->state = WHOOP_JOB_STATE_QUEUED;
+    job->queued_us = esp_timer_get_time();
+    portEXIT_CRITICAL();
+    if(queue_fetch_request(account, request_type, 0, *job_id))
+    {
+        set_job_state(*job_id, WHOOP_JOB_STATE_FAILED, -1);
+        return -1;
+    }
+    return 0;
+}
+
+int whoop_client_get_job(uint32_t job_id, whoop_job_t *job_out)
+{
+    int status = -1;
+    portENTER_CRITICAL();
+    if(job_id && g_jobs[job_id % WHOOP_JOB_COUNT].id == job_id)
+    {
+        *job_out = g_jobs[job_id % WHOOP_JOB_COUNT];
+        status = 0;
+    }
+    portEXIT_CRITICAL();
+    return status;
+}
+
+const char *whoop_job_state_name(whoop_job_state_n state)
+{
+    return (state >= WHOOP_JOB_STATE_QUEUED && state <= WHOOP_JOB_STATE_FAILED) ? g_job_state_names[state] : "unknown";
 }
 
-void whoop_get_token(const char *code_or_token, int token_request_type)
+int whoop_client_account_for_user(int user_id)
+{
+    for(int account = 0; account < WHOOP_ACCOUNT_COUNT; account++)
+    {
+        if(g_whoop_accounts[account].user_id == user_id) return account;
+    }
+    // A single account needs no mapping, even before its first record has been seen
+    if(WHOOP_ACCOUNT_COUNT == 1 && !g_whoop_accounts[0].user_id) return 0;
+    return -1;
+}
+
+void whoop_client_set_network_ready(int ready)
+{
+    if(!g_client_event_group) return;
+    if(ready && g_network_lost)
+    {
+        g_network_lost = 0;
+        g_reconnect_count++;
+    }
+    if(!ready && (xEventGroupGetBits(g_client_event_group) & WHOOP_NETWORK_READY_BIT)) g_network_lost = 1;
+    if(ready) xEventGroupSetBits(g_client_event_group, WHOOP_NETWORK_READY_BIT);
+    else xEventGroupClearBits(g_client_event_group, WHOOP_NETWORK_READY_BIT);
+}
+
+uint32_t whoop_client_get_reconnect_count(void)
+{
+    return g_reconnect_count;
+}
+
+int whoop_client_get_unix_time_ms(int64_t *now_ms_out)
+{
+#ifdef CONFIG_WHOOP_WEBHOOK_ENABLE
+    int64_t offset_ms;
+    portENTER_CRITICAL();
+    offset_ms = g_unix_offset_ms;
+    portEXIT_CRITICAL();
+    if(!offset_ms) return -1;
+    *now_ms_out = offset_ms + esp_timer_get_time() / 1000;
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+void whoop_client_webhook_received(void)
+{
+#ifdef CONFIG_WHOOP_WEBHOOK_ENABLE
+    g_last_webhook_us = esp_timer_get_time();
+#endif
+}
+
+void whoop_get_token(int account, const char *code_or_token, int token_request_type)
 {
     int response_code = 400;
-    char *loc = NULL;
+    const char *body = post_data;
+    int body_len = -1;
+    whoop_account_t *whoop_account = NULL;
+    whoop_mem_slot_n previous_mem_slot;
+    if(account < 0 || account >= WHOOP_ACCOUNT_COUNT)
+    {
+        ESP_LOGI(TAG, "Invalid account: %d", account);
+        return;
+    }
+    whoop_account = &g_whoop_accounts[account];
     if(token_request_type == TOKEN_REQUEST_TYPE_REFRESH)
     {
-        strcpy(post_data, "grant_type=refresh_token&client_id=" CLIENT_ID "&client_secret=" CLIENT_SECRET "&refresh_token=");
-        loc = post_data + strlen(post_data);
-        strcpy(loc, code_or_token);
-        ESP_LOGI(TAG, "Sending https post string: %s",post_data);
-     // grant_type=refresh_token&refresh_token=tGzv3JOkF0XG5Qx2TlKWIA&client_id=..&client_secret=..
+        // grant_type=refresh_token&refresh_token=tGzv3JOkF0XG5Qx2TlKWIA&client_id=..&client_secret=..
+        if(whoop_account->refresh_post_data_len > 0 && !strcmp(code_or_token, whoop_account->refresh_token))
+        {
+            body = whoop_account->refresh_post_data;
+            body_len = whoop_account->refresh_post_data_len;
+        }
+        else
+        {
+            body_len = build_post_data(post_data, sizeof(post_data), REFRESH_POST_DATA_PREFIX, STRLEN_CONST(REFRESH_POST_DATA_PREFIX), code_or_token);
+        }
     }
-    
     else if (token_request_type == TOKEN_REQUEST_TYPE_AUTH_CODE)
     {
-        strcpy(post_data, "grant_type=authorization_code&client_id=" CLIENT_ID "&client_secret=" CLIENT_SECRET "&scope=offline&redirect_uri=http://localhost:3100&code=");
-        loc = post_data + strlen(post_data);
-        strcpy(loc, code_or_token);
-        ESP_LOGI(TAG, "Sending https post string: %s",post_data);
         //grant_type=authorization_code&code=SplxlOBeZQQYbYS6WxSbIA&client_id=..&client_secret=...&
-     //&redirect_uri=http://localhost:3100
+        //&redirect_uri=http://localhost:3100
+        body_len = build_post_data(post_data, sizeof(post_data), AUTH_CODE_POST_DATA_PREFIX, STRLEN_CONST(AUTH_CODE_POST_DATA_PREFIX), code_or_token);
     }
     else
     {
         ESP_LOGI(TAG, "Invalid token request code");
         return;
     }
-    esp_http_client_set_url(client, "/oauth/oauth2/token");
+    if(body_len < 0)
+    {
+        ESP_LOGI(TAG, "Token request code too long");
+        return;
+    }
+    xSemaphoreTakeRecursive(g_client_mutex, portMAX_DELAY);
+    if(!client || take_request_budget(account))
+    {
+        xSemaphoreGiveRecursive(g_client_mutex);
+        return;
+    }
+    ESP_LOGI(TAG, "Sending https post string: %s", body);
+
+    previous_mem_slot = whoop_mem_request_begin(WHOOP_MEM_SLOT_TOKEN);
+    remove_authorization_header();
     esp_http_client_set_header(client, "content-type", "application/x-www-form-urlencoded");
-    esp_http_client_set_method(client, HTTP_METHOD_POST);
-    esp_http_client_set_post_field(client, post_data, strlen(post_data));
+    apply_request_template(&g_token_request_template, body, body_len);
 
-    response_code = perform_https_and_check_error(client);
+    response_code = perform_https_and_check_error(client, &g_whoop_rest_client, WHOOP_API_REQUEST_TYPE_TOKEN);
     if(response_code == 200)
     {
-        parse_token_json_response(&g_whoop_rest_client);
+        parse_token_json_response(account, g_whoop_rest_client.server_response);
     }
+    whoop_latency_record(WHOOP_API_REQUEST_TYPE_TOKEN, WHOOP_LATENCY_PHASE_TOTAL, esp_timer_get_time() - g_whoop_rest_client.timing.start_us);
 
     if(g_whoop_rest_client.server_response)
     {
-        free(g_whoop_rest_client.server_response);
+        whoop_mem_free(g_whoop_rest_client.server_response);
         g_whoop_rest_client.server_response = NULL;
     }
     //clean up
     esp_http_client_delete_header(client, "content-type");
+    whoop_mem_request_end(previous_mem_slot);
+    xSemaphoreGiveRecursive(g_client_mutex);
 }
 
 esp_http_client_config_t whoop_config = {
@@ -637,31 +1490,97 @@ esp_http_client_config_t whoop_config = {
 };
 void init_whoop_tls_client(void)
 {
+    char nvs_namespace[16];
+    size_t refresh_token_buffer_len;
     client = esp_http_client_init(&whoop_config);
+#ifdef CONFIG_WHOOP_HTTP_GZIP
+    esp_http_client_set_header(client, "Accept-Encoding", "gzip");
+#endif
+    g_client_mutex = xSemaphoreCreateRecursiveMutex();
+    g_client_event_group = xEventGroupCreate();
+    g_fetch_queue = xQueueCreate(WHOOP_FETCH_QUEUE_LEN, sizeof(whoop_fetch_request_t));
+    xTaskCreate(whoop_fetch_task, "whoop_fetch", WHOOP_FETCH_TASK_STACK_SIZE, NULL, tskIDLE_PRIORITY + 2, NULL);
 
-    esp_err_t err = nvs_flash_init();
-    if(!err)
+    // NVS is initialized by app_main before the cached records are restored
+    for(int account = 0; account < WHOOP_ACCOUNT_COUNT; account++)
     {
-        err = nvs_open("whoop_nvs", NVS_READWRITE, &g_nvs_handle);
+        whoop_account_t *whoop_account = &g_whoop_accounts[account];
+        // Account 0 keeps the original namespace so existing devices keep their token
+        if(account) snprintf(nvs_namespace, sizeof(nvs_namespace), "whoop_nvs%d", account);
+        else strcpy(nvs_namespace, "whoop_nvs");
+        if(nvs_open(nvs_namespace, NVS_READWRITE, &whoop_account->nvs_handle))
+        {
+            ESP_LOGI(TAG, "Could not open NVS namespace %s.", nvs_namespace);
+            continue;
+        }
+        refresh_token_buffer_len = sizeof(whoop_account->refresh_token);
+        if(ESP_ERR_NVS_NOT_FOUND == nvs_get_str(whoop_account->nvs_handle, "token", whoop_account->refresh_token, &refresh_token_buffer_len))
+        {
+            ESP_LOGI(TAG, "Account %d token not found in NVS... attempting to create now.", account);
+            nvs_set_str(whoop_account->nvs_handle, "token", "000");
+        }
+        else
+        {
+            ESP_LOGI(TAG, "Found account %d NVS token: %s", account, whoop_account->refresh_token);
+            // Refreshed in the background once Wi-Fi is up, queued ahead of the first poll
+            queue_fetch_request(account, WHOOP_API_REQUEST_TYPE_TOKEN, 0, 0);
+        }
     }
-    if(err)
+    ESP_LOGI(TAG, "%d account(s), memory per account: client %u bytes, store %u bytes",
+            WHOOP_ACCOUNT_COUNT, whoop_client_account_size(), get_whoop_data_account_size());
+}
+
+/*Fair round-robin over accounts: every authorized account gets one request per turn, and the account served
+  first rotates between polls so nobody is consistently last when budgets run short*/
+void whoop_poll_accounts(void)
+{
+#ifdef CONFIG_WHOOP_WEBHOOK_ENABLE
+    // While webhooks keep arriving, polling only runs as a slow safety net for missed deliveries
+    int64_t now_us = esp_timer_get_time();
+    if(g_last_webhook_us && now_us - g_last_webhook_us < WHOOP_SAFETY_POLL_US
+        && g_last_poll_us && now_us - g_last_poll_us < WHOOP_SAFETY_POLL_US)
     {
-        ESP_LOGI(TAG, "Could not open NVS partition.");
+        ESP_LOGI(TAG, "Webhooks active, skipping poll.");
         return;
     }
-    if(ESP_ERR_NVS_NOT_FOUND == nvs_get_str(g_nvs_handle, "token", g_whoop_rest_client.refresh_token, &g_refresh_token_buffer_len))
-    {
-        ESP_LOGI(TAG, "Token not found in NVS... attempting to create now.");
-        nvs_set_str(g_nvs_handle, "token", "000");
-    }
-    else
+    g_last_poll_us = now_us;
+#endif
+    for(int request_type = 0; request_type < WHOOP_API_REQUEST_TYPE_TOKEN; request_type++)
     {
-        ESP_LOGI(TAG, "Found NVS token: %s",g_whoop_rest_client.refresh_token);
-        whoop_get_token(g_whoop_rest_client.refresh_token, TOKEN_REQUEST_TYPE_REFRESH);
+        for(int turn = 0; turn < WHOOP_ACCOUNT_COUNT; turn++)
+        {
+            int account = (g_poll_first_account + turn) % WHOOP_ACCOUNT_COUNT;
+            if(!is_account_ready(account)) continue;
+            whoop_get_data(account, request_type);
+        }
     }
+    g_poll_first_account = (g_poll_first_account + 1) % WHOOP_ACCOUNT_COUNT;
+}
+
+int whoop_client_get_transfer_stats(whoop_api_request_type_n request_type, whoop_transfer_stats_t *stats_out)
+{
+    if(request_type < 0 || request_type >= WHOOP_API_REQUEST_TYPE_MAX || !stats_out) return -1;
+    *stats_out = g_transfer_stats[request_type];
+    return 0;
 }
 
+size_t whoop_client_account_size(void)
+{
+    return sizeof(whoop_account_t);
+}
+
+/*Only for shutdown, the client is kept across Wi-Fi drops. Waits for a request in flight to finish*/
 void end_whoop_tls_client(void)
 {
-    esp_http_client_cleanup(client);
+    xSemaphoreTakeRecursive(g_client_mutex, portMAX_DELAY);
+    if(client) esp_http_client_cleanup(client);
+    client = NULL;
+    xSemaphoreGiveRecursive(g_client_mutex);
+}
+
+const char *whoop_api_request_type_name(whoop_api_request_type_n request_type)
+{
+    static const char *request_type_names[WHOOP_API_REQUEST_TYPE_MAX] = {"sleep", "workout", "recovery", "cycle", "token"};
+    if(request_type < 0 || request_type >= WHOOP_API_REQUEST_TYPE_MAX) return "unknown";
+    return request_type_names[request_type];
 }
\ No newline at end of file
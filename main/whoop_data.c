@@ -1,10 +1,26 @@
 #include <string.h>
 #include <stdarg.h>
+#include <stdlib.h>
+#include <stdint.h>
 #include "esp_log.h"
+#include "nvs.h"
 #include "whoop_data.h"
+#ifdef CONFIG_WHOOP_DATA_LAZY
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#endif
 
 // Defines
 #define MAX_NUMBER_RECORDINGS 5
+#define WHOOP_DATA_CACHE_NAMESPACE "whoop_cache"
+#define WHOOP_DATA_VALUE_TEXT_LEN 24
+#ifdef CONFIG_WHOOP_DATA_LAZY
+#define WHOOP_LAZY_TEXT_LEN 256
+#define WHOOP_LAZY_FIELD_COUNT 32       /*One bit per field, ints from 0 and floats from WHOOP_LAZY_FLOAT_BIT*/
+#define WHOOP_LAZY_FLOAT_BIT 16
+#define WHOOP_LAZY_RECORD_COUNT (WHOOP_ACCOUNT_COUNT * WHOOP_DATA_TYPE_MAX)
+#endif
 
 #define WHOOP_SLEEP_BIT_ID  0x0001
 #define WHOOP_CYCLE_BIT_ID  0x0002
@@ -109,6 +125,55 @@ typedef struct whoop_sleep_data {
     whoop_sleep_floats_t sleep_floats;
 } whoop_sleep_data_t;
 
+// Largest record, sizes the flash cache blobs
+typedef union whoop_data_record {
+    whoop_sleep_data_t sleep;
+    whoop_cycle_data_t cycle;
+    whoop_workout_data_t workout;
+    whoop_recovery_data_t recovery;
+} whoop_data_record_t;
+
+#ifdef CONFIG_WHOOP_DATA_LAZY
+typedef struct whoop_lazy_span
+{
+    uint8_t offset;
+    uint8_t len;
+} whoop_lazy_span_t;
+
+/*JSON text of the fields of one record that have not been read yet*/
+typedef struct whoop_lazy_record
+{
+    whoop_data_handle_t handle;
+    int *int_array;
+    float *float_array;
+    uint32_t pending;
+    uint16_t text_len;
+    whoop_lazy_span_t spans[WHOOP_LAZY_FIELD_COUNT];
+    char text[WHOOP_LAZY_TEXT_LEN];
+} whoop_lazy_record_t;
+
+/*A lazy record as cached in flash, only text_len bytes of the text are stored*/
+typedef struct whoop_lazy_cache
+{
+    uint32_t pending;
+    uint16_t text_len;
+    uint16_t int_offset;        /*Of the record's int and float arrays from its start*/
+    uint16_t float_offset;
+    whoop_lazy_span_t spans[WHOOP_LAZY_FIELD_COUNT];
+    char text[WHOOP_LAZY_TEXT_LEN];
+} whoop_lazy_cache_t;
+#endif
+
+// A record as cached in flash, followed by the text of any fields not decoded yet
+typedef union whoop_data_cache_blob {
+    whoop_data_record_t record;
+#ifdef CONFIG_WHOOP_DATA_LAZY
+    unsigned char bytes[sizeof(whoop_data_record_t) + sizeof(whoop_lazy_cache_t)];
+#else
+    unsigned char bytes[sizeof(whoop_data_record_t)];
+#endif
+} whoop_data_cache_blob_t;
+
 typedef struct whoop_data {
     whoop_cycle_data_t **cycle_list;
     whoop_workout_data_t **workout_list;
@@ -119,28 +184,116 @@ typedef struct whoop_data {
 // Local Global Variables
 static const char *TAG = "WHOOP DATA";
 
-whoop_sleep_data_t g_sleep_data_list[MAX_NUMBER_RECORDINGS];
-whoop_cycle_data_t g_cycle_data_list[MAX_NUMBER_RECORDINGS];
-whoop_workout_data_t g_workout_data_list[MAX_NUMBER_RECORDINGS];
-whoop_recovery_data_t g_recovery_data_list[MAX_NUMBER_RECORDINGS];
+// Every account gets its own store, indexed by account number first
+whoop_sleep_data_t g_sleep_data_list[WHOOP_ACCOUNT_COUNT][MAX_NUMBER_RECORDINGS];
+whoop_cycle_data_t g_cycle_data_list[WHOOP_ACCOUNT_COUNT][MAX_NUMBER_RECORDINGS];
+whoop_workout_data_t g_workout_data_list[WHOOP_ACCOUNT_COUNT][MAX_NUMBER_RECORDINGS];
+whoop_recovery_data_t g_recovery_data_list[WHOOP_ACCOUNT_COUNT][MAX_NUMBER_RECORDINGS];
+
+whoop_sleep_data_t *g_sleep_data_ptr_list[WHOOP_ACCOUNT_COUNT][MAX_NUMBER_RECORDINGS];
+whoop_cycle_data_t *g_cycle_data_ptr_list[WHOOP_ACCOUNT_COUNT][MAX_NUMBER_RECORDINGS];
+whoop_workout_data_t *g_workout_data_ptr_list[WHOOP_ACCOUNT_COUNT][MAX_NUMBER_RECORDINGS];
+whoop_recovery_data_t *g_recovery_data_ptr_list[WHOOP_ACCOUNT_COUNT][MAX_NUMBER_RECORDINGS];
+
+static int g_cycle_data_record_count[WHOOP_ACCOUNT_COUNT] = {0};
+static int g_workout_data_record_count[WHOOP_ACCOUNT_COUNT] = {0};
+static int g_sleep_data_record_count[WHOOP_ACCOUNT_COUNT] = {0};
+static int g_recovery_data_record_count[WHOOP_ACCOUNT_COUNT] = {0};
+
+whoop_data_handle_t g_most_recent_sleep[WHOOP_ACCOUNT_COUNT] = {NULL};
+whoop_data_handle_t g_most_recent_cycle[WHOOP_ACCOUNT_COUNT] = {NULL};
+whoop_data_handle_t g_most_recent_workout[WHOOP_ACCOUNT_COUNT] = {NULL};
+whoop_data_handle_t g_most_recent_recovery[WHOOP_ACCOUNT_COUNT] = {NULL};
+
 
-whoop_sleep_data_t *g_sleep_data_ptr_list[MAX_NUMBER_RECORDINGS];
-whoop_cycle_data_t *g_cycle_data_ptr_list[MAX_NUMBER_RECORDINGS];
-whoop_workout_data_t *g_workout_data_ptr_list[MAX_NUMBER_RECORDINGS];
-whoop_recovery_data_t *g_recovery_data_ptr_list[MAX_NUMBER_RECORDINGS];
+whoop_data_t g_whoop_data[WHOOP_ACCOUNT_COUNT];
+static volatile unsigned int g_whoop_data_generation = 0;
+static volatile unsigned int g_whoop_data_versions[WHOOP_DATA_TYPE_MAX];
+// Records restored from flash stay stale until the client has fetched that type again
+static unsigned char g_whoop_data_stale[WHOOP_ACCOUNT_COUNT][WHOOP_DATA_TYPE_MAX];
+static nvs_handle_t g_whoop_data_cache_handle = 0;
+static const char *g_whoop_data_type_names[WHOOP_DATA_TYPE_MAX] = {"sleep", "workout", "recovery", "cycle"};
+static whoop_data_lazy_stats_t g_lazy_stats;
 
-static int g_cycle_data_record_count = 0;
-static int g_workout_data_record_count = 0;
-static int g_sleep_data_record_count = 0;
-static int g_recovery_data_record_count = 0;
+// Field names follow the Whoop API so responses can be matched and served under the same keys
+#define REQUIRED WHOOP_DATA_FIELD_REQUIRED
+static const whoop_data_field_t g_sleep_fields[] = {
+    { "id", WHOOP_DATA_OPT_SLEEP_ID, REQUIRED | WHOOP_DATA_FIELD_ID },
+    { "score_state", WHOOP_DATA_OPT_SLEEP_SCORE_STATE, REQUIRED | WHOOP_DATA_FIELD_SCORE_STATE },
+    { "nap", WHOOP_DATA_OPT_SLEEP_NAP_BOOL, REQUIRED | WHOOP_DATA_FIELD_BOOL },
+    { "total_in_bed_time_milli", WHOOP_DATA_OPT_SLEEP_STAGE_SUMMARY_TOTAL_IN_BED_TIME_MILLI, REQUIRED },
+    { "total_awake_time_milli", WHOOP_DATA_OPT_SLEEP_STAGE_SUMMARY_TOTAL_AWAKE_TIME_MILLI, REQUIRED },
+    { "total_no_data_time_milli", WHOOP_DATA_OPT_SLEEP_STAGE_SUMMARY_TOTAL_NO_DATA_TIME_MILLI, REQUIRED },
+    { "total_light_sleep_time_milli", WHOOP_DATA_OPT_SLEEP_STAGE_SUMMARY_TOTAL_LIGHT_SLEEP_TIME_MILLI, REQUIRED },
+    { "total_slow_wave_sleep_time_milli", WHOOP_DATA_OPT_SLEEP_STAGE_SUMMARY_TOTAL_SLOW_WAVE_TIME_MILLI, REQUIRED },
+    { "total_rem_sleep_time_milli", WHOOP_DATA_OPT_SLEEP_STAGE_SUMMARY_TOTAL_REM_SLEEP_TIME_MILLI, REQUIRED },
+    { "sleep_cycle_count", WHOOP_DATA_OPT_SLEEP_STAGE_SUMMARY_SLEEP_CYCLE_COUNT, REQUIRED },
+    { "disturbance_count", WHOOP_DATA_OPT_SLEEP_STAGE_SUMMARY_DISTURBANCE_COUNT, REQUIRED },
+    { "baseline_milli", WHOOP_DATA_OPT_SLEEP_SLEEP_NEEDED_BASELINE_MILLI, REQUIRED },
+    { "need_from_sleep_debt_milli", WHOOP_DATA_OPT_SLEEP_SLEEP_NEEDED_FROM_SLEEP_DEBT_MILLI, REQUIRED },
+    { "need_from_recent_strain_milli", WHOOP_DATA_OPT_SLEEP_SLEEP_NEEDED_FROM_RECENT_STRAIN_DEBT_MILLI, REQUIRED },
+    { "need_from_recent_nap_milli", WHOOP_DATA_OPT_SLEEP_SLEEP_NEEDED_FROM_RECENT_NAP_DEBT_MILLI, REQUIRED },
+    { "respiratory_rate", WHOOP_DATA_OPT_SLEEP_RESPIRATORY_RATE, REQUIRED },
+    { "sleep_performance_percentage", WHOOP_DATA_OPT_SLEEP_SLEEP_PERFORMANCE_PERCENTAGE, REQUIRED },
+    { "sleep_consistency_percentage", WHOOP_DATA_OPT_SLEEP_SLEEP_CONSISTENCY_PERCENTAGE, REQUIRED },
+    { "sleep_efficiency_percentage", WHOOP_DATA_OPT_SLEEP_SLEEP_EFFICIENCY_PERCENTAGE, REQUIRED },
+};
 
-whoop_data_handle_t g_most_recent_sleep = NULL;
-whoop_data_handle_t g_most_recent_cycle = NULL;
-whoop_data_handle_t g_most_recent_workout = NULL;
-whoop_data_handle_t g_most_recent_recovery = NULL;
+static const whoop_data_field_t g_workout_fields[] = {
+    { "id", WHOOP_DATA_OPT_WORKOUT_ID, REQUIRED | WHOOP_DATA_FIELD_ID },
+    { "score_state", WHOOP_DATA_OPT_WORKOUT_SCORE_STATE, REQUIRED | WHOOP_DATA_FIELD_SCORE_STATE },
+    { "sport_id", WHOOP_DATA_OPT_WORKOUT_SPORT_ID, REQUIRED },
+    { "strain", WHOOP_DATA_OPT_WORKOUT_STRAIN, REQUIRED },
+    { "average_heart_rate", WHOOP_DATA_OPT_WORKOUT_AVERAGE_HEART_RATE, REQUIRED },
+    { "max_heart_rate", WHOOP_DATA_OPT_WORKOUT_MAX_HEART_RATE, REQUIRED },
+    { "kilojoule", WHOOP_DATA_OPT_WORKOUT_KILOJOULE, REQUIRED },
+    { "percent_recorded", WHOOP_DATA_OPT_WORKOUT_PERCENT_RECORDED, REQUIRED },
+    { "distance_meter", WHOOP_DATA_OPT_WORKOUT_DISTANCE_METER, 0 },
+    { "altitude_gain_meter", WHOOP_DATA_OPT_WORKOUT_ALTITUDE_GAIN_METER, 0 },
+    { "altitude_change_meter", WHOOP_DATA_OPT_WORKOUT_ALTITUDE_CHANGE_METER, 0 },
+    { "zone_zero_milli", WHOOP_DATA_OPT_WORKOUT_ZONE_DURATION_ZERO, REQUIRED },
+    { "zone_one_milli", WHOOP_DATA_OPT_WORKOUT_ZONE_DURATION_ONE, REQUIRED },
+    { "zone_two_milli", WHOOP_DATA_OPT_WORKOUT_ZONE_DURATION_TWO, REQUIRED },
+    { "zone_three_milli", WHOOP_DATA_OPT_WORKOUT_ZONE_DURATION_THREE, REQUIRED },
+    { "zone_four_milli", WHOOP_DATA_OPT_WORKOUT_ZONE_DURATION_FOUR, REQUIRED },
+    { "zone_five_milli", WHOOP_DATA_OPT_WORKOUT_ZONE_DURATION_FIVE, REQUIRED },
+};
 
+static const whoop_data_field_t g_recovery_fields[] = {
+    { "sleep_id", WHOOP_DATA_OPT_RECOVERY_SLEEP_ID, REQUIRED | WHOOP_DATA_FIELD_ID },
+    { "cycle_id", WHOOP_DATA_OPT_RECOVERY_CYCLE_ID, REQUIRED | WHOOP_DATA_FIELD_ID },
+    { "score_state", WHOOP_DATA_OPT_RECOVERY_SCORE_STATE, REQUIRED | WHOOP_DATA_FIELD_SCORE_STATE },
+    { "user_calibrating", WHOOP_DATA_OPT_RECOVERY_USER_CALIBRATING, REQUIRED | WHOOP_DATA_FIELD_BOOL },
+    { "recovery_score", WHOOP_DATA_OPT_RECOVERY_RECOVERY_SCORE, REQUIRED },
+    { "resting_heart_rate", WHOOP_DATA_OPT_RECOVERY_RESTING_HEART_RATE, REQUIRED },
+    { "hrv_rmssd_milli", WHOOP_DATA_OPT_RECOVERY_HRV_RMSSD_MILLI, REQUIRED },
+    { "spo2_percentage", WHOOP_DATA_OPT_RECOVERY_SPO2_PERCENTAGE, 0 },
+    { "skin_temp_celsius", WHOOP_DATA_OPT_RECOVERY_SKIN_TEMP_CELCIUS, 0 },
+};
 
-whoop_data_t g_whoop_data;
+static const whoop_data_field_t g_cycle_fields[] = {
+    { "id", WHOOP_DATA_OPT_CYCLE_ID, REQUIRED | WHOOP_DATA_FIELD_ID },
+    { "score_state", WHOOP_DATA_OPT_CYCLE_SCORE_STATE, REQUIRED | WHOOP_DATA_FIELD_SCORE_STATE },
+    { "average_heart_rate", WHOOP_DATA_OPT_CYCLE_AVERAGE_HEART_RATE, REQUIRED },
+    { "max_heart_rate", WHOOP_DATA_OPT_CYCLE_MAX_HEART_RATE, REQUIRED },
+    { "strain", WHOOP_DATA_OPT_CYCLE_STRAIN, REQUIRED },
+    { "kilojoule", WHOOP_DATA_OPT_CYCLE_KILOJOULE, REQUIRED },
+};
+#undef REQUIRED
+
+#define FIELD_COUNT(table) (sizeof(table) / sizeof(table[0]))
+static const whoop_data_field_t *g_whoop_data_fields[WHOOP_DATA_TYPE_MAX] = { g_sleep_fields, g_workout_fields, g_recovery_fields, g_cycle_fields };
+static const int g_whoop_data_field_counts[WHOOP_DATA_TYPE_MAX] = {
+    FIELD_COUNT(g_sleep_fields), FIELD_COUNT(g_workout_fields), FIELD_COUNT(g_recovery_fields), FIELD_COUNT(g_cycle_fields)
+};
+#ifdef CONFIG_WHOOP_DATA_LAZY
+// One lazy record per account and type is enough, only the record just fetched has unread fields
+static whoop_lazy_record_t g_lazy_records[WHOOP_LAZY_RECORD_COUNT];
+static int g_lazy_next_record = 0;
+static SemaphoreHandle_t g_lazy_mutex = NULL;
+#endif
+
+#define IS_VALID_ACCOUNT(account) ( (account) >= 0 && (account) < WHOOP_ACCOUNT_COUNT )
 
 // Local functions  (Place holders if memory management is introduced)
 void discard_cycle_data(whoop_cycle_data_t *cycle_data)
@@ -204,160 +357,512 @@ int deconstruct_whoop_data_opt(whoop_data_handle_t handle, whoop_data_opt_n whoo
     return WHOOP_DATA_STATUS_OK;
 }
 
+/*Same conversion cJSON does for the eager parser, except JSON booleans read as 1 and 0*/
+static void decode_value_text(const char *text, size_t text_len, int data_is_int, int *int_out, float *float_out)
+{
+    char value[WHOOP_DATA_VALUE_TEXT_LEN];
+    text_len = MIN(text_len, sizeof(value) - 1);
+    memcpy(value, text, text_len);
+    value[text_len] = '\0';
+    if(data_is_int)
+        *int_out = !strcmp(value, "true") ? 1 : (int) strtol(value, NULL, 10);
+    else
+        *float_out = strtof(value, NULL);
+}
+
+#ifdef CONFIG_WHOOP_DATA_LAZY
+static whoop_lazy_record_t *find_lazy_record(whoop_data_handle_t handle)
+{
+    for(int index = 0; index < WHOOP_LAZY_RECORD_COUNT; index++)
+    {
+        if(g_lazy_records[index].handle == handle) return &g_lazy_records[index];
+    }
+    return NULL;
+}
+
+static void decode_lazy_field(whoop_lazy_record_t *lazy, int bit)
+{
+    int64_t start_us = esp_timer_get_time();
+    const whoop_lazy_span_t *span = &lazy->spans[bit];
+    if(bit < WHOOP_LAZY_FLOAT_BIT)
+        decode_value_text(lazy->text + span->offset, span->len, 1, &lazy->int_array[bit], NULL);
+    else
+        decode_value_text(lazy->text + span->offset, span->len, 0, NULL, &lazy->float_array[bit - WHOOP_LAZY_FLOAT_BIT]);
+    lazy->pending &= ~(1UL << bit);
+    g_lazy_stats.decoded++;
+    g_lazy_stats.decode_us += esp_timer_get_time() - start_us;
+}
+
+static void materialize_lazy_record(whoop_lazy_record_t *lazy)
+{
+    for(int bit = 0; lazy->pending && bit < WHOOP_LAZY_FIELD_COUNT; bit++)
+    {
+        if(lazy->pending & (1UL << bit)) decode_lazy_field(lazy, bit);
+    }
+}
+#endif
+
+/*Record memory is being reused, whatever was pending for it no longer applies*/
+static void drop_lazy_record(whoop_data_handle_t handle)
+{
+#ifdef CONFIG_WHOOP_DATA_LAZY
+    xSemaphoreTake(g_lazy_mutex, portMAX_DELAY);
+    whoop_lazy_record_t *lazy = find_lazy_record(handle);
+    if(lazy)
+    {
+        lazy->handle = NULL;
+        lazy->pending = 0;
+    }
+    xSemaphoreGive(g_lazy_mutex);
+#endif
+}
+
+/*Copies the record and the text of its unread fields, saving to flash never decodes. Returns the blob length*/
+static size_t build_cache_blob(whoop_data_handle_t handle, size_t record_len, whoop_data_cache_blob_t *blob)
+{
+#ifdef CONFIG_WHOOP_DATA_LAZY
+    whoop_lazy_cache_t *cache = (whoop_lazy_cache_t *) (blob->bytes + record_len);
+    size_t blob_len = record_len;
+    // A field decoded by a reader meanwhile is either still pending or already in the copied bytes
+    xSemaphoreTake(g_lazy_mutex, portMAX_DELAY);
+    memcpy(blob->bytes, handle, record_len);
+    whoop_lazy_record_t *lazy = find_lazy_record(handle);
+    if(lazy && lazy->pending)
+    {
+        cache->pending = lazy->pending;
+        cache->text_len = lazy->text_len;
+        cache->int_offset = (unsigned char *) lazy->int_array - (unsigned char *) handle;
+        cache->float_offset = (unsigned char *) lazy->float_array - (unsigned char *) handle;
+        memcpy(cache->spans, lazy->spans, sizeof(cache->spans));
+        memcpy(cache->text, lazy->text, lazy->text_len);
+        blob_len += offsetof(whoop_lazy_cache_t, text) + lazy->text_len;
+    }
+    xSemaphoreGive(g_lazy_mutex);
+    return blob_len;
+#else
+    memcpy(blob->bytes, handle, record_len);
+    return record_len;
+#endif
+}
+
+static int is_cache_blob_valid(size_t record_len, const whoop_data_cache_blob_t *blob, size_t blob_len)
+{
+    if(blob_len == record_len)
+        return 1;
+#ifdef CONFIG_WHOOP_DATA_LAZY
+    const whoop_lazy_cache_t *cache = (const whoop_lazy_cache_t *) (blob->bytes + record_len);
+    if(blob_len < record_len + offsetof(whoop_lazy_cache_t, text) || cache->text_len > WHOOP_LAZY_TEXT_LEN
+        || blob_len != record_len + offsetof(whoop_lazy_cache_t, text) + cache->text_len)
+        return 0;
+    for(int bit = 0; bit < WHOOP_LAZY_FIELD_COUNT; bit++)
+    {
+        if(!(cache->pending & (1UL << bit))) continue;
+        size_t field_end = bit < WHOOP_LAZY_FLOAT_BIT ? cache->int_offset + (bit + 1) * sizeof(int)
+            : cache->float_offset + (bit - WHOOP_LAZY_FLOAT_BIT + 1) * sizeof(float);
+        if(field_end > record_len || cache->spans[bit].offset + cache->spans[bit].len > cache->text_len)
+            return 0;
+    }
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+/*Unread fields come back as text and are decoded on first read, same as before the restart*/
+static void restore_cache_blob(whoop_data_handle_t handle, size_t record_len, const whoop_data_cache_blob_t *blob, size_t blob_len)
+{
+    memcpy(handle, blob->bytes, record_len);
+#ifdef CONFIG_WHOOP_DATA_LAZY
+    const whoop_lazy_cache_t *cache = (const whoop_lazy_cache_t *) (blob->bytes + record_len);
+    if(blob_len == record_len)
+        return;
+    begin_whoop_data_lazy(handle);
+    xSemaphoreTake(g_lazy_mutex, portMAX_DELAY);
+    whoop_lazy_record_t *lazy = find_lazy_record(handle);
+    lazy->int_array = (int *) ((unsigned char *) handle + cache->int_offset);
+    lazy->float_array = (float *) ((unsigned char *) handle + cache->float_offset);
+    lazy->pending = cache->pending;
+    lazy->text_len = cache->text_len;
+    memcpy(lazy->spans, cache->spans, sizeof(lazy->spans));
+    memcpy(lazy->text, cache->text, cache->text_len);
+    xSemaphoreGive(g_lazy_mutex);
+#endif
+}
+
+static whoop_data_type_n get_whoop_data_opt_type(whoop_data_opt_n whoop_data_opt)
+{
+    switch(whoop_data_opt & 0xf000)
+    {
+        case 0x1000:
+            return WHOOP_DATA_TYPE_SLEEP;
+        case 0x2000:
+            return WHOOP_DATA_TYPE_CYCLE;
+        case 0x4000:
+            return WHOOP_DATA_TYPE_WORKOUT;
+        default:
+            return WHOOP_DATA_TYPE_RECOVERY;
+    }
+}
+
+/*Every change to a type's records, for any account, moves its version and the overall generation on*/
+static void bump_whoop_data_version(whoop_data_type_n type)
+{
+    g_whoop_data_versions[type]++;
+    g_whoop_data_generation++;
+}
+
+static whoop_data_handle_t get_most_recent_record(int account, whoop_data_type_n type, size_t *size_out)
+{
+    switch(type)
+    {
+        case WHOOP_DATA_TYPE_SLEEP:
+            *size_out = sizeof(whoop_sleep_data_t);
+            return g_most_recent_sleep[account];
+        case WHOOP_DATA_TYPE_WORKOUT:
+            *size_out = sizeof(whoop_workout_data_t);
+            return g_most_recent_workout[account];
+        case WHOOP_DATA_TYPE_RECOVERY:
+            *size_out = sizeof(whoop_recovery_data_t);
+            return g_most_recent_recovery[account];
+        case WHOOP_DATA_TYPE_CYCLE:
+            *size_out = sizeof(whoop_cycle_data_t);
+            return g_most_recent_cycle[account];
+        default:
+            return NULL;
+    }
+}
+
+static int create_whoop_record(int account, whoop_data_type_n type, whoop_data_handle_t *handle)
+{
+    switch(type)
+    {
+        case WHOOP_DATA_TYPE_SLEEP:
+            return create_whoop_sleep_data(account, 0, handle);
+        case WHOOP_DATA_TYPE_WORKOUT:
+            return create_whoop_workout_data(account, 0, handle);
+        case WHOOP_DATA_TYPE_RECOVERY:
+            return create_whoop_recovery_data(account, 0, 0, handle);
+        case WHOOP_DATA_TYPE_CYCLE:
+            return create_whoop_cycle_data(account, 0, handle);
+        default:
+            return WHOOP_DATA_STATUS_INVALID_OPTION;
+    }
+}
+
+static int get_record_count(int account, whoop_data_type_n type)
+{
+    switch(type)
+    {
+        case WHOOP_DATA_TYPE_SLEEP:
+            return g_sleep_data_record_count[account];
+        case WHOOP_DATA_TYPE_WORKOUT:
+            return g_workout_data_record_count[account];
+        case WHOOP_DATA_TYPE_RECOVERY:
+            return g_recovery_data_record_count[account];
+        case WHOOP_DATA_TYPE_CYCLE:
+            return g_cycle_data_record_count[account];
+        default:
+            return 0;
+    }
+}
+
+/*Slot the record with this sequence number was written to, the caller checks it has not been reused*/
+static whoop_data_handle_t get_record_by_sequence(int account, whoop_data_type_n type, int sequence)
+{
+    int slot = sequence % MAX_NUMBER_RECORDINGS;
+    switch(type)
+    {
+        case WHOOP_DATA_TYPE_SLEEP:
+            return (whoop_data_handle_t) g_whoop_data[account].sleep_list[slot];
+        case WHOOP_DATA_TYPE_WORKOUT:
+            return (whoop_data_handle_t) g_whoop_data[account].workout_list[slot];
+        case WHOOP_DATA_TYPE_RECOVERY:
+            return (whoop_data_handle_t) g_whoop_data[account].recovery_list[slot];
+        case WHOOP_DATA_TYPE_CYCLE:
+            return (whoop_data_handle_t) g_whoop_data[account].cycle_list[slot];
+        default:
+            return NULL;
+    }
+}
+
+static void get_cache_key(char *key, size_t key_len, int account, whoop_data_type_n type)
+{
+    snprintf(key, key_len, "a%d_%s", account, g_whoop_data_type_names[type]);
+}
+
 // Global functions
 int init_whoop_data(void)
 {
-    for(int index = 0; index < MAX_NUMBER_RECORDINGS; index++)
+    for(int account = 0; account < WHOOP_ACCOUNT_COUNT; account++)
     {
-        g_sleep_data_ptr_list[index] =  &g_sleep_data_list[index];
-        g_cycle_data_ptr_list[index] = &g_cycle_data_list[index];
-        g_workout_data_ptr_list[index] = &g_workout_data_list[index];
-        g_recovery_data_ptr_list[index] = &g_recovery_data_list[index];
+        for(int index = 0; index < MAX_NUMBER_RECORDINGS; index++)
+        {
+            g_sleep_data_ptr_list[account][index] =  &g_sleep_data_list[account][index];
+            g_cycle_data_ptr_list[account][index] = &g_cycle_data_list[account][index];
+            g_workout_data_ptr_list[account][index] = &g_workout_data_list[account][index];
+            g_recovery_data_ptr_list[account][index] = &g_recovery_data_list[account][index];
+        }
+        g_whoop_data[account].recovery_list = g_recovery_data_ptr_list[account];
+        g_whoop_data[account].sleep_list = g_sleep_data_ptr_list[account];
+        g_whoop_data[account].cycle_list = g_cycle_data_ptr_list[account];
+        g_whoop_data[account].workout_list = g_workout_data_ptr_list[account];
     }
-    g_whoop_data.recovery_list = g_recovery_data_ptr_list;
-    g_whoop_data.sleep_list = g_sleep_data_ptr_list;
-    g_whoop_data.cycle_list = g_cycle_data_ptr_list;
-    g_whoop_data.workout_list = g_workout_data_ptr_list;
+#ifdef CONFIG_WHOOP_DATA_LAZY
+    g_lazy_mutex = xSemaphoreCreateMutex();
+#endif
     return WHOOP_DATA_STATUS_OK;
 }
 int discard_whoop_data(void)
 {   
     int index;
-    for(index = 0; index < MAX_NUMBER_RECORDINGS; index++)  discard_cycle_data(g_whoop_data.cycle_list[index]);
-    for(index = 0; index < MAX_NUMBER_RECORDINGS; index++)  discard_recovery_data(g_whoop_data.recovery_list[index]);    
-    for(index = 0; index < MAX_NUMBER_RECORDINGS; index++)  discard_sleep_data(g_whoop_data.sleep_list[index]);    
-    for(index = 0; index < MAX_NUMBER_RECORDINGS; index++)  discard_workout_data(g_whoop_data.workout_list[index]); 
+    for(int account = 0; account < WHOOP_ACCOUNT_COUNT; account++)
+    {
+        for(index = 0; index < MAX_NUMBER_RECORDINGS; index++)  discard_cycle_data(g_whoop_data[account].cycle_list[index]);
+        for(index = 0; index < MAX_NUMBER_RECORDINGS; index++)  discard_recovery_data(g_whoop_data[account].recovery_list[index]);    
+        for(index = 0; index < MAX_NUMBER_RECORDINGS; index++)  discard_sleep_data(g_whoop_data[account].sleep_list[index]);    
+        for(index = 0; index < MAX_NUMBER_RECORDINGS; index++)  discard_workout_data(g_whoop_data[account].workout_list[index]); 
+    }
     return WHOOP_DATA_STATUS_OK;      
 }
 
+size_t get_whoop_data_account_size(void)
+{
+    return sizeof(g_sleep_data_list[0]) + sizeof(g_cycle_data_list[0]) + sizeof(g_workout_data_list[0]) + sizeof(g_recovery_data_list[0])
+        + sizeof(g_sleep_data_ptr_list[0]) + sizeof(g_cycle_data_ptr_list[0]) + sizeof(g_workout_data_ptr_list[0]) + sizeof(g_recovery_data_ptr_list[0])
+        + 4 * sizeof(int) + 4 * sizeof(whoop_data_handle_t) + sizeof(whoop_data_t);
+}
+
+int restore_whoop_data(void)
+{
+    char key[16];
+    whoop_data_handle_t handle = NULL;
+    whoop_data_cache_blob_t cached;
+    size_t cached_len;
+    size_t record_len;
+    int restored = 0;
+    if(nvs_open(WHOOP_DATA_CACHE_NAMESPACE, NVS_READWRITE, &g_whoop_data_cache_handle))
+    {
+        ESP_LOGI(TAG, "Could not open NVS namespace %s.", WHOOP_DATA_CACHE_NAMESPACE);
+        g_whoop_data_cache_handle = 0;
+        return WHOOP_DATA_STATUS_NO_RECORDINGS;
+    }
+    for(int account = 0; account < WHOOP_ACCOUNT_COUNT; account++)
+    {
+        for(int type = 0; type < WHOOP_DATA_TYPE_MAX; type++)
+        {
+            get_cache_key(key, sizeof(key), account, type);
+            cached_len = sizeof(cached);
+            if(nvs_get_blob(g_whoop_data_cache_handle, key, &cached, &cached_len) != ESP_OK) continue;
+            get_most_recent_record(account, type, &record_len);
+            if(!is_cache_blob_valid(record_len, &cached, cached_len))
+            {
+                // Left over from a build with a different record layout
+                ESP_LOGI(TAG, "Discarding cached %s", key);
+                continue;
+            }
+            if(create_whoop_record(account, type, &handle)) continue;
+            restore_cache_blob(handle, record_len, &cached, cached_len);
+            g_whoop_data_stale[account][type] = 1;
+            restored++;
+        }
+    }
+    for(int type = 0; type < WHOOP_DATA_TYPE_MAX; type++)
+        bump_whoop_data_version(type);
+    ESP_LOGI(TAG, "Restored %d cached records", restored);
+    return restored ? WHOOP_DATA_STATUS_OK : WHOOP_DATA_STATUS_NO_RECORDINGS;
+}
+
+int save_whoop_data_record(int account, whoop_data_type_n type)
+{
+    char key[16];
+    whoop_data_cache_blob_t cached;
+    whoop_data_cache_blob_t blob;
+    size_t cached_len = sizeof(cached);
+    size_t blob_len;
+    size_t record_len = 0;
+    whoop_data_handle_t handle;
+    if(!IS_VALID_ACCOUNT(account))
+        return WHOOP_DATA_STATUS_INVALID_ACCOUNT;
+    if(type < 0 || type >= WHOOP_DATA_TYPE_MAX)
+        return WHOOP_DATA_STATUS_INVALID_OPTION;
+    if(!(handle = get_most_recent_record(account, type, &record_len)))
+        return WHOOP_DATA_STATUS_NO_RECORDINGS;
+    if(g_whoop_data_stale[account][type])
+    {
+        g_whoop_data_stale[account][type] = 0;
+        bump_whoop_data_version(type);
+    }
+    if(!g_whoop_data_cache_handle)
+        return WHOOP_DATA_STATUS_OK;
+
+    // Polls mostly return the record already cached, only write flash when it changed
+    get_cache_key(key, sizeof(key), account, type);
+    blob_len = build_cache_blob(handle, record_len, &blob);
+    if(nvs_get_blob(g_whoop_data_cache_handle, key, &cached, &cached_len) == ESP_OK
+        && cached_len == blob_len && !memcmp(&cached, &blob, blob_len))
+        return WHOOP_DATA_STATUS_OK;
+    if(nvs_set_blob(g_whoop_data_cache_handle, key, &blob, blob_len) || nvs_commit(g_whoop_data_cache_handle))
+    {
+        ESP_LOGI(TAG, "Could not cache %s", key);
+    }
+    return WHOOP_DATA_STATUS_OK;
+}
+
+int is_whoop_data_stale(int account, whoop_data_type_n type)
+{
+    if(!IS_VALID_ACCOUNT(account) || type < 0 || type >= WHOOP_DATA_TYPE_MAX)
+        return 0;
+    return g_whoop_data_stale[account][type];
+}
+
 /*Sleep ID or 0 for most recent*/
-int get_whoop_sleep_handle_by_id(int id, whoop_data_handle_t *handle)
+int get_whoop_sleep_handle_by_id(int account, int id, whoop_data_handle_t *handle)
 {
-    if(g_most_recent_sleep == NULL)
+    if(!IS_VALID_ACCOUNT(account))
+        return WHOOP_DATA_STATUS_INVALID_ACCOUNT;
+    if(g_most_recent_sleep[account] == NULL)
         return WHOOP_DATA_STATUS_NO_RECORDINGS;
     if(id == 0)
     {
-        *handle = g_most_recent_sleep;
+        *handle = g_most_recent_sleep[account];
         return WHOOP_DATA_STATUS_OK;
     }
-    int count = MIN(g_sleep_data_record_count, MAX_NUMBER_RECORDINGS);
+    int count = MIN(g_sleep_data_record_count[account], MAX_NUMBER_RECORDINGS);
     for(int index = 0; index < count; index++)
     {
-        if(g_whoop_data.sleep_list[index]->sleep_ints.id == id)
+        if(g_whoop_data[account].sleep_list[index]->sleep_ints.id == id)
         {
-            *handle = (whoop_data_handle_t) g_whoop_data.sleep_list[index];
+            *handle = (whoop_data_handle_t) g_whoop_data[account].sleep_list[index];
             return WHOOP_DATA_STATUS_OK;
         }
     }
     return WHOOP_DATA_STATUS_ID_NOT_FOUND;
 }
 
-int create_whoop_sleep_data(int id, whoop_data_handle_t *handle)
+int create_whoop_sleep_data(int account, int id, whoop_data_handle_t *handle)
 {
-    whoop_sleep_data_t *sleep_to_write = g_whoop_data.sleep_list[g_sleep_data_record_count % MAX_NUMBER_RECORDINGS];
+    if(!IS_VALID_ACCOUNT(account))
+        return WHOOP_DATA_STATUS_INVALID_ACCOUNT;
+    whoop_sleep_data_t *sleep_to_write = g_whoop_data[account].sleep_list[g_sleep_data_record_count[account] % MAX_NUMBER_RECORDINGS];
     memset( sleep_to_write, 0, sizeof(whoop_sleep_data_t) );
+    drop_lazy_record((whoop_data_handle_t) sleep_to_write);
     sleep_to_write->sleep_ints.id = id;
-    g_sleep_data_record_count++;
-    g_most_recent_sleep = (whoop_data_handle_t) sleep_to_write;
-    if(handle) *handle = g_most_recent_sleep;
+    g_sleep_data_record_count[account]++;
+    g_most_recent_sleep[account] = (whoop_data_handle_t) sleep_to_write;
+    if(handle) *handle = g_most_recent_sleep[account];
     return WHOOP_DATA_STATUS_OK;
 }
 
 /*sleep ID or 0 for most recent*/
-int get_whoop_cycle_handle_by_id(int id, whoop_data_handle_t *handle)
+int get_whoop_cycle_handle_by_id(int account, int id, whoop_data_handle_t *handle)
 {
-    if(g_most_recent_cycle == NULL)
+    if(!IS_VALID_ACCOUNT(account))
+        return WHOOP_DATA_STATUS_INVALID_ACCOUNT;
+    if(g_most_recent_cycle[account] == NULL)
         return WHOOP_DATA_STATUS_NO_RECORDINGS;
     if(id == 0)
     {
-        *handle = g_most_recent_cycle;
+        *handle = g_most_recent_cycle[account];
         return WHOOP_DATA_STATUS_OK;
     }
-    int count = MIN(g_cycle_data_record_count, MAX_NUMBER_RECORDINGS);
+    int count = MIN(g_cycle_data_record_count[account], MAX_NUMBER_RECORDINGS);
     for(int index = 0; index < count; index++)
     {
-        if(g_whoop_data.cycle_list[index]->cycle_ints.id == id)
+        if(g_whoop_data[account].cycle_list[index]->cycle_ints.id == id)
         {
-            *handle = (whoop_data_handle_t) g_whoop_data.cycle_list[index];
+            *handle = (whoop_data_handle_t) g_whoop_data[account].cycle_list[index];
             return WHOOP_DATA_STATUS_OK;
         }
     }
     return WHOOP_DATA_STATUS_ID_NOT_FOUND;
 }
-int create_whoop_cycle_data(int id, whoop_data_handle_t *handle)
+int create_whoop_cycle_data(int account, int id, whoop_data_handle_t *handle)
 {
-    whoop_cycle_data_t *cycle_to_write = g_whoop_data.cycle_list[g_cycle_data_record_count % MAX_NUMBER_RECORDINGS];
+    if(!IS_VALID_ACCOUNT(account))
+        return WHOOP_DATA_STATUS_INVALID_ACCOUNT;
+    whoop_cycle_data_t *cycle_to_write = g_whoop_data[account].cycle_list[g_cycle_data_record_count[account] % MAX_NUMBER_RECORDINGS];
     memset( cycle_to_write, 0, sizeof(whoop_cycle_data_t) );
+    drop_lazy_record((whoop_data_handle_t) cycle_to_write);
     cycle_to_write->cycle_ints.id = id;
-    g_cycle_data_record_count++;
-    g_most_recent_cycle = (whoop_data_handle_t) cycle_to_write;
-    if(handle) *handle = g_most_recent_cycle;
+    g_cycle_data_record_count[account]++;
+    g_most_recent_cycle[account] = (whoop_data_handle_t) cycle_to_write;
+    if(handle) *handle = g_most_recent_cycle[account];
     return WHOOP_DATA_STATUS_OK;
 }
 
 /*Workout ID or 0 for most recent*/
-int get_whoop_workout_handle_by_id(int id, whoop_data_handle_t *handle)
+int get_whoop_workout_handle_by_id(int account, int id, whoop_data_handle_t *handle)
 {
-    if(g_most_recent_workout == NULL)
+    if(!IS_VALID_ACCOUNT(account))
+        return WHOOP_DATA_STATUS_INVALID_ACCOUNT;
+    if(g_most_recent_workout[account] == NULL)
         return WHOOP_DATA_STATUS_NO_RECORDINGS;
     if(id == 0)
     {
-        *handle = g_most_recent_workout;
+        *handle = g_most_recent_workout[account];
         return WHOOP_DATA_STATUS_OK;
     }
-    int count = MIN(g_workout_data_record_count, MAX_NUMBER_RECORDINGS);
+    int count = MIN(g_workout_data_record_count[account], MAX_NUMBER_RECORDINGS);
     for(int index = 0; index < count; index++)
     {
-        if(g_whoop_data.workout_list[index]->workout_ints.id == id)
+        if(g_whoop_data[account].workout_list[index]->workout_ints.id == id)
         {
-            *handle = (whoop_data_handle_t) g_whoop_data.workout_list[index];
+            *handle = (whoop_data_handle_t) g_whoop_data[account].workout_list[index];
             return WHOOP_DATA_STATUS_OK;
         }
     }
     return WHOOP_DATA_STATUS_ID_NOT_FOUND;
 }
-int create_whoop_workout_data(int id, whoop_data_handle_t *handle)
+int create_whoop_workout_data(int account, int id, whoop_data_handle_t *handle)
 {
-    whoop_workout_data_t *workout_to_write = g_whoop_data.workout_list[g_workout_data_record_count % MAX_NUMBER_RECORDINGS];
+    if(!IS_VALID_ACCOUNT(account))
+        return WHOOP_DATA_STATUS_INVALID_ACCOUNT;
+    whoop_workout_data_t *workout_to_write = g_whoop_data[account].workout_list[g_workout_data_record_count[account] % MAX_NUMBER_RECORDINGS];
     memset( workout_to_write, 0, sizeof(whoop_workout_data_t) );
+    drop_lazy_record((whoop_data_handle_t) workout_to_write);
     workout_to_write->workout_ints.id = id;
-    g_workout_data_record_count++;
-    g_most_recent_workout = (whoop_data_handle_t) workout_to_write;
-    if(handle) *handle = g_most_recent_workout;
+    g_workout_data_record_count[account]++;
+    g_most_recent_workout[account] = (whoop_data_handle_t) workout_to_write;
+    if(handle) *handle = g_most_recent_workout[account];
     return WHOOP_DATA_STATUS_OK;
 }
 
 /*ID can be either sleep or sleep id related to recovery or 0 for most recent*/
-int get_whoop_recovery_handle_by_id(int id, whoop_data_handle_t *handle)
+int get_whoop_recovery_handle_by_id(int account, int id, whoop_data_handle_t *handle)
 {
-    if(g_most_recent_recovery == NULL)
+    if(!IS_VALID_ACCOUNT(account))
+        return WHOOP_DATA_STATUS_INVALID_ACCOUNT;
+    if(g_most_recent_recovery[account] == NULL)
         return WHOOP_DATA_STATUS_NO_RECORDINGS;
     if(id == 0)
     {
-        *handle = g_most_recent_recovery;
+        *handle = g_most_recent_recovery[account];
         return WHOOP_DATA_STATUS_OK;
     }
-    int count = MIN(g_recovery_data_record_count, MAX_NUMBER_RECORDINGS);
+    int count = MIN(g_recovery_data_record_count[account], MAX_NUMBER_RECORDINGS);
     for(int index = 0; index < count; index++)
     {
-        if(g_whoop_data.recovery_list[index]->recovery_ints.sleep_id == id 
-            || g_whoop_data.recovery_list[index]->recovery_ints.cycle_id == id)
+        if(g_whoop_data[account].recovery_list[index]->recovery_ints.sleep_id == id 
+            || g_whoop_data[account].recovery_list[index]->recovery_ints.cycle_id == id)
         {
-            *handle = (whoop_data_handle_t) g_whoop_data.recovery_list[index];
+            *handle = (whoop_data_handle_t) g_whoop_data[account].recovery_list[index];
             return WHOOP_DATA_STATUS_OK;
         }
     }
     return WHOOP_DATA_STATUS_ID_NOT_FOUND;
 }
-int create_whoop_recovery_data(int sleep_id, int cycle_id, whoop_data_handle_t *handle)
+int create_whoop_recovery_data(int account, int sleep_id, int cycle_id, whoop_data_handle_t *handle)
 {
-    whoop_recovery_data_t *recovery_to_write = g_whoop_data.recovery_list[g_recovery_data_record_count % MAX_NUMBER_RECORDINGS];
+    if(!IS_VALID_ACCOUNT(account))
+        return WHOOP_DATA_STATUS_INVALID_ACCOUNT;
+    whoop_recovery_data_t *recovery_to_write = g_whoop_data[account].recovery_list[g_recovery_data_record_count[account] % MAX_NUMBER_RECORDINGS];
     memset( recovery_to_write, 0, sizeof(whoop_recovery_data_t) );
+    drop_lazy_record((whoop_data_handle_t) recovery_to_write);
     recovery_to_write->recovery_ints.sleep_id = sleep_id;
     recovery_to_write->recovery_ints.cycle_id = cycle_id;
-    g_recovery_data_record_count++;
-    g_most_recent_recovery = (whoop_data_handle_t) recovery_to_write;
-    if(handle) *handle = g_most_recent_recovery;
+    g_recovery_data_record_count[account]++;
+    g_most_recent_recovery[account] = (whoop_data_handle_t) recovery_to_write;
+    if(handle) *handle = g_most_recent_recovery[account];
     return WHOOP_DATA_STATUS_OK;
 }
 
@@ -387,9 +892,155 @@ int set_whoop_data(whoop_data_handle_t handle, whoop_data_opt_n whoop_data_opt,
         *(float_array_ptr + data_array_offset) = data_value;
     }
     va_end (argptr);
+#ifdef CONFIG_WHOOP_DATA_LAZY
+    // A value set directly wins over text still waiting to be decoded
+    xSemaphoreTake(g_lazy_mutex, portMAX_DELAY);
+    whoop_lazy_record_t *lazy = find_lazy_record(handle);
+    if(lazy)
+        lazy->pending &= ~(1UL << (data_is_int ? data_array_offset : WHOOP_LAZY_FLOAT_BIT + data_array_offset));
+    xSemaphoreGive(g_lazy_mutex);
+#endif
+    bump_whoop_data_version(get_whoop_data_opt_type(whoop_data_opt));
     return WHOOP_DATA_STATUS_OK;
 }
 
+int begin_whoop_data_lazy(whoop_data_handle_t handle)
+{
+#ifdef CONFIG_WHOOP_DATA_LAZY
+    xSemaphoreTake(g_lazy_mutex, portMAX_DELAY);
+    whoop_lazy_record_t *lazy = find_lazy_record(handle);
+    if(!lazy)
+    {
+        lazy = &g_lazy_records[g_lazy_next_record];
+        g_lazy_next_record = (g_lazy_next_record + 1) % WHOOP_LAZY_RECORD_COUNT;
+    }
+    // Evicted records and fields missing from the new response keep their decoded values
+    materialize_lazy_record(lazy);
+    lazy->handle = handle;
+    lazy->pending = 0;
+    lazy->text_len = 0;
+    xSemaphoreGive(g_lazy_mutex);
+#endif
+    return WHOOP_DATA_STATUS_OK;
+}
+
+int set_whoop_data_lazy(whoop_data_handle_t handle, whoop_data_opt_n whoop_data_opt, const char *text, size_t text_len)
+{
+    int *int_array_ptr = NULL;
+    float *float_array_ptr = NULL;
+    int data_is_int = 0;
+    int data_array_offset = 0;
+    if(deconstruct_whoop_data_opt(handle, whoop_data_opt, &int_array_ptr, &float_array_ptr, &data_is_int, &data_array_offset))
+    {
+        ESP_LOGI(TAG, "Invalid Data Option: %x ", whoop_data_opt);
+        return WHOOP_DATA_STATUS_INVALID_OPTION;
+    }
+#ifdef CONFIG_WHOOP_DATA_LAZY
+    int bit = data_is_int ? data_array_offset : WHOOP_LAZY_FLOAT_BIT + data_array_offset;
+    xSemaphoreTake(g_lazy_mutex, portMAX_DELAY);
+    whoop_lazy_record_t *lazy = find_lazy_record(handle);
+    if(lazy && text_len < WHOOP_DATA_VALUE_TEXT_LEN && lazy->text_len + text_len <= WHOOP_LAZY_TEXT_LEN)
+    {
+        memcpy(lazy->text + lazy->text_len, text, text_len);
+        lazy->spans[bit].offset = lazy->text_len;
+        lazy->spans[bit].len = text_len;
+        lazy->text_len += text_len;
+        lazy->int_array = int_array_ptr;
+        lazy->float_array = float_array_ptr;
+        lazy->pending |= 1UL << bit;
+        g_lazy_stats.deferred++;
+        xSemaphoreGive(g_lazy_mutex);
+        bump_whoop_data_version(get_whoop_data_opt_type(whoop_data_opt));
+        return WHOOP_DATA_STATUS_OK;
+    }
+    xSemaphoreGive(g_lazy_mutex);
+#endif
+    decode_value_text(text, text_len, data_is_int, int_array_ptr + data_array_offset, float_array_ptr + data_array_offset);
+    bump_whoop_data_version(get_whoop_data_opt_type(whoop_data_opt));
+    return WHOOP_DATA_STATUS_OK;
+}
+
+int materialize_whoop_data(whoop_data_handle_t handle)
+{
+#ifdef CONFIG_WHOOP_DATA_LAZY
+    xSemaphoreTake(g_lazy_mutex, portMAX_DELAY);
+    whoop_lazy_record_t *lazy = find_lazy_record(handle);
+    if(lazy) materialize_lazy_record(lazy);
+    xSemaphoreGive(g_lazy_mutex);
+#endif
+    return WHOOP_DATA_STATUS_OK;
+}
+
+void get_whoop_data_lazy_stats(whoop_data_lazy_stats_t *stats_out)
+{
+    *stats_out = g_lazy_stats;
+}
+
+const whoop_data_field_t *get_whoop_data_fields(whoop_data_type_n type, int *field_count)
+{
+    if(type < 0 || type >= WHOOP_DATA_TYPE_MAX)
+    {
+        *field_count = 0;
+        return NULL;
+    }
+    *field_count = g_whoop_data_field_counts[type];
+    return g_whoop_data_fields[type];
+}
+
+int get_whoop_data_latest_handle(int account, whoop_data_type_n type, whoop_data_handle_t *handle)
+{
+    size_t record_len = 0;
+    if(!IS_VALID_ACCOUNT(account))
+        return WHOOP_DATA_STATUS_INVALID_ACCOUNT;
+    if(type < 0 || type >= WHOOP_DATA_TYPE_MAX)
+        return WHOOP_DATA_STATUS_INVALID_OPTION;
+    if(!(*handle = get_most_recent_record(account, type, &record_len)))
+        return WHOOP_DATA_STATUS_NO_RECORDINGS;
+    return WHOOP_DATA_STATUS_OK;
+}
+
+int begin_whoop_data_iter(int account, whoop_data_type_n type, unsigned int cursor, whoop_data_iter_t *iter)
+{
+    if(!IS_VALID_ACCOUNT(account))
+        return WHOOP_DATA_STATUS_INVALID_ACCOUNT;
+    if(type < 0 || type >= WHOOP_DATA_TYPE_MAX)
+        return WHOOP_DATA_STATUS_INVALID_OPTION;
+    unsigned int count = get_record_count(account, type);
+    iter->account = account;
+    iter->type = type;
+    iter->cursor = (cursor && cursor < count) ? cursor : count;
+    return WHOOP_DATA_STATUS_OK;
+}
+
+int next_whoop_data_iter(whoop_data_iter_t *iter, whoop_data_handle_t *handle)
+{
+    int count = get_record_count(iter->account, iter->type);
+    // Anything older than the ring has been written over since the cursor was handed out
+    if(!iter->cursor || (int) iter->cursor <= count - MAX_NUMBER_RECORDINGS)
+    {
+        iter->cursor = 0;
+        return WHOOP_DATA_STATUS_NO_RECORDINGS;
+    }
+    iter->cursor--;
+    *handle = get_record_by_sequence(iter->account, iter->type, iter->cursor);
+    return WHOOP_DATA_STATUS_OK;
+}
+
+const char *get_whoop_data_type_name(whoop_data_type_n type)
+{
+    return (type >= 0 && type < WHOOP_DATA_TYPE_MAX) ? g_whoop_data_type_names[type] : "unknown";
+}
+
+unsigned int get_whoop_data_generation(void)
+{
+    return g_whoop_data_generation;
+}
+
+unsigned int get_whoop_data_version(whoop_data_type_n type)
+{
+    return (type >= 0 && type < WHOOP_DATA_TYPE_MAX) ? g_whoop_data_versions[type] : 0;
+}
+
 int get_whoop_data(whoop_data_handle_t handle, whoop_data_opt_n whoop_data_opt, void *data_out)
 {
     int *int_array_ptr = NULL;
@@ -398,6 +1049,15 @@ int get_whoop_data(whoop_data_handle_t handle, whoop_data_opt_n whoop_data_opt,
     int data_array_offset = 0;
     if(deconstruct_whoop_data_opt(handle, whoop_data_opt, &int_array_ptr, &float_array_ptr, &data_is_int, &data_array_offset))
         return WHOOP_DATA_STATUS_INVALID_OPTION;
+#ifdef CONFIG_WHOOP_DATA_LAZY
+    // First read of a deferred field decodes it, later reads hit the stored value
+    int bit = data_is_int ? data_array_offset : WHOOP_LAZY_FLOAT_BIT + data_array_offset;
+    xSemaphoreTake(g_lazy_mutex, portMAX_DELAY);
+    whoop_lazy_record_t *lazy = find_lazy_record(handle);
+    if(lazy && (lazy->pending & (1UL << bit)))
+        decode_lazy_field(lazy, bit);
+    xSemaphoreGive(g_lazy_mutex);
+#endif
   
     if(data_is_int)
         *( (int *) data_out ) = *(int_array_ptr + data_array_offset);
@@ -409,6 +1069,7 @@ int get_whoop_data(whoop_data_handle_t handle, whoop_data_opt_n whoop_data_opt,
 
 void print_whoop_cycle_data(whoop_data_handle_t handle)
 {
+    materialize_whoop_data(handle);
     whoop_cycle_data_t *sleep = (whoop_cycle_data_t *) handle;
     ESP_LOGI(TAG, "Cycle ID: %d", sleep->cycle_ints.id);
     if(sleep->cycle_ints.score_state == WHOOP_SCORE_STATE_SCORED)
@@ -426,6 +1087,7 @@ void print_whoop_cycle_data(whoop_data_handle_t handle)
 
 void print_whoop_workout_data(whoop_data_handle_t handle)
 {
+    materialize_whoop_data(handle);
     whoop_workout_data_t *workout = (whoop_workout_data_t *) handle;
     ESP_LOGI(TAG, "Workout ID: %d", workout->workout_ints.id);
     ESP_LOGI(TAG, "\tSport ID: %d", workout->workout_ints.sport_id);
@@ -452,6 +1114,7 @@ void print_whoop_workout_data(whoop_data_handle_t handle)
 
 void print_whoop_sleep_data(whoop_data_handle_t handle)
 {
+    materialize_whoop_data(handle);
     whoop_sleep_data_t *sleep = (whoop_sleep_data_t *) handle;
     ESP_LOGI(TAG, "Sleep ID: %d", sleep->sleep_ints.id);
     if(sleep->sleep_ints.score_state == WHOOP_SCORE_STATE_SCORED)
@@ -483,6 +1146,7 @@ void print_whoop_sleep_data(whoop_data_handle_t handle)
 
 void print_whoop_recovery_data(whoop_data_handle_t handle)
 {
+    materialize_whoop_data(handle);
     whoop_recovery_data_t *recovery = (whoop_recovery_data_t *) handle;
     ESP_LOGI(TAG, "Recovery Sleep ID: %d", recovery->recovery_ints.sleep_id);
     ESP_LOGI(TAG, "Recovery Cycle ID: %d", recovery->recovery_ints.cycle_id);
@@ -0,0 +1,401 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/param.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "whoop_display.h"
+#include "whoop_data.h"
+#include "whoop_events.h"
+#include "gpio_manager.h"
+#include "i2c_led.h"
+
+// Defines
+#define WHOOP_DISPLAY_QUEUE_LEN 4
+#define WHOOP_DISPLAY_TASK_STACK_SIZE 3072
+#define DATA_SELECTION_COUNT 4
+#define WHOOP_DISPLAY_PAGE_COUNT (DATA_SELECTION_COUNT * WHOOP_ACCOUNT_COUNT)
+#define WHOOP_DISPLAY_SPARKLINE_LEN 5       /*Every record the store keeps*/
+#define WHOOP_DISPLAY_MAX_STRAIN 21.0
+
+// Types
+typedef enum current_data_selection
+{
+    DATA_SELECTION_RECOVERY,
+    DATA_SELECTION_SLEEP,
+    DATA_SELECTION_CYCLE,
+    DATA_SELECTION_WORKOUT
+} current_data_selection_t;
+
+typedef enum whoop_display_cmd_type
+{
+    WHOOP_DISPLAY_CMD_PAGE_NEXT,
+    WHOOP_DISPLAY_CMD_REFRESH,
+    WHOOP_DISPLAY_CMD_BACKLIGHT
+} whoop_display_cmd_type_n;
+
+typedef struct whoop_display_cmd
+{
+    whoop_display_cmd_type_n type;
+    int value;
+} whoop_display_cmd_t;
+
+// Local Global Variables
+static const char *TAG = "WHOOP DISPLAY";
+static const char *g_data_selection_text[DATA_SELECTION_COUNT] = {"Selected recovery", "Selected Sleep", "Selected Cycle", "Selected Workout"};
+static QueueHandle_t g_display_queue = NULL;
+static current_data_selection_t g_data_selection = DATA_SELECTION_WORKOUT;
+static int g_account_selection = WHOOP_ACCOUNT_COUNT - 1;
+static int64_t g_first_render_us = 0;
+static int64_t g_first_fresh_render_us = 0;
+static uint32_t g_render_count = 0;
+static uint32_t g_superseded_count = 0;
+static int g_published_page = -1;
+
+// Local functions
+static void recovery_to_led(float recovery_score)
+{
+    int r = 0;
+    int g = 0;
+    int b = 0;
+    if(recovery_score > 67.0)
+    {
+        g = 255;
+    }
+    else if (recovery_score > 34.0)
+    {
+        r = 255;
+        g = 255;
+    }
+    else
+    {
+        r = 255;
+    }
+    set_rgb_led_value(r, g, b);
+}
+
+static void strain_to_led(float strain)
+{
+    int r = 0;
+    int g = 0;
+    int b = 0;
+    if(strain < 10.0)
+    {
+        g = 255;
+    }
+    else if (strain < 14.0)
+    {
+        r = 255;
+        g = 255;
+    }
+    else if (strain < 19.0)
+    {
+        r = 255;
+        g = 127;
+    }
+    else
+    {
+        r = 255;
+    }
+    set_rgb_led_value(r, g, b);
+}
+
+static void sleep_percentage_to_led(float sleep_percentage)
+{
+    int r = 0;
+    int g = 0;
+    int b = 0;
+    if(sleep_percentage > 90.0)
+    {
+        g = 255;
+    }
+    else if (sleep_percentage > 70.0)
+    {
+        r = 255;
+        g = 255;
+    }
+    else
+    {
+        r = 255;
+    }
+    set_rgb_led_value(r, g, b);
+}
+
+/*Title on the first line, tagged with the user number when several accounts share the display and
+  with a '*' while the record is the copy restored from flash*/
+static void print_page_title(const char *title, int account, whoop_data_type_n type)
+{
+    char title_str[17];
+    int stale = is_whoop_data_stale(account, type);
+    if(WHOOP_ACCOUNT_COUNT > 1)
+        snprintf(title_str, sizeof(title_str), "%s U%d%s", title, account + 1, stale ? "*" : "");
+    else
+        snprintf(title_str, sizeof(title_str), "%s%s", title, stale ? "*" : "");
+    i2c_lcd_1602_framePrint(0, 0, title_str, strlen(title_str));
+    // Redraws for new data on the same page are covered by the record events
+    if(g_published_page != account * WHOOP_DATA_TYPE_MAX + (int) type)
+    {
+        g_published_page = account * WHOOP_DATA_TYPE_MAX + (int) type;
+        whoop_events_publish_page(account, type);
+    }
+    if(!stale && !g_first_fresh_render_us)
+    {
+        g_first_fresh_render_us = esp_timer_get_time();
+        ESP_LOGI(TAG, "First fresh render %d ms after boot", (int) (g_first_fresh_render_us / 1000));
+    }
+}
+
+/*One cell per stored record, oldest on the left and right aligned at col. A fixed scale keeps the set of bar
+  heights small, so the glyphs stay resident from one render to the next*/
+static void draw_sparkline(uint8_t col, uint8_t row, int account, whoop_data_type_n type, whoop_data_opt_n opt, float full_scale)
+{
+    float values[WHOOP_DISPLAY_SPARKLINE_LEN];
+    uint8_t glyph[I2C_LCD_1602_GLYPH_ROWS];
+    int count = 0;
+    whoop_data_iter_t iter;
+    whoop_data_handle_t handle = NULL;
+    if(begin_whoop_data_iter(account, type, 0, &iter) != WHOOP_DATA_STATUS_OK)
+        return;
+    while(count < WHOOP_DISPLAY_SPARKLINE_LEN && next_whoop_data_iter(&iter, &handle) == WHOOP_DATA_STATUS_OK)
+    {
+        values[count] = 0.0;
+        get_whoop_data(handle, opt, &values[count]);
+        count++;
+    }
+    for(int index = 0; index < count; index++)
+    {
+        int height = 1 + (int) (values[count - 1 - index] * (I2C_LCD_1602_GLYPH_ROWS - 1) / full_scale + 0.5);
+        height = MAX(1, MIN(I2C_LCD_1602_GLYPH_ROWS, height));
+        for(int glyph_row = 0; glyph_row < I2C_LCD_1602_GLYPH_ROWS; glyph_row++)
+            glyph[glyph_row] = glyph_row >= I2C_LCD_1602_GLYPH_ROWS - height ? 0x0e : 0x00;
+        i2c_lcd_1602_framePutGlyph(col + WHOOP_DISPLAY_SPARKLINE_LEN - count + index, row, glyph);
+    }
+}
+
+/*Horizontal bar five pixels to a cell. Full cells are the ROM's solid block, only the partly filled end cell
+  needs a glyph*/
+static void draw_bar(uint8_t col, uint8_t row, uint8_t cells, float value, float full_scale)
+{
+    uint8_t glyph[I2C_LCD_1602_GLYPH_ROWS];
+    char full_block = (char) I2C_LCD_1602_FULL_BLOCK;
+    int pixels = (int) (value * cells * 5 / full_scale + 0.5);
+    pixels = MAX(0, MIN(cells * 5, pixels));
+    for(int cell = 0; cell < cells; cell++)
+    {
+        int fill = MIN(5, pixels - cell * 5);
+        if(fill == 5)
+        {
+            i2c_lcd_1602_framePrint(col + cell, row, &full_block, 1);
+        }
+        else if(fill > 0)
+        {
+            memset(glyph, (0x1f << (5 - fill)) & 0x1f, sizeof(glyph));
+            i2c_lcd_1602_framePutGlyph(col + cell, row, glyph);
+        }
+    }
+}
+
+/*Sends what changed on the page since the last flush, a new value usually costs a cursor move and a few characters*/
+static void flush_page(void)
+{
+    i2c_lcd_1602_stats_t stats;
+    if(i2c_lcd_1602_frameFlush() != ESP_OK)
+        ESP_LOGI(TAG, "LCD write failed, the next render redraws the page");
+    i2c_lcd_1602_getStats(&stats);
+    ESP_LOGI(TAG, "Frame %u: %u LCD bytes, %u I2C bytes, glyph hit rate %u%%", stats.frames, stats.last_frame_lcd_bytes,
+             stats.last_frame_i2c_bytes, stats.glyph_hits + stats.glyph_misses ? 100 * stats.glyph_hits / (stats.glyph_hits + stats.glyph_misses) : 100);
+}
+
+static whoop_data_handle_t get_page_handle(int account, int data_selection)
+{
+    whoop_data_handle_t handle = NULL;
+    switch(data_selection)
+    {
+        case DATA_SELECTION_RECOVERY:
+            get_whoop_recovery_handle_by_id(account, 0, &handle);
+            break;
+        case DATA_SELECTION_SLEEP:
+            get_whoop_sleep_handle_by_id(account, 0, &handle);
+            break;
+        case DATA_SELECTION_CYCLE:
+            get_whoop_cycle_handle_by_id(account, 0, &handle);
+            break;
+        case DATA_SELECTION_WORKOUT:
+            get_whoop_workout_handle_by_id(account, 0, &handle);
+            break;
+    }
+    return handle;
+}
+
+/*Pages run through every data type of one user before moving on to the next user. Starting at offset 0 keeps the
+  current page when it has data, 1 moves on to the next page that does*/
+static whoop_data_handle_t select_page(int first_offset)
+{
+    whoop_data_handle_t handle = NULL;
+    int account = g_account_selection;
+    int data_selection = g_data_selection;
+    for(int i = first_offset; i < first_offset + WHOOP_DISPLAY_PAGE_COUNT; i++)
+    {
+        int page = (g_account_selection * DATA_SELECTION_COUNT + g_data_selection + i) % WHOOP_DISPLAY_PAGE_COUNT;
+        account = page / DATA_SELECTION_COUNT;
+        data_selection = page % DATA_SELECTION_COUNT;
+        handle = get_page_handle(account, data_selection);
+        if(handle) break;
+    }
+    g_data_selection = data_selection;
+    g_account_selection = account;
+    return handle;
+}
+
+static void render_page(int page_steps)
+{
+    float data_float = 0.0;
+    char data_str[17];
+    whoop_data_handle_t handle = NULL;
+    i2c_lcd_1602_frameClear();
+    g_render_count++;
+    if(!g_first_render_us)
+    {
+        g_first_render_us = esp_timer_get_time();
+        ESP_LOGI(TAG, "First render %d ms after boot", (int) (g_first_render_us / 1000));
+    }
+    handle = select_page(page_steps ? 1 : 0);
+    for(int step = 1; step < page_steps && handle; step++)
+        handle = select_page(1);
+    if(page_steps)
+        ESP_LOGI(TAG, "%s, user %d", g_data_selection_text[g_data_selection], g_account_selection + 1);
+
+    if(!handle)
+    {
+        i2c_lcd_1602_framePrint(0, 0, "No Data!", 8);
+        flush_page();
+        set_rgb_led_value(255, 0, 0);
+        return;
+    }
+    switch(g_data_selection)
+    {
+        case DATA_SELECTION_RECOVERY:
+            get_whoop_data(handle, WHOOP_DATA_OPT_RECOVERY_RECOVERY_SCORE, &data_float);
+            recovery_to_led(data_float);
+            print_page_title("Recovery", g_account_selection, WHOOP_DATA_TYPE_RECOVERY);
+            sprintf(data_str, "Score: %0.0f",data_float);
+            i2c_lcd_1602_framePrint(0, 1, data_str, strlen(data_str));
+            draw_sparkline(I2C_LCD_1602_COLS - WHOOP_DISPLAY_SPARKLINE_LEN, 1, g_account_selection, WHOOP_DATA_TYPE_RECOVERY,
+                           WHOOP_DATA_OPT_RECOVERY_RECOVERY_SCORE, 100.0);
+            break;
+        case DATA_SELECTION_SLEEP:
+            get_whoop_data(handle, WHOOP_DATA_OPT_SLEEP_SLEEP_PERFORMANCE_PERCENTAGE, &data_float);
+            sleep_percentage_to_led(data_float);
+            print_page_title("Sleep", g_account_selection, WHOOP_DATA_TYPE_SLEEP);
+            sprintf(data_str, "Perf: %0.2f%%",data_float);
+            i2c_lcd_1602_framePrint(0, 1, data_str, strlen(data_str));
+            draw_bar(strlen(data_str), 1, I2C_LCD_1602_COLS - strlen(data_str), data_float, 100.0);
+            break;
+        case DATA_SELECTION_CYCLE:
+            get_whoop_data(handle, WHOOP_DATA_OPT_CYCLE_STRAIN, &data_float);
+            strain_to_led(data_float);
+            print_page_title("Cycle", g_account_selection, WHOOP_DATA_TYPE_CYCLE);
+            sprintf(data_str, "Strain: %0.2f",data_float);
+            i2c_lcd_1602_framePrint(0, 1, data_str, strlen(data_str));
+            draw_bar(strlen(data_str), 1, I2C_LCD_1602_COLS - strlen(data_str), data_float, WHOOP_DISPLAY_MAX_STRAIN);
+            break;
+        case DATA_SELECTION_WORKOUT:
+            get_whoop_data(handle, WHOOP_DATA_OPT_WORKOUT_STRAIN, &data_float);
+            strain_to_led(data_float);
+            print_page_title("Workout", g_account_selection, WHOOP_DATA_TYPE_WORKOUT);
+            sprintf(data_str, "Strain: %0.2f",data_float);
+            i2c_lcd_1602_framePrint(0, 1, data_str, strlen(data_str));
+            draw_bar(strlen(data_str), 1, I2C_LCD_1602_COLS - strlen(data_str), data_float, WHOOP_DISPLAY_MAX_STRAIN);
+            break;
+    }
+    flush_page();
+}
+
+/*Everything queued while the last frame was going out is folded into one render: page changes add up, and a value
+  update only asks for the latest data which any render reads anyway*/
+static void whoop_display_task(void *arg)
+{
+    whoop_display_cmd_t cmd;
+    // The LCD's init waits and the first page run here rather than holding up app_main
+    i2c_lcd_1602_init();
+    render_page(1);
+    for(;;)
+    {
+        int page_steps = 0;
+        int render = 0;
+        int received = 0;
+        int backlight = -1;
+        if(xQueueReceive(g_display_queue, &cmd, portMAX_DELAY) != pdTRUE) continue;
+        do
+        {
+            received++;
+            switch(cmd.type)
+            {
+                case WHOOP_DISPLAY_CMD_PAGE_NEXT:
+                    page_steps++;
+                    render = 1;
+                    break;
+                case WHOOP_DISPLAY_CMD_REFRESH:
+                    render = 1;
+                    break;
+                case WHOOP_DISPLAY_CMD_BACKLIGHT:
+                    backlight = cmd.value;
+                    break;
+            }
+        } while(xQueueReceive(g_display_queue, &cmd, 0) == pdTRUE);
+        if(backlight == 0)
+            i2c_lcd_1602_noBacklight();
+        else if(backlight > 0)
+            i2c_lcd_1602_backlight();
+        g_superseded_count += received - 1;
+        if(render)
+            render_page(page_steps);
+    }
+}
+
+static int post_command(whoop_display_cmd_type_n type, int value)
+{
+    whoop_display_cmd_t cmd = { .type = type, .value = value };
+    if(!g_display_queue || xQueueSend(g_display_queue, &cmd, 0) != pdTRUE)
+        return -1;
+    return 0;
+}
+
+//Public functions
+int init_whoop_display(void)
+{
+    g_display_queue = xQueueCreate(WHOOP_DISPLAY_QUEUE_LEN, sizeof(whoop_display_cmd_t));
+    if(!g_display_queue)
+        return -1;
+    if(xTaskCreate(whoop_display_task, "whoop_display", WHOOP_DISPLAY_TASK_STACK_SIZE, NULL, tskIDLE_PRIORITY + 1, NULL) != pdPASS)
+        return -1;
+    return 0;
+}
+
+int whoop_display_next_page(void)
+{
+    return post_command(WHOOP_DISPLAY_CMD_PAGE_NEXT, 0);
+}
+
+int whoop_display_refresh(void)
+{
+    return post_command(WHOOP_DISPLAY_CMD_REFRESH, 0);
+}
+
+int whoop_display_set_backlight(int on)
+{
+    return post_command(WHOOP_DISPLAY_CMD_BACKLIGHT, on ? 1 : 0);
+}
+
+uint32_t whoop_display_get_render_count(void)
+{
+    return g_render_count;
+}
+
+uint32_t whoop_display_get_superseded_count(void)
+{
+    return g_superseded_count;
+}
\ No newline at end of file
@@ -0,0 +1,347 @@
+#include <string.h>
+
+#include "whoop_encode.h"
+
+// Defines
+#define CBOR_MAJOR_UINT         0
+#define CBOR_MAJOR_NEGINT       1
+#define CBOR_MAJOR_TEXT         3
+#define CBOR_ARRAY_BEGIN        0x9f
+#define CBOR_MAP_BEGIN          0xbf
+#define CBOR_FALSE              0xf4
+#define CBOR_TRUE               0xf5
+#define CBOR_NULL               0xf6
+#define CBOR_FLOAT32            0xfa
+#define CBOR_BREAK              0xff
+#define JSON_FLOAT_SCALE        1000        /*Three decimals*/
+#define JSON_FLOAT_LIMIT        4e15f       /*Scaled magnitude still exact in 64 bits*/
+
+// Local Global Variables
+static const char *g_format_names[WHOOP_ENCODE_FORMAT_MAX] = {"json", "cbor"};
+static const char *g_content_types[WHOOP_ENCODE_FORMAT_MAX] = {"application/json", "application/cbor"};
+static const char g_hex_digits[] = "0123456789abcdef";
+
+// Local functions
+static void flush_buffer(whoop_encoder_t *encoder)
+{
+    if(encoder->len && !encoder->err)
+        encoder->err = encoder->flush(encoder->ctx, encoder->buffer, encoder->len);
+    encoder->len = 0;
+}
+
+static void put(whoop_encoder_t *encoder, const void *data, size_t len)
+{
+    if(encoder->len + len > sizeof(encoder->buffer))
+    {
+        flush_buffer(encoder);
+        // Too long to ever fit, goes out as it is
+        if(len > sizeof(encoder->buffer))
+        {
+            if(!encoder->err)
+                encoder->err = encoder->flush(encoder->ctx, data, len);
+            return;
+        }
+    }
+    memcpy(encoder->buffer + encoder->len, data, len);
+    encoder->len += len;
+}
+
+static void put_byte(whoop_encoder_t *encoder, uint8_t byte)
+{
+    put(encoder, &byte, 1);
+}
+
+/*Comma between the items of a JSON container, nothing between a key and its value*/
+static void begin_item(whoop_encoder_t *encoder)
+{
+    uint16_t bit = 1U << encoder->depth;
+    if(encoder->after_key)
+    {
+        encoder->after_key = 0;
+        return;
+    }
+    if(encoder->format == WHOOP_ENCODE_FORMAT_JSON && (encoder->has_items & bit))
+        put_byte(encoder, ',');
+    encoder->has_items |= bit;
+}
+
+static void put_cbor_head(whoop_encoder_t *encoder, int major, uint32_t value)
+{
+    uint8_t head[5];
+    size_t len;
+    if(value < 24)
+    {
+        head[0] = (major << 5) | value;
+        len = 1;
+    }
+    else if(value <= 0xff)
+    {
+        head[0] = (major << 5) | 24;
+        head[1] = value;
+        len = 2;
+    }
+    else if(value <= 0xffff)
+    {
+        head[0] = (major << 5) | 25;
+        head[1] = value >> 8;
+        head[2] = value;
+        len = 3;
+    }
+    else
+    {
+        head[0] = (major << 5) | 26;
+        head[1] = value >> 24;
+        head[2] = value >> 16;
+        head[3] = value >> 8;
+        head[4] = value;
+        len = 5;
+    }
+    put(encoder, head, len);
+}
+
+/*Digits written backwards from end, returns where they start*/
+static char *format_digits(char *end, uint64_t value)
+{
+    do
+    {
+        *--end = '0' + value % 10;
+        value /= 10;
+    } while(value);
+    return end;
+}
+
+static void put_json_uint(whoop_encoder_t *encoder, uint32_t value, int negative)
+{
+    char text[12];
+    char *start = format_digits(text + sizeof(text), value);
+    if(negative)
+        *--start = '-';
+    put(encoder, start, text + sizeof(text) - start);
+}
+
+/*Fixed point with integer digits only. newlib's %f goes through dtoa, which is slow in soft float and takes its
+  bignums from the heap. Taking the whole part off first is exact, so only the fraction is ever scaled*/
+static void put_json_fixed(whoop_encoder_t *encoder, float value)
+{
+    char text[24];
+    char *end = text + sizeof(text);
+    int negative = value < 0;
+    float magnitude = negative ? -value : value;
+    uint64_t whole = (uint64_t) magnitude;
+    uint32_t fraction = (uint32_t) ((magnitude - (float) whole) * JSON_FLOAT_SCALE + 0.5f);
+    if(fraction >= JSON_FLOAT_SCALE)
+    {
+        whole++;
+        fraction -= JSON_FLOAT_SCALE;
+    }
+    // The leading 1 of the padded fraction becomes the decimal point
+    char *start = format_digits(end, fraction + JSON_FLOAT_SCALE);
+    *start = '.';
+    start = format_digits(start, whole);
+    if(negative && (whole || fraction))
+        *--start = '-';
+    put(encoder, start, end - start);
+}
+
+static void put_json_string(whoop_encoder_t *encoder, const char *value)
+{
+    char escaped[6] = {'\\', 'u', '0', '0'};
+    const char *run = value;
+    put_byte(encoder, '"');
+    for(; *value; value++)
+    {
+        unsigned char c = *value;
+        if(c >= 0x20 && c != '"' && c != '\\')
+            continue;
+        put(encoder, run, value - run);
+        if(c == '"' || c == '\\')
+        {
+            char pair[2] = {'\\', c};
+            put(encoder, pair, sizeof(pair));
+        }
+        else
+        {
+            escaped[4] = g_hex_digits[c >> 4];
+            escaped[5] = g_hex_digits[c & 0xf];
+            put(encoder, escaped, sizeof(escaped));
+        }
+        run = value + 1;
+    }
+    put(encoder, run, value - run);
+    put_byte(encoder, '"');
+}
+
+static void begin_container(whoop_encoder_t *encoder, int is_array)
+{
+    begin_item(encoder);
+    if(encoder->depth + 1 >= WHOOP_ENCODE_MAX_DEPTH)
+    {
+        encoder->err = -1;
+        return;
+    }
+    encoder->depth++;
+    encoder->has_items &= ~(1U << encoder->depth);
+    if(is_array)
+        encoder->is_array |= 1U << encoder->depth;
+    else
+        encoder->is_array &= ~(1U << encoder->depth);
+    if(encoder->format == WHOOP_ENCODE_FORMAT_CBOR)
+        put_byte(encoder, is_array ? CBOR_ARRAY_BEGIN : CBOR_MAP_BEGIN);
+    else
+        put_byte(encoder, is_array ? '[' : '{');
+}
+
+// Global functions
+void whoop_encode_begin(whoop_encoder_t *encoder, whoop_encode_format_n format, whoop_encode_flush_fn flush, void *ctx)
+{
+    memset(encoder, 0, offsetof(whoop_encoder_t, buffer));
+    encoder->format = format;
+    encoder->flush = flush;
+    encoder->ctx = ctx;
+}
+
+void whoop_encode_map_begin(whoop_encoder_t *encoder)
+{
+    begin_container(encoder, 0);
+}
+
+void whoop_encode_array_begin(whoop_encoder_t *encoder)
+{
+    begin_container(encoder, 1);
+}
+
+void whoop_encode_end(whoop_encoder_t *encoder)
+{
+    if(!encoder->depth)
+    {
+        encoder->err = -1;
+        return;
+    }
+    if(encoder->format == WHOOP_ENCODE_FORMAT_CBOR)
+        put_byte(encoder, CBOR_BREAK);
+    else
+        put_byte(encoder, (encoder->is_array & (1U << encoder->depth)) ? ']' : '}');
+    encoder->depth--;
+}
+
+void whoop_encode_key(whoop_encoder_t *encoder, const char *key)
+{
+    begin_item(encoder);
+    if(encoder->format == WHOOP_ENCODE_FORMAT_CBOR)
+    {
+        size_t len = strlen(key);
+        put_cbor_head(encoder, CBOR_MAJOR_TEXT, len);
+        put(encoder, key, len);
+    }
+    else
+    {
+        put_json_string(encoder, key);
+        put_byte(encoder, ':');
+    }
+    encoder->after_key = 1;
+}
+
+void whoop_encode_int(whoop_encoder_t *encoder, int32_t value)
+{
+    begin_item(encoder);
+    if(encoder->format == WHOOP_ENCODE_FORMAT_CBOR)
+    {
+        if(value < 0)
+            put_cbor_head(encoder, CBOR_MAJOR_NEGINT, (uint32_t) (-1 - value));
+        else
+            put_cbor_head(encoder, CBOR_MAJOR_UINT, value);
+        return;
+    }
+    put_json_uint(encoder, value < 0 ? -(uint32_t) value : (uint32_t) value, value < 0);
+}
+
+void whoop_encode_uint(whoop_encoder_t *encoder, uint32_t value)
+{
+    begin_item(encoder);
+    if(encoder->format == WHOOP_ENCODE_FORMAT_CBOR)
+    {
+        put_cbor_head(encoder, CBOR_MAJOR_UINT, value);
+        return;
+    }
+    put_json_uint(encoder, value, 0);
+}
+
+void whoop_encode_float(whoop_encoder_t *encoder, float value)
+{
+    if(encoder->format == WHOOP_ENCODE_FORMAT_CBOR)
+    {
+        uint32_t bits;
+        uint8_t head[5];
+        begin_item(encoder);
+        memcpy(&bits, &value, sizeof(bits));
+        head[0] = CBOR_FLOAT32;
+        head[1] = bits >> 24;
+        head[2] = bits >> 16;
+        head[3] = bits >> 8;
+        head[4] = bits;
+        put(encoder, head, sizeof(head));
+        return;
+    }
+    // JSON has no spelling for these, and nothing the device stores comes near the limit
+    if(!(value > -JSON_FLOAT_LIMIT / JSON_FLOAT_SCALE && value < JSON_FLOAT_LIMIT / JSON_FLOAT_SCALE))
+    {
+        whoop_encode_null(encoder);
+        return;
+    }
+    begin_item(encoder);
+    put_json_fixed(encoder, value);
+}
+
+void whoop_encode_bool(whoop_encoder_t *encoder, int value)
+{
+    begin_item(encoder);
+    if(encoder->format == WHOOP_ENCODE_FORMAT_CBOR)
+        put_byte(encoder, value ? CBOR_TRUE : CBOR_FALSE);
+    else if(value)
+        put(encoder, "true", 4);
+    else
+        put(encoder, "false", 5);
+}
+
+void whoop_encode_null(whoop_encoder_t *encoder)
+{
+    begin_item(encoder);
+    if(encoder->format == WHOOP_ENCODE_FORMAT_CBOR)
+        put_byte(encoder, CBOR_NULL);
+    else
+        put(encoder, "null", 4);
+}
+
+void whoop_encode_string(whoop_encoder_t *encoder, const char *value)
+{
+    begin_item(encoder);
+    if(encoder->format == WHOOP_ENCODE_FORMAT_CBOR)
+    {
+        size_t len = strlen(value);
+        put_cbor_head(encoder, CBOR_MAJOR_TEXT, len);
+        put(encoder, value, len);
+        return;
+    }
+    put_json_string(encoder, value);
+}
+
+int whoop_encode_finish(whoop_encoder_t *encoder)
+{
+    flush_buffer(encoder);
+    return encoder->err;
+}
+
+const char *whoop_encode_content_type(whoop_encode_format_n format)
+{
+    return (format >= 0 && format < WHOOP_ENCODE_FORMAT_MAX) ? g_content_types[format] : "application/octet-stream";
+}
+
+int whoop_encode_format_from_name(const char *name)
+{
+    for(int format = 0; format < WHOOP_ENCODE_FORMAT_MAX; format++)
+    {
+        if(!strcmp(name, g_format_names[format]))
+            return format;
+    }
+    return -1;
+}
\ No newline at end of file
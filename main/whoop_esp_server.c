@@ -1,24 +1,151 @@
+#include <sys/param.h>
+#include <stdarg.h>
 #include "esp_event.h"
 #include "esp_log.h"
+#include "esp_system.h"
+#include "esp_wifi.h"
 #include <esp_http_server.h>
+#include "lwip/sockets.h"
+#ifdef CONFIG_WHOOP_WEBHOOK_ENABLE
+#include "mbedtls/md.h"
+#include "mbedtls/base64.h"
+#endif
 
 #include "whoop_data.h"
 #include "whoop_client.h"
+#include "whoop_mem.h"
+#include "whoop_latency.h"
+#include "whoop_api.h"
+#include "whoop_display.h"
+#include "i2c_led.h"
+#include "whoop_events.h"
+#include "whoop_ratelimit.h"
+#include "cJSON.h"
 
 static const char *TAG="WHOOP REST SERVER";
 
+#define WHOOP_SERVER_MAX_URI_HANDLERS 24
+#define WHOOP_WEBHOOK_MAX_BODY_LEN 512
+#define WHOOP_WEBHOOK_SIGNATURE_LEN 64
+#define WHOOP_WEBHOOK_TIMESTAMP_LEN 24
+#define WHOOP_WEBHOOK_MAX_AGE_MS (CONFIG_WHOOP_WEBHOOK_MAX_AGE_SECONDS * 1000LL)
+#define WHOOP_METRICS_CHUNK_LEN 384
+#define WHOOP_STATIC_CHUNK_LEN 1024
+
 #define AUTH_ENDPOINT_CBK "/authenticate/callback"
+// The OAuth state carries the account being authorized back to the callback
+#define AUTH_STATE_PREFIX "wmonitor"
 const char * REDIRECT_URI_ESP8266_WHOOP = "https://api.prod.whoop.com/oauth/oauth2/auth"
                 "?client_id=02d55f66-a1a6-4970-8e8b-dd31837233ee&response_type=code&"
                 "redirect_uri=http://localhost:3100&"
-                "state=aaaaaaaa&"
-                "scope=offline%20read:recovery%20read:cycles%20read:workout%20read:sleep";
+                "state=" AUTH_STATE_PREFIX "%02d&"
+                "scope=offline%%20read:recovery%%20read:cycles%%20read:workout%%20read:sleep";
+
+// Dashboard assets, gzipped by component.mk
+extern const uint8_t dashboard_index_html_gz_start[] asm("_binary_index_html_gz_start");
+extern const uint8_t dashboard_index_html_gz_end[]   asm("_binary_index_html_gz_end");
+extern const uint8_t dashboard_app_js_gz_start[]     asm("_binary_app_js_gz_start");
+extern const uint8_t dashboard_app_js_gz_end[]       asm("_binary_app_js_gz_end");
+
+typedef struct whoop_static_asset
+{
+    const char *uri;
+    const char *type;
+    const char *cache_control;
+    const uint8_t *start;
+    const uint8_t *end;
+} whoop_static_asset_t;
+
+// The page is revalidated on every load so a firmware update shows up at once, the script it pulls in is
+// only revalidated daily
+static const whoop_static_asset_t g_static_assets[] = {
+    { "/", "text/html", "no-cache", dashboard_index_html_gz_start, dashboard_index_html_gz_end },
+    { "/dashboard/app.js", "application/javascript", "max-age=86400", dashboard_app_js_gz_start, dashboard_app_js_gz_end },
+};
+
+/*Account selected with ?user=N, 0 when absent and -1 when out of range*/
+static int get_request_account(httpd_req_t *req)
+{
+    char query[64];
+    char param[8];
+    int account = 0;
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK
+        && httpd_query_key_value(query, "user", param, sizeof(param)) == ESP_OK) {
+        account = atoi(param);
+    }
+    if (account < 0 || account >= WHOOP_ACCOUNT_COUNT) {
+        return -1;
+    }
+    return account;
+}
+
+static int send_encoded_chunk(void *ctx, const uint8_t *data, size_t len)
+{
+    return httpd_resp_send_chunk((httpd_req_t *) ctx, (const char *) data, len) == ESP_OK ? 0 : -1;
+}
+
+/*Every generated body is streamed through an encoder on the handler's stack, nothing is built on the heap.
+  Status and headers have to be set before the first value, the buffer may fill and go out at any point*/
+static void begin_encoded_response(httpd_req_t *req, whoop_encoder_t *encoder, whoop_encode_format_n format)
+{
+    httpd_resp_set_type(req, whoop_encode_content_type(format));
+    whoop_encode_begin(encoder, format, send_encoded_chunk, req);
+}
 
+static esp_err_t end_encoded_response(httpd_req_t *req, whoop_encoder_t *encoder)
+{
+    if (whoop_encode_finish(encoder)) {
+        return ESP_FAIL;
+    }
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+/*IPv4 address of the client, the server socket hands out IPv4-mapped addresses when it listens on IPv6*/
+static uint32_t get_client_addr(httpd_req_t *req)
+{
+    struct sockaddr_storage addr;
+    socklen_t addr_len = sizeof(addr);
+    uint32_t client_addr = 0;
+    if (getpeername(httpd_req_to_sockfd(req), (struct sockaddr *) &addr, &addr_len) < 0) {
+        return 0;
+    }
+#ifdef CONFIG_LWIP_IPV6
+    if (addr.ss_family == AF_INET6) {
+        memcpy(&client_addr, ((struct sockaddr_in6 *) &addr)->sin6_addr.s6_addr + 12, sizeof(client_addr));
+        return client_addr;
+    }
+#endif
+    client_addr = ((struct sockaddr_in *) &addr)->sin_addr.s_addr;
+    return client_addr;
+}
+
+/*Guards every handler that can cost a Whoop request, answers 429 and returns -1 once the client's bucket is
+  empty. Checked before anything else so a throttled request costs no more than the lookup*/
+static int throttle_request(httpd_req_t *req)
+{
+    char retry_after[12];
+    int retry_after_s = 0;
+    if (!whoop_ratelimit_take(get_client_addr(req), &retry_after_s)) {
+        return 0;
+    }
+    snprintf(retry_after, sizeof(retry_after), "%d", retry_after_s);
+    httpd_resp_set_status(req, "429 Too Many Requests");
+    httpd_resp_set_hdr(req, "Retry-After", retry_after);
+    httpd_resp_send(req, NULL, 0);
+    return -1;
+}
 
 esp_err_t auth_get_handler(httpd_req_t *req)
 {
+    char redirect_uri[320];
+    int account = get_request_account(req);
+    if (account < 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Unknown user");
+        return ESP_FAIL;
+    }
+    snprintf(redirect_uri, sizeof(redirect_uri), REDIRECT_URI_ESP8266_WHOOP, account);
     /* Set some custom headers */
-    httpd_resp_set_hdr(req, "Location", REDIRECT_URI_ESP8266_WHOOP);
+    httpd_resp_set_hdr(req, "Location", redirect_uri);
 
     /* Send response with custom headers and body set as the
         * string passed in user context*/
@@ -36,40 +163,70 @@ httpd_uri_t auth = {
     .user_ctx  = NULL
 };
 
+/*Sends the reply to a code or token handed to the fetch task, the exchange itself finishes later*/
+static esp_err_t send_token_queued(httpd_req_t *req, int account, int queue_status, const char *req_response)
+{
+    if (account < 0 || account >= WHOOP_ACCOUNT_COUNT) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Unknown user");
+        return ESP_FAIL;
+    }
+    if (queue_status) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_hdr(req, "Retry-After", "5");
+        httpd_resp_send(req, NULL, 0);
+        return ESP_OK;
+    }
+    httpd_resp_set_status(req, "202 Accepted");
+    httpd_resp_send(req, req_response, strlen(req_response));
+    return ESP_OK;
+}
+
 esp_err_t auth_cbk_get_handler(httpd_req_t *req)
 {
     char*  buf;
     size_t buf_len;
+    int account = 0;
+    int queue_status = 0;
+    if (throttle_request(req)) {
+        return ESP_OK;
+    }
+    whoop_mem_slot_n previous_mem_slot = whoop_mem_request_begin(WHOOP_MEM_SLOT_SERVER);
     /* Set some custom headers */
     buf_len = httpd_req_get_url_query_len(req) + 1;
     if (buf_len > 1) {
-        buf = malloc(buf_len);
+        buf = whoop_mem_malloc(buf_len);
+        if (!buf) {
+            whoop_mem_request_end(previous_mem_slot);
+            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+            return ESP_FAIL;
+        }
         if (httpd_req_get_url_query_str(req, buf, buf_len) == ESP_OK) {
             ESP_LOGI(TAG, "Found URL query => %s", buf);
             char param[254];
+            if (httpd_query_key_value(buf, "state", param, sizeof(param)) == ESP_OK) {
+                ESP_LOGI(TAG, "Found URL query parameter => state=%s", param);
+                if (!strncmp(param, AUTH_STATE_PREFIX, strlen(AUTH_STATE_PREFIX))) {
+                    account = atoi(param + strlen(AUTH_STATE_PREFIX));
+                }
+            }
             /* Get value of expected key from query string */
             if (httpd_query_key_value(buf, "code", param, sizeof(param)) == ESP_OK) {
                 ESP_LOGI(TAG, "Found URL query parameter => param=%s", param);
-                whoop_get_token(param, TOKEN_REQUEST_TYPE_AUTH_CODE);
+                queue_status = whoop_queue_token(account, param, TOKEN_REQUEST_TYPE_AUTH_CODE);
                 //whoop_get_data(WHOOP_API_REQUEST_TYPE_CYCLE);
                 //whoop_get_data(WHOOP_API_REQUEST_TYPE_RECOVERY);
                 //whoop_get_data(WHOOP_API_REQUEST_TYPE_SLEEP);
                 //whoop_get_data(WHOOP_API_REQUEST_TYPE_WORKOUT);
             }
-            if (httpd_query_key_value(buf, "state", param, sizeof(param)) == ESP_OK) {
-                ESP_LOGI(TAG, "Found URL query parameter => state=%s", param);
-            }
             if (httpd_query_key_value(buf, "scope", param, sizeof(param)) == ESP_OK) {
                 ESP_LOGI(TAG, "Found URL query parameter => scope=%s", param);
             }
         }
-        free(buf);
+        whoop_mem_free(buf);
     }
+    whoop_mem_request_end(previous_mem_slot);
 
-    const char *req_response = "Recieved authentication code.";
-    httpd_resp_send(req, req_response, strlen(req_response));
-
-    return ESP_OK;
+    return send_token_queued(req, account, queue_status, "Recieved authentication code.");
 }
 
 httpd_uri_t auth_cbk = {
@@ -79,14 +236,48 @@ httpd_uri_t auth_cbk = {
     .user_ctx  = NULL
 };
 
-esp_err_t whoop_sleep_get_handler(httpd_req_t *req)
+/*Queues the upstream fetch on the client's task and answers 202 straight away, the fetch is followed on
+  /jobs/{id} so the server is never held up by the TLS exchange*/
+static esp_err_t queue_fetch_job(httpd_req_t *req, whoop_api_request_type_n request_type)
 {
-    /* Set some custom headers */
-    whoop_get_data(WHOOP_API_REQUEST_TYPE_SLEEP);
+    whoop_encoder_t encoder;
+    char location[24];
+    uint32_t job_id = 0;
+    int account;
+    if (throttle_request(req)) {
+        return ESP_OK;
+    }
+    account = get_request_account(req);
+    if (account < 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Unknown user");
+        return ESP_FAIL;
+    }
+    if (whoop_queue_job(account, request_type, &job_id)) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_hdr(req, "Retry-After", "5");
+        httpd_resp_send(req, NULL, 0);
+        return ESP_OK;
+    }
+    snprintf(location, sizeof(location), "/jobs/%u", job_id);
+    httpd_resp_set_status(req, "202 Accepted");
+    httpd_resp_set_hdr(req, "Location", location);
     httpd_resp_set_hdr(req, "User", "ESP8266");
-    httpd_resp_send(req, NULL, 0);
+    begin_encoded_response(req, &encoder, WHOOP_ENCODE_FORMAT_JSON);
+    whoop_encode_map_begin(&encoder);
+    whoop_encode_key(&encoder, "job");
+    whoop_encode_uint(&encoder, job_id);
+    whoop_encode_key(&encoder, "state");
+    whoop_encode_string(&encoder, whoop_job_state_name(WHOOP_JOB_STATE_QUEUED));
+    whoop_encode_key(&encoder, "href");
+    whoop_encode_string(&encoder, location);
+    whoop_encode_end(&encoder);
 
-    return ESP_OK;
+    return end_encoded_response(req, &encoder);
+}
+
+esp_err_t whoop_sleep_get_handler(httpd_req_t *req)
+{
+    return queue_fetch_job(req, WHOOP_API_REQUEST_TYPE_SLEEP);
 }
 
 httpd_uri_t whoop_sleep_cbk = {
@@ -98,12 +289,7 @@ httpd_uri_t whoop_sleep_cbk = {
 
 esp_err_t whoop_recover_get_handler(httpd_req_t *req)
 {
-    /* Set some custom headers */
-    whoop_get_data(WHOOP_API_REQUEST_TYPE_RECOVERY);
-    httpd_resp_set_hdr(req, "User", "ESP8266");
-    httpd_resp_send(req, NULL, 0);
-
-    return ESP_OK;
+    return queue_fetch_job(req, WHOOP_API_REQUEST_TYPE_RECOVERY);
 }
 
 httpd_uri_t whoop_recover_cbk = {
@@ -115,12 +301,7 @@ httpd_uri_t whoop_recover_cbk = {
 
 esp_err_t whoop_workout_get_handler(httpd_req_t *req)
 {
-    /* Set some custom headers */
-    whoop_get_data(WHOOP_API_REQUEST_TYPE_WORKOUT);
-    httpd_resp_set_hdr(req, "User", "ESP8266");
-    httpd_resp_send(req, NULL, 0);
-
-    return ESP_OK;
+    return queue_fetch_job(req, WHOOP_API_REQUEST_TYPE_WORKOUT);
 }
 
 httpd_uri_t whoop_workout_cbk = {
@@ -132,12 +313,7 @@ httpd_uri_t whoop_workout_cbk = {
 
 esp_err_t whoop_cycle_get_handler(httpd_req_t *req)
 {
-    /* Set some custom headers */
-    whoop_get_data(WHOOP_API_REQUEST_TYPE_CYCLE);
-    httpd_resp_set_hdr(req, "User", "ESP8266");
-    httpd_resp_send(req, NULL, 0);
-
-    return ESP_OK;
+    return queue_fetch_job(req, WHOOP_API_REQUEST_TYPE_CYCLE);
 }
 
 httpd_uri_t whoop_cycle_cbk = {
@@ -147,47 +323,167 @@ httpd_uri_t whoop_cycle_cbk = {
     .user_ctx  = NULL
 };
 
+esp_err_t whoop_job_get_handler(httpd_req_t *req)
+{
+    whoop_encoder_t encoder;
+    whoop_job_t job;
+    char *end = NULL;
+    uint32_t job_id = strtoul(req->uri + strlen("/jobs/"), &end, 10);
+    if (end == req->uri + strlen("/jobs/") || (*end && *end != '?') || whoop_client_get_job(job_id, &job)) {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Unknown or expired job");
+        return ESP_FAIL;
+    }
+    begin_encoded_response(req, &encoder, WHOOP_ENCODE_FORMAT_JSON);
+    whoop_encode_map_begin(&encoder);
+    whoop_encode_key(&encoder, "job");
+    whoop_encode_uint(&encoder, job.id);
+    whoop_encode_key(&encoder, "user");
+    whoop_encode_int(&encoder, job.account);
+    whoop_encode_key(&encoder, "type");
+    whoop_encode_string(&encoder, whoop_api_request_type_name(job.request_type));
+    whoop_encode_key(&encoder, "state");
+    whoop_encode_string(&encoder, whoop_job_state_name(job.state));
+    whoop_encode_key(&encoder, "status");
+    whoop_encode_int(&encoder, job.status);
+    // Times are relative to queueing, 0 until the job reaches that point
+    whoop_encode_key(&encoder, "started_us");
+    whoop_encode_int(&encoder, job.started_us ? (int32_t) (job.started_us - job.queued_us) : 0);
+    whoop_encode_key(&encoder, "finished_us");
+    whoop_encode_int(&encoder, job.finished_us ? (int32_t) (job.finished_us - job.queued_us) : 0);
+    whoop_encode_end(&encoder);
+
+    return end_encoded_response(req, &encoder);
+}
+
+httpd_uri_t whoop_job_cbk = {
+    .uri       = "/jobs/*",
+    .method    = HTTP_GET,
+    .handler   = whoop_job_get_handler,
+    .user_ctx  = NULL
+};
+
 esp_err_t whoop_print_get_handler(httpd_req_t *req)
 {
     whoop_data_handle_t handle = NULL;
-    if(!get_whoop_cycle_handle_by_id(0, &handle))
-    {
-        print_whoop_cycle_data(handle);
-    }
-    else
+    for(int account = 0; account < WHOOP_ACCOUNT_COUNT; account++)
     {
-        ESP_LOGI(TAG, "No cycle data recorded yet");
+        ESP_LOGI(TAG, "Account %d", account);
+        if(!get_whoop_cycle_handle_by_id(account, 0, &handle))
+        {
+            print_whoop_cycle_data(handle);
+        }
+        else
+        {
+            ESP_LOGI(TAG, "No cycle data recorded yet");
+        }
+        if(!get_whoop_workout_handle_by_id(account, 0, &handle))
+        {
+            print_whoop_workout_data(handle);
+        }
+        else
+        {
+            ESP_LOGI(TAG, "No workout data recorded yet");
+        }
+        if(!get_whoop_sleep_handle_by_id(account, 0, &handle))
+        {
+            print_whoop_sleep_data(handle);
+        }
+        else
+        {
+            ESP_LOGI(TAG, "No sleep data recorded yet");
+        }
+        if(!get_whoop_recovery_handle_by_id(account, 0, &handle))
+        {
+            print_whoop_recovery_data(handle);
+        }
+        else
+        {
+            ESP_LOGI(TAG, "No workout data recorded yet");
+        }
     }
-    if(!get_whoop_workout_handle_by_id(0, &handle))
-    {
-        print_whoop_workout_data(handle);
+    httpd_resp_set_hdr(req, "User", "ESP8266");
+    httpd_resp_send(req, NULL, 0);
+
+    return ESP_OK;
+}
+
+/*Copy of If-None-Match sized to the header, a browser sends every tag it has cached for the URL. NULL when the
+  header is absent, freed with whoop_mem_free*/
+static char *get_if_none_match(httpd_req_t *req)
+{
+    char *if_none_match;
+    size_t if_none_match_len = httpd_req_get_hdr_value_len(req, "If-None-Match") + 1;
+    if (if_none_match_len == 1) {
+        return NULL;
     }
-    else
-    {
-        ESP_LOGI(TAG, "No workout data recorded yet");
+    // Charged to the server slot like any untracked task, a bracket would reset its peaks on every 304
+    if_none_match = whoop_mem_malloc(if_none_match_len);
+    if (if_none_match && httpd_req_get_hdr_value_str(req, "If-None-Match", if_none_match, if_none_match_len) != ESP_OK) {
+        whoop_mem_free(if_none_match);
+        if_none_match = NULL;
     }
-    if(!get_whoop_sleep_handle_by_id(0, &handle))
-    {
-        print_whoop_sleep_data(handle);
+    return if_none_match;
+}
+
+/*Sends a dashboard asset as it sits in flash, in chunks so nothing is staged on the heap. Every browser takes
+  gzip, so the asset is never inflated on the device. The CRC32 in the gzip trailer changes with the content
+  and doubles as the ETag*/
+esp_err_t whoop_static_get_handler(httpd_req_t *req)
+{
+    const whoop_static_asset_t *asset = NULL;
+    size_t uri_len = strcspn(req->uri, "?");
+    char *if_none_match;
+    char etag[12];
+    uint32_t crc;
+    int not_modified;
+    for (size_t index = 0; index < sizeof(g_static_assets) / sizeof(g_static_assets[0]); index++) {
+        if (strlen(g_static_assets[index].uri) == uri_len && !strncmp(g_static_assets[index].uri, req->uri, uri_len)) {
+            asset = &g_static_assets[index];
+            break;
+        }
     }
-    else
-    {
-        ESP_LOGI(TAG, "No sleep data recorded yet");
+    if (!asset) {
+        httpd_resp_send_404(req);
+        return ESP_FAIL;
     }
-    if(!get_whoop_recovery_handle_by_id(0, &handle))
-    {
-        print_whoop_recovery_data(handle);
+    memcpy(&crc, asset->end - 8, sizeof(crc));
+    snprintf(etag, sizeof(etag), "\"%08x\"", crc);
+    httpd_resp_set_hdr(req, "ETag", etag);
+    httpd_resp_set_hdr(req, "Cache-Control", asset->cache_control);
+    if_none_match = get_if_none_match(req);
+    not_modified = if_none_match && whoop_api_etag_list_matches(if_none_match, etag);
+    whoop_mem_free(if_none_match);
+    if (not_modified) {
+        httpd_resp_set_status(req, "304 Not Modified");
+        httpd_resp_send(req, NULL, 0);
+        return ESP_OK;
     }
-    else
-    {
-        ESP_LOGI(TAG, "No workout data recorded yet");
+    httpd_resp_set_type(req, asset->type);
+    httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+    for (const uint8_t *chunk = asset->start; chunk < asset->end; chunk += WHOOP_STATIC_CHUNK_LEN) {
+        if (httpd_resp_send_chunk(req, (const char *) chunk, MIN(WHOOP_STATIC_CHUNK_LEN, asset->end - chunk)) != ESP_OK) {
+            return ESP_FAIL;
+        }
     }
-    httpd_resp_set_hdr(req, "User", "ESP8266");
-    httpd_resp_send(req, NULL, 0);
+    httpd_resp_send_chunk(req, NULL, 0);
 
     return ESP_OK;
 }
 
+httpd_uri_t whoop_dashboard_cbk = {
+    .uri       = "/",
+    .method    = HTTP_GET,
+    .handler   = whoop_static_get_handler,
+    .user_ctx  = NULL
+};
+
+httpd_uri_t whoop_dashboard_assets_cbk = {
+    .uri       = "/dashboard/*",
+    .method    = HTTP_GET,
+    .handler   = whoop_static_get_handler,
+    .user_ctx  = NULL
+};
+
 httpd_uri_t whoop_print_cbk = {
     .uri       = "/whoop/print",
     .method    = HTTP_GET,
@@ -195,30 +491,173 @@ httpd_uri_t whoop_print_cbk = {
     .user_ctx  = NULL
 };
 
+/*Read-only view of the store, never reaches out to Whoop. Bodies come from the API cache, serialized only
+  when the store changed since the last request. Clients that send back the ETag get a 304 until then, and
+  max-age runs out when the next poll could bring something new*/
+esp_err_t whoop_api_get_handler(httpd_req_t *req)
+{
+    whoop_api_resource_n resource = (whoop_api_resource_n) req->user_ctx;
+    const char *body = NULL;
+    const char *body_etag = NULL;
+    size_t body_len = 0;
+    char *if_none_match;
+    char etag[WHOOP_API_ETAG_LEN];
+    int not_modified;
+    // Headers are only copied when the response goes out, these outlive the send
+    char cache_control[24];
+    int account = get_request_account(req);
+    if (account < 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Unknown user");
+        return ESP_FAIL;
+    }
+    snprintf(cache_control, sizeof(cache_control), "max-age=%d", (int) (whoop_client_get_next_poll_us() / 1000000));
+    if_none_match = get_if_none_match(req);
+    not_modified = whoop_api_not_modified(account, resource, if_none_match, etag, sizeof(etag));
+    whoop_mem_free(if_none_match);
+    if (not_modified) {
+        httpd_resp_set_status(req, "304 Not Modified");
+        httpd_resp_set_hdr(req, "ETag", etag);
+        httpd_resp_set_hdr(req, "Cache-Control", cache_control);
+        httpd_resp_send(req, NULL, 0);
+        return ESP_OK;
+    }
+    if (whoop_api_get_body(account, resource, &body, &body_len, &body_etag)) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+        return ESP_FAIL;
+    }
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "ETag", body_etag);
+    httpd_resp_set_hdr(req, "Cache-Control", cache_control);
+    httpd_resp_send(req, body, body_len);
+
+    return ESP_OK;
+}
+
+/*History pages go out as they are encoded, through the encoder's buffer, so a page costs the same RAM whatever
+  its length. ?type= is required, from= and to= bound record IDs, format=cbor for binary output*/
+esp_err_t whoop_history_get_handler(httpd_req_t *req)
+{
+    char query_str[160];
+    char param[16];
+    whoop_encoder_t encoder;
+    whoop_api_history_query_t query = { .account = get_request_account(req), .type = WHOOP_DATA_TYPE_MAX };
+    int format = WHOOP_ENCODE_FORMAT_JSON;
+    if (query.account < 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Unknown user");
+        return ESP_FAIL;
+    }
+    if (httpd_req_get_url_query_str(req, query_str, sizeof(query_str)) == ESP_OK) {
+        if (httpd_query_key_value(query_str, "type", param, sizeof(param)) == ESP_OK) {
+            for (int type = 0; type < WHOOP_DATA_TYPE_MAX; type++) {
+                if (!strcmp(param, get_whoop_data_type_name(type))) {
+                    query.type = type;
+                }
+            }
+        }
+        if (httpd_query_key_value(query_str, "format", param, sizeof(param)) == ESP_OK) {
+            format = whoop_encode_format_from_name(param);
+        }
+        if (httpd_query_key_value(query_str, "from", param, sizeof(param)) == ESP_OK) {
+            query.from_id = atoi(param);
+        }
+        if (httpd_query_key_value(query_str, "to", param, sizeof(param)) == ESP_OK) {
+            query.to_id = atoi(param);
+        }
+        if (httpd_query_key_value(query_str, "cursor", param, sizeof(param)) == ESP_OK) {
+            query.cursor = strtoul(param, NULL, 10);
+        }
+        if (httpd_query_key_value(query_str, "limit", param, sizeof(param)) == ESP_OK) {
+            query.limit = atoi(param);
+        }
+    }
+    if (query.type == WHOOP_DATA_TYPE_MAX || format < 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Expected type=sleep|workout|recovery|cycle and format=json|cbor");
+        return ESP_FAIL;
+    }
+    begin_encoded_response(req, &encoder, format);
+    whoop_api_write_history(&encoder, &query);
+
+    return end_encoded_response(req, &encoder);
+}
+
+httpd_uri_t whoop_history_cbk = {
+    .uri       = "/api/v1/history",
+    .method    = HTTP_GET,
+    .handler   = whoop_history_get_handler,
+    .user_ctx  = NULL
+};
+
+httpd_uri_t whoop_api_latest_cbk = {
+    .uri       = "/api/v1/latest",
+    .method    = HTTP_GET,
+    .handler   = whoop_api_get_handler,
+    .user_ctx  = (void *) WHOOP_API_RESOURCE_LATEST
+};
+
+httpd_uri_t whoop_api_sleep_cbk = {
+    .uri       = "/api/v1/sleep",
+    .method    = HTTP_GET,
+    .handler   = whoop_api_get_handler,
+    .user_ctx  = (void *) WHOOP_API_RESOURCE_SLEEP
+};
+
+httpd_uri_t whoop_api_workout_cbk = {
+    .uri       = "/api/v1/workout",
+    .method    = HTTP_GET,
+    .handler   = whoop_api_get_handler,
+    .user_ctx  = (void *) WHOOP_API_RESOURCE_WORKOUT
+};
+
+httpd_uri_t whoop_api_recovery_cbk = {
+    .uri       = "/api/v1/recovery",
+    .method    = HTTP_GET,
+    .handler   = whoop_api_get_handler,
+    .user_ctx  = (void *) WHOOP_API_RESOURCE_RECOVERY
+};
+
+httpd_uri_t whoop_api_cycle_cbk = {
+    .uri       = "/api/v1/cycle",
+    .method    = HTTP_GET,
+    .handler   = whoop_api_get_handler,
+    .user_ctx  = (void *) WHOOP_API_RESOURCE_CYCLE
+};
+
 esp_err_t refresh_token_cbk_get_handler(httpd_req_t *req)
 {
     char*  buf;
     size_t buf_len;
+    int account = 0;
+    int queue_status = 0;
+    if (throttle_request(req)) {
+        return ESP_OK;
+    }
+    whoop_mem_slot_n previous_mem_slot = whoop_mem_request_begin(WHOOP_MEM_SLOT_SERVER);
     /* Set some custom headers */
     buf_len = httpd_req_get_url_query_len(req) + 1;
     if (buf_len > 1) {
-        buf = malloc(buf_len);
+        buf = whoop_mem_malloc(buf_len);
+        if (!buf) {
+            whoop_mem_request_end(previous_mem_slot);
+            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+            return ESP_FAIL;
+        }
         if (httpd_req_get_url_query_str(req, buf, buf_len) == ESP_OK) {
             ESP_LOGI(TAG, "Found URL query => %s", buf);
             char param[254];
             /* Get value of expected key from query string */
+            if (httpd_query_key_value(buf, "user", param, sizeof(param)) == ESP_OK) {
+                account = atoi(param);
+            }
             if (httpd_query_key_value(buf, "token", param, sizeof(param)) == ESP_OK) {
                 ESP_LOGI(TAG, "Found URL query parameter => token=%s", param);
-                whoop_get_token(param, TOKEN_REQUEST_TYPE_REFRESH);
+                queue_status = whoop_queue_token(account, param, TOKEN_REQUEST_TYPE_REFRESH);
             }
         }
-        free(buf);
+        whoop_mem_free(buf);
     }
+    whoop_mem_request_end(previous_mem_slot);
 
-    const char *req_response = "Recieved refresh token.";
-    httpd_resp_send(req, req_response, strlen(req_response));
-
-    return ESP_OK;
+    return send_token_queued(req, account, queue_status, "Recieved refresh token.");
 }
 
 httpd_uri_t refresh_cbk = {
@@ -228,10 +667,543 @@ httpd_uri_t refresh_cbk = {
     .user_ctx  = NULL
 };
 
+esp_err_t whoop_heap_get_handler(httpd_req_t *req)
+{
+    whoop_encoder_t encoder;
+    whoop_mem_stats_t stats;
+
+    begin_encoded_response(req, &encoder, WHOOP_ENCODE_FORMAT_JSON);
+    whoop_encode_map_begin(&encoder);
+    whoop_encode_key(&encoder, "free_heap");
+    whoop_encode_uint(&encoder, esp_get_free_heap_size());
+    whoop_encode_key(&encoder, "min_free_heap");
+    whoop_encode_uint(&encoder, whoop_mem_get_min_free_heap());
+    whoop_encode_key(&encoder, "accounts");
+    whoop_encode_int(&encoder, WHOOP_ACCOUNT_COUNT);
+    whoop_encode_key(&encoder, "account_bytes");
+    whoop_encode_uint(&encoder, whoop_client_account_size() + get_whoop_data_account_size());
+    whoop_encode_key(&encoder, "slots");
+    whoop_encode_map_begin(&encoder);
+    for(int slot = 0; slot < WHOOP_MEM_SLOT_MAX; slot++)
+    {
+        whoop_mem_get_stats(slot, &stats);
+        whoop_encode_key(&encoder, whoop_mem_slot_name(slot));
+        whoop_encode_map_begin(&encoder);
+        whoop_encode_key(&encoder, "requests");
+        whoop_encode_uint(&encoder, stats.request_count);
+        whoop_encode_key(&encoder, "allocs");
+        whoop_encode_uint(&encoder, stats.alloc_count);
+        whoop_encode_key(&encoder, "failed");
+        whoop_encode_uint(&encoder, stats.failed_count);
+        whoop_encode_key(&encoder, "peak");
+        whoop_encode_uint(&encoder, stats.peak_bytes);
+        whoop_encode_key(&encoder, "largest");
+        whoop_encode_uint(&encoder, stats.largest_block);
+        whoop_encode_key(&encoder, "max_peak");
+        whoop_encode_uint(&encoder, stats.max_peak_bytes);
+        whoop_encode_key(&encoder, "live");
+        whoop_encode_uint(&encoder, stats.live_bytes);
+        whoop_encode_end(&encoder);
+    }
+    whoop_encode_end(&encoder);
+    whoop_encode_end(&encoder);
+
+    return end_encoded_response(req, &encoder);
+}
+
+httpd_uri_t whoop_heap_cbk = {
+    .uri       = "/whoop/heap",
+    .method    = HTTP_GET,
+    .handler   = whoop_heap_get_handler,
+    .user_ctx  = NULL
+};
+
+esp_err_t whoop_latency_get_handler(httpd_req_t *req)
+{
+    whoop_encoder_t encoder;
+    whoop_latency_summary_t summary;
+    whoop_data_lazy_stats_t lazy_stats;
+    whoop_api_stats_t api_stats;
+
+    begin_encoded_response(req, &encoder, WHOOP_ENCODE_FORMAT_JSON);
+    whoop_encode_map_begin(&encoder);
+    for(int request_type = 0; request_type < WHOOP_API_REQUEST_TYPE_MAX; request_type++)
+    {
+        whoop_encode_key(&encoder, whoop_api_request_type_name(request_type));
+        whoop_encode_map_begin(&encoder);
+        for(int phase = 0; phase < WHOOP_LATENCY_PHASE_MAX; phase++)
+        {
+            whoop_latency_get_summary(request_type, phase, &summary);
+            whoop_encode_key(&encoder, whoop_latency_phase_name(phase));
+            whoop_encode_map_begin(&encoder);
+            whoop_encode_key(&encoder, "count");
+            whoop_encode_uint(&encoder, summary.count);
+            whoop_encode_key(&encoder, "p50_us");
+            whoop_encode_uint(&encoder, summary.p50_us);
+            whoop_encode_key(&encoder, "p90_us");
+            whoop_encode_uint(&encoder, summary.p90_us);
+            whoop_encode_key(&encoder, "p99_us");
+            whoop_encode_uint(&encoder, summary.p99_us);
+            whoop_encode_end(&encoder);
+        }
+        whoop_encode_end(&encoder);
+    }
+    // Decoding deferred by lazy mode lands here instead of in the parse phase
+    get_whoop_data_lazy_stats(&lazy_stats);
+    whoop_encode_key(&encoder, "lazy");
+    whoop_encode_map_begin(&encoder);
+    whoop_encode_key(&encoder, "deferred");
+    whoop_encode_uint(&encoder, lazy_stats.deferred);
+    whoop_encode_key(&encoder, "decoded");
+    whoop_encode_uint(&encoder, lazy_stats.decoded);
+    whoop_encode_key(&encoder, "decode_us");
+    whoop_encode_uint(&encoder, lazy_stats.decode_us);
+    whoop_encode_end(&encoder);
+    whoop_api_get_stats(&api_stats);
+    whoop_encode_key(&encoder, "api");
+    whoop_encode_map_begin(&encoder);
+    whoop_encode_key(&encoder, "hits");
+    whoop_encode_uint(&encoder, api_stats.hits);
+    whoop_encode_key(&encoder, "builds");
+    whoop_encode_uint(&encoder, api_stats.builds);
+    whoop_encode_key(&encoder, "build_us");
+    whoop_encode_uint(&encoder, api_stats.build_us);
+    whoop_encode_key(&encoder, "not_modified");
+    whoop_encode_uint(&encoder, api_stats.not_modified);
+    whoop_encode_end(&encoder);
+    whoop_encode_end(&encoder);
+
+    return end_encoded_response(req, &encoder);
+}
+
+httpd_uri_t whoop_latency_cbk = {
+    .uri       = "/whoop/latency",
+    .method    = HTTP_GET,
+    .handler   = whoop_latency_get_handler,
+    .user_ctx  = NULL
+};
+
+esp_err_t whoop_transfer_get_handler(httpd_req_t *req)
+{
+    whoop_encoder_t encoder;
+    whoop_transfer_stats_t stats;
+
+    begin_encoded_response(req, &encoder, WHOOP_ENCODE_FORMAT_JSON);
+    whoop_encode_map_begin(&encoder);
+    for(int request_type = 0; request_type < WHOOP_API_REQUEST_TYPE_MAX; request_type++)
+    {
+        whoop_client_get_transfer_stats(request_type, &stats);
+        whoop_encode_key(&encoder, whoop_api_request_type_name(request_type));
+        whoop_encode_map_begin(&encoder);
+        whoop_encode_key(&encoder, "responses");
+        whoop_encode_uint(&encoder, stats.responses);
+        whoop_encode_key(&encoder, "gzip_responses");
+        whoop_encode_uint(&encoder, stats.gzip_responses);
+        whoop_encode_key(&encoder, "wire_bytes");
+        whoop_encode_uint(&encoder, stats.wire_bytes);
+        whoop_encode_key(&encoder, "body_bytes");
+        whoop_encode_uint(&encoder, stats.body_bytes);
+        whoop_encode_end(&encoder);
+    }
+    whoop_encode_end(&encoder);
+
+    return end_encoded_response(req, &encoder);
+}
+
+httpd_uri_t whoop_transfer_cbk = {
+    .uri       = "/whoop/transfer",
+    .method    = HTTP_GET,
+    .handler   = whoop_transfer_get_handler,
+    .user_ctx  = NULL
+};
+
+// Prometheus text is written a chunk at a time, the whole page is never held in RAM
+typedef struct metrics_writer
+{
+    httpd_req_t *req;
+    esp_err_t err;
+    size_t len;
+    char buffer[WHOOP_METRICS_CHUNK_LEN];
+} metrics_writer_t;
+
+typedef struct record_metric
+{
+    const char *name;
+    const char *help;
+    whoop_data_type_n type;
+    whoop_data_opt_n opt;
+} record_metric_t;
+
+static const record_metric_t g_record_metrics[] = {
+    { "whoop_recovery_score", "Recovery score of the latest scored recovery, percent.", WHOOP_DATA_TYPE_RECOVERY, WHOOP_DATA_OPT_RECOVERY_RECOVERY_SCORE },
+    { "whoop_hrv_rmssd_milliseconds", "Heart rate variability (RMSSD) of the latest scored recovery.", WHOOP_DATA_TYPE_RECOVERY, WHOOP_DATA_OPT_RECOVERY_HRV_RMSSD_MILLI },
+    { "whoop_resting_heart_rate_bpm", "Resting heart rate of the latest scored recovery.", WHOOP_DATA_TYPE_RECOVERY, WHOOP_DATA_OPT_RECOVERY_RESTING_HEART_RATE },
+    { "whoop_cycle_strain", "Strain of the latest scored cycle.", WHOOP_DATA_TYPE_CYCLE, WHOOP_DATA_OPT_CYCLE_STRAIN },
+    { "whoop_sleep_performance_percent", "Sleep performance of the latest scored sleep.", WHOOP_DATA_TYPE_SLEEP, WHOOP_DATA_OPT_SLEEP_SLEEP_PERFORMANCE_PERCENTAGE },
+};
+
+static const whoop_data_opt_n g_score_state_opts[WHOOP_DATA_TYPE_MAX] = {
+    WHOOP_DATA_OPT_SLEEP_SCORE_STATE, WHOOP_DATA_OPT_WORKOUT_SCORE_STATE, WHOOP_DATA_OPT_RECOVERY_SCORE_STATE, WHOOP_DATA_OPT_CYCLE_SCORE_STATE
+};
+
+static void metrics_flush(metrics_writer_t *writer)
+{
+    if (writer->len && writer->err == ESP_OK) {
+        writer->err = httpd_resp_send_chunk(writer->req, writer->buffer, writer->len);
+    }
+    writer->len = 0;
+}
+
+static void metrics_printf(metrics_writer_t *writer, const char *format, ...)
+{
+    va_list argptr;
+    int len;
+    // A line that does not fit goes out with the next chunk, after the buffered text is sent
+    for (int attempt = 0; attempt < 2 && writer->err == ESP_OK; attempt++) {
+        va_start(argptr, format);
+        len = vsnprintf(writer->buffer + writer->len, sizeof(writer->buffer) - writer->len, format, argptr);
+        va_end(argptr);
+        if (len >= 0 && writer->len + len < sizeof(writer->buffer)) {
+            writer->len += len;
+            return;
+        }
+        metrics_flush(writer);
+    }
+}
+
+static void metrics_header(metrics_writer_t *writer, const char *name, const char *type, const char *help)
+{
+    metrics_printf(writer, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+static void write_record_metrics(metrics_writer_t *writer)
+{
+    whoop_data_handle_t handle = NULL;
+    int score_state;
+    float value;
+
+    for (size_t metric = 0; metric < sizeof(g_record_metrics) / sizeof(g_record_metrics[0]); metric++) {
+        const record_metric_t *record_metric = &g_record_metrics[metric];
+        metrics_header(writer, record_metric->name, "gauge", record_metric->help);
+        for (int account = 0; account < WHOOP_ACCOUNT_COUNT; account++) {
+            // Accounts without a scored record are left out rather than reported as 0
+            if (get_whoop_data_latest_handle(account, record_metric->type, &handle)
+                || get_whoop_data(handle, g_score_state_opts[record_metric->type], &score_state)
+                || score_state != WHOOP_SCORE_STATE_SCORED
+                || get_whoop_data(handle, record_metric->opt, &value)) {
+                continue;
+            }
+            metrics_printf(writer, "%s{user=\"%d\"} %.3f\n", record_metric->name, account, value);
+        }
+    }
+
+    metrics_header(writer, "whoop_record_stale", "gauge", "1 while the latest record is the copy restored from flash.");
+    for (int account = 0; account < WHOOP_ACCOUNT_COUNT; account++) {
+        for (int type = 0; type < WHOOP_DATA_TYPE_MAX; type++) {
+            if (get_whoop_data_latest_handle(account, type, &handle)) continue;
+            metrics_printf(writer, "whoop_record_stale{user=\"%d\",type=\"%s\"} %d\n", account, get_whoop_data_type_name(type),
+                           is_whoop_data_stale(account, type) ? 1 : 0);
+        }
+    }
+}
+
+static void write_upstream_metrics(metrics_writer_t *writer)
+{
+    whoop_transfer_stats_t stats;
+    uint32_t buckets[WHOOP_LATENCY_BUCKET_COUNT];
+    uint64_t sum_us;
+
+    metrics_header(writer, "whoop_upstream_requests_total", "counter", "Requests sent to the Whoop API.");
+    for (int request_type = 0; request_type < WHOOP_API_REQUEST_TYPE_MAX; request_type++) {
+        whoop_client_get_transfer_stats(request_type, &stats);
+        metrics_printf(writer, "whoop_upstream_requests_total{type=\"%s\"} %u\n", whoop_api_request_type_name(request_type), stats.requests);
+    }
+    metrics_header(writer, "whoop_upstream_errors_total", "counter", "Whoop API requests that failed or returned a non-2xx status.");
+    for (int request_type = 0; request_type < WHOOP_API_REQUEST_TYPE_MAX; request_type++) {
+        whoop_client_get_transfer_stats(request_type, &stats);
+        metrics_printf(writer, "whoop_upstream_errors_total{type=\"%s\"} %u\n", whoop_api_request_type_name(request_type), stats.errors);
+    }
+    whoop_client_get_transfer_stats(WHOOP_API_REQUEST_TYPE_TOKEN, &stats);
+    metrics_header(writer, "whoop_token_refreshes_total", "counter", "OAuth token exchanges, authorization codes included.");
+    metrics_printf(writer, "whoop_token_refreshes_total %u\n", stats.requests);
+
+    // Bucket n of the latency histogram holds [2^n, 2^(n+1)) us, counted since boot
+    metrics_header(writer, "whoop_upstream_request_duration_seconds", "histogram", "Whole request time by type, from the device latency histogram.");
+    for (int request_type = 0; request_type < WHOOP_API_REQUEST_TYPE_MAX; request_type++) {
+        const char *type_name = whoop_api_request_type_name(request_type);
+        uint32_t count = 0;
+        whoop_latency_get_buckets(request_type, WHOOP_LATENCY_PHASE_TOTAL, buckets, &sum_us);
+        for (int bucket = 0; bucket < WHOOP_LATENCY_BUCKET_COUNT - 1; bucket++) {
+            count += buckets[bucket];
+            metrics_printf(writer, "whoop_upstream_request_duration_seconds_bucket{type=\"%s\",le=\"%g\"} %u\n",
+                           type_name, (double) (1UL << (bucket + 1)) / 1e6, count);
+        }
+        count += buckets[WHOOP_LATENCY_BUCKET_COUNT - 1];
+        metrics_printf(writer, "whoop_upstream_request_duration_seconds_bucket{type=\"%s\",le=\"+Inf\"} %u\n", type_name, count);
+        metrics_printf(writer, "whoop_upstream_request_duration_seconds_sum{type=\"%s\"} %.6f\n", type_name, (double) sum_us / 1e6);
+        metrics_printf(writer, "whoop_upstream_request_duration_seconds_count{type=\"%s\"} %u\n", type_name, count);
+    }
+}
+
+static void write_device_metrics(metrics_writer_t *writer)
+{
+    wifi_ap_record_t ap_info;
+    i2c_lcd_1602_stats_t lcd_stats;
+
+    metrics_header(writer, "whoop_free_heap_bytes", "gauge", "Free heap.");
+    metrics_printf(writer, "whoop_free_heap_bytes %u\n", esp_get_free_heap_size());
+    metrics_header(writer, "whoop_min_free_heap_bytes", "gauge", "Lowest free heap since boot.");
+    metrics_printf(writer, "whoop_min_free_heap_bytes %u\n", whoop_mem_get_min_free_heap());
+    if (esp_wifi_sta_get_ap_info(&ap_info) == ESP_OK) {
+        metrics_header(writer, "whoop_wifi_rssi_dbm", "gauge", "Signal strength of the access point.");
+        metrics_printf(writer, "whoop_wifi_rssi_dbm %d\n", ap_info.rssi);
+    }
+    metrics_header(writer, "whoop_wifi_reconnects_total", "counter", "Times the network came back after being lost.");
+    metrics_printf(writer, "whoop_wifi_reconnects_total %u\n", whoop_client_get_reconnect_count());
+    metrics_header(writer, "whoop_display_renders_total", "counter", "LCD page redraws.");
+    metrics_printf(writer, "whoop_display_renders_total %u\n", whoop_display_get_render_count());
+    metrics_header(writer, "whoop_display_superseded_total", "counter", "Display commands folded into a later render.");
+    metrics_printf(writer, "whoop_display_superseded_total %u\n", whoop_display_get_superseded_count());
+    i2c_lcd_1602_getStats(&lcd_stats);
+    metrics_header(writer, "whoop_display_glyph_hits_total", "counter", "Custom characters already in CGRAM when a frame needed them.");
+    metrics_printf(writer, "whoop_display_glyph_hits_total %u\n", lcd_stats.glyph_hits);
+    metrics_header(writer, "whoop_display_glyph_misses_total", "counter", "Custom characters written to CGRAM.");
+    metrics_printf(writer, "whoop_display_glyph_misses_total %u\n", lcd_stats.glyph_misses);
+}
+
+static void write_events_metrics(metrics_writer_t *writer)
+{
+    whoop_events_stats_t stats;
+    whoop_events_get_stats(&stats);
+
+    metrics_header(writer, "whoop_sse_clients", "gauge", "Clients streaming /events.");
+    metrics_printf(writer, "whoop_sse_clients %u\n", stats.clients);
+    metrics_header(writer, "whoop_sse_client_state_bytes", "gauge", "Stream state allocated per client, socket buffers and unsent events excluded.");
+    metrics_printf(writer, "whoop_sse_client_state_bytes %u\n", stats.client_state_bytes);
+    metrics_header(writer, "whoop_sse_backlog_bytes", "gauge", "Event backlog shared by every client.");
+    metrics_printf(writer, "whoop_sse_backlog_bytes %u\n", stats.backlog_bytes);
+    metrics_header(writer, "whoop_sse_connects_total", "counter", "Event streams opened.");
+    metrics_printf(writer, "whoop_sse_connects_total %u\n", stats.connects);
+    metrics_header(writer, "whoop_sse_rejected_total", "counter", "Event streams refused with every client slot taken.");
+    metrics_printf(writer, "whoop_sse_rejected_total %u\n", stats.rejected);
+    metrics_header(writer, "whoop_sse_evictions_total", "counter", "Event streams closed for a full backlog or a failed send.");
+    metrics_printf(writer, "whoop_sse_evictions_total %u\n", stats.evicted);
+    metrics_header(writer, "whoop_sse_events_published_total", "counter", "Events published, pings included.");
+    metrics_printf(writer, "whoop_sse_events_published_total %u\n", stats.published);
+    metrics_header(writer, "whoop_sse_events_delivered_total", "counter", "Events completely written to a client.");
+    metrics_printf(writer, "whoop_sse_events_delivered_total %u\n", stats.delivered);
+    metrics_header(writer, "whoop_sse_fanout_seconds", "gauge", "Publish until written to a client socket.");
+    metrics_printf(writer, "whoop_sse_fanout_seconds{stat=\"avg\"} %.6f\n", stats.fanout_avg_us / 1e6);
+    metrics_printf(writer, "whoop_sse_fanout_seconds{stat=\"max\"} %.6f\n", stats.fanout_max_us / 1e6);
+}
+
+static void write_ratelimit_metrics(metrics_writer_t *writer)
+{
+    whoop_ratelimit_stats_t stats;
+    whoop_ratelimit_get_stats(&stats);
+
+    metrics_header(writer, "whoop_ratelimit_clients", "gauge", "LAN clients holding a rate limit bucket.");
+    metrics_printf(writer, "whoop_ratelimit_clients %u\n", stats.clients);
+    metrics_header(writer, "whoop_ratelimit_requests_total", "counter", "Requests to endpoints that can reach Whoop, by outcome.");
+    metrics_printf(writer, "whoop_ratelimit_requests_total{result=\"allowed\"} %u\n", stats.allowed);
+    metrics_printf(writer, "whoop_ratelimit_requests_total{result=\"throttled\"} %u\n", stats.throttled);
+    metrics_header(writer, "whoop_ratelimit_evictions_total", "counter", "Buckets recycled for a new client with the table full.");
+    metrics_printf(writer, "whoop_ratelimit_evictions_total %u\n", stats.evicted);
+}
+
+esp_err_t whoop_metrics_get_handler(httpd_req_t *req)
+{
+    metrics_writer_t writer = { .req = req, .err = ESP_OK, .len = 0 };
+
+    httpd_resp_set_type(req, "text/plain; version=0.0.4");
+    write_record_metrics(&writer);
+    write_upstream_metrics(&writer);
+    write_device_metrics(&writer);
+    write_events_metrics(&writer);
+    write_ratelimit_metrics(&writer);
+    metrics_flush(&writer);
+    if (writer.err != ESP_OK) {
+        return ESP_FAIL;
+    }
+    httpd_resp_send_chunk(req, NULL, 0);
+
+    return ESP_OK;
+}
+
+httpd_uri_t whoop_metrics_cbk = {
+    .uri       = "/metrics",
+    .method    = HTTP_GET,
+    .handler   = whoop_metrics_get_handler,
+    .user_ctx  = NULL
+};
+
+esp_err_t whoop_events_get_handler(httpd_req_t *req)
+{
+    return whoop_events_add_client(req);
+}
+
+httpd_uri_t whoop_events_cbk = {
+    .uri       = "/events",
+    .method    = HTTP_GET,
+    .handler   = whoop_events_get_handler,
+    .user_ctx  = NULL
+};
+
+#ifdef CONFIG_WHOOP_WEBHOOK_ENABLE
+/*X-WHOOP-Signature is base64(HMAC-SHA256(timestamp header + raw body)) keyed with the client secret*/
+static int verify_webhook_signature(const char *timestamp, const char *body, size_t body_len, const char *signature)
+{
+    unsigned char hmac[32];
+    unsigned char expected[WHOOP_WEBHOOK_SIGNATURE_LEN];
+    size_t expected_len = 0;
+    unsigned char diff = 0;
+    size_t signature_len = strlen(signature);
+    mbedtls_md_context_t ctx;
+
+    mbedtls_md_init(&ctx);
+    if (mbedtls_md_setup(&ctx, mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), 1)
+        || mbedtls_md_hmac_starts(&ctx, (const unsigned char *) CONFIG_CLIENT_SECRET, strlen(CONFIG_CLIENT_SECRET))
+        || mbedtls_md_hmac_update(&ctx, (const unsigned char *) timestamp, strlen(timestamp))
+        || mbedtls_md_hmac_update(&ctx, (const unsigned char *) body, body_len)
+        || mbedtls_md_hmac_finish(&ctx, hmac)) {
+        mbedtls_md_free(&ctx);
+        return -1;
+    }
+    mbedtls_md_free(&ctx);
+    if (mbedtls_base64_encode(expected, sizeof(expected), &expected_len, hmac, sizeof(hmac)) || expected_len != signature_len) {
+        return -1;
+    }
+    // Constant time compare so the signature cannot be guessed byte by byte
+    for (size_t i = 0; i < expected_len; i++) {
+        diff |= expected[i] ^ (unsigned char) signature[i];
+    }
+    return diff ? -1 : 0;
+}
+
+static whoop_api_request_type_n get_webhook_request_type(const char *type)
+{
+    if (!strcmp(type, "sleep.updated")) return WHOOP_API_REQUEST_TYPE_SLEEP;
+    if (!strcmp(type, "workout.updated")) return WHOOP_API_REQUEST_TYPE_WORKOUT;
+    if (!strcmp(type, "recovery.updated")) return WHOOP_API_REQUEST_TYPE_RECOVERY;
+    return WHOOP_API_REQUEST_TYPE_MAX;
+}
+
+/*Milliseconds between the signed timestamp and the device clock, negative for timestamps ahead of it. Returns
+  -1 while the clock is unknown*/
+static int get_webhook_age_ms(const char *timestamp, int64_t *age_ms_out)
+{
+    int64_t now_ms;
+    if (whoop_client_get_unix_time_ms(&now_ms)) return -1;
+    *age_ms_out = now_ms - strtoll(timestamp, NULL, 10);
+    return 0;
+}
+
+/*Verifies the delivery and queues a fetch of the changed record. The upstream request runs on the client's
+  fetch task so Whoop gets its 2xx without waiting on the TLS round trip*/
+esp_err_t whoop_webhook_post_handler(httpd_req_t *req)
+{
+    char *body = NULL;
+    char signature[WHOOP_WEBHOOK_SIGNATURE_LEN];
+    char timestamp[WHOOP_WEBHOOK_TIMESTAMP_LEN];
+    size_t received = 0;
+    int ret;
+    cJSON *json = NULL;
+    const cJSON *item = NULL;
+    int user_id, id, account;
+    int64_t age_ms;
+    whoop_api_request_type_n request_type;
+    esp_err_t err = ESP_FAIL;
+    whoop_mem_slot_n previous_mem_slot;
+
+    if (req->content_len == 0 || req->content_len > WHOOP_WEBHOOK_MAX_BODY_LEN) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Bad webhook body");
+        return ESP_FAIL;
+    }
+    if (httpd_req_get_hdr_value_str(req, "X-WHOOP-Signature", signature, sizeof(signature)) != ESP_OK
+        || httpd_req_get_hdr_value_str(req, "X-WHOOP-Signature-Timestamp", timestamp, sizeof(timestamp)) != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing signature");
+        return ESP_FAIL;
+    }
+
+    previous_mem_slot = whoop_mem_request_begin(WHOOP_MEM_SLOT_SERVER);
+    body = whoop_mem_malloc(req->content_len + 1);
+    if (!body) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+        goto Error;
+    }
+    while (received < req->content_len) {
+        ret = httpd_req_recv(req, body + received, req->content_len - received);
+        if (ret == HTTPD_SOCK_ERR_TIMEOUT) continue;
+        if (ret <= 0) goto Error;
+        received += ret;
+    }
+    body[received] = '\0';
+
+    if (verify_webhook_signature(timestamp, body, received, signature)) {
+        ESP_LOGI(TAG, "Rejected webhook with bad signature");
+        httpd_resp_set_status(req, "401 Unauthorized");
+        httpd_resp_send(req, NULL, 0);
+        goto Error;
+    }
+    if (get_webhook_age_ms(timestamp, &age_ms)) {
+        // Nothing to check the timestamp against until Whoop has answered once, Whoop retries the delivery
+        ESP_LOGI(TAG, "Clock not set, deferring webhook");
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_send(req, NULL, 0);
+        goto Error;
+    }
+    if (age_ms > WHOOP_WEBHOOK_MAX_AGE_MS || age_ms < -WHOOP_WEBHOOK_MAX_AGE_MS) {
+        ESP_LOGI(TAG, "Rejected webhook signed %lld ms from now", (long long) -age_ms);
+        httpd_resp_set_status(req, "401 Unauthorized");
+        httpd_resp_send(req, NULL, 0);
+        goto Error;
+    }
+    whoop_client_webhook_received();
+
+    json = cJSON_Parse(body);
+    if (!json || !(item = cJSON_GetObjectItem(json, "type")) || !cJSON_IsString(item)) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Bad webhook payload");
+        goto Error;
+    }
+    request_type = get_webhook_request_type(item->valuestring);
+    user_id = (item = cJSON_GetObjectItem(json, "user_id")) ? item->valueint : 0;
+    id = (item = cJSON_GetObjectItem(json, "id")) ? item->valueint : 0;
+    account = whoop_client_account_for_user(user_id);
+    ESP_LOGI(TAG, "Webhook %s id %d user %d -> account %d", cJSON_GetObjectItem(json, "type")->valuestring, id, user_id, account);
+
+    // Deletions and unknown users need no fetch, acknowledge them so Whoop does not retry
+    if (request_type != WHOOP_API_REQUEST_TYPE_MAX && account >= 0 && whoop_queue_fetch(account, request_type, id)) {
+        // Whoop retries failed deliveries, so let it try again once the queue drains
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_send(req, NULL, 0);
+        goto Error;
+    }
+    httpd_resp_set_status(req, "204 No Content");
+    httpd_resp_send(req, NULL, 0);
+    err = ESP_OK;
+
+Error:
+    if (json) cJSON_Delete(json);
+    if (body) whoop_mem_free(body);
+    whoop_mem_request_end(previous_mem_slot);
+    return err;
+}
+
+httpd_uri_t whoop_webhook_cbk = {
+    .uri       = "/webhook",
+    .method    = HTTP_POST,
+    .handler   = whoop_webhook_post_handler,
+    .user_ctx  = NULL
+};
+#endif
+
 httpd_handle_t start_webserver(void)
 {
     httpd_handle_t server = NULL;
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.max_uri_handlers = WHOOP_SERVER_MAX_URI_HANDLERS;
+    // Exact URIs still match exactly, only /jobs/* and /dashboard/* use the wildcard
+    config.uri_match_fn = httpd_uri_match_wildcard;
 
     // Start the httpd server
     ESP_LOGI(TAG, "Starting server on port: '%d'", config.server_port);
@@ -246,6 +1218,24 @@ httpd_handle_t start_webserver(void)
         httpd_register_uri_handler(server, &whoop_workout_cbk);
         httpd_register_uri_handler(server, &whoop_print_cbk);
         httpd_register_uri_handler(server, &refresh_cbk);
+        httpd_register_uri_handler(server, &whoop_heap_cbk);
+        httpd_register_uri_handler(server, &whoop_latency_cbk);
+        httpd_register_uri_handler(server, &whoop_transfer_cbk);
+        httpd_register_uri_handler(server, &whoop_api_latest_cbk);
+        httpd_register_uri_handler(server, &whoop_api_sleep_cbk);
+        httpd_register_uri_handler(server, &whoop_api_workout_cbk);
+        httpd_register_uri_handler(server, &whoop_api_recovery_cbk);
+        httpd_register_uri_handler(server, &whoop_api_cycle_cbk);
+        httpd_register_uri_handler(server, &whoop_history_cbk);
+        httpd_register_uri_handler(server, &whoop_metrics_cbk);
+        httpd_register_uri_handler(server, &whoop_events_cbk);
+        httpd_register_uri_handler(server, &whoop_job_cbk);
+        httpd_register_uri_handler(server, &whoop_dashboard_cbk);
+        httpd_register_uri_handler(server, &whoop_dashboard_assets_cbk);
+        whoop_events_set_server(server);
+#ifdef CONFIG_WHOOP_WEBHOOK_ENABLE
+        httpd_register_uri_handler(server, &whoop_webhook_cbk);
+#endif
         return server;
     }
 
@@ -253,11 +1243,12 @@ httpd_handle_t start_webserver(void)
     return NULL;
 }
 
+/*Runs on every Wi-Fi drop. The Whoop client stays up, queued fetches wait for the network to come back*/
 void stop_webserver(httpd_handle_t server)
 {
-    // Stop the httpd server
+    // Stop the httpd server, open event streams are closed with it
+    whoop_events_set_server(NULL);
     httpd_stop(server);
-    end_whoop_tls_client();
 }
 
 
@@ -294,5 +1285,9 @@ void init_whoop_server(void)
 
 void discard_whoop_server(void)
 {
-    stop_webserver(server);
+    if (server) {
+        stop_webserver(server);
+        server = NULL;
+    }
+    end_whoop_tls_client();
 }
\ No newline at end of file
@@ -0,0 +1,242 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <sys/param.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/timers.h"
+#include "lwip/sockets.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "whoop_events.h"
+#include "whoop_mem.h"
+
+// Defines
+#define WHOOP_EVENTS_MAX_CLIENTS CONFIG_WHOOP_SSE_MAX_CLIENTS
+#define WHOOP_EVENTS_BACKLOG CONFIG_WHOOP_SSE_BACKLOG_EVENTS
+#define WHOOP_EVENT_TEXT_LEN 96
+#define WHOOP_EVENTS_TICK_MS 1000
+#define WHOOP_EVENTS_PING_TICKS 15
+#define WHOOP_EVENTS_STREAM_HEADER "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nCache-Control: no-cache\r\n" \
+                                   "Connection: keep-alive\r\nAccess-Control-Allow-Origin: *\r\n\r\n"
+
+// Types
+typedef struct whoop_event
+{
+    uint32_t seq;
+    int64_t publish_us;
+    uint8_t len;
+    char text[WHOOP_EVENT_TEXT_LEN];
+} whoop_event_t;
+
+/*Owned by the httpd session, freed when the socket closes*/
+typedef struct whoop_events_client
+{
+    int fd;
+    uint32_t next_seq;          /*Next event to write, events between this and the head are the client's backlog*/
+    uint8_t offset;             /*Bytes of that event already written*/
+} whoop_events_client_t;
+
+// Local Global Variables
+static const char *TAG = "WHOOP EVENTS";
+static SemaphoreHandle_t g_events_mutex = NULL;
+static whoop_event_t g_events[WHOOP_EVENTS_BACKLOG];
+static uint32_t g_head_seq = 0;
+static whoop_events_client_t *g_clients[WHOOP_EVENTS_MAX_CLIENTS];     /*httpd task only*/
+static httpd_handle_t g_server = NULL;
+static volatile int g_client_count = 0;
+static volatile int g_flush_queued = 0;
+static int g_tick_count = 0;
+static whoop_events_stats_t g_stats;
+static uint64_t g_fanout_total_us = 0;
+
+// Local functions
+static void remove_client(whoop_events_client_t *client)
+{
+    for(int index = 0; index < WHOOP_EVENTS_MAX_CLIENTS; index++)
+    {
+        if(g_clients[index] == client)
+        {
+            g_clients[index] = NULL;
+            g_client_count--;
+        }
+    }
+}
+
+static void free_client(void *ctx)
+{
+    remove_client(ctx);
+    whoop_mem_free(ctx);
+}
+
+static void evict_client(whoop_events_client_t *client, const char *reason)
+{
+    ESP_LOGI(TAG, "Evicting event client %d: %s", client->fd, reason);
+    g_stats.evicted++;
+    remove_client(client);
+    // The session keeps the client until httpd closes the socket and calls free_client
+    httpd_sess_trigger_close(g_server, client->fd);
+}
+
+/*Writes as much of the backlog as the socket takes without blocking, a slow client keeps its place until
+  the backlog wraps past it*/
+static void flush_client(whoop_events_client_t *client)
+{
+    whoop_event_t event;
+    while(client->next_seq != g_head_seq)
+    {
+        if(g_head_seq - client->next_seq > WHOOP_EVENTS_BACKLOG)
+        {
+            evict_client(client, "backlog full");
+            return;
+        }
+        xSemaphoreTake(g_events_mutex, portMAX_DELAY);
+        event = g_events[client->next_seq % WHOOP_EVENTS_BACKLOG];
+        xSemaphoreGive(g_events_mutex);
+        if(event.seq != client->next_seq)
+        {
+            evict_client(client, "backlog overwritten");
+            return;
+        }
+        int ret = httpd_socket_send(g_server, client->fd, event.text + client->offset, event.len - client->offset, MSG_DONTWAIT);
+        if(ret == HTTPD_SOCK_ERR_TIMEOUT)
+            return;
+        if(ret < 0)
+        {
+            evict_client(client, "send failed");
+            return;
+        }
+        client->offset += ret;
+        if(client->offset < event.len)
+            return;
+        client->offset = 0;
+        client->next_seq++;
+
+        uint32_t fanout_us = esp_timer_get_time() - event.publish_us;
+        g_stats.delivered++;
+        g_fanout_total_us += fanout_us;
+        if(fanout_us > g_stats.fanout_max_us) g_stats.fanout_max_us = fanout_us;
+    }
+}
+
+static void flush_clients_work(void *arg)
+{
+    g_flush_queued = 0;
+    for(int index = 0; index < WHOOP_EVENTS_MAX_CLIENTS; index++)
+    {
+        if(g_clients[index]) flush_client(g_clients[index]);
+    }
+}
+
+static void queue_flush(void)
+{
+    if(!g_server || !g_client_count || g_flush_queued)
+        return;
+    g_flush_queued = 1;
+    if(httpd_queue_work(g_server, flush_clients_work, NULL) != ESP_OK)
+        g_flush_queued = 0;
+}
+
+static void publish_event(const char *format, ...) __attribute__((format(printf, 1, 2)));
+static void publish_event(const char *format, ...)
+{
+    va_list argptr;
+    if(!g_events_mutex || !g_client_count)
+        return;
+    xSemaphoreTake(g_events_mutex, portMAX_DELAY);
+    whoop_event_t *event = &g_events[g_head_seq % WHOOP_EVENTS_BACKLOG];
+    va_start(argptr, format);
+    int len = vsnprintf(event->text, sizeof(event->text), format, argptr);
+    va_end(argptr);
+    event->len = MIN(len, (int) sizeof(event->text) - 1);
+    event->seq = g_head_seq++;
+    event->publish_us = esp_timer_get_time();
+    g_stats.published++;
+    xSemaphoreGive(g_events_mutex);
+    queue_flush();
+}
+
+/*Retries clients that could not take the whole backlog, and pings idle streams so proxies and dead peers are noticed*/
+static void events_tick(TimerHandle_t timer)
+{
+    if(++g_tick_count % WHOOP_EVENTS_PING_TICKS == 0)
+        publish_event(": ping\n\n");
+    else
+        queue_flush();
+}
+
+// Global Functions
+void init_whoop_events(void)
+{
+    g_events_mutex = xSemaphoreCreateMutex();
+    TimerHandle_t timer = xTimerCreate("events", pdMS_TO_TICKS(WHOOP_EVENTS_TICK_MS), pdTRUE, NULL, events_tick);
+    if(!g_events_mutex || !timer || xTimerStart(timer, 0) != pdPASS)
+        ESP_LOGE(TAG, "Could not start event stream");
+}
+
+void whoop_events_set_server(httpd_handle_t server)
+{
+    g_server = server;
+}
+
+esp_err_t whoop_events_add_client(httpd_req_t *req)
+{
+    int slot = 0;
+    int fd = httpd_req_to_sockfd(req);
+    while(slot < WHOOP_EVENTS_MAX_CLIENTS && g_clients[slot]) slot++;
+    if(slot == WHOOP_EVENTS_MAX_CLIENTS)
+    {
+        g_stats.rejected++;
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_send(req, "Too many event clients", HTTPD_RESP_USE_STRLEN);
+        return ESP_OK;
+    }
+
+    whoop_mem_slot_n previous_mem_slot = whoop_mem_request_begin(WHOOP_MEM_SLOT_SERVER);
+    whoop_events_client_t *client = whoop_mem_malloc(sizeof(whoop_events_client_t));
+    whoop_mem_request_end(previous_mem_slot);
+    if(!client)
+    {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+        return ESP_FAIL;
+    }
+    // The stream outlives the handler, so the headers go straight to the socket rather than through httpd_resp
+    if(httpd_socket_send(req->handle, fd, WHOOP_EVENTS_STREAM_HEADER, strlen(WHOOP_EVENTS_STREAM_HEADER), 0) < 0)
+    {
+        whoop_mem_free(client);
+        return ESP_FAIL;
+    }
+    client->fd = fd;
+    client->offset = 0;
+    xSemaphoreTake(g_events_mutex, portMAX_DELAY);
+    client->next_seq = g_head_seq;
+    xSemaphoreGive(g_events_mutex);
+    req->sess_ctx = client;
+    req->free_ctx = free_client;
+    g_clients[slot] = client;
+    g_client_count++;
+    g_stats.connects++;
+    ESP_LOGI(TAG, "Event client %d connected, %d streaming", fd, g_client_count);
+    return ESP_OK;
+}
+
+void whoop_events_publish_record(int account, whoop_data_type_n type)
+{
+    publish_event("event: record\ndata: {\"user\":%d,\"type\":\"%s\",\"generation\":%u}\n\n",
+                  account, get_whoop_data_type_name(type), get_whoop_data_generation());
+}
+
+void whoop_events_publish_page(int account, whoop_data_type_n type)
+{
+    publish_event("event: page\ndata: {\"user\":%d,\"page\":\"%s\"}\n\n", account, get_whoop_data_type_name(type));
+}
+
+void whoop_events_get_stats(whoop_events_stats_t *stats_out)
+{
+    *stats_out = g_stats;
+    stats_out->clients = g_client_count;
+    stats_out->fanout_avg_us = g_stats.delivered ? g_fanout_total_us / g_stats.delivered : 0;
+    stats_out->client_state_bytes = sizeof(whoop_events_client_t);
+    stats_out->backlog_bytes = sizeof(g_events);
+}
\ No newline at end of file
@@ -0,0 +1,501 @@
+#include <string.h>
+#include <stdint.h>
+#include "esp_log.h"
+
+#include "whoop_inflate.h"
+#include "whoop_mem.h"
+
+// Defines
+#define WHOOP_INFLATE_CARRY_LEN 640     /*Largest unit that can be cut short is a dynamic block header, about 560 bytes at worst*/
+#define WHOOP_INFLATE_MIN_OUTPUT 512
+#define WHOOP_INFLATE_MAX_BITS 15
+#define WHOOP_INFLATE_MAX_LENGTH_CODES 286
+#define WHOOP_INFLATE_MAX_DISTANCE_CODES 30
+#define WHOOP_INFLATE_FIXED_LENGTH_CODES 288
+#define WHOOP_INFLATE_CODE_LENGTH_CODES 19
+
+#define GZIP_FLAG_HEADER_CRC 0x02
+#define GZIP_FLAG_EXTRA 0x04
+#define GZIP_FLAG_NAME 0x08
+#define GZIP_FLAG_COMMENT 0x10
+
+static const char *TAG = "WHOOP INFLATE";
+
+// Types
+typedef enum whoop_inflate_state
+{
+    WHOOP_INFLATE_STATE_GZIP_HEADER,
+    WHOOP_INFLATE_STATE_BLOCK_HEADER,
+    WHOOP_INFLATE_STATE_STORED,
+    WHOOP_INFLATE_STATE_CODES,
+    WHOOP_INFLATE_STATE_TRAILER,
+    WHOOP_INFLATE_STATE_DONE
+} whoop_inflate_state_n;
+
+/*Input is decoded in units (a header, a block header, one literal or one length/distance pair). A unit that
+  runs out of input is rolled back to its first bit and retried once the next chunk arrives, so the decoder
+  never has to suspend mid-code; the undecoded tail is kept in the carry*/
+struct whoop_inflate
+{
+    whoop_inflate_state_n state;
+    int status;                         /*Sticky once an error is hit*/
+    int last_block;
+    size_t stored_remaining;
+    // Input is the carry followed by the chunk being fed, read as one stream
+    unsigned char carry[WHOOP_INFLATE_CARRY_LEN];
+    size_t carry_len;
+    const unsigned char *input;
+    size_t input_len;
+    size_t position;
+    uint32_t bit_buffer;
+    int bit_count;
+    int underflow;
+    // Canonical Huffman tables of the current block, counts per code length and symbols in code order
+    uint16_t length_count[WHOOP_INFLATE_MAX_BITS + 1];
+    uint16_t length_symbol[WHOOP_INFLATE_FIXED_LENGTH_CODES];
+    uint16_t distance_count[WHOOP_INFLATE_MAX_BITS + 1];
+    uint16_t distance_symbol[WHOOP_INFLATE_MAX_DISTANCE_CODES];
+    // Inflated body, also the window back references are copied from
+    char *output;
+    size_t output_len;
+    size_t output_capacity;
+};
+
+// Local Global Variables
+static const uint16_t g_length_base[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                           35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t g_length_extra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                           3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t g_distance_base[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                                             257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const uint8_t g_distance_extra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                                             7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+static const uint8_t g_code_length_order[WHOOP_INFLATE_CODE_LENGTH_CODES] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+static const uint32_t g_crc_table[16] = {0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+                                         0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c};
+
+// Local functions
+static int next_byte(whoop_inflate_handle_t inflate)
+{
+    if(inflate->position < inflate->carry_len)
+        return inflate->carry[inflate->position++];
+    if(inflate->position - inflate->carry_len < inflate->input_len)
+        return inflate->input[inflate->position++ - inflate->carry_len];
+    inflate->underflow = 1;
+    return 0;
+}
+
+/*Bits are read LSB first. Returns 0 and flags underflow when the input runs out*/
+static uint32_t read_bits(whoop_inflate_handle_t inflate, int bit_count)
+{
+    uint32_t value = inflate->bit_buffer;
+    while(inflate->bit_count < bit_count)
+    {
+        int byte = next_byte(inflate);
+        if(inflate->underflow) return 0;
+        value |= (uint32_t) byte << inflate->bit_count;
+        inflate->bit_count += 8;
+    }
+    inflate->bit_buffer = value >> bit_count;
+    inflate->bit_count -= bit_count;
+    return value & ((1UL << bit_count) - 1);
+}
+
+static void align_to_byte(whoop_inflate_handle_t inflate)
+{
+    inflate->bit_buffer = 0;
+    inflate->bit_count = 0;
+}
+
+/*Returns 0 for a complete code, more than 0 for an incomplete one and less than 0 when over-subscribed*/
+static int build_huffman(uint16_t *count, uint16_t *symbol, const uint8_t *lengths, int symbol_count)
+{
+    uint16_t offsets[WHOOP_INFLATE_MAX_BITS + 1];
+    int left = 1;
+    memset(count, 0, sizeof(uint16_t) * (WHOOP_INFLATE_MAX_BITS + 1));
+    for(int index = 0; index < symbol_count; index++)
+        count[lengths[index]]++;
+    if(count[0] == symbol_count)
+        return 0;
+    for(int len = 1; len <= WHOOP_INFLATE_MAX_BITS; len++)
+    {
+        left = (left << 1) - count[len];
+        if(left < 0) return left;
+    }
+    offsets[1] = 0;
+    for(int len = 1; len < WHOOP_INFLATE_MAX_BITS; len++)
+        offsets[len + 1] = offsets[len] + count[len];
+    for(int index = 0; index < symbol_count; index++)
+    {
+        if(lengths[index]) symbol[offsets[lengths[index]]++] = index;
+    }
+    return left;
+}
+
+/*Walks the canonical code one bit at a time, slow but needs no lookup table*/
+static int decode_symbol(whoop_inflate_handle_t inflate, const uint16_t *count, const uint16_t *symbol)
+{
+    int code = 0;
+    int first = 0;
+    int index = 0;
+    for(int len = 1; len <= WHOOP_INFLATE_MAX_BITS; len++)
+    {
+        code |= read_bits(inflate, 1);
+        if(inflate->underflow) return -1;
+        if(code - count[len] < first)
+            return symbol[index + (code - first)];
+        index += count[len];
+        first = (first + count[len]) << 1;
+        code <<= 1;
+    }
+    return -1;
+}
+
+static int reserve_output(whoop_inflate_handle_t inflate, size_t extra)
+{
+    size_t needed = inflate->output_len + extra + 1;
+    size_t capacity = inflate->output_capacity;
+    char *output;
+    if(needed <= capacity) return WHOOP_INFLATE_STATUS_OK;
+    while(capacity < needed) capacity *= 2;
+    if(!(output = whoop_mem_realloc(inflate->output, capacity)))
+        return WHOOP_INFLATE_STATUS_NO_MEM;
+    inflate->output = output;
+    inflate->output_capacity = capacity;
+    return WHOOP_INFLATE_STATUS_OK;
+}
+
+static uint32_t crc32_update(uint32_t crc, const char *data, size_t data_len)
+{
+    crc = ~crc;
+    while(data_len--)
+    {
+        crc ^= (unsigned char) *data++;
+        crc = (crc >> 4) ^ g_crc_table[crc & 0x0f];
+        crc = (crc >> 4) ^ g_crc_table[crc & 0x0f];
+    }
+    return ~crc;
+}
+
+static int inflate_gzip_header(whoop_inflate_handle_t inflate)
+{
+    int id1 = read_bits(inflate, 8);
+    int id2 = read_bits(inflate, 8);
+    int method = read_bits(inflate, 8);
+    int flags = read_bits(inflate, 8);
+    read_bits(inflate, 16);     /*Modification time*/
+    read_bits(inflate, 16);
+    read_bits(inflate, 16);     /*Extra flags, OS*/
+    if(inflate->underflow) return WHOOP_INFLATE_STATUS_OK;
+    if(id1 != 0x1f || id2 != 0x8b || method != 8)
+        return WHOOP_INFLATE_STATUS_BAD_DATA;
+    if(flags & GZIP_FLAG_EXTRA)
+    {
+        for(int extra_len = read_bits(inflate, 16); extra_len > 0 && !inflate->underflow; extra_len--)
+            read_bits(inflate, 8);
+    }
+    if(flags & GZIP_FLAG_NAME)
+        while(read_bits(inflate, 8) && !inflate->underflow);
+    if(flags & GZIP_FLAG_COMMENT)
+        while(read_bits(inflate, 8) && !inflate->underflow);
+    if(flags & GZIP_FLAG_HEADER_CRC)
+        read_bits(inflate, 16);
+    if(inflate->underflow) return WHOOP_INFLATE_STATUS_OK;
+    inflate->state = WHOOP_INFLATE_STATE_BLOCK_HEADER;
+    return WHOOP_INFLATE_STATUS_OK;
+}
+
+static int inflate_fixed_tables(whoop_inflate_handle_t inflate)
+{
+    uint8_t lengths[WHOOP_INFLATE_FIXED_LENGTH_CODES];
+    int symbol = 0;
+    for(; symbol < 144; symbol++) lengths[symbol] = 8;
+    for(; symbol < 256; symbol++) lengths[symbol] = 9;
+    for(; symbol < 280; symbol++) lengths[symbol] = 7;
+    for(; symbol < WHOOP_INFLATE_FIXED_LENGTH_CODES; symbol++) lengths[symbol] = 8;
+    build_huffman(inflate->length_count, inflate->length_symbol, lengths, WHOOP_INFLATE_FIXED_LENGTH_CODES);
+    memset(lengths, 5, WHOOP_INFLATE_MAX_DISTANCE_CODES);
+    build_huffman(inflate->distance_count, inflate->distance_symbol, lengths, WHOOP_INFLATE_MAX_DISTANCE_CODES);
+    inflate->state = WHOOP_INFLATE_STATE_CODES;
+    return WHOOP_INFLATE_STATUS_OK;
+}
+
+static int inflate_dynamic_tables(whoop_inflate_handle_t inflate)
+{
+    uint8_t lengths[WHOOP_INFLATE_MAX_LENGTH_CODES + WHOOP_INFLATE_MAX_DISTANCE_CODES];
+    int length_codes = read_bits(inflate, 5) + 257;
+    int distance_codes = read_bits(inflate, 5) + 1;
+    int code_length_codes = read_bits(inflate, 4) + 4;
+    int index;
+    int left;
+    if(inflate->underflow) return WHOOP_INFLATE_STATUS_OK;
+    if(length_codes > WHOOP_INFLATE_MAX_LENGTH_CODES || distance_codes > WHOOP_INFLATE_MAX_DISTANCE_CODES)
+        return WHOOP_INFLATE_STATUS_BAD_DATA;
+
+    // The code length code is built into the literal/length table, which is rebuilt right after
+    memset(lengths, 0, WHOOP_INFLATE_CODE_LENGTH_CODES);
+    for(index = 0; index < code_length_codes; index++)
+        lengths[g_code_length_order[index]] = read_bits(inflate, 3);
+    if(inflate->underflow) return WHOOP_INFLATE_STATUS_OK;
+    if(build_huffman(inflate->length_count, inflate->length_symbol, lengths, WHOOP_INFLATE_CODE_LENGTH_CODES))
+        return WHOOP_INFLATE_STATUS_BAD_DATA;
+
+    index = 0;
+    while(index < length_codes + distance_codes)
+    {
+        int symbol = decode_symbol(inflate, inflate->length_count, inflate->length_symbol);
+        int repeat;
+        uint8_t len = 0;
+        if(inflate->underflow) return WHOOP_INFLATE_STATUS_OK;
+        if(symbol < 0) return WHOOP_INFLATE_STATUS_BAD_DATA;
+        if(symbol < 16)
+        {
+            lengths[index++] = symbol;
+            continue;
+        }
+        if(symbol == 16)
+        {
+            if(!index) return WHOOP_INFLATE_STATUS_BAD_DATA;
+            len = lengths[index - 1];
+            repeat = 3 + read_bits(inflate, 2);
+        }
+        else if(symbol == 17)
+            repeat = 3 + read_bits(inflate, 3);
+        else
+            repeat = 11 + read_bits(inflate, 7);
+        if(inflate->underflow) return WHOOP_INFLATE_STATUS_OK;
+        if(index + repeat > length_codes + distance_codes)
+            return WHOOP_INFLATE_STATUS_BAD_DATA;
+        while(repeat--) lengths[index++] = len;
+    }
+    if(!lengths[256])
+        return WHOOP_INFLATE_STATUS_BAD_DATA;
+
+    // Incomplete codes are only allowed when they hold a single symbol
+    left = build_huffman(inflate->length_count, inflate->length_symbol, lengths, length_codes);
+    if(left < 0 || (left > 0 && length_codes - inflate->length_count[0] != 1))
+        return WHOOP_INFLATE_STATUS_BAD_DATA;
+    left = build_huffman(inflate->distance_count, inflate->distance_symbol, lengths + length_codes, distance_codes);
+    if(left < 0 || (left > 0 && distance_codes - inflate->distance_count[0] != 1))
+        return WHOOP_INFLATE_STATUS_BAD_DATA;
+    inflate->state = WHOOP_INFLATE_STATE_CODES;
+    return WHOOP_INFLATE_STATUS_OK;
+}
+
+static int inflate_block_header(whoop_inflate_handle_t inflate)
+{
+    int last_block = read_bits(inflate, 1);
+    int type = read_bits(inflate, 2);
+    uint32_t len, inverted_len;
+    if(inflate->underflow) return WHOOP_INFLATE_STATUS_OK;
+    inflate->last_block = last_block;
+    switch(type)
+    {
+        case 0:
+            align_to_byte(inflate);
+            len = read_bits(inflate, 16);
+            inverted_len = read_bits(inflate, 16);
+            if(inflate->underflow) return WHOOP_INFLATE_STATUS_OK;
+            if(len != (~inverted_len & 0xffff))
+                return WHOOP_INFLATE_STATUS_BAD_DATA;
+            inflate->stored_remaining = len;
+            inflate->state = WHOOP_INFLATE_STATE_STORED;
+            return WHOOP_INFLATE_STATUS_OK;
+        case 1:
+            return inflate_fixed_tables(inflate);
+        case 2:
+            return inflate_dynamic_tables(inflate);
+        default:
+            return WHOOP_INFLATE_STATUS_BAD_DATA;
+    }
+}
+
+static int inflate_stored(whoop_inflate_handle_t inflate)
+{
+    size_t available = inflate->carry_len + inflate->input_len - inflate->position;
+    size_t copy_len;
+    int status;
+    if(!inflate->stored_remaining)
+    {
+        inflate->state = inflate->last_block ? WHOOP_INFLATE_STATE_TRAILER : WHOOP_INFLATE_STATE_BLOCK_HEADER;
+        return WHOOP_INFLATE_STATUS_OK;
+    }
+    if(!available)
+    {
+        inflate->underflow = 1;
+        return WHOOP_INFLATE_STATUS_OK;
+    }
+    copy_len = available < inflate->stored_remaining ? available : inflate->stored_remaining;
+    if((status = reserve_output(inflate, copy_len)))
+        return status;
+    for(size_t index = 0; index < copy_len; index++)
+        inflate->output[inflate->output_len++] = next_byte(inflate);
+    inflate->stored_remaining -= copy_len;
+    return WHOOP_INFLATE_STATUS_OK;
+}
+
+static int inflate_codes(whoop_inflate_handle_t inflate)
+{
+    int symbol = decode_symbol(inflate, inflate->length_count, inflate->length_symbol);
+    int len, distance, status;
+    if(inflate->underflow) return WHOOP_INFLATE_STATUS_OK;
+    if(symbol < 0) return WHOOP_INFLATE_STATUS_BAD_DATA;
+    if(symbol < 256)
+    {
+        if((status = reserve_output(inflate, 1)))
+            return status;
+        inflate->output[inflate->output_len++] = symbol;
+        return WHOOP_INFLATE_STATUS_OK;
+    }
+    if(symbol == 256)
+    {
+        inflate->state = inflate->last_block ? WHOOP_INFLATE_STATE_TRAILER : WHOOP_INFLATE_STATE_BLOCK_HEADER;
+        return WHOOP_INFLATE_STATUS_OK;
+    }
+    symbol -= 257;
+    if(symbol >= 29) return WHOOP_INFLATE_STATUS_BAD_DATA;
+    len = g_length_base[symbol] + read_bits(inflate, g_length_extra[symbol]);
+    symbol = decode_symbol(inflate, inflate->distance_count, inflate->distance_symbol);
+    if(inflate->underflow) return WHOOP_INFLATE_STATUS_OK;
+    if(symbol < 0 || symbol >= WHOOP_INFLATE_MAX_DISTANCE_CODES) return WHOOP_INFLATE_STATUS_BAD_DATA;
+    distance = g_distance_base[symbol] + read_bits(inflate, g_distance_extra[symbol]);
+    if(inflate->underflow) return WHOOP_INFLATE_STATUS_OK;
+    if((size_t) distance > inflate->output_len) return WHOOP_INFLATE_STATUS_BAD_DATA;
+    if((status = reserve_output(inflate, len)))
+        return status;
+    // Byte by byte, the source may overlap what is being written
+    while(len--)
+    {
+        inflate->output[inflate->output_len] = inflate->output[inflate->output_len - distance];
+        inflate->output_len++;
+    }
+    return WHOOP_INFLATE_STATUS_OK;
+}
+
+static int inflate_trailer(whoop_inflate_handle_t inflate)
+{
+    uint32_t crc, size;
+    align_to_byte(inflate);
+    crc = read_bits(inflate, 16);
+    crc |= read_bits(inflate, 16) << 16;
+    size = read_bits(inflate, 16);
+    size |= read_bits(inflate, 16) << 16;
+    if(inflate->underflow) return WHOOP_INFLATE_STATUS_OK;
+    if(size != (uint32_t) inflate->output_len || crc != crc32_update(0, inflate->output, inflate->output_len))
+    {
+        ESP_LOGI(TAG, "Trailer mismatch, %u bytes inflated", inflate->output_len);
+        return WHOOP_INFLATE_STATUS_BAD_DATA;
+    }
+    inflate->state = WHOOP_INFLATE_STATE_DONE;
+    return WHOOP_INFLATE_STATUS_OK;
+}
+
+static int inflate_unit(whoop_inflate_handle_t inflate)
+{
+    switch(inflate->state)
+    {
+        case WHOOP_INFLATE_STATE_GZIP_HEADER:
+            return inflate_gzip_header(inflate);
+        case WHOOP_INFLATE_STATE_BLOCK_HEADER:
+            return inflate_block_header(inflate);
+        case WHOOP_INFLATE_STATE_STORED:
+            return inflate_stored(inflate);
+        case WHOOP_INFLATE_STATE_CODES:
+            return inflate_codes(inflate);
+        case WHOOP_INFLATE_STATE_TRAILER:
+            return inflate_trailer(inflate);
+        default:
+            return WHOOP_INFLATE_STATUS_OK;
+    }
+}
+
+// Global functions
+int whoop_inflate_begin(whoop_inflate_handle_t *handle, size_t size_hint)
+{
+    whoop_inflate_handle_t inflate = whoop_mem_malloc(sizeof(struct whoop_inflate));
+    if(!inflate) return WHOOP_INFLATE_STATUS_NO_MEM;
+    memset(inflate, 0, sizeof(struct whoop_inflate));
+    inflate->output_capacity = size_hint + 1 > WHOOP_INFLATE_MIN_OUTPUT ? size_hint + 1 : WHOOP_INFLATE_MIN_OUTPUT;
+    if(!(inflate->output = whoop_mem_malloc(inflate->output_capacity)))
+    {
+        whoop_mem_free(inflate);
+        return WHOOP_INFLATE_STATUS_NO_MEM;
+    }
+    *handle = inflate;
+    return WHOOP_INFLATE_STATUS_OK;
+}
+
+int whoop_inflate_feed(whoop_inflate_handle_t inflate, const void *data, size_t data_len)
+{
+    size_t position;
+    size_t remaining;
+    uint32_t bit_buffer;
+    int bit_count;
+    if(inflate->status) return inflate->status;
+    if(inflate->state == WHOOP_INFLATE_STATE_DONE) return WHOOP_INFLATE_STATUS_DONE;
+
+    inflate->input = data;
+    inflate->input_len = data_len;
+    inflate->position = 0;
+    while(inflate->state != WHOOP_INFLATE_STATE_DONE)
+    {
+        position = inflate->position;
+        bit_buffer = inflate->bit_buffer;
+        bit_count = inflate->bit_count;
+        inflate->underflow = 0;
+        if((inflate->status = inflate_unit(inflate)))
+            return inflate->status;
+        if(inflate->underflow)
+        {
+            inflate->position = position;
+            inflate->bit_buffer = bit_buffer;
+            inflate->bit_count = bit_count;
+            break;
+        }
+    }
+
+    // Keep what the cut short unit needs for next time
+    remaining = inflate->carry_len + inflate->input_len - inflate->position;
+    if(inflate->state == WHOOP_INFLATE_STATE_DONE)
+    {
+        remaining = 0;
+    }
+    else if(remaining > WHOOP_INFLATE_CARRY_LEN)
+    {
+        inflate->status = WHOOP_INFLATE_STATUS_BAD_DATA;
+        return inflate->status;
+    }
+    else if(inflate->position < inflate->carry_len)
+    {
+        size_t carry_left = inflate->carry_len - inflate->position;
+        memmove(inflate->carry, inflate->carry + inflate->position, carry_left);
+        memcpy(inflate->carry + carry_left, inflate->input, inflate->input_len);
+    }
+    else
+    {
+        memcpy(inflate->carry, inflate->input + (inflate->position - inflate->carry_len), remaining);
+    }
+    inflate->carry_len = remaining;
+    inflate->input = NULL;
+    inflate->input_len = 0;
+    inflate->position = 0;
+    return inflate->state == WHOOP_INFLATE_STATE_DONE ? WHOOP_INFLATE_STATUS_DONE : WHOOP_INFLATE_STATUS_OK;
+}
+
+int whoop_inflate_finish(whoop_inflate_handle_t inflate, char **output, size_t *output_len)
+{
+    if(inflate->status) return inflate->status;
+    if(inflate->state != WHOOP_INFLATE_STATE_DONE) return WHOOP_INFLATE_STATUS_INCOMPLETE;
+    inflate->output[inflate->output_len] = '\0';
+    *output = inflate->output;
+    *output_len = inflate->output_len;
+    inflate->output = NULL;
+    return WHOOP_INFLATE_STATUS_OK;
+}
+
+void whoop_inflate_end(whoop_inflate_handle_t inflate)
+{
+    if(!inflate) return;
+    if(inflate->output) whoop_mem_free(inflate->output);
+    whoop_mem_free(inflate);
+}
\ No newline at end of file
@@ -0,0 +1,93 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "whoop_latency.h"
+
+// Local Global Variables
+static const char *g_phase_names[WHOOP_LATENCY_PHASE_MAX] = {"connect", "request", "first_byte", "body", "parse", "commit", "total"};
+
+/*Samples since boot. Counts only ever increase so they can be exported as Prometheus counters*/
+static uint32_t g_histograms[WHOOP_API_REQUEST_TYPE_MAX][WHOOP_LATENCY_PHASE_MAX][WHOOP_LATENCY_BUCKET_COUNT];
+static uint64_t g_sums_us[WHOOP_API_REQUEST_TYPE_MAX][WHOOP_LATENCY_PHASE_MAX];
+
+// Local functions
+static int duration_to_bucket(uint32_t duration_us)
+{
+    int bucket = 0;
+    while(duration_us > 1 && bucket < WHOOP_LATENCY_BUCKET_COUNT - 1)
+    {
+        duration_us >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+static int is_valid(whoop_api_request_type_n request_type, whoop_latency_phase_n phase)
+{
+    return request_type >= 0 && request_type < WHOOP_API_REQUEST_TYPE_MAX
+        && phase >= 0 && phase < WHOOP_LATENCY_PHASE_MAX;
+}
+
+/*Linear interpolation inside the bucket holding the requested rank*/
+static uint32_t percentile_from_buckets(const uint32_t *buckets, uint32_t total, uint32_t percent)
+{
+    uint32_t rank = (total * percent + 99) / 100;
+    uint32_t seen = 0;
+    for(int bucket = 0; bucket < WHOOP_LATENCY_BUCKET_COUNT; bucket++)
+    {
+        if(!buckets[bucket]) continue;
+        if(seen + buckets[bucket] >= rank)
+        {
+            uint32_t lower = bucket ? (1UL << bucket) : 0;
+            uint32_t width = (1UL << (bucket + 1)) - lower;
+            return lower + (uint32_t) ( ( (uint64_t) width * (rank - seen) ) / buckets[bucket] );
+        }
+        seen += buckets[bucket];
+    }
+    return 0;
+}
+
+// Global functions
+void whoop_latency_record(whoop_api_request_type_n request_type, whoop_latency_phase_n phase, int64_t duration_us)
+{
+    if(!is_valid(request_type, phase) || duration_us < 0) return;
+    uint32_t clamped_us = duration_us > UINT32_MAX ? UINT32_MAX : (uint32_t) duration_us;
+    int bucket = duration_to_bucket(clamped_us);
+
+    portENTER_CRITICAL();
+    g_histograms[request_type][phase][bucket]++;
+    g_sums_us[request_type][phase] += clamped_us;
+    portEXIT_CRITICAL();
+}
+
+int whoop_latency_get_buckets(whoop_api_request_type_n request_type, whoop_latency_phase_n phase, uint32_t *buckets_out, uint64_t *sum_us_out)
+{
+    if(!is_valid(request_type, phase) || !buckets_out) return -1;
+    portENTER_CRITICAL();
+    memcpy(buckets_out, g_histograms[request_type][phase], sizeof(g_histograms[request_type][phase]));
+    if(sum_us_out) *sum_us_out = g_sums_us[request_type][phase];
+    portEXIT_CRITICAL();
+    return 0;
+}
+
+int whoop_latency_get_summary(whoop_api_request_type_n request_type, whoop_latency_phase_n phase, whoop_latency_summary_t *summary_out)
+{
+    uint32_t buckets[WHOOP_LATENCY_BUCKET_COUNT];
+    if(!summary_out || whoop_latency_get_buckets(request_type, phase, buckets, NULL)) return -1;
+
+    memset(summary_out, 0, sizeof(whoop_latency_summary_t));
+    for(int bucket = 0; bucket < WHOOP_LATENCY_BUCKET_COUNT; bucket++) summary_out->count += buckets[bucket];
+    if(!summary_out->count) return 0;
+
+    summary_out->p50_us = percentile_from_buckets(buckets, summary_out->count, 50);
+    summary_out->p90_us = percentile_from_buckets(buckets, summary_out->count, 90);
+    summary_out->p99_us = percentile_from_buckets(buckets, summary_out->count, 99);
+    return 0;
+}
+
+const char *whoop_latency_phase_name(whoop_latency_phase_n phase)
+{
+    if(phase < 0 || phase >= WHOOP_LATENCY_PHASE_MAX) return "unknown";
+    return g_phase_names[phase];
+}
\ No newline at end of file
@@ -0,0 +1,229 @@
+#include <string.h>
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_system.h"
+
+#include "cJSON.h"
+#include "whoop_mem.h"
+
+// Defines
+#define WHOOP_MEM_HEADER_SIZE sizeof(whoop_mem_header_t)
+#define WHOOP_MEM_TASK_SLOTS 4 /*httpd, fetch, display and one spare*/
+#define WHOOP_MEM_SLOT_NONE WHOOP_MEM_SLOT_MAX
+#define WHOOP_MEM_SUMMARY_FORMAT "%s request: %u allocs, peak %u bytes, largest block %u bytes, min free heap %u, watermark %u"
+
+// Types
+/*Prepended to every tracked block so frees are charged back to the slot that allocated them*/
+typedef union whoop_mem_header
+{
+    struct
+    {
+        size_t size;
+        int slot;
+    } info;
+    double align;
+} whoop_mem_header_t;
+
+typedef struct whoop_mem_slot_data
+{
+    whoop_mem_stats_t stats;
+    size_t min_free_heap;
+} whoop_mem_slot_data_t;
+
+/*Slot a task is charging to. Tasks run requests concurrently, so each brackets its own*/
+typedef struct whoop_mem_task_slot
+{
+    TaskHandle_t task;
+    whoop_mem_slot_n slot;
+} whoop_mem_task_slot_t;
+
+// Local Global Variables
+static const char *TAG = "WHOOP MEM";
+static const char *g_slot_names[WHOOP_MEM_SLOT_MAX] = {"sleep", "workout", "recovery", "cycle", "token", "server"};
+
+static whoop_mem_slot_data_t g_slot_data[WHOOP_MEM_SLOT_MAX];
+static whoop_mem_task_slot_t g_task_slots[WHOOP_MEM_TASK_SLOTS];
+
+// Local functions
+/*Must be called inside a critical section*/
+static whoop_mem_task_slot_t *find_task_slot(TaskHandle_t task)
+{
+    for(int i = 0; i < WHOOP_MEM_TASK_SLOTS; i++)
+    {
+        if(g_task_slots[i].task == task) return &g_task_slots[i];
+    }
+    return NULL;
+}
+
+/*Must be called inside a critical section. Allocations outside any request are charged to the server slot*/
+static whoop_mem_slot_n active_slot(void)
+{
+    whoop_mem_task_slot_t *task_slot = find_task_slot(xTaskGetCurrentTaskHandle());
+    return task_slot ? task_slot->slot : WHOOP_MEM_SLOT_SERVER;
+}
+
+static void charge_alloc(int slot, size_t size)
+{
+    whoop_mem_stats_t *stats = &g_slot_data[slot].stats;
+    size_t free_heap = esp_get_free_heap_size();
+    stats->alloc_count++;
+    stats->live_bytes += size;
+    if(stats->live_bytes > stats->peak_bytes) stats->peak_bytes = stats->live_bytes;
+    if(stats->peak_bytes > stats->max_peak_bytes) stats->max_peak_bytes = stats->peak_bytes;
+    if(size > stats->largest_block) stats->largest_block = size;
+    if(free_heap < g_slot_data[slot].min_free_heap) g_slot_data[slot].min_free_heap = free_heap;
+}
+
+static void charge_free(int slot, size_t size)
+{
+    whoop_mem_stats_t *stats = &g_slot_data[slot].stats;
+    stats->live_bytes = (stats->live_bytes > size) ? stats->live_bytes - size : 0;
+}
+
+// Global functions
+void init_whoop_mem(void)
+{
+    cJSON_Hooks hooks = {
+        .malloc_fn = whoop_mem_malloc,
+        .free_fn = whoop_mem_free
+    };
+    memset(g_slot_data, 0, sizeof(g_slot_data));
+    memset(g_task_slots, 0, sizeof(g_task_slots));
+    for(int slot = 0; slot < WHOOP_MEM_SLOT_MAX; slot++)
+    {
+        g_slot_data[slot].min_free_heap = esp_get_free_heap_size();
+    }
+    cJSON_InitHooks(&hooks);
+}
+
+whoop_mem_slot_n whoop_mem_request_begin(whoop_mem_slot_n slot)
+{
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    whoop_mem_task_slot_t *task_slot;
+    whoop_mem_slot_n previous_slot = WHOOP_MEM_SLOT_NONE;
+    if(slot < 0 || slot >= WHOOP_MEM_SLOT_MAX) return previous_slot;
+
+    portENTER_CRITICAL();
+    if((task_slot = find_task_slot(task))) previous_slot = task_slot->slot;
+    else if((task_slot = find_task_slot(NULL))) task_slot->task = task;
+    if(!task_slot)
+    {
+        portEXIT_CRITICAL();
+        ESP_LOGE(TAG, "No free task slot, %s request not tracked", g_slot_names[slot]);
+        return previous_slot;
+    }
+    g_slot_data[slot].stats.alloc_count = 0;
+    g_slot_data[slot].stats.peak_bytes = g_slot_data[slot].stats.live_bytes;
+    g_slot_data[slot].stats.largest_block = 0;
+    g_slot_data[slot].min_free_heap = esp_get_free_heap_size();
+    task_slot->slot = slot;
+    portEXIT_CRITICAL();
+    return previous_slot;
+}
+
+void whoop_mem_request_end(whoop_mem_slot_n previous_slot)
+{
+    whoop_mem_stats_t stats;
+    size_t min_free_heap;
+    whoop_mem_task_slot_t *task_slot;
+    whoop_mem_slot_n slot;
+
+    portENTER_CRITICAL();
+    if(!(task_slot = find_task_slot(xTaskGetCurrentTaskHandle())))
+    {
+        portEXIT_CRITICAL();
+        return;
+    }
+    slot = task_slot->slot;
+    g_slot_data[slot].stats.request_count++;
+    stats = g_slot_data[slot].stats;
+    min_free_heap = g_slot_data[slot].min_free_heap;
+    if(previous_slot == WHOOP_MEM_SLOT_NONE) task_slot->task = NULL;
+    else task_slot->slot = previous_slot;
+    portEXIT_CRITICAL();
+
+    // Server requests come from every webhook, callback and cache rebuild, /whoop/heap has their numbers
+    if(slot == WHOOP_MEM_SLOT_SERVER)
+    {
+        ESP_LOGD(TAG, WHOOP_MEM_SUMMARY_FORMAT, g_slot_names[slot], stats.alloc_count, stats.peak_bytes,
+                stats.largest_block, min_free_heap, esp_get_minimum_free_heap_size());
+        return;
+    }
+    ESP_LOGI(TAG, WHOOP_MEM_SUMMARY_FORMAT, g_slot_names[slot], stats.alloc_count, stats.peak_bytes,
+            stats.largest_block, min_free_heap, esp_get_minimum_free_heap_size());
+}
+
+void *whoop_mem_malloc(size_t size)
+{
+    whoop_mem_header_t *header = (whoop_mem_header_t *) malloc(WHOOP_MEM_HEADER_SIZE + size);
+    portENTER_CRITICAL();
+    whoop_mem_slot_n slot = active_slot();
+    if(!header)
+    {
+        g_slot_data[slot].stats.failed_count++;
+        portEXIT_CRITICAL();
+        return NULL;
+    }
+    header->info.size = size;
+    header->info.slot = slot;
+    charge_alloc(slot, size);
+    portEXIT_CRITICAL();
+    return (void *) (header + 1);
+}
+
+void *whoop_mem_realloc(void *ptr, size_t size)
+{
+    if(!ptr) return whoop_mem_malloc(size);
+
+    whoop_mem_header_t *header = ((whoop_mem_header_t *) ptr) - 1;
+    size_t old_size = header->info.size;
+    int old_slot = header->info.slot;
+    whoop_mem_header_t *new_header = (whoop_mem_header_t *) realloc(header, WHOOP_MEM_HEADER_SIZE + size);
+    portENTER_CRITICAL();
+    whoop_mem_slot_n slot = active_slot();
+    if(!new_header)
+    {
+        g_slot_data[slot].stats.failed_count++;
+        portEXIT_CRITICAL();
+        return NULL;
+    }
+    charge_free(old_slot, old_size);
+    new_header->info.size = size;
+    new_header->info.slot = slot;
+    charge_alloc(slot, size);
+    portEXIT_CRITICAL();
+    return (void *) (new_header + 1);
+}
+
+void whoop_mem_free(void *ptr)
+{
+    if(!ptr) return;
+
+    whoop_mem_header_t *header = ((whoop_mem_header_t *) ptr) - 1;
+    portENTER_CRITICAL();
+    charge_free(header->info.slot, header->info.size);
+    portEXIT_CRITICAL();
+    free(header);
+}
+
+int whoop_mem_get_stats(whoop_mem_slot_n slot, whoop_mem_stats_t *stats_out)
+{
+    if(slot < 0 || slot >= WHOOP_MEM_SLOT_MAX || !stats_out) return -1;
+    portENTER_CRITICAL();
+    *stats_out = g_slot_data[slot].stats;
+    portEXIT_CRITICAL();
+    return 0;
+}
+
+size_t whoop_mem_get_min_free_heap(void)
+{
+    return esp_get_minimum_free_heap_size();
+}
+
+const char *whoop_mem_slot_name(whoop_mem_slot_n slot)
+{
+    if(slot < 0 || slot >= WHOOP_MEM_SLOT_MAX) return "unknown";
+    return g_slot_names[slot];
+}
\ No newline at end of file
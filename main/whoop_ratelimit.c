@@ -0,0 +1,78 @@
+#include "sdkconfig.h"
+#include "esp_timer.h"
+
+#include "whoop_ratelimit.h"
+
+// Defines
+#define WHOOP_RATELIMIT_REFILL_US (CONFIG_WHOOP_RATELIMIT_REFILL_SECONDS * 1000000LL)
+#define WHOOP_RATELIMIT_CAPACITY_US (CONFIG_WHOOP_RATELIMIT_BURST * WHOOP_RATELIMIT_REFILL_US)
+
+// Types
+/*Tokens are kept as microseconds of refill time, a request costs one refill interval*/
+typedef struct whoop_ratelimit_bucket
+{
+    uint32_t client_addr;
+    int64_t credit_us;
+    int64_t last_us;            /*Last request, refills the credit and orders the table for eviction*/
+    int used;
+} whoop_ratelimit_bucket_t;
+
+// Local Global Variables
+static whoop_ratelimit_bucket_t g_buckets[CONFIG_WHOOP_RATELIMIT_CLIENTS];
+static whoop_ratelimit_stats_t g_stats;
+
+// Local functions
+/*Bucket of a known client, or a full one in a free or least recently seen slot*/
+static whoop_ratelimit_bucket_t *find_bucket(uint32_t client_addr, int64_t now_us)
+{
+    whoop_ratelimit_bucket_t *oldest = &g_buckets[0];
+    for(int index = 0; index < CONFIG_WHOOP_RATELIMIT_CLIENTS; index++)
+    {
+        whoop_ratelimit_bucket_t *bucket = &g_buckets[index];
+        if(bucket->used && bucket->client_addr == client_addr)
+            return bucket;
+        if(!bucket->used || (oldest->used && bucket->last_us < oldest->last_us))
+            oldest = bucket;
+    }
+    if(oldest->used)
+    {
+        // An evicted client comes back with a full bucket, which is no more than it would have earned idle
+        g_stats.evicted++;
+    }
+    else
+    {
+        g_stats.clients++;
+    }
+    oldest->used = 1;
+    oldest->client_addr = client_addr;
+    oldest->credit_us = WHOOP_RATELIMIT_CAPACITY_US;
+    oldest->last_us = now_us;
+    return oldest;
+}
+
+// Global functions
+int whoop_ratelimit_take(uint32_t client_addr, int *retry_after_s)
+{
+    int64_t now_us = esp_timer_get_time();
+    whoop_ratelimit_bucket_t *bucket = find_bucket(client_addr, now_us);
+
+    bucket->credit_us += now_us - bucket->last_us;
+    if(bucket->credit_us > WHOOP_RATELIMIT_CAPACITY_US)
+        bucket->credit_us = WHOOP_RATELIMIT_CAPACITY_US;
+    bucket->last_us = now_us;
+    if(bucket->credit_us >= WHOOP_RATELIMIT_REFILL_US)
+    {
+        bucket->credit_us -= WHOOP_RATELIMIT_REFILL_US;
+        g_stats.allowed++;
+        return 0;
+    }
+    *retry_after_s = (int) ((WHOOP_RATELIMIT_REFILL_US - bucket->credit_us + 999999) / 1000000);
+    // Counted rather than logged, printing each 429 would cost more than serving the request
+    g_stats.throttled++;
+    return -1;
+}
+
+void whoop_ratelimit_get_stats(whoop_ratelimit_stats_t *stats_out)
+{
+    *stats_out = g_stats;
+}
\ No newline at end of file
@@ -0,0 +1,192 @@
+/*Host throughput benchmark of the JSON and CBOR encoders behind the device's responses.
+  Encodes a page of sleep and workout shaped records over and over into a sink that only counts bytes:
+
+    gcc -O2 -I../../main/include encode_bench.c ../../main/whoop_encode.c -o encode_bench && ./encode_bench
+
+  Add the SDK's cJSON to compare against building the same page as a cJSON tree and printing it:
+
+    CJSON=$IDF_PATH/components/json/cJSON
+    gcc -O2 -DBENCH_CJSON -I../../main/include -I$CJSON encode_bench.c ../../main/whoop_encode.c $CJSON/cJSON.c -lm \
+        -o encode_bench && ./encode_bench*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "whoop_encode.h"
+#ifdef BENCH_CJSON
+#include "cJSON.h"
+#endif
+
+#define BENCH_PAGES 20000
+#define BENCH_RECORDS_PER_PAGE 5
+
+typedef struct bench_sink
+{
+    size_t bytes;
+    size_t flushes;
+} bench_sink_t;
+
+typedef struct bench_record_shape
+{
+    const char *name;
+    const char **int_fields;
+    int int_count;
+    const char **float_fields;
+    int float_count;
+} bench_record_shape_t;
+
+static const char *g_sleep_int_fields[] = {
+    "id", "total_in_bed_time_milli", "total_awake_time_milli", "total_no_data_time_milli", "total_light_sleep_time_milli",
+    "total_slow_wave_sleep_time_milli", "total_rem_sleep_time_milli", "sleep_cycle_count", "disturbance_count",
+    "baseline_milli", "need_from_sleep_debt_milli", "need_from_recent_strain_milli", "need_from_recent_nap_milli",
+};
+static const char *g_sleep_float_fields[] = {
+    "respiratory_rate", "sleep_performance_percentage", "sleep_consistency_percentage", "sleep_efficiency_percentage",
+};
+static const char *g_workout_int_fields[] = {
+    "id", "sport_id", "average_heart_rate", "max_heart_rate", "zone_zero_milli", "zone_one_milli", "zone_two_milli",
+    "zone_three_milli", "zone_four_milli", "zone_five_milli",
+};
+static const char *g_workout_float_fields[] = {
+    "strain", "kilojoule", "percent_recorded", "distance_meter", "altitude_gain_meter", "altitude_change_meter",
+};
+
+static double elapsed_seconds(const struct timespec *start)
+{
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static int record_int(int seed, int index)
+{
+    return 1000003 * (seed + index) % 30000000;
+}
+
+static float record_float(int seed, int index)
+{
+    return (float) ((seed * 37 + index * 11) % 10000) / 97.0f;
+}
+
+static int count_flush(void *ctx, const uint8_t *data, size_t len)
+{
+    bench_sink_t *sink = ctx;
+    (void) data;
+    sink->bytes += len;
+    sink->flushes++;
+    return 0;
+}
+
+static void encode_record(whoop_encoder_t *encoder, const bench_record_shape_t *shape, int seed)
+{
+    whoop_encode_map_begin(encoder);
+    whoop_encode_key(encoder, "score_state");
+    whoop_encode_string(encoder, "SCORED");
+    for(int index = 0; index < shape->int_count; index++)
+    {
+        whoop_encode_key(encoder, shape->int_fields[index]);
+        whoop_encode_int(encoder, record_int(seed, index));
+    }
+    for(int index = 0; index < shape->float_count; index++)
+    {
+        whoop_encode_key(encoder, shape->float_fields[index]);
+        whoop_encode_float(encoder, record_float(seed, index));
+    }
+    whoop_encode_end(encoder);
+}
+
+static void report(const char *shape_name, const char *encoder_name, double seconds, size_t bytes, size_t allocs)
+{
+    double records = (double) BENCH_PAGES * BENCH_RECORDS_PER_PAGE;
+    printf("%-8s %-6s %8.0f records/s %7.1f MB/s %6.1f bytes/record %6.2f us/page %5.1f allocs/page\n", shape_name,
+           encoder_name, records / seconds, bytes / seconds / 1e6, bytes / records, seconds * 1e6 / BENCH_PAGES,
+           (double) allocs / BENCH_PAGES);
+}
+
+static void run(whoop_encode_format_n format, const bench_record_shape_t *shape)
+{
+    bench_sink_t sink = {0};
+    whoop_encoder_t encoder;
+    struct timespec start;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(int page = 0; page < BENCH_PAGES; page++)
+    {
+        whoop_encode_begin(&encoder, format, count_flush, &sink);
+        whoop_encode_map_begin(&encoder);
+        whoop_encode_key(&encoder, "records");
+        whoop_encode_array_begin(&encoder);
+        for(int record = 0; record < BENCH_RECORDS_PER_PAGE; record++)
+            encode_record(&encoder, shape, page + record);
+        whoop_encode_end(&encoder);
+        whoop_encode_key(&encoder, "next");
+        whoop_encode_null(&encoder);
+        whoop_encode_end(&encoder);
+        whoop_encode_finish(&encoder);
+    }
+    report(shape->name, format == WHOOP_ENCODE_FORMAT_JSON ? "json" : "cbor", elapsed_seconds(&start), sink.bytes, 0);
+}
+
+#ifdef BENCH_CJSON
+static size_t g_allocs = 0;
+
+static void *counting_malloc(size_t size)
+{
+    g_allocs++;
+    return malloc(size);
+}
+
+/*What a handler would do without the encoder, build the page as a tree and print it*/
+static void run_cjson(const bench_record_shape_t *shape)
+{
+    cJSON_Hooks hooks = { counting_malloc, free };
+    size_t bytes = 0;
+    struct timespec start;
+
+    cJSON_InitHooks(&hooks);
+    g_allocs = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(int page = 0; page < BENCH_PAGES; page++)
+    {
+        cJSON *root = cJSON_CreateObject();
+        cJSON *records = cJSON_AddArrayToObject(root, "records");
+        for(int record = 0; record < BENCH_RECORDS_PER_PAGE; record++)
+        {
+            cJSON *item = cJSON_CreateObject();
+            cJSON_AddStringToObject(item, "score_state", "SCORED");
+            for(int index = 0; index < shape->int_count; index++)
+                cJSON_AddNumberToObject(item, shape->int_fields[index], record_int(page + record, index));
+            for(int index = 0; index < shape->float_count; index++)
+                cJSON_AddNumberToObject(item, shape->float_fields[index], record_float(page + record, index));
+            cJSON_AddItemToArray(records, item);
+        }
+        cJSON_AddNullToObject(root, "next");
+        char *text = cJSON_PrintUnformatted(root);
+        bytes += strlen(text);
+        free(text);
+        cJSON_Delete(root);
+    }
+    report(shape->name, "cjson", elapsed_seconds(&start), bytes, g_allocs);
+}
+#endif
+
+int main(void)
+{
+    static const bench_record_shape_t shapes[] = {
+        { "sleep", g_sleep_int_fields, sizeof(g_sleep_int_fields) / sizeof(g_sleep_int_fields[0]),
+          g_sleep_float_fields, sizeof(g_sleep_float_fields) / sizeof(g_sleep_float_fields[0]) },
+        { "workout", g_workout_int_fields, sizeof(g_workout_int_fields) / sizeof(g_workout_int_fields[0]),
+          g_workout_float_fields, sizeof(g_workout_float_fields) / sizeof(g_workout_float_fields[0]) },
+    };
+    for(size_t shape = 0; shape < sizeof(shapes) / sizeof(shapes[0]); shape++)
+    {
+        for(int format = 0; format < WHOOP_ENCODE_FORMAT_MAX; format++)
+            run(format, &shapes[shape]);
+#ifdef BENCH_CJSON
+        run_cjson(&shapes[shape]);
+#endif
+    }
+    return 0;
+}
@@ -0,0 +1,268 @@
+/*Host benchmark of the CPU lazy decoding saves over eager decoding, from committing a fetched record to reading it.
+  Commits sleep records field by field, caches each one in a stand-in for flash and reads some of its fields back:
+
+    gcc -O2 -DCONFIG_WHOOP_DATA_LAZY -I../loadtest/include -I../../main/include lazy_bench.c ../../main/whoop_data.c \
+        -o lazy_bench && ./lazy_bench
+
+  Eager commits convert every value the way cJSON_Parse does before set_whoop_data, lazy commits keep the text and
+  convert what is read. Finding the values in the response costs both the same and is left out*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "freertos/semphr.h"
+#include "whoop_data.h"
+
+#define BENCH_RECORDS 200000
+#define BENCH_VARIANTS 16               /*Distinct responses cycled through so every save writes flash*/
+#define BENCH_VALUE_TEXT_LEN 16
+#define BENCH_MAX_FIELDS 24
+#define BENCH_OPT_FLOAT 0x0100          /*Set in every float option of whoop_data_opt_n*/
+#define BENCH_FLASH_LEN 1024
+
+typedef struct bench_response
+{
+    char text[BENCH_MAX_FIELDS][BENCH_VALUE_TEXT_LEN];
+    size_t len[BENCH_MAX_FIELDS];
+} bench_response_t;
+
+static bench_response_t g_responses[BENCH_VARIANTS];
+static const whoop_data_field_t *g_fields;
+static int g_field_count;
+// One record type of one account is cached, a single blob is all the flash needed
+static unsigned char g_flash[BENCH_FLASH_LEN];
+static size_t g_flash_len = 0;
+static size_t g_flash_written = 0;
+
+// Just enough of the SDK for the store, single threaded and silent
+void shim_log(const char *level, const char *tag, const char *format, ...)
+{
+}
+
+int64_t esp_timer_get_time(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return (SemaphoreHandle_t) g_flash;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks_to_wait)
+{
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+    return pdTRUE;
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle)
+{
+    *out_handle = 1;
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length)
+{
+    if(!g_flash_len || strcmp(key, "a0_sleep")) return ESP_ERR_NVS_NOT_FOUND;
+    if(*length < g_flash_len) return ESP_FAIL;
+    memcpy(out_value, g_flash, g_flash_len);
+    *length = g_flash_len;
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length)
+{
+    if(length > sizeof(g_flash)) return ESP_FAIL;
+    memcpy(g_flash, value, length);
+    g_flash_len = length;
+    g_flash_written += length;
+    return ESP_OK;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+}
+
+static double elapsed_seconds(const struct timespec *start)
+{
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static int is_metric(const whoop_data_field_t *field)
+{
+    return !(field->flags & (WHOOP_DATA_FIELD_ID | WHOOP_DATA_FIELD_SCORE_STATE));
+}
+
+static void make_responses(void)
+{
+    for(int variant = 0; variant < BENCH_VARIANTS; variant++)
+    {
+        bench_response_t *response = &g_responses[variant];
+        for(int index = 0; index < g_field_count; index++)
+        {
+            const whoop_data_field_t *field = &g_fields[index];
+            if(field->flags & WHOOP_DATA_FIELD_BOOL)
+                snprintf(response->text[index], BENCH_VALUE_TEXT_LEN, "%s", variant & 1 ? "true" : "false");
+            else if(field->opt & BENCH_OPT_FLOAT)
+                snprintf(response->text[index], BENCH_VALUE_TEXT_LEN, "%.6f", (variant * 37 + index * 11) % 10000 / 97.0);
+            else
+                snprintf(response->text[index], BENCH_VALUE_TEXT_LEN, "%d", 1000003 * (variant + index) % 30000000);
+            response->len[index] = strlen(response->text[index]);
+        }
+    }
+}
+
+/*What the eager parse leaves for set_whoop_data, the text as cJSON_Parse converts it*/
+static void commit_eager(whoop_data_handle_t handle, const bench_response_t *response)
+{
+    for(int index = 0; index < g_field_count; index++)
+    {
+        const whoop_data_field_t *field = &g_fields[index];
+        if(!is_metric(field)) continue;
+        if(field->flags & WHOOP_DATA_FIELD_BOOL)
+            set_whoop_data(handle, field->opt, response->text[index][0] == 't');
+        else if(field->opt & BENCH_OPT_FLOAT)
+            set_whoop_data(handle, field->opt, (float) strtod(response->text[index], NULL));
+        else
+            set_whoop_data(handle, field->opt, (int) strtod(response->text[index], NULL));
+    }
+}
+
+static void commit_lazy(whoop_data_handle_t handle, const bench_response_t *response)
+{
+    begin_whoop_data_lazy(handle);
+    for(int index = 0; index < g_field_count; index++)
+    {
+        if(is_metric(&g_fields[index]))
+            set_whoop_data_lazy(handle, g_fields[index].opt, response->text[index], response->len[index]);
+    }
+}
+
+/*Reads the first reads metrics, returns a sum so the reads cannot be left out*/
+static double read_fields(whoop_data_handle_t handle, int reads)
+{
+    double sum = 0;
+    for(int index = 0; index < g_field_count && reads > 0; index++)
+    {
+        const whoop_data_field_t *field = &g_fields[index];
+        int int_value;
+        float float_value;
+        if(!is_metric(field)) continue;
+        if(field->opt & BENCH_OPT_FLOAT)
+        {
+            get_whoop_data(handle, field->opt, &float_value);
+            sum += float_value;
+        }
+        else
+        {
+            get_whoop_data(handle, field->opt, &int_value);
+            sum += int_value;
+        }
+        reads--;
+    }
+    return sum;
+}
+
+static double run(int lazy, int reads, int metric_count)
+{
+    whoop_data_lazy_stats_t stats_before;
+    whoop_data_lazy_stats_t stats_after;
+    whoop_data_handle_t handle;
+    struct timespec start;
+    double sum = 0;
+
+    get_whoop_data_lazy_stats(&stats_before);
+    g_flash_written = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(int record = 0; record < BENCH_RECORDS; record++)
+    {
+        const bench_response_t *response = &g_responses[record % BENCH_VARIANTS];
+        create_whoop_sleep_data(0, record + 1, &handle);
+        set_whoop_data(handle, WHOOP_DATA_OPT_SLEEP_SCORE_STATE, WHOOP_SCORE_STATE_SCORED);
+        if(lazy)
+            commit_lazy(handle, response);
+        else
+            commit_eager(handle, response);
+        save_whoop_data_record(0, WHOOP_DATA_TYPE_SLEEP);
+        sum += read_fields(handle, reads);
+    }
+    double seconds = elapsed_seconds(&start);
+    get_whoop_data_lazy_stats(&stats_after);
+    printf("%-5s %2d/%-2d read %7.0f records/s %6.0f ns/record %6.1f flash bytes/record %5.1f decoded/record\n",
+           lazy ? "lazy" : "eager", reads, metric_count, BENCH_RECORDS / seconds, seconds * 1e9 / BENCH_RECORDS,
+           (double) g_flash_written / BENCH_RECORDS, (double) (stats_after.decoded - stats_before.decoded) / BENCH_RECORDS);
+    return sum;
+}
+
+/*Restarting with a lazy record in flash has to bring back the same values an eager one would*/
+static int check_restore(int metric_count)
+{
+    whoop_data_handle_t handle;
+    double eager_sum;
+
+    create_whoop_sleep_data(0, 1, &handle);
+    set_whoop_data(handle, WHOOP_DATA_OPT_SLEEP_SCORE_STATE, WHOOP_SCORE_STATE_SCORED);
+    commit_eager(handle, &g_responses[1]);
+    eager_sum = read_fields(handle, metric_count);
+    create_whoop_sleep_data(0, 2, &handle);
+    set_whoop_data(handle, WHOOP_DATA_OPT_SLEEP_SCORE_STATE, WHOOP_SCORE_STATE_SCORED);
+    commit_lazy(handle, &g_responses[1]);
+    save_whoop_data_record(0, WHOOP_DATA_TYPE_SLEEP);
+    restore_whoop_data();
+    get_whoop_sleep_handle_by_id(0, 0, &handle);
+    if(read_fields(handle, metric_count) != eager_sum)
+    {
+        printf("Restored lazy record does not match the eager one\n");
+        return 1;
+    }
+    return 0;
+}
+
+int main(void)
+{
+    int metric_count = 0;
+
+    init_whoop_data();
+    restore_whoop_data();
+    g_fields = get_whoop_data_fields(WHOOP_DATA_TYPE_SLEEP, &g_field_count);
+    if(g_field_count > BENCH_MAX_FIELDS) return 1;
+    for(int index = 0; index < g_field_count; index++)
+        metric_count += is_metric(&g_fields[index]);
+    make_responses();
+
+    // Nothing read is a poll nobody looks at, a few is the display, all of them a full page of the API
+    const int reads[] = { 0, 4, metric_count };
+    double sums[2][3];
+    for(int index = 0; index < 3; index++)
+    {
+        sums[0][index] = run(0, reads[index], metric_count);
+        sums[1][index] = run(1, reads[index], metric_count);
+    }
+    for(int index = 0; index < 3; index++)
+    {
+        if(sums[0][index] != sums[1][index])
+        {
+            printf("Lazy and eager read different values\n");
+            return 1;
+        }
+    }
+    return check_restore(metric_count);
+}
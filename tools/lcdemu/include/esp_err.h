@@ -0,0 +1,24 @@
+#ifndef _ESP_ERR_H_
+#define _ESP_ERR_H_
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef int32_t esp_err_t;
+
+#define ESP_OK                  0
+#define ESP_FAIL                -1
+#define ESP_ERR_NO_MEM          0x101
+#define ESP_ERR_INVALID_ARG     0x102
+#define ESP_ERR_INVALID_STATE   0x103
+#define ESP_ERR_TIMEOUT         0x107
+
+#define ESP_ERROR_CHECK(x) do {                                                         \
+        esp_err_t __err = (x);                                                          \
+        if (__err != ESP_OK) {                                                          \
+            fprintf(stderr, "ESP_ERROR_CHECK failed: %d at %s:%d\n", (int) __err, __FILE__, __LINE__); \
+            abort();                                                                    \
+        }                                                                               \
+    } while(0)
+
+#endif //_ESP_ERR_H_
\ No newline at end of file
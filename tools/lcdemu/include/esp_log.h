@@ -0,0 +1,10 @@
+#ifndef _ESP_LOG_H_
+#define _ESP_LOG_H_
+#include "esp_err.h"
+
+#define ESP_LOGE(tag, format, ...) fprintf(stderr, "E %s: " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) fprintf(stderr, "W %s: " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) do { (void) (tag); } while(0)
+#define ESP_LOGD(tag, format, ...) do { (void) (tag); } while(0)
+
+#endif //_ESP_LOG_H_
\ No newline at end of file
@@ -0,0 +1,5 @@
+#ifndef _ESP_SYSTEM_H_
+#define _ESP_SYSTEM_H_
+#include "esp_err.h"
+
+#endif //_ESP_SYSTEM_H_
\ No newline at end of file
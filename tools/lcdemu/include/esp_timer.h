@@ -0,0 +1,8 @@
+#ifndef _ESP_TIMER_H_
+#define _ESP_TIMER_H_
+#include <stdint.h>
+
+/*Microseconds on the emulator's clock*/
+int64_t esp_timer_get_time(void);
+
+#endif //_ESP_TIMER_H_
\ No newline at end of file
@@ -0,0 +1,19 @@
+#ifndef _FREERTOS_H_
+#define _FREERTOS_H_
+#include <stdint.h>
+#include <stddef.h>
+
+typedef uint32_t TickType_t;
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+
+#define pdTRUE                  1
+#define pdFALSE                 0
+#define pdPASS                  1
+#define portMAX_DELAY           0xffffffffUL
+// CONFIG_FREERTOS_HZ is 100 on the ESP8266
+#define portTICK_PERIOD_MS      10
+#define portTICK_RATE_MS        portTICK_PERIOD_MS
+#define pdMS_TO_TICKS(ms)       ((TickType_t) (ms) / portTICK_PERIOD_MS)
+
+#endif //_FREERTOS_H_
\ No newline at end of file
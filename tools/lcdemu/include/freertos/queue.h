@@ -0,0 +1,5 @@
+#ifndef _FREERTOS_QUEUE_H_
+#define _FREERTOS_QUEUE_H_
+#include "freertos/FreeRTOS.h"
+
+#endif //_FREERTOS_QUEUE_H_
\ No newline at end of file
@@ -0,0 +1,8 @@
+#ifndef _FREERTOS_TASK_H_
+#define _FREERTOS_TASK_H_
+#include "freertos/FreeRTOS.h"
+
+/*Advances the emulator's clock by whole ticks*/
+void vTaskDelay(TickType_t ticks);
+
+#endif //_FREERTOS_TASK_H_
\ No newline at end of file
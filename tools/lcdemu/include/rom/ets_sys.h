@@ -0,0 +1,8 @@
+#ifndef _ETS_SYS_H_
+#define _ETS_SYS_H_
+#include <stdint.h>
+
+/*Advances the emulator's clock*/
+void ets_delay_us(uint32_t us);
+
+#endif //_ETS_SYS_H_
\ No newline at end of file
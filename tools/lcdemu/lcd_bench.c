@@ -0,0 +1,336 @@
+/*Runs the firmware's LCD driver against lcd_emu.c, a PCF8574 backpack and HD44780 simulated down to the
+  bus clock. Every driver feature is a step with the screen and controller state it has to leave behind, and
+  each reports how long it keeps the bus and the calling task busy:
+
+    mkdir -p build && gcc -O2 -Iinclude -I. -I../../main/include lcd_bench.c lcd_emu.c ../../main/i2c_led.c \
+        -o build/lcd_bench && ./build/lcd_bench
+
+  ./build/lcd_bench [-k bus_khz] [-o osc_khz] [-t] [-n byte] [-s]
+
+    -k  I2C clock, default 100 which is about what the ESP8266's bit-banged driver manages. The driver relies on
+        the bus to pace characters, above roughly 340 kHz a slow controller is still busy when the next arrives
+        and from about 200 kHz a status read is cheap enough that clear and home poll the busy flag
+    -o  controller oscillator, default 190 which is the slowest the datasheet allows and so the strictest
+        check of the driver's waits
+    -t  RW tied to ground on the backpack, the driver has to notice it can't read the busy flag and fall back
+        to timed waits
+    -n  bus byte of the recovery step's flush that is NACKed, default 40
+    -s  draw the screen after every step, custom characters pixel by pixel
+
+  Time is simulated, the bus at its nominal rate plus every ets_delay_us and vTaskDelay the driver makes.
+  Exits non-zero when a step leaves the panel showing something else than was drawn, leaves the controller
+  in the wrong state, or the driver wrote to it while it was busy*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "esp_err.h"
+#include "i2c_led.h"
+#include "lcd_emu.h"
+
+static int g_failures = 0;
+static int g_show_screens = 0;
+static uint32_t g_nack_byte = 40;
+
+static void begin(lcd_emu_stats_t *before, uint64_t *start_ns)
+{
+    lcd_emu_get_stats(before);
+    *start_ns = lcd_emu_now_ns();
+}
+
+static void end(const char *name, const lcd_emu_stats_t *before, uint64_t start_ns, const char *line0,
+                const char *line1)
+{
+    lcd_emu_stats_t after;
+    char screen[LCD_EMU_ROWS][LCD_EMU_COLS + 1];
+    uint32_t violations;
+    int match;
+    lcd_emu_get_stats(&after);
+    lcd_emu_get_screen(screen);
+    violations = after.busy_violations - before->busy_violations;
+    match = !strcmp(screen[0], line0) && !strcmp(screen[1], line1);
+    printf("%-18s %9.3f ms %5u %6u %5u %5u %5u %9.3f ms %9.3f ms %5u  |%s|%s|%s\n", name,
+           (lcd_emu_now_ns() - start_ns) / 1e6,
+           after.transactions - before->transactions,
+           after.bus_bytes - before->bus_bytes,
+           after.lcd_bytes - before->lcd_bytes,
+           after.status_reads - before->status_reads,
+           after.cgram_writes - before->cgram_writes,
+           (after.bus_ns - before->bus_ns) / 1e6,
+           (after.delay_ns - before->delay_ns) / 1e6,
+           violations, screen[0], screen[1], match ? "" : " MISMATCH");
+    if (!match || violations) g_failures++;
+    if (g_show_screens) lcd_emu_print_screen(stdout);
+}
+
+static void check_state(const char *name, const char *what, int value, int expected)
+{
+    if (value == expected) return;
+    printf("%s: %s is %d, expected %d\n", name, what, value, expected);
+    g_failures++;
+}
+
+static void spark_glyph(int height, uint8_t glyph[I2C_LCD_1602_GLYPH_ROWS])
+{
+    for (int row = 0; row < I2C_LCD_1602_GLYPH_ROWS; row++) {
+        glyph[row] = row >= I2C_LCD_1602_GLYPH_ROWS - height ? 0x0e : 0x00;
+    }
+}
+
+// Draws a sparkline from col and checks it after the flush
+static void put_sparkline(uint8_t col, const int *heights, int count)
+{
+    uint8_t glyph[I2C_LCD_1602_GLYPH_ROWS];
+    for (int index = 0; index < count; index++) {
+        spark_glyph(heights[index], glyph);
+        i2c_lcd_1602_framePutGlyph(col + index, 1, glyph);
+    }
+}
+
+static void check_sparkline(const char *name, uint8_t col, const int *heights, int count)
+{
+    uint8_t expected[I2C_LCD_1602_GLYPH_ROWS];
+    uint8_t shown[LCD_EMU_GLYPH_ROWS];
+    for (int index = 0; index < count; index++) {
+        spark_glyph(heights[index], expected);
+        if (!lcd_emu_get_cell_bitmap(1, col + index, shown) || memcmp(shown, expected, sizeof(expected))) {
+            printf("%s: cell %d shows the wrong glyph\n", name, col + index);
+            g_failures++;
+        }
+    }
+}
+
+static void print_glyph_stats(const i2c_lcd_1602_stats_t *before)
+{
+    i2c_lcd_1602_stats_t after;
+    i2c_lcd_1602_getStats(&after);
+    printf("%-18s glyph hits %u, misses %u\n", "", after.glyph_hits - before->glyph_hits,
+           after.glyph_misses - before->glyph_misses);
+}
+
+int main(int argc, char **argv)
+{
+    int bus_khz = 100;
+    int osc_khz = 190;
+    int rw_tied = 0;
+    int opt;
+    lcd_emu_stats_t before;
+    uint64_t start_ns;
+    while ((opt = getopt(argc, argv, "k:o:tn:s")) != -1) {
+        switch (opt) {
+            case 'k':
+                bus_khz = atoi(optarg);
+                break;
+            case 'o':
+                osc_khz = atoi(optarg);
+                break;
+            case 't':
+                rw_tied = 1;
+                break;
+            case 'n':
+                g_nack_byte = strtoul(optarg, NULL, 0);
+                break;
+            case 's':
+                g_show_screens = 1;
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-k bus_khz] [-o osc_khz] [-t] [-n byte] [-s]\n", argv[0]);
+                return 2;
+        }
+    }
+    if (bus_khz <= 0 || osc_khz <= 0) {
+        fprintf(stderr, "bus and oscillator rates must be positive\n");
+        return 2;
+    }
+    lcd_emu_set_rw_tied(rw_tied);
+    lcd_emu_reset(bus_khz, osc_khz);
+    printf("bus %d kHz, oscillator %d kHz%s\n", bus_khz, osc_khz, rw_tied ? ", RW tied low" : "");
+    printf("%-18s %12s %5s %6s %5s %5s %5s %12s %12s %5s\n", "step", "elapsed", "txns", "bytes", "lcd", "polls",
+           "cgram", "bus", "delay", "busy");
+
+    begin(&before, &start_ns);
+    i2c_lcd_1602_init();
+    end("init", &before, start_ns, "                ", "                ");
+
+    begin(&before, &start_ns);
+    i2c_lcd_1602_clear();
+    end("clear", &before, start_ns, "                ", "                ");
+
+    begin(&before, &start_ns);
+    i2c_lcd_1602_home();
+    end("home", &before, start_ns, "                ", "                ");
+
+    begin(&before, &start_ns);
+    i2c_lcd_1602_setCursor(0, 0);
+    i2c_lcd_1602_print("Recovery Alice  ", 16);
+    i2c_lcd_1602_setCursor(0, 1);
+    i2c_lcd_1602_print("Score: 67%      ", 16);
+    end("print 32 chars", &before, start_ns, "Recovery Alice  ", "Score: 67%      ");
+
+    begin(&before, &start_ns);
+    i2c_lcd_1602_frameClear();
+    i2c_lcd_1602_framePrint(0, 0, "Sleep Alice", 11);
+    i2c_lcd_1602_framePrint(0, 1, "Perf: 91%", 9);
+    i2c_lcd_1602_frameFlush();
+    end("frame full", &before, start_ns, "Sleep Alice     ", "Perf: 91%       ");
+
+    begin(&before, &start_ns);
+    i2c_lcd_1602_frameClear();
+    i2c_lcd_1602_framePrint(0, 0, "Sleep Alice", 11);
+    i2c_lcd_1602_framePrint(0, 1, "Perf: 88%", 9);
+    i2c_lcd_1602_frameFlush();
+    end("frame value", &before, start_ns, "Sleep Alice     ", "Perf: 88%       ");
+
+    begin(&before, &start_ns);
+    i2c_lcd_1602_frameClear();
+    i2c_lcd_1602_framePrint(0, 0, "Strain Bob", 10);
+    i2c_lcd_1602_framePrint(0, 1, "Strain: 12.4", 12);
+    i2c_lcd_1602_frameFlush();
+    end("frame page", &before, start_ns, "Strain Bob      ", "Strain: 12.4    ");
+
+    // Two pages sharing the eight CGRAM slots, then a third that needs more than are free
+    static const int recovery_heights[] = { 3, 5, 6, 8, 6 };
+    static const int history_heights[] = { 1, 2, 4, 7 };
+    uint8_t bar_end[I2C_LCD_1602_GLYPH_ROWS];
+    char full_block = (char) I2C_LCD_1602_FULL_BLOCK;
+    i2c_lcd_1602_stats_t lcd_before;
+
+    i2c_lcd_1602_getStats(&lcd_before);
+    begin(&before, &start_ns);
+    i2c_lcd_1602_frameClear();
+    i2c_lcd_1602_framePrint(0, 0, "Recovery Alice", 14);
+    i2c_lcd_1602_framePrint(0, 1, "Score: 67", 9);
+    put_sparkline(11, recovery_heights, 5);
+    i2c_lcd_1602_frameFlush();
+    end("glyph load", &before, start_ns, "Recovery Alice  ", "Score: 67  *****");
+    check_sparkline("glyph load", 11, recovery_heights, 5);
+    print_glyph_stats(&lcd_before);
+
+    i2c_lcd_1602_getStats(&lcd_before);
+    begin(&before, &start_ns);
+    i2c_lcd_1602_frameClear();
+    i2c_lcd_1602_framePrint(0, 0, "Recovery Alice", 14);
+    i2c_lcd_1602_framePrint(0, 1, "Score: 68", 9);
+    put_sparkline(11, recovery_heights, 5);
+    i2c_lcd_1602_frameFlush();
+    end("glyph steady", &before, start_ns, "Recovery Alice  ", "Score: 68  *****");
+    check_sparkline("glyph steady", 11, recovery_heights, 5);
+    print_glyph_stats(&lcd_before);
+
+    i2c_lcd_1602_getStats(&lcd_before);
+    begin(&before, &start_ns);
+    i2c_lcd_1602_frameClear();
+    i2c_lcd_1602_framePrint(0, 0, "Sleep Alice", 11);
+    i2c_lcd_1602_framePrint(0, 1, "Perf: 91.00%", 12);
+    for (int cell = 12; cell < 15; cell++) {
+        i2c_lcd_1602_framePrint(cell, 1, &full_block, 1);
+    }
+    memset(bar_end, 0x1c, sizeof(bar_end));
+    i2c_lcd_1602_framePutGlyph(15, 1, bar_end);
+    i2c_lcd_1602_frameFlush();
+    end("glyph bar", &before, start_ns, "Sleep Alice     ", "Perf: 91.00%###*");
+    print_glyph_stats(&lcd_before);
+
+    i2c_lcd_1602_getStats(&lcd_before);
+    begin(&before, &start_ns);
+    i2c_lcd_1602_frameClear();
+    i2c_lcd_1602_framePrint(0, 0, "Recovery Alice", 14);
+    i2c_lcd_1602_framePrint(0, 1, "Score: 68", 9);
+    put_sparkline(11, recovery_heights, 5);
+    i2c_lcd_1602_frameFlush();
+    end("glyph page back", &before, start_ns, "Recovery Alice  ", "Score: 68  *****");
+    check_sparkline("glyph page back", 11, recovery_heights, 5);
+    print_glyph_stats(&lcd_before);
+
+    i2c_lcd_1602_getStats(&lcd_before);
+    begin(&before, &start_ns);
+    i2c_lcd_1602_frameClear();
+    i2c_lcd_1602_framePrint(0, 0, "Recovery Bob", 12);
+    i2c_lcd_1602_framePrint(0, 1, "Score: 40", 9);
+    put_sparkline(12, history_heights, 4);
+    i2c_lcd_1602_frameFlush();
+    end("glyph evict", &before, start_ns, "Recovery Bob    ", "Score: 40   ****");
+    check_sparkline("glyph evict", 12, history_heights, 4);
+    print_glyph_stats(&lcd_before);
+
+    // Commands that change how the panel shows DDRAM rather than what it holds
+    lcd_emu_state_t state;
+    begin(&before, &start_ns);
+    i2c_lcd_1602_noDisplay();
+    end("display off", &before, start_ns, "                ", "                ");
+    lcd_emu_get_state(&state);
+    check_state("display off", "display", state.display_on, 0);
+
+    begin(&before, &start_ns);
+    i2c_lcd_1602_display();
+    end("display on", &before, start_ns, "Recovery Bob    ", "Score: 40   ****");
+
+    begin(&before, &start_ns);
+    i2c_lcd_1602_cursor();
+    i2c_lcd_1602_blink();
+    end("cursor blink", &before, start_ns, "Recovery Bob    ", "Score: 40   ****");
+    lcd_emu_get_state(&state);
+    check_state("cursor blink", "cursor", state.cursor, 1);
+    check_state("cursor blink", "blink", state.blink, 1);
+    i2c_lcd_1602_noCursor();
+    i2c_lcd_1602_noBlink();
+    lcd_emu_get_state(&state);
+    check_state("cursor blink", "cursor after noCursor", state.cursor, 0);
+    check_state("cursor blink", "blink after noBlink", state.blink, 0);
+
+    begin(&before, &start_ns);
+    i2c_lcd_1602_noBacklight();
+    end("backlight off", &before, start_ns, "Recovery Bob    ", "Score: 40   ****");
+    lcd_emu_get_state(&state);
+    check_state("backlight off", "backlight", state.backlight, 0);
+    i2c_lcd_1602_backlight();
+    lcd_emu_get_state(&state);
+    check_state("backlight off", "backlight after backlight()", state.backlight, 1);
+
+    begin(&before, &start_ns);
+    i2c_lcd_1602_scrollDisplayLeft();
+    end("scroll left", &before, start_ns, "ecovery Bob     ", "core: 40   **** ");
+    begin(&before, &start_ns);
+    i2c_lcd_1602_scrollDisplayRight();
+    end("scroll right", &before, start_ns, "Recovery Bob    ", "Score: 40   ****");
+
+    // A scroll leaves the shadow panel unknown, so the next flush redraws every cell
+    begin(&before, &start_ns);
+    i2c_lcd_1602_frameClear();
+    i2c_lcd_1602_frameFlush();
+    end("flush after scroll", &before, start_ns, "                ", "                ");
+
+    begin(&before, &start_ns);
+    i2c_lcd_1602_rightToLeft();
+    i2c_lcd_1602_setCursor(15, 0);
+    i2c_lcd_1602_print("olleh", 5);
+    i2c_lcd_1602_leftToRight();
+    end("right to left", &before, start_ns, "           hello", "                ");
+    lcd_emu_get_state(&state);
+    check_state("right to left", "increment", state.increment, 1);
+
+    begin(&before, &start_ns);
+    i2c_lcd_1602_clear();
+    i2c_lcd_1602_autoscroll();
+    i2c_lcd_1602_setCursor(16, 0);
+    i2c_lcd_1602_print("abc", 3);
+    i2c_lcd_1602_noAutoscroll();
+    end("autoscroll", &before, start_ns, "             abc", "                ");
+    lcd_emu_get_state(&state);
+    check_state("autoscroll", "display shift", state.display_shift, 3);
+    check_state("autoscroll", "shift on write", state.shift_on_write, 0);
+    i2c_lcd_1602_clear();
+
+    // A write that fails partway leaves the panel half drawn, the next flush of the same frame has to finish it
+    begin(&before, &start_ns);
+    i2c_lcd_1602_frameClear();
+    i2c_lcd_1602_framePrint(0, 0, "Cycle Alice", 11);
+    i2c_lcd_1602_framePrint(0, 1, "Strain: 9.80", 12);
+    lcd_emu_fail_after(g_nack_byte);
+    check_state("nack", "first flush", i2c_lcd_1602_frameFlush() != ESP_OK, 1);
+    check_state("nack", "second flush", i2c_lcd_1602_frameFlush(), ESP_OK);
+    end("nack recovery", &before, start_ns, "Cycle Alice     ", "Strain: 9.80    ");
+
+    if (g_failures) printf("%d step(s) failed\n", g_failures);
+    return g_failures ? 1 : 0;
+}
\ No newline at end of file
@@ -0,0 +1,467 @@
+/*PCF8574 I2C backpack driving an HD44780, behind the SDK's I2C master calls. Time only moves with the bus
+  clock and the driver's delays, so a run measures what the panel would see rather than what the host spent*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "driver/i2c.h"
+#include "rom/ets_sys.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "lcd_emu.h"
+
+#define LCD_EMU_I2C_ADDR 0x27
+#define LCD_EMU_MAX_OPS 64
+
+// Expander pins as wired on the common backpack
+#define LCD_EMU_RS 0x01
+#define LCD_EMU_RW 0x02
+#define LCD_EMU_E 0x04
+#define LCD_EMU_BACKLIGHT 0x08
+
+// Datasheet execution times at the nominal 270 kHz oscillator
+#define LCD_EMU_EXEC_NS 37000
+#define LCD_EMU_SLOW_EXEC_NS 1520000
+#define LCD_EMU_POWER_ON_NS 40000000ULL
+#define LCD_EMU_INIT_FIRST_NS 4100000
+#define LCD_EMU_INIT_SECOND_NS 100000
+
+typedef enum lcd_emu_op_kind
+{
+    LCD_EMU_OP_START,
+    LCD_EMU_OP_STOP,
+    LCD_EMU_OP_WRITE,
+    LCD_EMU_OP_READ
+} lcd_emu_op_kind_n;
+
+typedef struct lcd_emu_op
+{
+    lcd_emu_op_kind_n kind;
+    const uint8_t *data;            /*NULL for a single byte held in byte*/
+    uint8_t *out;
+    uint8_t byte;
+    size_t len;
+} lcd_emu_op_t;
+
+typedef struct lcd_emu_cmd
+{
+    lcd_emu_op_t ops[LCD_EMU_MAX_OPS];
+    int count;
+} lcd_emu_cmd_t;
+
+typedef struct lcd_emu_hd44780
+{
+    int four_bit;
+    int two_lines;
+    int init_function_sets;         /*8-bit function sets seen, the first two need the long init waits*/
+    int nibble_pending;
+    int nibble_dropped;
+    uint8_t high_nibble;
+    uint8_t ddram[0x80];
+    uint8_t cgram[64];
+    int cgram_mode;                 /*The address counter points into CGRAM since the last set CGRAM address*/
+    uint8_t ac;
+    int increment;
+    int shift_on_write;
+    int display_shift;
+    uint8_t display_control;
+    uint8_t drive;                  /*D4-D7 pulled down by a read in progress, 0xff when not driving*/
+    uint64_t busy_until_ns;
+} lcd_emu_hd44780_t;
+
+static uint64_t g_now_ns = 0;
+static uint64_t g_bit_ns = 10000;
+static int g_osc_khz = 270;
+static uint8_t g_pins = 0;
+static uint8_t g_lcd_pins = 0;      /*Expander outputs as the controller sees them*/
+static int g_rw_tied = 0;
+static uint32_t g_fail_at_byte = 0;  /*Bus byte count the injected NACK lands on, 0 for none*/
+static lcd_emu_hd44780_t g_lcd;
+static lcd_emu_stats_t g_stats;
+
+void lcd_emu_reset(int bus_khz, int osc_khz)
+{
+    g_now_ns = 0;
+    g_bit_ns = 1000000 / bus_khz;
+    g_osc_khz = osc_khz;
+    g_pins = 0xff;
+    g_fail_at_byte = 0;
+    g_lcd_pins = g_rw_tied ? 0xff & ~LCD_EMU_RW : 0xff;
+    memset(&g_stats, 0, sizeof(g_stats));
+    memset(&g_lcd, 0, sizeof(g_lcd));
+    memset(g_lcd.ddram, ' ', sizeof(g_lcd.ddram));
+    g_lcd.increment = 1;
+    g_lcd.drive = 0xff;
+    g_lcd.busy_until_ns = LCD_EMU_POWER_ON_NS;
+}
+
+void lcd_emu_set_rw_tied(int tied)
+{
+    g_rw_tied = tied;
+}
+
+void lcd_emu_fail_after(uint32_t bytes)
+{
+    g_fail_at_byte = bytes ? g_stats.bus_bytes + bytes : 0;
+}
+
+uint64_t lcd_emu_now_ns(void)
+{
+    return g_now_ns;
+}
+
+void lcd_emu_get_stats(lcd_emu_stats_t *stats_out)
+{
+    *stats_out = g_stats;
+}
+
+static uint64_t exec_ns(uint64_t nominal_ns)
+{
+    return nominal_ns * 270 / g_osc_khz;
+}
+
+static uint8_t next_ac(uint8_t ac, int increment)
+{
+    if (increment) {
+        ac++;
+        if (ac == 0x28) return 0x40;
+        if (ac == 0x68) return 0x00;
+        return ac;
+    }
+    if (ac == 0x00) return 0x67;
+    if (ac == 0x40) return 0x27;
+    return ac - 1;
+}
+
+static void execute(uint8_t data, int rs)
+{
+    uint64_t busy_ns = exec_ns(LCD_EMU_EXEC_NS);
+    g_stats.lcd_bytes++;
+    if (rs && g_lcd.cgram_mode) {
+        g_lcd.cgram[g_lcd.ac] = data & 0x1f;
+        g_lcd.ac = (g_lcd.ac + (g_lcd.increment ? 1 : -1)) & 0x3f;
+        g_stats.cgram_writes++;
+    } else if (rs) {
+        g_lcd.ddram[g_lcd.ac] = data;
+        g_lcd.ac = next_ac(g_lcd.ac, g_lcd.increment);
+        if (g_lcd.shift_on_write) g_lcd.display_shift += g_lcd.increment ? 1 : -1;
+    } else if (data & 0x80) {
+        g_lcd.ac = data & 0x7f;
+        g_lcd.cgram_mode = 0;
+    } else if (data & 0x40) {
+        g_lcd.ac = data & 0x3f;
+        g_lcd.cgram_mode = 1;
+    } else if (data & 0x20) {
+        if (!g_lcd.four_bit && g_lcd.init_function_sets < 2) {
+            busy_ns = g_lcd.init_function_sets ? LCD_EMU_INIT_SECOND_NS : LCD_EMU_INIT_FIRST_NS;
+            g_lcd.init_function_sets++;
+        }
+        g_lcd.four_bit = !(data & 0x10);
+        g_lcd.two_lines = !!(data & 0x08);
+    } else if (data & 0x10) {
+        int step = (data & 0x04) ? 1 : -1;
+        if (data & 0x08) g_lcd.display_shift -= step;
+        else g_lcd.ac = next_ac(g_lcd.ac, step > 0);
+    } else if (data & 0x08) {
+        g_lcd.display_control = data & 0x07;
+    } else if (data & 0x04) {
+        g_lcd.increment = !!(data & 0x02);
+        g_lcd.shift_on_write = data & 0x01;
+    } else if (data & 0x02) {
+        g_lcd.ac = 0;
+        g_lcd.cgram_mode = 0;
+        g_lcd.display_shift = 0;
+        busy_ns = exec_ns(LCD_EMU_SLOW_EXEC_NS);
+    } else if (data & 0x01) {
+        memset(g_lcd.ddram, ' ', sizeof(g_lcd.ddram));
+        g_lcd.ac = 0;
+        g_lcd.cgram_mode = 0;
+        g_lcd.increment = 1;
+        g_lcd.display_shift = 0;
+        busy_ns = exec_ns(LCD_EMU_SLOW_EXEC_NS);
+    }
+    g_lcd.busy_until_ns = g_now_ns + busy_ns;
+}
+
+// With RW high the controller drives D4-D7 from the rising edge of E, the busy flag and address counter with
+// RS low or the character at the address counter with RS high. High half first in 4-bit mode. Status can be
+// read while busy, that is what it is for
+static void drive_nibble(uint8_t pins)
+{
+    uint8_t data;
+    int second = g_lcd.four_bit && g_lcd.nibble_pending;
+    if (pins & LCD_EMU_RS) {
+        data = g_lcd.cgram_mode ? g_lcd.cgram[g_lcd.ac & 0x3f] : g_lcd.ddram[g_lcd.ac & 0x7f];
+    } else {
+        data = (g_now_ns < g_lcd.busy_until_ns ? 0x80 : 0) | (g_lcd.ac & 0x7f);
+        if (!second) g_stats.status_reads++;
+    }
+    g_lcd.drive = (second ? data << 4 : data & 0xf0) | 0x0f;
+}
+
+// The controller takes D4-D7 on the falling edge of E. Anything arriving while it is busy is lost, in 4-bit
+// mode along with the other half of its byte
+static void latch_nibble(uint8_t pins)
+{
+    uint8_t nibble = pins >> 4;
+    int busy = g_now_ns < g_lcd.busy_until_ns;
+    if (pins & LCD_EMU_RW) {
+        g_lcd.drive = 0xff;
+        if (g_lcd.four_bit && !g_lcd.nibble_pending) {
+            g_lcd.nibble_pending = 1;
+            g_lcd.nibble_dropped = 0;
+            return;
+        }
+        g_lcd.nibble_pending = 0;
+        if ((pins & LCD_EMU_RS) && !busy && g_lcd.cgram_mode) g_lcd.ac = (g_lcd.ac + (g_lcd.increment ? 1 : -1)) & 0x3f;
+        else if ((pins & LCD_EMU_RS) && !busy) g_lcd.ac = next_ac(g_lcd.ac, g_lcd.increment);
+        return;
+    }
+    if (busy) g_stats.busy_violations++;
+    if (!g_lcd.four_bit) {
+        if (!busy) execute(nibble << 4, pins & LCD_EMU_RS);
+        return;
+    }
+    if (!g_lcd.nibble_pending) {
+        g_lcd.high_nibble = nibble;
+        g_lcd.nibble_pending = 1;
+        g_lcd.nibble_dropped = busy;
+        return;
+    }
+    g_lcd.nibble_pending = 0;
+    if (!busy && !g_lcd.nibble_dropped) execute(g_lcd.high_nibble << 4 | nibble, pins & LCD_EMU_RS);
+}
+
+static void expander_write(uint8_t pins)
+{
+    uint8_t previous = g_lcd_pins;
+    g_pins = pins;
+    if (g_rw_tied) pins &= ~LCD_EMU_RW;
+    g_lcd_pins = pins;
+    if (!(previous & LCD_EMU_E) && (pins & LCD_EMU_E) && (pins & LCD_EMU_RW)) drive_nibble(pins);
+    if ((previous & LCD_EMU_E) && !(pins & LCD_EMU_E)) latch_nibble(previous);
+}
+
+// Outputs are weak pull-ups, reading back a pin written high shows whether the controller pulls it down
+static uint8_t expander_read(void)
+{
+    return g_pins & g_lcd.drive;
+}
+
+static void clock_bits(int bits)
+{
+    g_now_ns += bits * g_bit_ns;
+    g_stats.bus_ns += bits * g_bit_ns;
+}
+
+esp_err_t i2c_driver_install(i2c_port_t i2c_num, i2c_mode_t mode)
+{
+    return ESP_OK;
+}
+
+esp_err_t i2c_param_config(i2c_port_t i2c_num, const i2c_config_t *i2c_conf)
+{
+    return ESP_OK;
+}
+
+i2c_cmd_handle_t i2c_cmd_link_create(void)
+{
+    return calloc(1, sizeof(lcd_emu_cmd_t));
+}
+
+void i2c_cmd_link_delete(i2c_cmd_handle_t cmd_handle)
+{
+    free(cmd_handle);
+}
+
+static esp_err_t add_op(i2c_cmd_handle_t cmd_handle, lcd_emu_op_t op)
+{
+    lcd_emu_cmd_t *cmd = cmd_handle;
+    if (cmd->count == LCD_EMU_MAX_OPS) return ESP_FAIL;
+    cmd->ops[cmd->count++] = op;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_start(i2c_cmd_handle_t cmd_handle)
+{
+    return add_op(cmd_handle, (lcd_emu_op_t) { .kind = LCD_EMU_OP_START });
+}
+
+esp_err_t i2c_master_stop(i2c_cmd_handle_t cmd_handle)
+{
+    return add_op(cmd_handle, (lcd_emu_op_t) { .kind = LCD_EMU_OP_STOP });
+}
+
+esp_err_t i2c_master_write_byte(i2c_cmd_handle_t cmd_handle, uint8_t data, bool ack_en)
+{
+    return add_op(cmd_handle, (lcd_emu_op_t) { .kind = LCD_EMU_OP_WRITE, .byte = data, .len = 1 });
+}
+
+esp_err_t i2c_master_write(i2c_cmd_handle_t cmd_handle, uint8_t *data, size_t data_len, bool ack_en)
+{
+    return add_op(cmd_handle, (lcd_emu_op_t) { .kind = LCD_EMU_OP_WRITE, .data = data, .len = data_len });
+}
+
+esp_err_t i2c_master_read_byte(i2c_cmd_handle_t cmd_handle, uint8_t *data, i2c_ack_type_t ack)
+{
+    return add_op(cmd_handle, (lcd_emu_op_t) { .kind = LCD_EMU_OP_READ, .out = data, .len = 1 });
+}
+
+esp_err_t i2c_master_read(i2c_cmd_handle_t cmd_handle, uint8_t *data, size_t data_len, i2c_ack_type_t ack)
+{
+    return add_op(cmd_handle, (lcd_emu_op_t) { .kind = LCD_EMU_OP_READ, .out = data, .len = data_len });
+}
+
+// The first byte after a start is the address. Every byte is nine clocks with its acknowledge, and the
+// expander's outputs change as a written byte is acknowledged. A NACK ends the transaction with a stop, as the
+// SDK does with ack checking on, and the rest of the command link never reaches the bus
+esp_err_t i2c_master_cmd_begin(i2c_port_t i2c_num, i2c_cmd_handle_t cmd_handle, TickType_t ticks_to_wait)
+{
+    lcd_emu_cmd_t *cmd = cmd_handle;
+    int expect_address = 0;
+    int addressed = 0;
+    g_stats.transactions++;
+    for (int index = 0; index < cmd->count; index++) {
+        lcd_emu_op_t *op = &cmd->ops[index];
+        switch (op->kind) {
+            case LCD_EMU_OP_START:
+                clock_bits(1);
+                expect_address = 1;
+                break;
+            case LCD_EMU_OP_STOP:
+                clock_bits(1);
+                addressed = 0;
+                break;
+            case LCD_EMU_OP_WRITE:
+                for (size_t byte_index = 0; byte_index < op->len; byte_index++) {
+                    uint8_t byte = op->data ? op->data[byte_index] : op->byte;
+                    clock_bits(9);
+                    g_stats.bus_bytes++;
+                    if (g_stats.bus_bytes == g_fail_at_byte || (expect_address && (byte >> 1) != LCD_EMU_I2C_ADDR)) {
+                        g_fail_at_byte = 0;
+                        g_stats.nacks++;
+                        clock_bits(1);
+                        return ESP_FAIL;
+                    }
+                    if (expect_address) {
+                        expect_address = 0;
+                        addressed = 1;
+                    } else if (addressed) {
+                        expander_write(byte);
+                    }
+                }
+                break;
+            case LCD_EMU_OP_READ:
+                for (size_t byte_index = 0; byte_index < op->len; byte_index++) {
+                    clock_bits(9);
+                    g_stats.bus_bytes++;
+                    op->out[byte_index] = addressed ? expander_read() : 0xff;
+                }
+                break;
+        }
+    }
+    return ESP_OK;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return g_now_ns / 1000;
+}
+
+void ets_delay_us(uint32_t us)
+{
+    g_now_ns += (uint64_t) us * 1000;
+    g_stats.delay_ns += (uint64_t) us * 1000;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    g_now_ns += (uint64_t) ticks * portTICK_PERIOD_MS * 1000000;
+    g_stats.delay_ns += (uint64_t) ticks * portTICK_PERIOD_MS * 1000000;
+}
+
+// Character code shown in a cell, blank while the display is off
+static uint8_t cell_code(int row, int col)
+{
+    static const uint8_t row_offsets[LCD_EMU_ROWS] = { 0x00, 0x40 };
+    int offset = ((col + g_lcd.display_shift) % 40 + 40) % 40;
+    if (!(g_lcd.display_control & 0x04) || (row && !g_lcd.two_lines)) return ' ';
+    return g_lcd.ddram[row_offsets[row] + offset];
+}
+
+void lcd_emu_get_screen(char screen[LCD_EMU_ROWS][LCD_EMU_COLS + 1])
+{
+    for (int row = 0; row < LCD_EMU_ROWS; row++) {
+        for (int col = 0; col < LCD_EMU_COLS; col++) {
+            uint8_t data = cell_code(row, col);
+            if (data < 0x10) screen[row][col] = '*';
+            else if (data == 0xff) screen[row][col] = '#';
+            else screen[row][col] = data >= 0x20 && data < 0x7f ? (char) data : '?';
+        }
+        screen[row][LCD_EMU_COLS] = '\0';
+    }
+}
+
+int lcd_emu_get_cell_bitmap(int row, int col, uint8_t bitmap[LCD_EMU_GLYPH_ROWS])
+{
+    uint8_t data = cell_code(row, col);
+    if (data == 0xff) {
+        memset(bitmap, 0x1f, LCD_EMU_GLYPH_ROWS);
+        return 1;
+    }
+    if (data >= 0x10) return 0;
+    // Codes 8-15 show the same eight CGRAM characters as 0-7
+    memcpy(bitmap, &g_lcd.cgram[(data & 0x07) * LCD_EMU_GLYPH_ROWS], LCD_EMU_GLYPH_ROWS);
+    return 1;
+}
+
+void lcd_emu_get_state(lcd_emu_state_t *state_out)
+{
+    state_out->four_bit = g_lcd.four_bit;
+    state_out->two_lines = g_lcd.two_lines;
+    state_out->display_on = !!(g_lcd.display_control & 0x04);
+    state_out->cursor = !!(g_lcd.display_control & 0x02);
+    state_out->blink = !!(g_lcd.display_control & 0x01);
+    state_out->backlight = !!(g_pins & LCD_EMU_BACKLIGHT);
+    state_out->increment = g_lcd.increment;
+    state_out->shift_on_write = g_lcd.shift_on_write;
+    state_out->display_shift = ((g_lcd.display_shift % 40) + 40) % 40;
+    state_out->cgram_mode = g_lcd.cgram_mode;
+    state_out->address = g_lcd.ac;
+}
+
+// Text lines in a frame, then for each line showing custom characters their pixels under the cells they sit in
+void lcd_emu_print_screen(FILE *out)
+{
+    char screen[LCD_EMU_ROWS][LCD_EMU_COLS + 1];
+    uint8_t bitmap[LCD_EMU_GLYPH_ROWS];
+    lcd_emu_state_t state;
+    lcd_emu_get_screen(screen);
+    lcd_emu_get_state(&state);
+    fprintf(out, "+----------------+\n");
+    for (int row = 0; row < LCD_EMU_ROWS; row++) {
+        fprintf(out, "|%s|\n", screen[row]);
+    }
+    fprintf(out, "+----------------+ backlight %s", state.backlight ? "on" : "off");
+    if (state.cursor || state.blink) {
+        fprintf(out, ", %s%s at %02x", state.cursor ? "cursor" : "", state.blink ? " blinking" : "", state.address);
+    }
+    fprintf(out, "\n");
+    for (int row = 0; row < LCD_EMU_ROWS; row++) {
+        int custom = 0;
+        for (int col = 0; col < LCD_EMU_COLS; col++) {
+            custom |= screen[row][col] == '*';
+        }
+        if (!custom) continue;
+        for (int pixel_row = 0; pixel_row < LCD_EMU_GLYPH_ROWS; pixel_row++) {
+            fprintf(out, " ");
+            for (int col = 0; col < LCD_EMU_COLS; col++) {
+                int shown = lcd_emu_get_cell_bitmap(row, col, bitmap);
+                for (int bit = 4; bit >= 0; bit--) {
+                    fputc(!shown ? ' ' : bitmap[pixel_row] & (1 << bit) ? '#' : '.', out);
+                }
+                fputc(' ', out);
+            }
+            fprintf(out, "\n");
+        }
+    }
+}
\ No newline at end of file
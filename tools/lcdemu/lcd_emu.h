@@ -0,0 +1,59 @@
+#ifndef _LCD_EMU_H_
+#define _LCD_EMU_H_
+#include <stdint.h>
+#include <stdio.h>
+
+#define LCD_EMU_ROWS 2
+#define LCD_EMU_COLS 16
+#define LCD_EMU_GLYPH_ROWS 8
+
+/*Bus and controller activity since the last lcd_emu_reset*/
+typedef struct lcd_emu_stats
+{
+    uint32_t transactions;          /*i2c_master_cmd_begin calls*/
+    uint32_t bus_bytes;             /*Address and data bytes, each nine clocks*/
+    uint32_t lcd_bytes;             /*Commands and characters the controller took*/
+    uint32_t busy_violations;       /*Nibbles sent while the controller was still busy, it drops them*/
+    uint32_t status_reads;          /*Busy flag and address counter reads*/
+    uint32_t cgram_writes;          /*Custom character rows written*/
+    uint32_t nacks;                 /*Transactions cut short, injected or to a missing address*/
+    uint64_t bus_ns;                /*Time the bus was clocking*/
+    uint64_t delay_ns;              /*Time spent in ets_delay_us and vTaskDelay*/
+} lcd_emu_stats_t;
+
+/*What the controller holds beyond the screen, for checking the commands that don't draw anything*/
+typedef struct lcd_emu_state
+{
+    int four_bit;
+    int two_lines;
+    int display_on;
+    int cursor;
+    int blink;
+    int backlight;                  /*Expander pin P3*/
+    int increment;                  /*Entry mode I/D*/
+    int shift_on_write;             /*Entry mode S, autoscroll*/
+    int display_shift;              /*Columns the display is scrolled left, 0-39*/
+    int cgram_mode;
+    uint8_t address;                /*Address counter*/
+} lcd_emu_state_t;
+
+/*Powers the panel up at time 0 with the bus at bus_khz. osc_khz is the controller's oscillator, execution
+  times scale from the datasheet's 270 kHz and the part may run as slow as 190 kHz*/
+void lcd_emu_reset(int bus_khz, int osc_khz);
+/*Backpacks with the controller's RW pin tied to ground, reads turn into writes and the expander reads back its
+  own outputs. Takes effect at the next reset*/
+void lcd_emu_set_rw_tied(int tied);
+/*NACKs the bus byte that many bytes from now, the driver sees its transaction fail there. 0 cancels*/
+void lcd_emu_fail_after(uint32_t bytes);
+uint64_t lcd_emu_now_ns(void);
+void lcd_emu_get_stats(lcd_emu_stats_t *stats_out);
+/*Visible characters of each line, NUL terminated. Custom characters show as '*' and the ROM's solid block as '#'*/
+void lcd_emu_get_screen(char screen[LCD_EMU_ROWS][LCD_EMU_COLS + 1]);
+/*Pixel rows of a cell showing a custom character or the solid block, bit 4 is the leftmost column. Returns 0 and
+  leaves bitmap alone for other ROM characters*/
+int lcd_emu_get_cell_bitmap(int row, int col, uint8_t bitmap[LCD_EMU_GLYPH_ROWS]);
+void lcd_emu_get_state(lcd_emu_state_t *state_out);
+/*The screen framed as text with the pixels of any custom characters drawn out below their line*/
+void lcd_emu_print_screen(FILE *out);
+
+#endif //_LCD_EMU_H_
\ No newline at end of file
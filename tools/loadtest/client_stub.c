@@ -0,0 +1,107 @@
+/*Client side of the firmware as the handlers see it. Nothing goes upstream, queued fetches finish at once so
+  /jobs/{id} has something to report*/
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+#include "whoop_client.h"
+#include "whoop_data.h"
+#include "whoop_display.h"
+#include "i2c_led.h"
+
+#define WHOOP_JOB_COUNT 8
+
+static whoop_job_t g_jobs[WHOOP_JOB_COUNT];
+static uint32_t g_next_job_id = 1;
+static whoop_transfer_stats_t g_transfer_stats[WHOOP_API_REQUEST_TYPE_MAX];
+
+int whoop_queue_token(int account, const char *code_or_token, int token_request_type)
+{
+    return 0;
+}
+
+int whoop_queue_job(int account, whoop_api_request_type_n request_type, uint32_t *job_id)
+{
+    whoop_job_t *job;
+    if(request_type < 0 || request_type >= WHOOP_API_REQUEST_TYPE_TOKEN || account < 0 || account >= WHOOP_ACCOUNT_COUNT)
+    {
+        return -1;
+    }
+    portENTER_CRITICAL();
+    *job_id = g_next_job_id++;
+    job = &g_jobs[*job_id % WHOOP_JOB_COUNT];
+    memset(job, 0, sizeof(whoop_job_t));
+    job->id = *job_id;
+    job->account = account;
+    job->request_type = request_type;
+    job->state = WHOOP_JOB_STATE_DONE;
+    job->queued_us = job->started_us = job->finished_us = esp_timer_get_time();
+    portEXIT_CRITICAL();
+    return 0;
+}
+
+int whoop_client_get_job(uint32_t job_id, whoop_job_t *job_out)
+{
+    int status = -1;
+    portENTER_CRITICAL();
+    if(job_id && g_jobs[job_id % WHOOP_JOB_COUNT].id == job_id)
+    {
+        *job_out = g_jobs[job_id % WHOOP_JOB_COUNT];
+        status = 0;
+    }
+    portEXIT_CRITICAL();
+    return status;
+}
+
+const char *whoop_job_state_name(whoop_job_state_n state)
+{
+    static const char *job_state_names[] = {"queued", "running", "done", "failed"};
+    return (state >= WHOOP_JOB_STATE_QUEUED && state <= WHOOP_JOB_STATE_FAILED) ? job_state_names[state] : "unknown";
+}
+
+int64_t whoop_client_get_next_poll_us(void)
+{
+    return (int64_t) WHOOP_POLL_INTERVAL_MS * 1000;
+}
+
+uint32_t whoop_client_get_reconnect_count(void)
+{
+    return 0;
+}
+
+int whoop_client_get_transfer_stats(whoop_api_request_type_n request_type, whoop_transfer_stats_t *stats_out)
+{
+    if(request_type < 0 || request_type >= WHOOP_API_REQUEST_TYPE_MAX || !stats_out) return -1;
+    *stats_out = g_transfer_stats[request_type];
+    return 0;
+}
+
+size_t whoop_client_account_size(void)
+{
+    return 0;
+}
+
+void end_whoop_tls_client(void)
+{
+}
+
+const char *whoop_api_request_type_name(whoop_api_request_type_n request_type)
+{
+    static const char *request_type_names[WHOOP_API_REQUEST_TYPE_MAX] = {"sleep", "workout", "recovery", "cycle", "token"};
+    if(request_type < 0 || request_type >= WHOOP_API_REQUEST_TYPE_MAX) return "unknown";
+    return request_type_names[request_type];
+}
+
+uint32_t whoop_display_get_render_count(void)
+{
+    return 0;
+}
+
+uint32_t whoop_display_get_superseded_count(void)
+{
+    return 0;
+}
+
+void i2c_lcd_1602_getStats(i2c_lcd_1602_stats_t *stats_out)
+{
+    memset(stats_out, 0, sizeof(*stats_out));
+}
\ No newline at end of file
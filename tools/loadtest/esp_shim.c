@@ -0,0 +1,243 @@
+/*The SDK and FreeRTOS calls the server side reaches, backed by the host*/
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "esp_event.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "nvs.h"
+#include "cJSON.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "freertos/timers.h"
+#include "shim.h"
+
+// Dashboard assets, gzipped into build/ the way component.mk does
+#ifndef SHIM_ASSET_DIR
+#define SHIM_ASSET_DIR "build"
+#endif
+#define SHIM_EMBED_FILE(name, file)                                 \
+    __asm__(".section .rodata\n"                                    \
+            ".global _binary_" name "_start\n"                      \
+            "_binary_" name "_start:\n"                             \
+            ".incbin \"" SHIM_ASSET_DIR "/" file "\"\n"             \
+            ".global _binary_" name "_end\n"                        \
+            "_binary_" name "_end:\n"                               \
+            ".previous\n")
+
+SHIM_EMBED_FILE("index_html_gz", "index.html.gz");
+SHIM_EMBED_FILE("app_js_gz", "app.js.gz");
+
+esp_event_base_t IP_EVENT = "IP_EVENT";
+esp_event_base_t WIFI_EVENT = "WIFI_EVENT";
+
+/*Prefix kept in front of every block so free() knows whether it was charged*/
+typedef struct shim_block
+{
+    size_t size;
+    size_t tracked;
+} __attribute__((aligned(16))) shim_block_t;
+
+static __thread int g_track_thread = 0;
+static size_t g_heap_live = 0;
+static size_t g_heap_peak = 0;
+static size_t g_heap_max = 0;
+static int g_log_verbose = 0;
+static pthread_mutex_t g_critical_lock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+
+void *__real_malloc(size_t size);
+void __real_free(void *ptr);
+
+static void charge(size_t size)
+{
+    size_t live = __atomic_add_fetch(&g_heap_live, size, __ATOMIC_RELAXED);
+    size_t peak = __atomic_load_n(&g_heap_peak, __ATOMIC_RELAXED);
+    while(live > peak && !__atomic_compare_exchange_n(&g_heap_peak, &peak, live, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    if(live > g_heap_max) g_heap_max = live;
+}
+
+void *__wrap_malloc(size_t size)
+{
+    if(g_track_thread && g_heap_live + size > SHIM_HEAP_SIZE) return NULL;
+    shim_block_t *block = __real_malloc(sizeof(shim_block_t) + size);
+    if(!block) return NULL;
+    block->size = size;
+    block->tracked = g_track_thread;
+    if(block->tracked) charge(size);
+    return block + 1;
+}
+
+void __wrap_free(void *ptr)
+{
+    if(!ptr) return;
+    shim_block_t *block = (shim_block_t *) ptr - 1;
+    if(block->tracked) __atomic_sub_fetch(&g_heap_live, block->size, __ATOMIC_RELAXED);
+    __real_free(block);
+}
+
+void *__wrap_calloc(size_t count, size_t size)
+{
+    void *ptr = __wrap_malloc(count * size);
+    if(ptr) memset(ptr, 0, count * size);
+    return ptr;
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    if(!ptr) return __wrap_malloc(size);
+    shim_block_t *block = (shim_block_t *) ptr - 1;
+    void *moved = __wrap_malloc(size);
+    if(!moved) return NULL;
+    memcpy(moved, ptr, block->size < size ? block->size : size);
+    __wrap_free(ptr);
+    return moved;
+}
+
+void shim_heap_track_thread(void)
+{
+    g_track_thread = 1;
+}
+
+size_t shim_heap_get_live(void)
+{
+    return __atomic_load_n(&g_heap_live, __ATOMIC_RELAXED);
+}
+
+size_t shim_heap_get_peak(void)
+{
+    return __atomic_load_n(&g_heap_peak, __ATOMIC_RELAXED);
+}
+
+void shim_heap_reset_peak(void)
+{
+    __atomic_store_n(&g_heap_peak, shim_heap_get_live(), __ATOMIC_RELAXED);
+}
+
+uint32_t esp_get_free_heap_size(void)
+{
+    return SHIM_HEAP_SIZE - shim_heap_get_live();
+}
+
+uint32_t esp_get_minimum_free_heap_size(void)
+{
+    return SHIM_HEAP_SIZE - g_heap_max;
+}
+
+uint32_t esp_random(void)
+{
+    return (uint32_t) random();
+}
+
+int64_t esp_timer_get_time(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+void shim_log_set_verbose(int verbose)
+{
+    g_log_verbose = verbose;
+}
+
+void shim_log(const char *level, const char *tag, const char *format, ...)
+{
+    va_list args;
+    if(!g_log_verbose && level[0] != 'E') return;
+    va_start(args, format);
+    fprintf(stderr, "%s (%lld) %s: ", level, (long long) (esp_timer_get_time() / 1000), tag);
+    vfprintf(stderr, format, args);
+    fputc('\n', stderr);
+    va_end(args);
+}
+
+void shim_enter_critical(void)
+{
+    pthread_mutex_lock(&g_critical_lock);
+}
+
+void shim_exit_critical(void)
+{
+    pthread_mutex_unlock(&g_critical_lock);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return (TaskHandle_t) pthread_self();
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    pthread_mutex_t *mutex = malloc(sizeof(pthread_mutex_t));
+    if(mutex) pthread_mutex_init(mutex, NULL);
+    return mutex;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks_to_wait)
+{
+    return pthread_mutex_lock(semaphore) ? pdFALSE : pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+    return pthread_mutex_unlock(semaphore) ? pdFALSE : pdTRUE;
+}
+
+TimerHandle_t xTimerCreate(const char *name, TickType_t period, UBaseType_t auto_reload, void *timer_id, TimerCallbackFunction_t callback)
+{
+    return (TimerHandle_t) callback;
+}
+
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t ticks_to_wait)
+{
+    return pdPASS;
+}
+
+esp_err_t esp_event_handler_register(esp_event_base_t event_base, int32_t event_id, esp_event_handler_t event_handler, void *event_handler_arg)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t *ap_info)
+{
+    memset(ap_info, 0, sizeof(wifi_ap_record_t));
+    strcpy((char *) ap_info->ssid, "loadtest");
+    ap_info->primary = 1;
+    ap_info->rssi = -50;
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle)
+{
+    *out_handle = 1;
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length)
+{
+    return ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length)
+{
+    return ESP_OK;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+}
+
+void cJSON_InitHooks(cJSON_Hooks *hooks)
+{
+}
\ No newline at end of file
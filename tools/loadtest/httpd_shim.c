@@ -0,0 +1,636 @@
+/*esp_http_server over POSIX sockets for the load test. Like the SDK's server it is one task polling every
+  session, running one handler at a time and queued work in between, so a slow handler stalls everything
+  behind it the way it would on the device*/
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <strings.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include "esp_log.h"
+#include "esp_http_server.h"
+#include "shim.h"
+
+static const char *TAG = "HTTPD SHIM";
+
+// CONFIG_HTTPD_MAX_REQ_HDR_LEN, larger than the SDK default of 512 so long history queries fit
+#define SHIM_RECV_BUF_LEN 1024
+#define SHIM_RESP_HEAD_LEN 1024
+#define SHIM_WORK_QUEUE_LEN 16
+
+typedef struct shim_sess
+{
+    int fd;                         /*-1 when the slot is free*/
+    int close;
+    void *ctx;
+    httpd_free_ctx_fn_t free_ctx;
+    size_t len;
+    char buf[SHIM_RECV_BUF_LEN];
+} shim_sess_t;
+
+typedef struct shim_req_aux
+{
+    shim_sess_t *sess;
+    const char *head;               /*Header lines of the request, after the request line*/
+    size_t head_len;
+    size_t body_offset;             /*Where the body starts in the session buffer*/
+    size_t body_remaining;
+    const char *status;
+    const char *type;
+    const char **hdr_fields;
+    const char **hdr_values;
+    int hdr_count;
+    int headers_sent;
+} shim_req_aux_t;
+
+typedef struct shim_work
+{
+    httpd_work_fn_t fn;
+    void *arg;
+} shim_work_t;
+
+typedef struct shim_server
+{
+    httpd_config_t config;
+    int listen_fd;
+    int wake[2];
+    httpd_uri_t *handlers;
+    int handler_count;
+    shim_sess_t *sessions;
+    const char **hdr_fields;
+    const char **hdr_values;
+    pthread_t thread;
+    volatile int running;
+    pthread_mutex_t work_lock;
+    shim_work_t work[SHIM_WORK_QUEUE_LEN];
+    int work_count;
+} shim_server_t;
+
+static uint16_t g_port_override = 0;
+
+static const char *get_status_text(int code)
+{
+    switch(code)
+    {
+        case 400: return "400 Bad Request";
+        case 404: return "404 Not Found";
+        case 405: return "405 Method Not Allowed";
+        case 408: return "408 Request Timeout";
+        case 431: return "431 Request Header Fields Too Large";
+        default: return "500 Internal Server Error";
+    }
+}
+
+static int parse_method(const char *method, size_t len)
+{
+    static const struct { const char *name; httpd_method_t method; } methods[] = {
+        { "DELETE", HTTP_DELETE }, { "GET", HTTP_GET }, { "HEAD", HTTP_HEAD }, { "POST", HTTP_POST }, { "PUT", HTTP_PUT },
+    };
+    for(size_t index = 0; index < sizeof(methods) / sizeof(methods[0]); index++)
+    {
+        if(strlen(methods[index].name) == len && !strncmp(methods[index].name, method, len))
+            return methods[index].method;
+    }
+    return -1;
+}
+
+static int send_all(int fd, const char *buf, size_t len)
+{
+    while(len)
+    {
+        ssize_t sent = send(fd, buf, len, MSG_NOSIGNAL);
+        if(sent < 0)
+        {
+            if(errno == EINTR) continue;
+            return -1;
+        }
+        buf += sent;
+        len -= sent;
+    }
+    return 0;
+}
+
+static void close_session(shim_sess_t *sess)
+{
+    if(sess->ctx)
+    {
+        if(sess->free_ctx) sess->free_ctx(sess->ctx);
+        else free(sess->ctx);
+    }
+    close(sess->fd);
+    sess->fd = -1;
+    sess->close = 0;
+    sess->ctx = NULL;
+    sess->free_ctx = NULL;
+    sess->len = 0;
+}
+
+static shim_sess_t *find_session(shim_server_t *server, int fd)
+{
+    for(int index = 0; index < server->config.max_open_sockets; index++)
+    {
+        if(server->sessions[index].fd == fd) return &server->sessions[index];
+    }
+    return NULL;
+}
+
+bool httpd_uri_match_wildcard(const char *uri_template, const char *uri_to_match, size_t match_upto)
+{
+    size_t template_len = strlen(uri_template);
+    if(template_len && uri_template[template_len - 1] == '*')
+    {
+        // "/jobs/*" also matches "/jobs" and "/jobs/"
+        template_len--;
+        if(template_len && uri_template[template_len - 1] == '/' && match_upto == template_len - 1)
+            return !strncmp(uri_template, uri_to_match, match_upto);
+        return match_upto >= template_len && !strncmp(uri_template, uri_to_match, template_len);
+    }
+    return template_len == match_upto && !strncmp(uri_template, uri_to_match, match_upto);
+}
+
+static const httpd_uri_t *find_handler(shim_server_t *server, const char *uri, int method, int *uri_found)
+{
+    size_t match_upto = strcspn(uri, "?");
+    *uri_found = 0;
+    for(int index = 0; index < server->handler_count; index++)
+    {
+        const httpd_uri_t *handler = &server->handlers[index];
+        int matched = server->config.uri_match_fn
+            ? server->config.uri_match_fn(handler->uri, uri, match_upto)
+            : strlen(handler->uri) == match_upto && !strncmp(handler->uri, uri, match_upto);
+        if(!matched) continue;
+        *uri_found = 1;
+        if((int) handler->method == method) return handler;
+    }
+    return NULL;
+}
+
+/*Parses and dispatches one request at the front of the session buffer. Returns the bytes it took, 0 while the
+  header is incomplete and -1 when the session should close*/
+static int handle_request(shim_server_t *server, shim_sess_t *sess)
+{
+    char *end = memmem(sess->buf, sess->len, "\r\n\r\n", 4);
+    if(!end)
+    {
+        if(sess->len < sizeof(sess->buf)) return 0;
+        static const char too_large[] = "HTTP/1.1 431 Request Header Fields Too Large\r\nContent-Length: 0\r\n\r\n";
+        send_all(sess->fd, too_large, sizeof(too_large) - 1);
+        return -1;
+    }
+    size_t head_len = end - sess->buf + 4;
+    char *line_end = memchr(sess->buf, '\r', head_len);
+    char *method_end = memchr(sess->buf, ' ', line_end - sess->buf);
+    char *uri_end = method_end ? memchr(method_end + 1, ' ', line_end - method_end - 1) : NULL;
+
+    httpd_req_t req = { 0 };
+    shim_req_aux_t aux = {
+        .sess = sess,
+        .head = line_end + 2,
+        .head_len = head_len - (line_end + 2 - sess->buf),
+        .body_offset = head_len,
+        .status = "200 OK",
+        .type = "text/html",
+        .hdr_fields = server->hdr_fields,
+        .hdr_values = server->hdr_values,
+    };
+    req.handle = server;
+    req.aux = &aux;
+    if(!uri_end || uri_end - method_end - 1 > HTTPD_MAX_URI_LEN || (req.method = parse_method(sess->buf, method_end - sess->buf)) < 0)
+    {
+        httpd_resp_send_err(&req, HTTPD_400_BAD_REQUEST, NULL);
+        return -1;
+    }
+    memcpy((char *) req.uri, method_end + 1, uri_end - method_end - 1);
+
+    char content_len[16];
+    if(httpd_req_get_hdr_value_str(&req, "Content-Length", content_len, sizeof(content_len)) == ESP_OK)
+        req.content_len = strtoul(content_len, NULL, 10);
+    aux.body_remaining = req.content_len;
+
+    int uri_found = 0;
+    int ret = 0;
+    const httpd_uri_t *handler = find_handler(server, req.uri, req.method, &uri_found);
+    if(!handler)
+    {
+        httpd_resp_send_err(&req, uri_found ? HTTPD_405_METHOD_NOT_ALLOWED : HTTPD_404_NOT_FOUND, NULL);
+    }
+    else
+    {
+        req.user_ctx = handler->user_ctx;
+        req.sess_ctx = sess->ctx;
+        req.free_ctx = sess->free_ctx;
+        ret = handler->handler(&req);
+        if(sess->ctx && sess->ctx != req.sess_ctx)
+        {
+            if(sess->free_ctx) sess->free_ctx(sess->ctx);
+            else free(sess->ctx);
+        }
+        sess->ctx = req.sess_ctx;
+        sess->free_ctx = req.free_ctx;
+    }
+
+    // Drop whatever body the handler left unread so the next request starts on its request line
+    size_t buffered = sess->len > aux.body_offset ? sess->len - aux.body_offset : 0;
+    size_t skip = aux.body_remaining < buffered ? aux.body_remaining : buffered;
+    aux.body_offset += skip;
+    aux.body_remaining -= skip;
+    char discard[256];
+    while(aux.body_remaining)
+    {
+        ssize_t got = recv(sess->fd, discard, aux.body_remaining < sizeof(discard) ? aux.body_remaining : sizeof(discard), 0);
+        if(got <= 0) return -1;
+        aux.body_remaining -= got;
+    }
+    if(ret != ESP_OK) return -1;
+    return aux.body_offset;
+}
+
+static void read_session(shim_server_t *server, shim_sess_t *sess)
+{
+    ssize_t got = recv(sess->fd, sess->buf + sess->len, sizeof(sess->buf) - sess->len, 0);
+    if(got <= 0)
+    {
+        close_session(sess);
+        return;
+    }
+    sess->len += got;
+    for(;;)
+    {
+        int used = handle_request(server, sess);
+        if(used < 0)
+        {
+            close_session(sess);
+            return;
+        }
+        if(!used) return;
+        sess->len = (size_t) used < sess->len ? sess->len - used : 0;
+        memmove(sess->buf, sess->buf + used, sess->len);
+    }
+}
+
+static void accept_session(shim_server_t *server)
+{
+    int fd = accept(server->listen_fd, NULL, NULL);
+    if(fd < 0) return;
+    shim_sess_t *sess = find_session(server, -1);
+    if(!sess)
+    {
+        // With lru_purge_enable off the SDK turns the connection away as well
+        close(fd);
+        return;
+    }
+    int one = 1;
+    struct timeval timeout = { .tv_sec = server->config.send_wait_timeout };
+    // lwIP on the device sends small segments straight away, without this Nagle's delay swamps the handlers
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    timeout.tv_sec = server->config.recv_wait_timeout;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    sess->fd = fd;
+}
+
+static void run_work(shim_server_t *server)
+{
+    char drain[32];
+    shim_work_t work[SHIM_WORK_QUEUE_LEN];
+    int work_count;
+    while(read(server->wake[0], drain, sizeof(drain)) == sizeof(drain));
+    pthread_mutex_lock(&server->work_lock);
+    work_count = server->work_count;
+    memcpy(work, server->work, work_count * sizeof(shim_work_t));
+    server->work_count = 0;
+    pthread_mutex_unlock(&server->work_lock);
+    for(int index = 0; index < work_count; index++)
+    {
+        work[index].fn(work[index].arg);
+    }
+}
+
+static void *server_task(void *arg)
+{
+    shim_server_t *server = arg;
+    int max_fds = server->config.max_open_sockets + 2;
+    struct pollfd fds[max_fds];
+    shim_heap_track_thread();
+    while(server->running)
+    {
+        int fd_count = 2;
+        fds[0] = (struct pollfd) { .fd = server->wake[0], .events = POLLIN };
+        fds[1] = (struct pollfd) { .fd = server->listen_fd, .events = POLLIN };
+        for(int index = 0; index < server->config.max_open_sockets; index++)
+        {
+            if(server->sessions[index].fd >= 0)
+                fds[fd_count++] = (struct pollfd) { .fd = server->sessions[index].fd, .events = POLLIN };
+        }
+        if(poll(fds, fd_count, -1) < 0)
+        {
+            if(errno == EINTR) continue;
+            break;
+        }
+        if(fds[0].revents) run_work(server);
+        for(int index = 2; index < fd_count; index++)
+        {
+            shim_sess_t *sess = find_session(server, fds[index].fd);
+            if(sess && fds[index].revents) read_session(server, sess);
+        }
+        if(fds[1].revents) accept_session(server);
+        for(int index = 0; index < server->config.max_open_sockets; index++)
+        {
+            if(server->sessions[index].fd >= 0 && server->sessions[index].close)
+                close_session(&server->sessions[index]);
+        }
+    }
+    return NULL;
+}
+
+esp_err_t httpd_start(httpd_handle_t *handle, const httpd_config_t *config)
+{
+    shim_server_t *server = calloc(1, sizeof(shim_server_t));
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    int one = 1;
+    if(!server) return ESP_ERR_NO_MEM;
+    server->config = *config;
+    server->handlers = calloc(config->max_uri_handlers, sizeof(httpd_uri_t));
+    server->sessions = calloc(config->max_open_sockets, sizeof(shim_sess_t));
+    server->hdr_fields = calloc(config->max_resp_headers, sizeof(char *));
+    server->hdr_values = calloc(config->max_resp_headers, sizeof(char *));
+    for(int index = 0; index < config->max_open_sockets; index++)
+    {
+        server->sessions[index].fd = -1;
+    }
+    pthread_mutex_init(&server->work_lock, NULL);
+    addr.sin_port = htons(g_port_override ? g_port_override : config->server_port);
+    server->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    setsockopt(server->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if(server->listen_fd < 0 || bind(server->listen_fd, (struct sockaddr *) &addr, sizeof(addr))
+       || listen(server->listen_fd, config->backlog_conn) || pipe2(server->wake, O_NONBLOCK))
+    {
+        ESP_LOGE(TAG, "Could not listen on port %d: %s", ntohs(addr.sin_port), strerror(errno));
+        if(server->listen_fd >= 0) close(server->listen_fd);
+        free(server->handlers);
+        free(server->sessions);
+        free(server->hdr_fields);
+        free(server->hdr_values);
+        free(server);
+        return ESP_FAIL;
+    }
+    server->running = 1;
+    pthread_create(&server->thread, NULL, server_task, server);
+    *handle = server;
+    return ESP_OK;
+}
+
+esp_err_t httpd_stop(httpd_handle_t handle)
+{
+    shim_server_t *server = handle;
+    if(!server) return ESP_ERR_INVALID_ARG;
+    server->running = 0;
+    if(write(server->wake[1], "", 1) < 0) return ESP_FAIL;
+    pthread_join(server->thread, NULL);
+    for(int index = 0; index < server->config.max_open_sockets; index++)
+    {
+        if(server->sessions[index].fd >= 0) close_session(&server->sessions[index]);
+    }
+    close(server->listen_fd);
+    close(server->wake[0]);
+    close(server->wake[1]);
+    free(server->handlers);
+    free(server->sessions);
+    free(server->hdr_fields);
+    free(server->hdr_values);
+    free(server);
+    return ESP_OK;
+}
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t *uri_handler)
+{
+    shim_server_t *server = handle;
+    if(server->handler_count == server->config.max_uri_handlers)
+    {
+        ESP_LOGE(TAG, "No slot left for %s", uri_handler->uri);
+        return ESP_FAIL;
+    }
+    server->handlers[server->handler_count++] = *uri_handler;
+    return ESP_OK;
+}
+
+void httpd_shim_set_port(uint16_t port)
+{
+    g_port_override = port;
+}
+
+
+int httpd_req_recv(httpd_req_t *r, char *buf, size_t buf_len)
+{
+    shim_req_aux_t *aux = r->aux;
+    shim_sess_t *sess = aux->sess;
+    if(buf_len > aux->body_remaining) buf_len = aux->body_remaining;
+    if(!buf_len) return 0;
+    if(aux->body_offset < sess->len)
+    {
+        size_t buffered = sess->len - aux->body_offset;
+        if(buf_len > buffered) buf_len = buffered;
+        memcpy(buf, sess->buf + aux->body_offset, buf_len);
+        aux->body_offset += buf_len;
+        aux->body_remaining -= buf_len;
+        return buf_len;
+    }
+    ssize_t got = recv(sess->fd, buf, buf_len, 0);
+    if(got < 0) return errno == EAGAIN || errno == EWOULDBLOCK ? HTTPD_SOCK_ERR_TIMEOUT : HTTPD_SOCK_ERR_FAIL;
+    if(got == 0) return HTTPD_SOCK_ERR_FAIL;
+    aux->body_remaining -= got;
+    // Keeps body_offset past the buffer so the request's own bytes are not handed out again
+    aux->body_offset = sess->len;
+    return got;
+}
+
+int httpd_req_to_sockfd(httpd_req_t *r)
+{
+    return ((shim_req_aux_t *) r->aux)->sess->fd;
+}
+
+static const char *find_header(httpd_req_t *r, const char *field, size_t *value_len)
+{
+    shim_req_aux_t *aux = r->aux;
+    size_t field_len = strlen(field);
+    const char *line = aux->head;
+    const char *head_end = aux->head + aux->head_len;
+    while(line < head_end)
+    {
+        const char *line_end = memmem(line, head_end - line, "\r\n", 2);
+        if(!line_end || line_end == line) break;
+        if((size_t) (line_end - line) > field_len && line[field_len] == ':' && !strncasecmp(line, field, field_len))
+        {
+            const char *value = line + field_len + 1;
+            while(value < line_end && *value == ' ') value++;
+            *value_len = line_end - value;
+            return value;
+        }
+        line = line_end + 2;
+    }
+    return NULL;
+}
+
+size_t httpd_req_get_hdr_value_len(httpd_req_t *r, const char *field)
+{
+    size_t value_len = 0;
+    return find_header(r, field, &value_len) ? value_len : 0;
+}
+
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t *r, const char *field, char *val, size_t val_size)
+{
+    size_t value_len = 0;
+    const char *value = find_header(r, field, &value_len);
+    if(!value) return ESP_ERR_NOT_FOUND;
+    if(!val_size) return ESP_ERR_HTTPD_RESULT_TRUNC;
+    size_t copy_len = value_len < val_size - 1 ? value_len : val_size - 1;
+    memcpy(val, value, copy_len);
+    val[copy_len] = '\0';
+    return copy_len < value_len ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+}
+
+size_t httpd_req_get_url_query_len(httpd_req_t *r)
+{
+    const char *query = strchr(r->uri, '?');
+    return query ? strlen(query + 1) : 0;
+}
+
+esp_err_t httpd_req_get_url_query_str(httpd_req_t *r, char *buf, size_t buf_len)
+{
+    const char *query = strchr(r->uri, '?');
+    if(!query) return ESP_ERR_NOT_FOUND;
+    if(!buf_len) return ESP_ERR_HTTPD_RESULT_TRUNC;
+    size_t query_len = strlen(query + 1);
+    size_t copy_len = query_len < buf_len - 1 ? query_len : buf_len - 1;
+    memcpy(buf, query + 1, copy_len);
+    buf[copy_len] = '\0';
+    return copy_len < query_len ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+}
+
+esp_err_t httpd_query_key_value(const char *qry, const char *key, char *val, size_t val_size)
+{
+    size_t key_len = strlen(key);
+    const char *pair = qry;
+    while(pair && *pair)
+    {
+        const char *pair_end = pair + strcspn(pair, "&");
+        const char *equals = memchr(pair, '=', pair_end - pair);
+        const char *name_end = equals ? equals : pair_end;
+        if((size_t) (name_end - pair) == key_len && !strncmp(pair, key, key_len))
+        {
+            const char *value = equals ? equals + 1 : pair_end;
+            size_t value_len = pair_end - value;
+            if(!val_size) return ESP_ERR_HTTPD_RESULT_TRUNC;
+            size_t copy_len = value_len < val_size - 1 ? value_len : val_size - 1;
+            memcpy(val, value, copy_len);
+            val[copy_len] = '\0';
+            return copy_len < value_len ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+        }
+        pair = *pair_end ? pair_end + 1 : NULL;
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t httpd_resp_set_status(httpd_req_t *r, const char *status)
+{
+    ((shim_req_aux_t *) r->aux)->status = status;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t *r, const char *type)
+{
+    ((shim_req_aux_t *) r->aux)->type = type;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_hdr(httpd_req_t *r, const char *field, const char *value)
+{
+    shim_req_aux_t *aux = r->aux;
+    shim_server_t *server = r->handle;
+    if(aux->hdr_count == server->config.max_resp_headers) return ESP_FAIL;
+    aux->hdr_fields[aux->hdr_count] = field;
+    aux->hdr_values[aux->hdr_count] = value;
+    aux->hdr_count++;
+    return ESP_OK;
+}
+
+static esp_err_t send_head(httpd_req_t *r, ssize_t content_len)
+{
+    shim_req_aux_t *aux = r->aux;
+    char head[SHIM_RESP_HEAD_LEN];
+    int len = snprintf(head, sizeof(head), "HTTP/1.1 %s\r\nContent-Type: %s\r\n", aux->status, aux->type);
+    if(content_len < 0)
+        len += snprintf(head + len, sizeof(head) - len, "Transfer-Encoding: chunked\r\n");
+    else
+        len += snprintf(head + len, sizeof(head) - len, "Content-Length: %zd\r\n", content_len);
+    for(int index = 0; index < aux->hdr_count && len < (int) sizeof(head); index++)
+    {
+        len += snprintf(head + len, sizeof(head) - len, "%s: %s\r\n", aux->hdr_fields[index], aux->hdr_values[index]);
+    }
+    len += snprintf(head + len, sizeof(head) - len, "\r\n");
+    if(len >= (int) sizeof(head)) return ESP_FAIL;
+    aux->headers_sent = 1;
+    return send_all(aux->sess->fd, head, len) ? ESP_FAIL : ESP_OK;
+}
+
+esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len)
+{
+    shim_req_aux_t *aux = r->aux;
+    if(buf_len == HTTPD_RESP_USE_STRLEN) buf_len = buf ? strlen(buf) : 0;
+    if(aux->headers_sent || send_head(r, buf_len) != ESP_OK) return ESP_FAIL;
+    return buf_len && send_all(aux->sess->fd, buf, buf_len) ? ESP_FAIL : ESP_OK;
+}
+
+esp_err_t httpd_resp_send_chunk(httpd_req_t *r, const char *buf, ssize_t buf_len)
+{
+    shim_req_aux_t *aux = r->aux;
+    char size[16];
+    if(buf_len == HTTPD_RESP_USE_STRLEN) buf_len = buf ? strlen(buf) : 0;
+    if(!aux->headers_sent && send_head(r, -1) != ESP_OK) return ESP_FAIL;
+    int size_len = snprintf(size, sizeof(size), "%zx\r\n", buf_len);
+    if(send_all(aux->sess->fd, size, size_len)) return ESP_FAIL;
+    if(buf_len && send_all(aux->sess->fd, buf, buf_len)) return ESP_FAIL;
+    return send_all(aux->sess->fd, "\r\n", 2) ? ESP_FAIL : ESP_OK;
+}
+
+esp_err_t httpd_resp_send_err(httpd_req_t *req, httpd_err_code_t error, const char *msg)
+{
+    httpd_resp_set_status(req, get_status_text(error));
+    httpd_resp_set_type(req, "text/html");
+    return httpd_resp_send(req, msg ? msg : get_status_text(error), HTTPD_RESP_USE_STRLEN);
+}
+
+esp_err_t httpd_queue_work(httpd_handle_t handle, httpd_work_fn_t work, void *arg)
+{
+    shim_server_t *server = handle;
+    pthread_mutex_lock(&server->work_lock);
+    if(server->work_count == SHIM_WORK_QUEUE_LEN)
+    {
+        pthread_mutex_unlock(&server->work_lock);
+        return ESP_FAIL;
+    }
+    server->work[server->work_count++] = (shim_work_t) { work, arg };
+    pthread_mutex_unlock(&server->work_lock);
+    return write(server->wake[1], "", 1) == 1 ? ESP_OK : ESP_FAIL;
+}
+
+int httpd_socket_send(httpd_handle_t hd, int sockfd, const char *buf, size_t buf_len, int flags)
+{
+    ssize_t sent = send(sockfd, buf, buf_len, flags | MSG_NOSIGNAL);
+    if(sent >= 0) return sent;
+    return errno == EAGAIN || errno == EWOULDBLOCK ? HTTPD_SOCK_ERR_TIMEOUT : HTTPD_SOCK_ERR_FAIL;
+}
+
+esp_err_t httpd_sess_trigger_close(httpd_handle_t handle, int sockfd)
+{
+    shim_sess_t *sess = find_session(handle, sockfd);
+    if(!sess) return ESP_ERR_NOT_FOUND;
+    // Closed by the server task once the current handler or work item returns, like the SDK's queued close
+    sess->close = 1;
+    return ESP_OK;
+}
\ No newline at end of file
@@ -0,0 +1,21 @@
+#ifndef _ESP_ERR_H_
+#define _ESP_ERR_H_
+#include <stdint.h>
+#include <stddef.h>
+
+typedef int32_t esp_err_t;
+
+#define ESP_OK                          0
+#define ESP_FAIL                        -1
+#define ESP_ERR_NO_MEM                  0x101
+#define ESP_ERR_INVALID_ARG             0x102
+#define ESP_ERR_INVALID_STATE           0x103
+#define ESP_ERR_NOT_FOUND               0x105
+#define ESP_ERR_NVS_NOT_FOUND           0x1102
+#define ESP_ERR_HTTPD_BASE              0x8000
+#define ESP_ERR_HTTPD_RESULT_TRUNC      (ESP_ERR_HTTPD_BASE + 6)
+#define ESP_ERR_HTTPD_INVALID_REQ       (ESP_ERR_HTTPD_BASE + 5)
+
+#define ESP_ERROR_CHECK(x) do { esp_err_t __err = (x); (void) __err; } while(0)
+
+#endif //_ESP_ERR_H_
\ No newline at end of file
@@ -0,0 +1,15 @@
+#ifndef _ESP_EVENT_H_
+#define _ESP_EVENT_H_
+#include "esp_err.h"
+
+typedef const char *esp_event_base_t;
+typedef void (*esp_event_handler_t)(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data);
+
+extern esp_event_base_t IP_EVENT;
+extern esp_event_base_t WIFI_EVENT;
+enum { IP_EVENT_STA_GOT_IP, WIFI_EVENT_STA_DISCONNECTED };
+
+/*Nothing is ever posted on the host*/
+esp_err_t esp_event_handler_register(esp_event_base_t event_base, int32_t event_id, esp_event_handler_t event_handler, void *event_handler_arg);
+
+#endif //_ESP_EVENT_H_
\ No newline at end of file
@@ -0,0 +1,15 @@
+#ifndef _ESP_LOG_H_
+#define _ESP_LOG_H_
+#include <stdarg.h>
+#include <stdio.h>
+#include "esp_err.h"
+
+/*Quiet unless the load test is run with -v, printing from the server thread would be what gets measured*/
+void shim_log(const char *level, const char *tag, const char *format, ...);
+
+#define ESP_LOGE(tag, format, ...) shim_log("E", tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) shim_log("W", tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) shim_log("I", tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) shim_log("D", tag, format, ##__VA_ARGS__)
+
+#endif //_ESP_LOG_H_
\ No newline at end of file
@@ -0,0 +1,10 @@
+#ifndef _ESP_SYSTEM_H_
+#define _ESP_SYSTEM_H_
+#include "esp_err.h"
+
+/*Heap as the device would see it, a fixed size less what the server thread has live*/
+uint32_t esp_get_free_heap_size(void);
+uint32_t esp_get_minimum_free_heap_size(void);
+uint32_t esp_random(void);
+
+#endif //_ESP_SYSTEM_H_
\ No newline at end of file
@@ -0,0 +1,7 @@
+#ifndef _ESP_TIMER_H_
+#define _ESP_TIMER_H_
+#include <stdint.h>
+
+int64_t esp_timer_get_time(void);
+
+#endif //_ESP_TIMER_H_
\ No newline at end of file
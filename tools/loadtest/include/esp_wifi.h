@@ -0,0 +1,15 @@
+#ifndef _ESP_WIFI_H_
+#define _ESP_WIFI_H_
+#include "esp_err.h"
+
+typedef struct
+{
+    uint8_t bssid[6];
+    uint8_t ssid[33];
+    uint8_t primary;
+    int8_t rssi;
+} wifi_ap_record_t;
+
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t *ap_info);
+
+#endif //_ESP_WIFI_H_
\ No newline at end of file
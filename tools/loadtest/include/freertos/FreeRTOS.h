@@ -0,0 +1,24 @@
+#ifndef _FREERTOS_H_
+#define _FREERTOS_H_
+#include <stdint.h>
+#include <stddef.h>
+
+typedef uint32_t TickType_t;
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+
+#define pdTRUE                  1
+#define pdFALSE                 0
+#define pdPASS                  1
+#define pdFAIL                  0
+#define portMAX_DELAY           0xffffffffUL
+#define portTICK_PERIOD_MS      10
+#define pdMS_TO_TICKS(ms)       ((TickType_t) (ms) / portTICK_PERIOD_MS)
+
+/*One process wide recursive lock stands in for disabling interrupts*/
+void shim_enter_critical(void);
+void shim_exit_critical(void);
+#define portENTER_CRITICAL()    shim_enter_critical()
+#define portEXIT_CRITICAL()     shim_exit_critical()
+
+#endif //_FREERTOS_H_
\ No newline at end of file
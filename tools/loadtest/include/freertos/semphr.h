@@ -0,0 +1,12 @@
+#ifndef _FREERTOS_SEMPHR_H_
+#define _FREERTOS_SEMPHR_H_
+#include "freertos/FreeRTOS.h"
+
+typedef void *SemaphoreHandle_t;
+
+/*pthread mutexes*/
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks_to_wait);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
+
+#endif //_FREERTOS_SEMPHR_H_
\ No newline at end of file
@@ -0,0 +1,13 @@
+#ifndef _FREERTOS_TASK_H_
+#define _FREERTOS_TASK_H_
+#include "freertos/FreeRTOS.h"
+
+#define taskENTER_CRITICAL()    portENTER_CRITICAL()
+#define taskEXIT_CRITICAL()     portEXIT_CRITICAL()
+
+typedef void *TaskHandle_t;
+
+/*The calling pthread*/
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+
+#endif //_FREERTOS_TASK_H_
\ No newline at end of file
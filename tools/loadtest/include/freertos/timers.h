@@ -0,0 +1,12 @@
+#ifndef _FREERTOS_TIMERS_H_
+#define _FREERTOS_TIMERS_H_
+#include "freertos/FreeRTOS.h"
+
+typedef void *TimerHandle_t;
+typedef void (*TimerCallbackFunction_t)(TimerHandle_t timer);
+
+/*Timers are created but never fire, the event stream's pings are not part of a load test*/
+TimerHandle_t xTimerCreate(const char *name, TickType_t period, UBaseType_t auto_reload, void *timer_id, TimerCallbackFunction_t callback);
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t ticks_to_wait);
+
+#endif //_FREERTOS_TIMERS_H_
\ No newline at end of file
@@ -0,0 +1,6 @@
+#ifndef _LWIP_SOCKETS_H_
+#define _LWIP_SOCKETS_H_
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#endif //_LWIP_SOCKETS_H_
\ No newline at end of file
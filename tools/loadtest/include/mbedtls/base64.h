@@ -0,0 +1,9 @@
+#ifndef _MBEDTLS_BASE64_H_
+#define _MBEDTLS_BASE64_H_
+#include <stddef.h>
+
+#define MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL -0x002A
+
+int mbedtls_base64_encode(unsigned char *dst, size_t dlen, size_t *olen, const unsigned char *src, size_t slen);
+
+#endif //_MBEDTLS_BASE64_H_
\ No newline at end of file
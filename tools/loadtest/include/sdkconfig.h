@@ -0,0 +1,20 @@
+/*Configuration the handlers are built with on the host, Kconfig defaults except where noted*/
+#ifndef _SDKCONFIG_H_
+#define _SDKCONFIG_H_
+
+#define CONFIG_WIFI_SSID "loadtest"
+#define CONFIG_WIFI_PASSWORD ""
+#define CONFIG_CLIENT_ID "loadtest"
+#define CONFIG_CLIENT_SECRET "loadtest"
+#define CONFIG_WHOOP_ACCOUNT_COUNT 2
+#define CONFIG_WHOOP_ACCOUNT_REQUEST_BUDGET 8
+#define CONFIG_WHOOP_HTTP_GZIP 1
+#define CONFIG_WHOOP_FRESHNESS_WINDOW_SECONDS 30
+#define CONFIG_WHOOP_RATELIMIT_BURST 4
+#define CONFIG_WHOOP_RATELIMIT_REFILL_SECONDS 30
+#define CONFIG_WHOOP_RATELIMIT_CLIENTS 8
+#define CONFIG_WHOOP_SSE_MAX_CLIENTS 3
+#define CONFIG_WHOOP_SSE_BACKLOG_EVENTS 8
+// Webhooks need mbedTLS and are left out, webhook_replay.c turns them on. Lazy decoding follows the Kconfig default (off)
+
+#endif //_SDKCONFIG_H_
\ No newline at end of file
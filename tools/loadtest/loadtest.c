@@ -0,0 +1,420 @@
+/*Host load test of the local HTTP server. The firmware's own handlers, encoder and record store run behind
+  httpd_shim.c, a single task esp_http_server stand-in over POSIX sockets, with a few records seeded per type.
+  Each endpoint is then hit by concurrent keep-alive clients for a fixed time, reporting throughput, latency
+  percentiles and the most heap the server side held above its idle level:
+
+    mkdir -p build && for f in index.html app.js; do gzip -9 -n -c ../../main/dashboard/$f > build/$f.gz; done
+    gcc -O2 -pthread -D_GNU_SOURCE -Iinclude -I. -I../../main/include -include include/sdkconfig.h \
+        loadtest.c httpd_shim.c esp_shim.c client_stub.c \
+        ../../main/whoop_{esp_server,api,encode,data,ratelimit,latency,mem,events}.c \
+        -Wl,--wrap=malloc,--wrap=free,--wrap=calloc,--wrap=realloc -lm -o build/loadtest && ./build/loadtest
+
+  ./build/loadtest [-c clients] [-d seconds] [-p port] [-e] [-t] [-v] [path ...]
+
+    -c  concurrent clients per endpoint, default 4. The SDK's 7 open sockets and listen backlog of 5 apply, so
+        more clients than that see refused connections and handshakes the kernel retries a second later
+    -d  seconds per endpoint, default 2
+    -e  revalidate with the ETag of the previous response, measures the 304 path
+    -t  tab separated output, for keeping a baseline to diff later runs against
+    -v  firmware logs on stderr
+
+  Latency here is the handlers on a desktop CPU over loopback, useful to compare before and after a change,
+  not as a prediction of the device. Heap is the firmware's own allocations on the server task*/
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include "esp_http_server.h"
+#include "esp_timer.h"
+#include "whoop_data.h"
+#include "whoop_events.h"
+#include "whoop_esp_server.h"
+#include "whoop_mem.h"
+#include "shim.h"
+
+#define LOADTEST_MAX_CLIENTS 64
+#define LOADTEST_MAX_SAMPLES (1 << 18)
+#define LOADTEST_RECORDS_PER_TYPE 5
+#define LOADTEST_RECV_BUF_LEN 4096
+#define LOADTEST_ETAG_LEN 64
+
+static const char *g_default_paths[] = {
+    "/api/v1/latest",
+    "/api/v1/sleep?user=1",
+    "/api/v1/history?type=workout",
+    "/api/v1/history?type=cycle&format=cbor&limit=2",
+    "/metrics",
+    "/whoop/heap",
+    "/whoop/latency",
+    "/whoop/transfer",
+    "/",
+    "/dashboard/app.js",
+    "/whoop/sleep",
+    "/jobs/1",                      /*Queued by the /whoop/sleep run, which the rate limit cuts short*/
+};
+
+typedef struct loadtest_conn
+{
+    int fd;
+    size_t start;
+    size_t end;
+    char buf[LOADTEST_RECV_BUF_LEN];
+} loadtest_conn_t;
+
+typedef struct loadtest_client
+{
+    pthread_t thread;
+    const char *path;
+    uint16_t port;
+    int revalidate;
+    int64_t deadline_us;
+    uint32_t *samples;              /*Latency of each request in microseconds*/
+    size_t sample_count;
+    uint32_t requests;
+    uint32_t ok;
+    uint32_t not_modified;
+    uint32_t throttled;
+    uint32_t other;
+    uint32_t errors;
+    uint64_t body_bytes;
+} loadtest_client_t;
+
+static int connect_server(loadtest_conn_t *conn, uint16_t port)
+{
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(port), .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    int one = 1;
+    conn->start = conn->end = 0;
+    conn->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if(conn->fd < 0) return -1;
+    setsockopt(conn->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if(connect(conn->fd, (struct sockaddr *) &addr, sizeof(addr)))
+    {
+        close(conn->fd);
+        conn->fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+static void disconnect_server(loadtest_conn_t *conn)
+{
+    if(conn->fd >= 0) close(conn->fd);
+    conn->fd = -1;
+}
+
+static int fill_conn(loadtest_conn_t *conn)
+{
+    if(conn->start)
+    {
+        memmove(conn->buf, conn->buf + conn->start, conn->end - conn->start);
+        conn->end -= conn->start;
+        conn->start = 0;
+    }
+    if(conn->end == sizeof(conn->buf)) return -1;
+    ssize_t got = recv(conn->fd, conn->buf + conn->end, sizeof(conn->buf) - conn->end, 0);
+    if(got <= 0) return -1;
+    conn->end += got;
+    return 0;
+}
+
+/*Next line without its CRLF, valid until the connection is read again*/
+static char *read_line(loadtest_conn_t *conn)
+{
+    char *line_end;
+    while(!(line_end = memmem(conn->buf + conn->start, conn->end - conn->start, "\r\n", 2)))
+    {
+        if(fill_conn(conn)) return NULL;
+    }
+    char *line = conn->buf + conn->start;
+    *line_end = '\0';
+    conn->start = line_end + 2 - conn->buf;
+    return line;
+}
+
+static int skip_bytes(loadtest_conn_t *conn, size_t len)
+{
+    while(len)
+    {
+        if(conn->start == conn->end && fill_conn(conn)) return -1;
+        size_t buffered = conn->end - conn->start;
+        size_t skip = len < buffered ? len : buffered;
+        conn->start += skip;
+        len -= skip;
+    }
+    return 0;
+}
+
+/*Reads one response, returns its status code or -1 when the connection failed*/
+static int read_response(loadtest_conn_t *conn, char *etag, size_t *body_len)
+{
+    size_t content_len = 0;
+    int chunked = 0;
+    int keep_alive = 1;
+    char *line = read_line(conn);
+    if(!line || strncmp(line, "HTTP/1.1 ", 9)) return -1;
+    int status = atoi(line + 9);
+    while((line = read_line(conn)) && *line)
+    {
+        if(!strncasecmp(line, "Content-Length:", 15)) content_len = strtoul(line + 15, NULL, 10);
+        else if(!strncasecmp(line, "Transfer-Encoding:", 18)) chunked = strstr(line + 18, "chunked") != NULL;
+        else if(!strncasecmp(line, "Connection:", 11)) keep_alive = strstr(line + 11, "close") == NULL;
+        else if(etag && !strncasecmp(line, "ETag:", 5)) snprintf(etag, LOADTEST_ETAG_LEN, "%s", line + 5 + strspn(line + 5, " "));
+    }
+    if(!line) return -1;
+    *body_len = 0;
+    if(!chunked)
+    {
+        *body_len = content_len;
+        if(skip_bytes(conn, content_len)) return -1;
+    }
+    else for(;;)
+    {
+        if(!(line = read_line(conn))) return -1;
+        size_t chunk_len = strtoul(line, NULL, 16);
+        if(!chunk_len)
+        {
+            if(!read_line(conn)) return -1;
+            break;
+        }
+        *body_len += chunk_len;
+        if(skip_bytes(conn, chunk_len + 2)) return -1;
+    }
+    if(!keep_alive) disconnect_server(conn);
+    return status;
+}
+
+static void *client_task(void *arg)
+{
+    loadtest_client_t *client = arg;
+    loadtest_conn_t *conn = malloc(sizeof(loadtest_conn_t));
+    char request[HTTPD_MAX_URI_LEN + 128];
+    char etag[LOADTEST_ETAG_LEN] = "";
+    conn->fd = -1;
+    while(esp_timer_get_time() < client->deadline_us)
+    {
+        if(conn->fd < 0 && connect_server(conn, client->port))
+        {
+            client->errors++;
+            usleep(1000);
+            continue;
+        }
+        int request_len = snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: localhost\r\n", client->path);
+        if(client->revalidate && *etag)
+            request_len += snprintf(request + request_len, sizeof(request) - request_len, "If-None-Match: %s\r\n", etag);
+        request_len += snprintf(request + request_len, sizeof(request) - request_len, "\r\n");
+
+        size_t body_len = 0;
+        int64_t start_us = esp_timer_get_time();
+        int status = send(conn->fd, request, request_len, MSG_NOSIGNAL) == request_len
+            ? read_response(conn, etag, &body_len) : -1;
+        int64_t elapsed_us = esp_timer_get_time() - start_us;
+        if(status < 0)
+        {
+            // Refused for want of a free socket or closed by a handler error, either way not a served request
+            client->errors++;
+            disconnect_server(conn);
+            continue;
+        }
+        client->requests++;
+        client->body_bytes += body_len;
+        if(status >= 200 && status < 300) client->ok++;
+        else if(status == 304) client->not_modified++;
+        else if(status == 429) client->throttled++;
+        else client->other++;
+        if(client->sample_count < LOADTEST_MAX_SAMPLES)
+            client->samples[client->sample_count++] = elapsed_us;
+    }
+    disconnect_server(conn);
+    free(conn);
+    return NULL;
+}
+
+static int compare_samples(const void *a, const void *b)
+{
+    uint32_t left = *(const uint32_t *) a;
+    uint32_t right = *(const uint32_t *) b;
+    return (left > right) - (left < right);
+}
+
+static double get_percentile_ms(const uint32_t *samples, size_t count, double percentile)
+{
+    return count ? samples[(size_t) ((count - 1) * percentile)] / 1000.0 : 0;
+}
+
+static void run_endpoint(const char *path, loadtest_client_t *clients, int client_count, int seconds, uint16_t port,
+                         int revalidate, int tabs)
+{
+    loadtest_client_t total = { 0 };
+    uint32_t *samples = NULL;
+    size_t sample_count = 0;
+    size_t idle_heap = shim_heap_get_live();
+    int64_t start_us = esp_timer_get_time();
+
+    shim_heap_reset_peak();
+    for(int index = 0; index < client_count; index++)
+    {
+        uint32_t *client_samples = clients[index].samples;
+        memset(&clients[index], 0, sizeof(loadtest_client_t));
+        clients[index].samples = client_samples;
+        clients[index].path = path;
+        clients[index].port = port;
+        clients[index].revalidate = revalidate;
+        clients[index].deadline_us = start_us + (int64_t) seconds * 1000000;
+        pthread_create(&clients[index].thread, NULL, client_task, &clients[index]);
+    }
+    for(int index = 0; index < client_count; index++)
+    {
+        pthread_join(clients[index].thread, NULL);
+        total.requests += clients[index].requests;
+        total.ok += clients[index].ok;
+        total.not_modified += clients[index].not_modified;
+        total.throttled += clients[index].throttled;
+        total.other += clients[index].other;
+        total.errors += clients[index].errors;
+        total.body_bytes += clients[index].body_bytes;
+        sample_count += clients[index].sample_count;
+    }
+    double elapsed_s = (esp_timer_get_time() - start_us) / 1e6;
+    size_t heap_peak = shim_heap_get_peak() - idle_heap;
+
+    samples = malloc(sample_count * sizeof(uint32_t) + 1);
+    sample_count = 0;
+    for(int index = 0; index < client_count; index++)
+    {
+        memcpy(samples + sample_count, clients[index].samples, clients[index].sample_count * sizeof(uint32_t));
+        sample_count += clients[index].sample_count;
+    }
+    qsort(samples, sample_count, sizeof(uint32_t), compare_samples);
+
+    const char *format = tabs
+        ? "%s\t%u\t%.0f\t%.3f\t%.3f\t%.3f\t%.3f\t%.0f\t%u\t%u\t%u\t%u\t%u\t%zu\n"
+        : "%-48s %8u %8.0f %7.3f %7.3f %7.3f %8.3f %7.0f %7u %5u %5u %5u %5u %7zu\n";
+    printf(format, path, total.requests, total.requests / elapsed_s,
+           get_percentile_ms(samples, sample_count, 0.50), get_percentile_ms(samples, sample_count, 0.90),
+           get_percentile_ms(samples, sample_count, 0.99), sample_count ? samples[sample_count - 1] / 1000.0 : 0,
+           total.requests ? (double) total.body_bytes / total.requests : 0,
+           total.ok, total.not_modified, total.throttled, total.other,
+           total.errors, heap_peak);
+    fflush(stdout);
+    free(samples);
+}
+
+/*A few scored records of every type for every account, IDs counting up so history pages have an order*/
+static void seed_whoop_data(void)
+{
+    srandom(1);
+    for(int account = 0; account < WHOOP_ACCOUNT_COUNT; account++)
+    {
+        for(int record = 1; record <= LOADTEST_RECORDS_PER_TYPE; record++)
+        {
+            int id = 1000 * (account + 1) + record;
+            for(int type = 0; type < WHOOP_DATA_TYPE_MAX; type++)
+            {
+                whoop_data_handle_t handle = NULL;
+                int field_count = 0;
+                const whoop_data_field_t *fields = get_whoop_data_fields(type, &field_count);
+                switch(type)
+                {
+                    case WHOOP_DATA_TYPE_SLEEP: create_whoop_sleep_data(account, id, &handle); break;
+                    case WHOOP_DATA_TYPE_WORKOUT: create_whoop_workout_data(account, id, &handle); break;
+                    case WHOOP_DATA_TYPE_RECOVERY: create_whoop_recovery_data(account, id, id, &handle); break;
+                    case WHOOP_DATA_TYPE_CYCLE: create_whoop_cycle_data(account, id, &handle); break;
+                }
+                for(int index = 0; index < field_count; index++)
+                {
+                    const whoop_data_field_t *field = &fields[index];
+                    // Option bit 0x100 marks the float fields of every type
+                    if(field->flags & WHOOP_DATA_FIELD_ID) continue;
+                    else if(field->flags & WHOOP_DATA_FIELD_SCORE_STATE) set_whoop_data(handle, field->opt, WHOOP_SCORE_STATE_SCORED);
+                    else if(field->flags & WHOOP_DATA_FIELD_BOOL) set_whoop_data(handle, field->opt, (int) (random() & 1));
+                    else if(field->opt & 0x100) set_whoop_data(handle, field->opt, (double) (random() % 100000) / 1000.0);
+                    else set_whoop_data(handle, field->opt, (int) (random() % 30000000));
+                }
+            }
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int client_count = 4;
+    int seconds = 2;
+    int port = 8080;
+    int revalidate = 0;
+    int tabs = 0;
+    int option;
+    while((option = getopt(argc, argv, "c:d:p:etv")) != -1)
+    {
+        switch(option)
+        {
+            case 'c': client_count = atoi(optarg); break;
+            case 'd': seconds = atoi(optarg); break;
+            case 'p': port = atoi(optarg); break;
+            case 'e': revalidate = 1; break;
+            case 't': tabs = 1; break;
+            case 'v': shim_log_set_verbose(1); break;
+            default:
+                fprintf(stderr, "usage: %s [-c clients] [-d seconds] [-p port] [-e] [-t] [-v] [path ...]\n", argv[0]);
+                return 1;
+        }
+    }
+    if(client_count < 1 || client_count > LOADTEST_MAX_CLIENTS || seconds < 1 || port < 1 || port > 65535)
+    {
+        fprintf(stderr, "clients must be 1 to %d, seconds and port positive\n", LOADTEST_MAX_CLIENTS);
+        return 1;
+    }
+
+    init_whoop_mem();
+    init_whoop_data();
+    init_whoop_events();
+    seed_whoop_data();
+    httpd_shim_set_port(port);
+    init_whoop_server();
+    loadtest_conn_t probe;
+    if(connect_server(&probe, port))
+    {
+        fprintf(stderr, "server did not come up on port %d\n", port);
+        return 1;
+    }
+    disconnect_server(&probe);
+
+    loadtest_client_t clients[LOADTEST_MAX_CLIENTS];
+    for(int index = 0; index < client_count; index++)
+    {
+        clients[index].samples = malloc(LOADTEST_MAX_SAMPLES * sizeof(uint32_t));
+    }
+    if(tabs)
+        printf("path\trequests\treq_s\tp50_ms\tp90_ms\tp99_ms\tmax_ms\tbody_b\t2xx\t304\t429\tother\terrors\theap_b\n");
+    else
+        printf("%-48s %8s %8s %7s %7s %7s %8s %7s %7s %5s %5s %5s %5s %7s\n", "path", "requests", "req/s", "p50 ms", "p90 ms", "p99 ms", "max ms", "body B",
+           "2xx", "304", "429", "other", "err", "heap B");
+    if(optind < argc)
+    {
+        for(int index = optind; index < argc; index++)
+        {
+            run_endpoint(argv[index], clients, client_count, seconds, port, revalidate, tabs);
+        }
+    }
+    else
+    {
+        for(size_t index = 0; index < sizeof(g_default_paths) / sizeof(g_default_paths[0]); index++)
+        {
+            run_endpoint(g_default_paths[index], clients, client_count, seconds, port, revalidate, tabs);
+        }
+    }
+
+    discard_whoop_server();
+    for(int index = 0; index < client_count; index++)
+    {
+        free(clients[index].samples);
+    }
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,17 @@
+#ifndef _SHIM_H_
+#define _SHIM_H_
+#include <stddef.h>
+
+/*Heap the firmware sees on the host. Allocations made by the firmware sources on a tracked thread are
+  charged against SHIM_HEAP_SIZE, so esp_get_free_heap_size() moves the way it would on the device*/
+#define SHIM_HEAP_SIZE (80 * 1024)
+
+/*Charges the calling thread's allocations, the httpd task calls it on start*/
+void shim_heap_track_thread(void);
+size_t shim_heap_get_live(void);
+/*Highest live total since the last reset*/
+size_t shim_heap_get_peak(void);
+void shim_heap_reset_peak(void);
+void shim_log_set_verbose(int verbose);
+
+#endif //_SHIM_H_
\ No newline at end of file
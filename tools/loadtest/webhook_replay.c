@@ -0,0 +1,279 @@
+/*Replays signed Whoop webhook deliveries against /webhook and checks each answer. By default the firmware's
+  handler runs in process behind httpd_shim.c, with the client side stubbed so queued fetches are counted
+  instead of sent. With -a the same deliveries go to a device on the LAN:
+
+    gcc -O2 -pthread -D_GNU_SOURCE -Iinclude -I. -I../../main/include -include include/sdkconfig.h \
+        -DCONFIG_WHOOP_WEBHOOK_ENABLE=1 -DCONFIG_WHOOP_WEBHOOK_MAX_AGE_SECONDS=300 \
+        webhook_replay.c webhook_shim.c httpd_shim.c esp_shim.c client_stub.c \
+        ../../main/whoop_{esp_server,api,encode,data,ratelimit,latency,mem,events}.c \
+        -Wl,--wrap=malloc,--wrap=free,--wrap=calloc,--wrap=realloc -lcrypto -lm -o build/webhook_replay \
+        && ./build/webhook_replay
+
+  (esp_shim.c embeds the dashboard, so the gzipped assets have to be in build/ first, see loadtest.c)
+
+  ./build/webhook_replay [-a address] [-p port] [-s secret] [-u user_id] [-m max_age_seconds] [-v]
+
+    -a  IPv4 address of a device to send to instead of the in process server
+    -p  port, default 8080 in process and 80 for a device
+    -s  client secret the deliveries are signed with, default the one the handler is built with
+    -u  Whoop user_id of an account on the device, default the stubbed account 0
+    -m  signature age the device accepts, CONFIG_WHOOP_WEBHOOK_MAX_AGE_SECONDS
+    -v  firmware logs on stderr
+
+  A device needs a Whoop response since boot before it trusts its clock, until then every delivery gets 503*/
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+
+#include "esp_http_server.h"
+#include "whoop_client.h"
+#include "whoop_data.h"
+#include "whoop_events.h"
+#include "whoop_esp_server.h"
+#include "whoop_mem.h"
+#include "shim.h"
+
+#define REPLAY_USER_ID 10129
+#define REPLAY_RECORD_ID 4711
+#define REPLAY_BODY_LEN 256
+#define REPLAY_REQUEST_LEN 1024
+#define REPLAY_RESPONSE_LEN 1024
+
+typedef enum replay_tamper
+{
+    REPLAY_TAMPER_NONE,
+    REPLAY_TAMPER_BODY,             /*Signed, then the user_id changed*/
+    REPLAY_TAMPER_SIGNATURE,        /*One signature character changed*/
+    REPLAY_TAMPER_TIMESTAMP,        /*Signed, then the timestamp header moved by a second*/
+    REPLAY_TAMPER_SECRET,           /*Signed with a different secret*/
+    REPLAY_TAMPER_UNSIGNED,         /*No signature headers at all*/
+} replay_tamper_n;
+
+typedef struct replay_case
+{
+    const char *name;
+    const char *type;
+    replay_tamper_n tamper;
+    int age_s;                      /*Seconds the signed timestamp lies in the past, negative for the future*/
+    int age_windows;                /*Added to age_s in multiples of the accepted age, so the stale cases follow -m*/
+    int clock_unknown;              /*In process only, the device has not heard from Whoop yet*/
+    int expected_status;
+    int expected_fetches;           /*In process only*/
+} replay_case_t;
+
+static const replay_case_t g_cases[] = {
+    { "valid",                      "sleep.updated",    REPLAY_TAMPER_NONE,      0,  0,  0, 204, 1 },
+    { "valid, 30 s in transit",     "recovery.updated", REPLAY_TAMPER_NONE,      30, 0,  0, 204, 1 },
+    { "deletion",                   "sleep.deleted",    REPLAY_TAMPER_NONE,      0,  0,  0, 204, 0 },
+    { "body tampered",              "sleep.updated",    REPLAY_TAMPER_BODY,      0,  0,  0, 401, 0 },
+    { "signature tampered",         "sleep.updated",    REPLAY_TAMPER_SIGNATURE, 0,  0,  0, 401, 0 },
+    { "timestamp tampered",         "sleep.updated",    REPLAY_TAMPER_TIMESTAMP, 0,  0,  0, 401, 0 },
+    { "wrong secret",               "sleep.updated",    REPLAY_TAMPER_SECRET,    0,  0,  0, 401, 0 },
+    { "unsigned",                   "sleep.updated",    REPLAY_TAMPER_UNSIGNED,  0,  0,  0, 400, 0 },
+    { "just inside the window",     "workout.updated",  REPLAY_TAMPER_NONE,      -5, 1,  0, 204, 1 },
+    { "stale replay",               "workout.updated",  REPLAY_TAMPER_NONE,      0,  2,  0, 401, 0 },
+    { "from the future",            "workout.updated",  REPLAY_TAMPER_NONE,      0,  -2, 0, 401, 0 },
+    { "clock not set",              "sleep.updated",    REPLAY_TAMPER_NONE,      0,  0,  1, 503, 0 },
+};
+
+static volatile int g_clock_unknown = 0;
+static volatile int g_fetch_count = 0;
+
+// Client side of the webhook path, the rest comes from client_stub.c
+int whoop_client_account_for_user(int user_id)
+{
+    return user_id == REPLAY_USER_ID ? 0 : -1;
+}
+
+int whoop_queue_fetch(int account, whoop_api_request_type_n request_type, int id)
+{
+    __atomic_add_fetch(&g_fetch_count, 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+void whoop_client_webhook_received(void)
+{
+}
+
+int whoop_client_get_unix_time_ms(int64_t *now_ms_out)
+{
+    struct timeval now;
+    if(g_clock_unknown) return -1;
+    gettimeofday(&now, NULL);
+    *now_ms_out = (int64_t) now.tv_sec * 1000 + now.tv_usec / 1000;
+    return 0;
+}
+
+/*Whoop's scheme, base64(HMAC-SHA256(timestamp + body)) keyed with the client secret*/
+static void sign_delivery(const char *secret, const char *timestamp, const char *body, char *signature, size_t signature_len)
+{
+    unsigned char hmac[EVP_MAX_MD_SIZE];
+    unsigned int hmac_len = 0;
+    size_t timestamp_len = strlen(timestamp);
+    size_t body_len = strlen(body);
+    unsigned char *message = malloc(timestamp_len + body_len);
+    memcpy(message, timestamp, timestamp_len);
+    memcpy(message + timestamp_len, body, body_len);
+    HMAC(EVP_sha256(), secret, strlen(secret), message, timestamp_len + body_len, hmac, &hmac_len);
+    free(message);
+    if(4 * ((hmac_len + 2) / 3) < signature_len) EVP_EncodeBlock((unsigned char *) signature, hmac, hmac_len);
+    else signature[0] = '\0';
+}
+
+/*Sends one delivery on its own connection, returns the status code or -1*/
+static int send_delivery(const struct sockaddr_in *addr, const char *body, const char *timestamp, const char *signature)
+{
+    char request[REPLAY_REQUEST_LEN];
+    char response[REPLAY_RESPONSE_LEN];
+    size_t received = 0;
+    int request_len;
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if(fd < 0) return -1;
+    if(connect(fd, (const struct sockaddr *) addr, sizeof(*addr)))
+    {
+        close(fd);
+        return -1;
+    }
+    request_len = snprintf(request, sizeof(request), "POST /webhook HTTP/1.1\r\nHost: whoop\r\nContent-Type: application/json\r\n"
+                           "Content-Length: %zu\r\nConnection: close\r\n", strlen(body));
+    if(signature)
+    {
+        request_len += snprintf(request + request_len, sizeof(request) - request_len,
+                                "X-WHOOP-Signature: %s\r\nX-WHOOP-Signature-Timestamp: %s\r\n", signature, timestamp);
+    }
+    request_len += snprintf(request + request_len, sizeof(request) - request_len, "\r\n%s", body);
+    if(send(fd, request, request_len, MSG_NOSIGNAL) != request_len)
+    {
+        close(fd);
+        return -1;
+    }
+    // The status line is all that is checked
+    while(received < sizeof(response) - 1 && !memchr(response, '\n', received))
+    {
+        ssize_t got = recv(fd, response + received, sizeof(response) - 1 - received, 0);
+        if(got <= 0) break;
+        received += got;
+    }
+    close(fd);
+    response[received] = '\0';
+    if(strncmp(response, "HTTP/1.1 ", 9)) return -1;
+    return atoi(response + 9);
+}
+
+static int run_case(const replay_case_t *replay_case, const struct sockaddr_in *addr, const char *secret, int user_id,
+                    int max_age_s, int in_process)
+{
+    char body[REPLAY_BODY_LEN];
+    char timestamp[24];
+    char signature[64];
+    struct timeval now;
+    int64_t age_s = replay_case->age_s + (int64_t) replay_case->age_windows * max_age_s;
+    int fetches_before = g_fetch_count;
+    int status;
+
+    gettimeofday(&now, NULL);
+    snprintf(timestamp, sizeof(timestamp), "%lld", (long long) (now.tv_sec - age_s) * 1000 + now.tv_usec / 1000);
+    snprintf(body, sizeof(body), "{\"user_id\":%d,\"id\":%d,\"type\":\"%s\",\"trace_id\":\"replay-%ld\"}",
+             user_id, REPLAY_RECORD_ID, replay_case->type, (long) now.tv_usec);
+    sign_delivery(replay_case->tamper == REPLAY_TAMPER_SECRET ? "not-the-secret" : secret, timestamp, body,
+                  signature, sizeof(signature));
+
+    switch(replay_case->tamper)
+    {
+        case REPLAY_TAMPER_BODY:
+            snprintf(body, sizeof(body), "{\"user_id\":%d,\"id\":%d,\"type\":\"%s\",\"trace_id\":\"replay-%ld\"}",
+                     user_id + 1, REPLAY_RECORD_ID, replay_case->type, (long) now.tv_usec);
+            break;
+        case REPLAY_TAMPER_SIGNATURE:
+            signature[5] = signature[5] == 'A' ? 'B' : 'A';
+            break;
+        case REPLAY_TAMPER_TIMESTAMP:
+            snprintf(timestamp, sizeof(timestamp), "%lld", (long long) (now.tv_sec - age_s - 1) * 1000 + now.tv_usec / 1000);
+            break;
+        default:
+            break;
+    }
+
+    g_clock_unknown = replay_case->clock_unknown;
+    status = send_delivery(addr, body, timestamp, replay_case->tamper == REPLAY_TAMPER_UNSIGNED ? NULL : signature);
+    g_clock_unknown = 0;
+
+    int fetches = g_fetch_count - fetches_before;
+    int failed = status != replay_case->expected_status || (in_process && fetches != replay_case->expected_fetches);
+    if(in_process)
+        printf("%-26s %-18s %6d %8d %6d %8d  %s\n", replay_case->name, replay_case->type, replay_case->expected_status, status,
+               replay_case->expected_fetches, fetches, failed ? "FAIL" : "ok");
+    else
+        printf("%-26s %-18s %6d %8d  %s\n", replay_case->name, replay_case->type, replay_case->expected_status, status,
+               failed ? "FAIL" : "ok");
+    return failed;
+}
+
+int main(int argc, char **argv)
+{
+    const char *address = NULL;
+    const char *secret = CONFIG_CLIENT_SECRET;
+    int port = 0;
+    int user_id = REPLAY_USER_ID;
+    int max_age_s = CONFIG_WHOOP_WEBHOOK_MAX_AGE_SECONDS;
+    int failures = 0;
+    int sent = 0;
+    int option;
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+
+    while((option = getopt(argc, argv, "a:p:s:u:m:v")) != -1)
+    {
+        switch(option)
+        {
+            case 'a': address = optarg; break;
+            case 'p': port = atoi(optarg); break;
+            case 's': secret = optarg; break;
+            case 'u': user_id = atoi(optarg); break;
+            case 'm': max_age_s = atoi(optarg); break;
+            case 'v': shim_log_set_verbose(1); break;
+            default:
+                fprintf(stderr, "usage: %s [-a address] [-p port] [-s secret] [-u user_id] [-m max_age_seconds] [-v]\n", argv[0]);
+                return 1;
+        }
+    }
+    if(!port) port = address ? 80 : 8080;
+    if(port < 1 || port > 65535 || max_age_s < 1 || (address && inet_pton(AF_INET, address, &addr.sin_addr) != 1))
+    {
+        fprintf(stderr, "address must be IPv4, port 1 to 65535 and max age positive\n");
+        return 1;
+    }
+    addr.sin_port = htons(port);
+
+    if(!address)
+    {
+        init_whoop_mem();
+        init_whoop_data();
+        init_whoop_events();
+        httpd_shim_set_port(port);
+        init_whoop_server();
+        printf("%-26s %-18s %6s %8s %6s %8s\n", "delivery", "type", "expect", "status", "fetch", "fetched");
+    }
+    else
+    {
+        printf("%-26s %-18s %6s %8s\n", "delivery", "type", "expect", "status");
+    }
+    for(size_t index = 0; index < sizeof(g_cases) / sizeof(g_cases[0]); index++)
+    {
+        // A device's clock cannot be cleared from here
+        if(address && g_cases[index].clock_unknown) continue;
+        failures += run_case(&g_cases[index], &addr, secret, user_id, max_age_s, !address);
+        sent++;
+    }
+    if(!address) discard_whoop_server();
+    printf("%d of %d deliveries answered as expected\n", sent - failures, sent);
+    return failures ? 1 : 0;
+}
\ No newline at end of file
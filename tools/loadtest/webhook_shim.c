@@ -0,0 +1,215 @@
+/*What the webhook handler needs beyond the load test shims: mbedTLS HMAC and base64 on top of OpenSSL, and a
+  cJSON parser for the small objects Whoop delivers. Only linked into webhook_replay*/
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <openssl/core_names.h>
+#include <openssl/evp.h>
+#include "cJSON.h"
+#include "mbedtls/base64.h"
+#include "mbedtls/md.h"
+
+#define SHIM_JSON_MAX_DEPTH 8
+
+// Never dereferenced, only told apart from NULL
+static const char g_sha256_info;
+
+const mbedtls_md_info_t *mbedtls_md_info_from_type(mbedtls_md_type_t md_type)
+{
+    return md_type == MBEDTLS_MD_SHA256 ? (const mbedtls_md_info_t *) &g_sha256_info : NULL;
+}
+
+void mbedtls_md_init(mbedtls_md_context_t *ctx)
+{
+    ctx->mac_ctx = NULL;
+}
+
+void mbedtls_md_free(mbedtls_md_context_t *ctx)
+{
+    EVP_MAC_CTX_free(ctx->mac_ctx);
+    ctx->mac_ctx = NULL;
+}
+
+int mbedtls_md_setup(mbedtls_md_context_t *ctx, const mbedtls_md_info_t *md_info, int hmac)
+{
+    EVP_MAC *mac;
+    if(!md_info || !hmac || !(mac = EVP_MAC_fetch(NULL, "HMAC", NULL))) return -1;
+    ctx->mac_ctx = EVP_MAC_CTX_new(mac);
+    EVP_MAC_free(mac);
+    return ctx->mac_ctx ? 0 : -1;
+}
+
+int mbedtls_md_hmac_starts(mbedtls_md_context_t *ctx, const unsigned char *key, size_t keylen)
+{
+    OSSL_PARAM params[] = {
+        OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, "SHA256", 0),
+        OSSL_PARAM_construct_end()
+    };
+    return EVP_MAC_init(ctx->mac_ctx, key, keylen, params) == 1 ? 0 : -1;
+}
+
+int mbedtls_md_hmac_update(mbedtls_md_context_t *ctx, const unsigned char *input, size_t ilen)
+{
+    return EVP_MAC_update(ctx->mac_ctx, input, ilen) == 1 ? 0 : -1;
+}
+
+int mbedtls_md_hmac_finish(mbedtls_md_context_t *ctx, unsigned char *output)
+{
+    size_t len;
+    return EVP_MAC_final(ctx->mac_ctx, output, &len, 32) == 1 ? 0 : -1;
+}
+
+/*Like mbedTLS, the output is NUL terminated and the terminator has to fit*/
+int mbedtls_base64_encode(unsigned char *dst, size_t dlen, size_t *olen, const unsigned char *src, size_t slen)
+{
+    size_t needed = 4 * ((slen + 2) / 3);
+    if(dlen < needed + 1)
+    {
+        *olen = needed + 1;
+        return MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL;
+    }
+    *olen = EVP_EncodeBlock(dst, src, slen);
+    return 0;
+}
+
+static const char *skip_space(const char *text)
+{
+    while(isspace((unsigned char) *text)) text++;
+    return text;
+}
+
+/*Escapes other than \uXXXX are kept, which is all a webhook payload holds*/
+static const char *parse_string(const char *text, char **out)
+{
+    const char *end = ++text;
+    char *copy;
+    size_t len = 0;
+    while(*end && *end != '"')
+    {
+        if(*end == '\\' && !*++end) return NULL;
+        end++;
+    }
+    if(*end != '"' || !(copy = malloc(end - text + 1))) return NULL;
+    while(text < end)
+    {
+        if(*text == '\\')
+        {
+            text++;
+            switch(*text)
+            {
+                case 'n': copy[len++] = '\n'; break;
+                case 't': copy[len++] = '\t'; break;
+                case 'r': copy[len++] = '\r'; break;
+                case 'b': copy[len++] = '\b'; break;
+                case 'f': copy[len++] = '\f'; break;
+                default: copy[len++] = *text; break;
+            }
+            text++;
+        }
+        else copy[len++] = *text++;
+    }
+    copy[len] = '\0';
+    *out = copy;
+    return end + 1;
+}
+
+static const char *parse_value(const char *text, cJSON *item, int depth);
+
+static const char *parse_members(const char *text, cJSON *item, int depth, char close)
+{
+    cJSON *last = NULL;
+    text = skip_space(text + 1);
+    if(*text == close) return text + 1;
+    for(;;)
+    {
+        cJSON *child = calloc(1, sizeof(cJSON));
+        if(!child) return NULL;
+        if(last) last->next = child, child->prev = last;
+        else item->child = child;
+        last = child;
+        if(close == '}')
+        {
+            if(*text != '"' || !(text = parse_string(text, &child->string))) return NULL;
+            text = skip_space(text);
+            if(*text++ != ':') return NULL;
+        }
+        if(!(text = parse_value(skip_space(text), child, depth + 1))) return NULL;
+        text = skip_space(text);
+        if(*text == close) return text + 1;
+        if(*text != ',') return NULL;
+        text = skip_space(text + 1);
+    }
+}
+
+static const char *parse_value(const char *text, cJSON *item, int depth)
+{
+    char *end;
+    if(depth > SHIM_JSON_MAX_DEPTH) return NULL;
+    if(*text == '{')
+    {
+        item->type = cJSON_Object;
+        return parse_members(text, item, depth, '}');
+    }
+    if(*text == '[')
+    {
+        item->type = cJSON_Array;
+        return parse_members(text, item, depth, ']');
+    }
+    if(*text == '"')
+    {
+        item->type = cJSON_String;
+        return parse_string(text, &item->valuestring);
+    }
+    if(!strncmp(text, "true", 4) || !strncmp(text, "false", 5) || !strncmp(text, "null", 4))
+    {
+        item->type = *text == 't' ? cJSON_True : *text == 'f' ? cJSON_False : cJSON_NULL;
+        item->valueint = *text == 't';
+        return text + (*text == 'f' ? 5 : 4);
+    }
+    item->valuedouble = strtod(text, &end);
+    if(end == text) return NULL;
+    item->type = cJSON_Number;
+    item->valueint = item->valuedouble >= 2147483647.0 ? 2147483647
+        : item->valuedouble <= -2147483648.0 ? -2147483647 - 1 : (int) item->valuedouble;
+    return end;
+}
+
+cJSON *cJSON_Parse(const char *value)
+{
+    cJSON *item = calloc(1, sizeof(cJSON));
+    if(!item) return NULL;
+    value = parse_value(skip_space(value), item, 0);
+    if(!value || *skip_space(value))
+    {
+        cJSON_Delete(item);
+        return NULL;
+    }
+    return item;
+}
+
+void cJSON_Delete(cJSON *item)
+{
+    while(item)
+    {
+        cJSON *next = item->next;
+        cJSON_Delete(item->child);
+        free(item->valuestring);
+        free(item->string);
+        free(item);
+        item = next;
+    }
+}
+
+cJSON *cJSON_GetObjectItem(const cJSON * const object, const char * const string)
+{
+    for(cJSON *child = object ? object->child : NULL; child; child = child->next)
+    {
+        if(child->string && !strcasecmp(child->string, string)) return child;
+    }
+    return NULL;
+}
+
+int cJSON_IsString(const cJSON * const item)
+{
+    return item && item->type == cJSON_String;
+}
\ No newline at end of file